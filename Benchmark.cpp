@@ -0,0 +1,356 @@
+/**
+* Micro-benchmarks of the capture pipeline building blocks.
+*
+* Usage : VideoCapture_Benchmark [conversion|resize|transport|compression|histogram] [nbFrames]
+*
+* conversion : RGBA (bottom-up) to yuv420p / nv12 and rgb10_a2 to yuv420p10le / p010 CPU kernels, scalar path against each SIMD path
+*              at 720p, 1080p and 4K (also check every path output the same bytes)
+* resize     : RGBA box resampling of the renditions from 720p, 1080p and 4K to half and to 640x360, scalar against SSE2
+*              (also check both output the same bytes)
+* transport  : RGBA frames piped to a consumer process ("cat > /dev/null") with popen/fwrite (the OS_FWRITE path)
+*              against the Linux raw pipe transport with writev and with vmsplice, at 720p, 1080p and 4K
+* compression : lossless FrameCodec of an animated RGBA scene, every frame alone on a single stripe against a stripe per core,
+*              then with the differences to the previous frame, and their decoding (also check the decoded frames are identical)
+* histogram  : record() of 10000 latencies into the LatencyHistogram of the capture statistics (also check its percentiles stay within
+*              a bucket of the exact ones, a single stall not pulling them up to the max)
+*
+* Results are printed one per line as : benchmark;case;implementation;ms_per_frame;speedup;mb_per_s[;ratio]
+* (the compression ratio only for the compression benchmark)
+*/
+
+#include "ColorConversion.h"
+#include "PipeTransport.h"
+#include "FrameCodec.h"
+#include "CaptureStats.h"
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+
+//===========================================================================================================
+
+struct Resolution
+{
+	const char* name;
+	int			width;
+	int			height;
+};
+static const Resolution gResolutions[] = { {"720p", 1280, 720}, {"1080p", 1920, 1080}, {"4K", 3840, 2160} };
+
+/// Average milliseconds per call of f over nbFrames calls (after a warm up call)
+template<typename F>
+static double timeIt(int nbFrames, F f)
+{
+	f();
+	auto start = std::chrono::steady_clock::now();
+	for(int i = 0; i < nbFrames; i++)
+		f();
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	return elapsed.count() / nbFrames;
+}
+
+/// bytes is the size of a frame given to the implementation (to print the throughput)
+static void printResult(const std::string& benchmark, const std::string& name, const std::string& impl, double ms, double reference, size_t bytes,
+						double ratio = 0)
+{
+	std::cout << benchmark << ";" << name << ";" << impl << ";"
+			  << std::fixed << std::setprecision(3) << ms << ";"
+			  << std::setprecision(2) << (ms > 0 ? reference / ms : 0) << ";"
+			  << std::setprecision(1) << (ms > 0 ? bytes / (ms * 1000.0) : 0);
+	if(ratio > 0)
+		std::cout << ";" << std::setprecision(2) << ratio;
+	std::cout << std::endl;
+}
+
+
+//===========================================================================================================
+
+static bool benchmarkConversion(int nbFrames)
+{
+	typedef ColorConversion::INSTRUCTION_SET ISET;
+	bool identical = true;
+	std::vector<ISET> sets;
+	sets.push_back(ISET::SCALAR);
+	if(ColorConversion::bestInstructionSet() >= ISET::SSE2) sets.push_back(ISET::SSE2);
+	if(ColorConversion::bestInstructionSet() >= ISET::AVX2) sets.push_back(ISET::AVX2);
+
+	for(const Resolution& res : gResolutions)
+	{
+		// pseudo random frame (not too much compressible data patterns to not favor anything)
+		std::vector<unsigned char> rgba(size_t(res.width) * res.height * 4);
+		unsigned int seed = 12345;
+		for(unsigned char& c : rgba)
+			c = (unsigned char)((seed = seed * 1103515245u + 12345u) >> 16);
+
+		// the random bytes are as well rgb10_a2 pixels for the 10 bits formats
+		const char* formats[] = { "yuv420p", "nv12", "yuv420p10le", "p010" };
+		for(int format = 0; format < 4; format++)
+		{
+			std::vector<unsigned char> reference(format < 2 ? ColorConversion::yuv420Size(res.width, res.height) : ColorConversion::yuv420p10Size(res.width, res.height));
+			std::vector<unsigned char> yuv(reference.size());
+			double scalarMs = 0;
+			for(ISET set : sets)
+			{
+				unsigned char* out = set == ISET::SCALAR ? reference.data() : yuv.data();
+				double ms = timeIt(nbFrames, [&]()
+				{
+					switch(format)
+					{
+					case 0:	ColorConversion::rgbaToYuv420p(rgba.data(), res.width, res.height, out, true, set);		break;
+					case 1:	ColorConversion::rgbaToNv12(rgba.data(), res.width, res.height, out, true, set);		break;
+					case 2:	ColorConversion::rgb10a2ToYuv420p10(rgba.data(), res.width, res.height, out, true, set);break;
+					default:ColorConversion::rgb10a2ToP010(rgba.data(), res.width, res.height, out, true, set);		break;
+					}
+				});
+				if(set == ISET::SCALAR)
+					scalarMs = ms;
+				else if(std::memcmp(reference.data(), yuv.data(), yuv.size()) != 0)
+				{
+					std::cerr << "[Benchmark] " << ColorConversion::name(set) << " output differs from the scalar one" << std::endl;
+					identical = false;
+				}
+				printResult("conversion", std::string(res.name) + " " + formats[format], ColorConversion::name(set), ms, scalarMs, rgba.size());
+			}
+		}
+	}
+	return identical;
+}
+
+
+//===========================================================================================================
+
+static bool benchmarkResize(int nbFrames)
+{
+	typedef ColorConversion::INSTRUCTION_SET ISET;
+	bool identical = true;
+	std::vector<ISET> sets;
+	sets.push_back(ISET::SCALAR);
+	if(ColorConversion::bestInstructionSet() >= ISET::SSE2) sets.push_back(ISET::SSE2);
+
+	for(const Resolution& res : gResolutions)
+	{
+		std::vector<unsigned char> rgba(size_t(res.width) * res.height * 4);
+		unsigned int seed = 12345;
+		for(unsigned char& c : rgba)
+			c = (unsigned char)((seed = seed * 1103515245u + 12345u) >> 16);
+
+		struct { int width; int height; } targets[] = { {res.width / 2, res.height / 2}, {640, 360} };
+		for(const auto& target : targets)
+		{
+			std::vector<unsigned char> reference(size_t(target.width) * target.height * 4);
+			std::vector<unsigned char> resized(reference.size());
+			std::string name = std::string(res.name) + " to " + std::to_string(target.width) + "x" + std::to_string(target.height);
+			double scalarMs = 0;
+			for(ISET set : sets)
+			{
+				unsigned char* out = set == ISET::SCALAR ? reference.data() : resized.data();
+				double ms = timeIt(nbFrames, [&]()
+				{
+					ColorConversion::resizeRgba(rgba.data(), res.width, res.height, out, target.width, target.height, set);
+				});
+				if(set == ISET::SCALAR)
+					scalarMs = ms;
+				else if(std::memcmp(reference.data(), resized.data(), resized.size()) != 0)
+				{
+					std::cerr << "[Benchmark] " << ColorConversion::name(set) << " resize differs from the scalar one" << std::endl;
+					identical = false;
+				}
+				printResult("resize", name, ColorConversion::name(set), ms, scalarMs, rgba.size());
+			}
+		}
+	}
+	return identical;
+}
+
+
+//===========================================================================================================
+
+static bool benchmarkTransport(int nbFrames)
+{
+#ifdef WIN32
+	(void)nbFrames;
+	return true;
+#else
+	const char* consumer = "cat > /dev/null";
+	bool ok = true;
+	for(const Resolution& res : gResolutions)
+	{
+		size_t size = size_t(res.width) * res.height * 4;
+		std::vector<unsigned char> frame(size);
+
+		// each frame is first written as a read back would do, then piped
+		FILE* pipe = popen(consumer, "w");
+		double fwriteMs = timeIt(nbFrames, [&]()
+		{
+			std::memset(frame.data(), 0x80, size);
+			fwrite(frame.data(), size, 1, pipe);
+		});
+		pclose(pipe);
+		printResult("transport", res.name, "popen_fwrite", fwriteMs, fwriteMs, size);
+
+		if(!PipeTransport::available())
+			continue;
+		for(int zeroCopy = 0; zeroCopy < 2; zeroCopy++)
+		{
+			PipeTransport transport;
+			if(!transport.open(consumer, size, zeroCopy != 0))
+			{
+				ok = false;
+				continue;
+			}
+			double ms = timeIt(nbFrames, [&]()
+			{
+				unsigned char* buffer = zeroCopy ? transport.frameBuffer() : frame.data();
+				std::memset(buffer, 0x80, size);
+				transport.write(buffer, size);
+			});
+			std::string impl = zeroCopy ? (transport.zeroCopy() ? "vmsplice" : "vmsplice_refused_writev") : "writev";
+			impl += "_pipe" + std::to_string(transport.pipeSize() >> 10) + "k";
+			ok &= transport.close() == 0;
+			printResult("transport", res.name, impl, ms, fwriteMs, size);
+		}
+	}
+	return ok;
+#endif
+}
+
+
+//===========================================================================================================
+
+/// Rendered-like RGBA frame t of an animation : gradients, a moving rectangle and a noisy band
+static void drawScene(std::vector<unsigned char>& rgba, int width, int height, int t)
+{
+	unsigned int seed = 12345u + t;
+	int left = t * 37 % width;
+	for(int y = 0; y < height; y++)
+		for(int x = 0; x < width; x++)
+		{
+			unsigned char* p = &rgba[(size_t(y) * width + x) * 4];
+			p[0] = (unsigned char)(x * 255 / width);
+			p[1] = (unsigned char)(y * 255 / height);
+			p[2] = (unsigned char)((x + y + t) / 8);
+			p[3] = 255;
+			if(x >= left && x < left + width / 6 && y >= height / 3 && y < height / 2)
+			{
+				p[0] = 220;
+				p[1] = (unsigned char)(40 + t);
+				p[2] = (unsigned char)(x - left);
+			}
+			if(y < height / 10) // film grain like noise : the worst part to compress
+				p[1] ^= (unsigned char)((seed = seed * 1103515245u + 12345u) >> 16) & 7;
+		}
+}
+
+static bool benchmarkCompression(int nbFrames)
+{
+	const int scenes = 4; // frames drawn in advance, played in a loop
+	unsigned int cores = std::max(std::thread::hardware_concurrency(), 1u);
+	bool identical = true;
+	for(const Resolution& res : gResolutions)
+	{
+		std::vector<std::vector<unsigned char>> frames(scenes, std::vector<unsigned char>(size_t(res.width) * res.height * 4));
+		for(int t = 0; t < scenes; t++)
+			drawScene(frames[t], res.width, res.height, t);
+		size_t size = frames[0].size();
+
+		struct { const char* name; unsigned int stripes; unsigned int keyframeInterval; } cases[] =
+			{ {"intra", 1, 1}, {"intra", cores, 1}, {"delta", cores, 60} };
+		double intraMs = 0, intraDecodeMs = 0; // references of the speedups : a single stripe
+		for(const auto& c : cases)
+		{
+			FrameCodec encoder(c.stripes, c.keyframeInterval), decoder(c.stripes, 0);
+			std::vector<std::vector<unsigned char>> encoded(nbFrames + 1);
+			int frame = 0;
+			double ms = timeIt(nbFrames, [&]() { encoder.encode(frames[frame % scenes].data(), size, encoded[frame]); frame++; });
+			unsigned long long compressed = 0;
+			for(int i = 1; i <= nbFrames; i++)
+				compressed += encoded[i].size();
+			if(c.stripes == 1 && c.keyframeInterval == 1)
+				intraMs = ms;
+			std::string impl = std::string(c.name) + "_" + std::to_string(c.stripes) + "stripes";
+			printResult("compression", res.name, impl, ms, intraMs, size, compressed > 0 ? double(size) * nbFrames / compressed : 0);
+
+			// the frames were encoded in order from the first one
+			std::vector<unsigned char> decoded;
+			frame = 0;
+			bool ok = true;
+			double decodeMs = timeIt(nbFrames, [&]()
+			{
+				ok = ok && decoder.decode(encoded[frame].data(), encoded[frame].size(), decoded) && decoded == frames[frame % scenes];
+				frame++;
+			});
+			if(!ok)
+			{
+				std::cerr << "[Benchmark] " << impl << " decoded frames differ from the original ones" << std::endl;
+				identical = false;
+			}
+			if(c.stripes == 1 && c.keyframeInterval == 1)
+				intraDecodeMs = decodeMs;
+			printResult("compression", res.name, "decode_" + impl, decodeMs, intraDecodeMs, size);
+		}
+	}
+	return identical;
+}
+
+
+//===========================================================================================================
+
+static bool benchmarkHistogram(int nbFrames)
+{
+	LatencyHistogram histogram;
+	double ms = timeIt(nbFrames, [&histogram]()
+	{
+		for(unsigned long long us = 1; us <= 10000; us++)
+			histogram.record(us);
+	});
+	printResult("histogram", "10000 latencies", "record", ms, ms, 10000 * sizeof(unsigned long long));
+
+	// the percentiles are the upper bound of their bucket (25% wide) : never below the exact ones nor above by more than a bucket
+	auto near = [](double value, double expected) { return value >= expected && value <= 1.25 * expected; };
+
+	LatencyHistogram stall;
+	for(int i = 0; i < 99; i++)
+		stall.record(1000);
+	stall.record(50000);
+	LatencyHistogram::Snapshot stallValues = stall.snapshot();
+	bool ok = near(stallValues.percentileMs(50), 1) && near(stallValues.percentileMs(99), 1) && stallValues.percentileMs(100) == 50;
+
+	LatencyHistogram uniform; // 1 to 10000 us
+	for(unsigned long long us = 1; us <= 10000; us++)
+		uniform.record(us);
+	LatencyHistogram::Snapshot uniformValues = uniform.snapshot();
+	ok &= near(uniformValues.percentileMs(50), 5) && near(uniformValues.percentileMs(90), 9) && near(uniformValues.percentileMs(99), 9.9);
+	if(!ok)
+		std::cerr << "[Benchmark] the histogram percentiles differ from the exact ones by more than a bucket" << std::endl;
+	return ok;
+}
+
+
+//===========================================================================================================
+
+int main(int argc, char** argv)
+{
+	std::string which	= argc > 1 ? argv[1] : "all";
+	int			nbFrames	= argc > 2 ? std::atoi(argv[2]) : 50;
+	bool		ok			= true;
+
+	std::cout << "benchmark;case;implementation;ms_per_frame;speedup;mb_per_s" << std::endl;
+	if(which == "all" || which == "conversion")
+		ok &= benchmarkConversion(nbFrames);
+	if(which == "all" || which == "resize")
+		ok &= benchmarkResize(nbFrames);
+	if(which == "all" || which == "transport")
+		ok &= benchmarkTransport(nbFrames);
+	if(which == "all" || which == "compression")
+		ok &= benchmarkCompression(nbFrames);
+	if(which == "all" || which == "histogram")
+		ok &= benchmarkHistogram(nbFrames);
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
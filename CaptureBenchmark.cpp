@@ -0,0 +1,367 @@
+/**
+* End to end benchmark of the recorder in a headless OpenGL context (EGL surfaceless, e.g. Mesa llvmpipe).
+*
+* Usage : VideoCapture_CaptureBenchmark [stub|ffmpeg|raw|mapped|compressed|null|shm] [nbFrames] [outputPath]
+*         VideoCapture_CaptureBenchmark check [outputPath]
+*
+* An animated scene is rendered into a framebuffer object, then init(), capture() of each frame and finish() are driven
+* for each resolution (720p, 1080p), preset (with ffmpeg only) and transport (STDIO, WRITEV, VMSPLICE, only with stub and ffmpeg).
+* stub   : the frames are piped to a stub "ffmpeg" discarding its input (measures the capture side and the pipe) [default]
+* ffmpeg : the ffmpeg executable found in the PATH encodes the videos into outputPath (removed after each case)
+* raw    : the frames are written without encoding into outputPath (RawFileSink, removed after each case)
+* mapped : the frames are read back straight into a memory-mapped file of outputPath (MappedFileSink, removed after each case)
+* compressed : the frames are compressed without loss into outputPath (CompressedFileSink, removed after each case)
+* null   : the frames are discarded (NullSink, measures the capture side alone)
+* shm    : the frames are published in a shared memory ring drained by a consumer thread (SharedMemorySink)
+*
+* Results are printed one per line (the recorder logs are silenced) as :
+*	benchmark;resolution;preset;transport;sink;frames;init_ms;p50_ms;p90_ms;p99_ms;max_ms;capture_fps;sustained_fps;finish_ms
+* where init_ms is the time of warmUp() and init(), the percentiles are the latencies of capture(), capture_fps the rate of the capture loop alone
+* and sustained_fps the frames over the whole session (the frames still encoded by finish() included).
+*
+* check runs the regression checks of the recorder instead (stub sink), printed as check;name;ok|FAILED (exit failure if any failed).
+*/
+
+#include "FFmpegVideoRecorderProcess.h"
+#include "SharedMemoryRing.h"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+
+#ifndef WIN32
+	#include <sys/stat.h>	// chmod, mkdir
+#endif
+
+typedef FFmpegVideoRecorderProcess::PRESET		PRESET;
+typedef FFmpegVideoRecorderProcess::TRANSPORT	TRANSPORT;
+typedef FFmpegVideoRecorderProcess::SINK		SINK;
+typedef std::chrono::steady_clock				Clock;
+
+
+//===========================================================================================================
+
+struct Resolution
+{
+	const char* name;
+	int			width;
+	int			height;
+};
+static const Resolution gResolutions[] = { {"720p", 1280, 720}, {"1080p", 1920, 1080} };
+
+static const struct { PRESET preset; const char* name; }		gPresets[]		= { {PRESET::FASTEST_ENCODING, "ultrafast"}, {PRESET::BALANCED, "medium"} };
+static const struct { TRANSPORT transport; const char* name; }	gTransports[]	= { {TRANSPORT::STDIO, "stdio"}, {TRANSPORT::WRITEV, "writev"}, {TRANSPORT::VMSPLICE, "vmsplice"} };
+static const struct { SINK sink; const char* name; }			gSinks[]		= { {SINK::ENCODER, "stub"}, {SINK::ENCODER, "ffmpeg"}, {SINK::RAW_FILE, "raw"},
+																					{SINK::MAPPED_FILE, "mapped"}, {SINK::COMPRESSED_FILE, "compressed"},
+																					{SINK::NONE, "null"}, {SINK::SHARED_MEMORY, "shm"} };
+
+static double milliseconds(Clock::duration duration)
+{
+	return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+/// Nearest rank percentile of sorted values
+static double percentile(const std::vector<double>& sorted, double p)
+{
+	if(sorted.empty()) return 0;
+	size_t rank = size_t(p / 100.0 * sorted.size() + 0.5);
+	return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+
+//===========================================================================================================
+// headless OpenGL
+
+/// Make current a compatibility context without any surface (the scene is rendered in a framebuffer object)
+static bool createHeadlessContext()
+{
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	EGLDisplay display = getPlatformDisplay != nullptr ? getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr)
+													   : eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	EGLint major = 0, minor = 0;
+	if(display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+	{
+		std::cerr << "[CaptureBenchmark] no EGL display" << std::endl;
+		return false;
+	}
+	eglBindAPI(EGL_OPENGL_API);
+	const EGLint attributes[] = { EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 2,
+								  EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT, EGL_NONE };
+	EGLContext context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attributes);
+	if(context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+	{
+		std::cerr << "[CaptureBenchmark] can not create a surfaceless OpenGL 3.2 context" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+/// Framebuffer object the scene is rendered into and read back from
+class Scene : protected GLFunctions
+{
+public:
+	Scene(int width, int height) : mWidth(width), mHeight(height), mTexture(0), mFbo(0)
+	{
+		GLFunctions::init();
+		glGenTextures(1, &mTexture);
+		glBindTexture(GL_TEXTURE_2D, mTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		glGenFramebuffers(1, &mFbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, mFbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mTexture, 0);
+		glViewport(0, 0, width, height);
+	}
+
+	~Scene()
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glDeleteFramebuffers(1, &mFbo);
+		glDeleteTextures(1, &mTexture);
+	}
+
+	bool valid() { return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE; }
+
+	/// Background fading with time and bars sliding at different speeds (moving edges for the encoder)
+	void render(int frame)
+	{
+		glDisable(GL_SCISSOR_TEST);
+		glClearColor(0.2f + 0.1f * (frame % 60) / 60.0f, 0.25f, 0.3f, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT);
+		glEnable(GL_SCISSOR_TEST);
+		const int bars = 12;
+		for(int i = 0; i < bars; i++)
+		{
+			int barWidth	= mWidth / (2 * bars);
+			int x			= (frame * (i + 1) * 3 + i * mWidth / bars) % mWidth;
+			glScissor(x, i * mHeight / bars, barWidth, mHeight / bars);
+			glClearColor((i % 3) / 2.0f, ((i + frame / 8) % 5) / 4.0f, 1.0f - (i % 4) / 3.0f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT);
+		}
+		glDisable(GL_SCISSOR_TEST);
+	}
+
+protected:
+	int		mWidth;
+	int		mHeight;
+	GLuint	mTexture;
+	GLuint	mFbo;
+};
+
+
+//===========================================================================================================
+
+/// Put first in the PATH an "ffmpeg" discarding its stdin, return false if it can not
+static bool installStubFFmpeg(const std::string& dir)
+{
+#ifdef WIN32
+	(void)dir;
+	std::cerr << "[CaptureBenchmark] the stub sink is not available on Windows" << std::endl;
+	return false;
+#else
+	mkdir(dir.substr(0, dir.find_last_of('/')).c_str(), S_IRWXU);
+	mkdir(dir.c_str(), S_IRWXU);
+	std::string stub = dir + "/ffmpeg";
+	{
+		std::ofstream script(stub.c_str());
+		script << "#!/bin/sh\nexec cat > /dev/null\n";
+		if(!script) return false;
+	}
+	chmod(stub.c_str(), S_IRWXU);
+	const char* path = std::getenv("PATH");
+	std::string value = dir + (path != nullptr ? std::string(":") + path : std::string());
+	return setenv("PATH", value.c_str(), 1) == 0; // before the first recorder resolves ffmpeg
+#endif
+}
+
+/// One recording session : result line (empty if it could not start)
+static std::string benchmarkCapture(const Resolution& res, PRESET preset, const char* presetName, TRANSPORT transport, const char* transportName,
+									const std::string& sink, SINK sinkMode, int nbFrames, const std::string& outputPath)
+{
+	Scene scene(res.width, res.height);
+	if(!scene.valid())
+	{
+		std::cerr << "[CaptureBenchmark] incomplete framebuffer object at " << res.name << std::endl;
+		return std::string();
+	}
+
+	FFmpegVideoRecorderProcess recorder(outputPath);
+	recorder.setTransport(transport);
+	recorder.setOutputBaseFileName(std::string("benchmark_") + res.name + "_");
+	recorder.setPreset(preset);
+	recorder.setSink(sinkMode);
+
+	// from nothing to the first frame expected (ffmpeg spawned at the resolution)
+	Clock::time_point start = Clock::now();
+	if(!recorder.warmUp(res.width, res.height) || !recorder.init())
+	{
+		std::cerr << "[CaptureBenchmark] the recorder did not start at " << res.name << " with " << transportName << std::endl;
+		return std::string();
+	}
+	double initMs = milliseconds(Clock::now() - start);
+	std::string file = recorder.getOutputVideoFilePath();
+
+	// the other side of the shared memory ring : reads each frame in place
+	std::thread consumer;
+	if(sinkMode == SINK::SHARED_MEMORY)
+		consumer = std::thread([&recorder]()
+		{
+			SharedMemoryRing ring;
+			if(!ring.attach("/" + recorder.getOutputFileName()))
+				return;
+			size_t size = 0;
+			long long pts = 0;
+			volatile unsigned char touched = 0;
+			while(!ring.ended())
+				if(const unsigned char* frame = ring.acquire(size, pts, 100))
+				{
+					touched = frame[size / 2];
+					ring.release();
+				}
+			(void)touched;
+		});
+
+	std::vector<double> latencies;
+	latencies.reserve(nbFrames);
+	Clock::time_point loopStart = Clock::now();
+	for(int frame = 0; frame < nbFrames; frame++)
+	{
+		scene.render(frame);
+		Clock::time_point before = Clock::now();
+		recorder.capture(res.width, res.height);
+		latencies.push_back(milliseconds(Clock::now() - before));
+	}
+	Clock::time_point loopEnd = Clock::now();
+	recorder.finish();
+	Clock::time_point end = Clock::now();
+	if(consumer.joinable())
+		consumer.join();
+	if(sinkMode == SINK::ENCODER ? sink != "stub" : (sinkMode == SINK::RAW_FILE || sinkMode == SINK::MAPPED_FILE || sinkMode == SINK::COMPRESSED_FILE))
+		std::remove(file.c_str());
+
+	std::sort(latencies.begin(), latencies.end());
+	double loopMs	= milliseconds(loopEnd - loopStart);
+	double totalMs	= milliseconds(end - loopStart);
+	std::stringstream line;
+	line << "capture;" << res.name << ";" << presetName << ";" << transportName << ";" << sink << ";" << nbFrames << ";"
+		 << std::fixed << std::setprecision(3) << initMs << ";"
+		 << percentile(latencies, 50) << ";" << percentile(latencies, 90) << ";" << percentile(latencies, 99) << ";" << latencies.back() << ";"
+		 << std::setprecision(1) << (loopMs > 0 ? 1000.0 * nbFrames / loopMs : 0) << ";" << (totalMs > 0 ? 1000.0 * nbFrames / totalMs : 0) << ";"
+		 << std::setprecision(3) << milliseconds(end - loopEnd);
+	return line.str();
+}
+
+
+//===========================================================================================================
+// regression checks
+
+/// The capture size changes during an asynchronous read back with a CPU conversion : the frames still in the read back ring
+/// are converted at their own size before the next video starts at the new one, and none is lost
+static bool checkAsyncResize(const std::string& outputPath)
+{
+	const Resolution sizes[] = { {"240p", 320, 240}, {"1080p", 1920, 1080}, {"240p", 320, 240} };
+	const int framesPerSize = 10;
+
+	FFmpegVideoRecorderProcess recorder(outputPath);
+	recorder.setOutputBaseFileName("check_resize_");
+	recorder.asyncReadback(true);
+	recorder.setConversion(FFmpegVideoRecorderProcess::CONVERSION::CPU_YUV420P);
+	int frames = 0;
+	for(const Resolution& res : sizes)
+	{
+		Scene scene(res.width, res.height);
+		if(!scene.valid())
+			return false;
+		for(int frame = 0; frame < framesPerSize; frame++, frames++)
+		{
+			scene.render(frames);
+			recorder.capture(res.width, res.height);
+		}
+	}
+	recorder.finish();
+	return recorder.getStats().framesWritten == (unsigned long long)frames;
+}
+
+/// Run the checks, print their results : all passed
+static bool runChecks(std::ostream& results, const std::string& outputPath)
+{
+	static const struct { const char* name; bool (*check)(const std::string&); } checks[] = { {"async_resize", checkAsyncResize} };
+	bool ok = true;
+	for(const auto& check : checks)
+	{
+		bool passed = check.check(outputPath);
+		results << "check;" << check.name << ";" << (passed ? "ok" : "FAILED") << std::endl;
+		ok &= passed;
+	}
+	return ok;
+}
+
+
+//===========================================================================================================
+
+int main(int argc, char** argv)
+{
+	std::string sink		= argc > 1 ? argv[1] : "stub";
+	bool		check		= sink == "check";
+	if(check)
+		sink = "stub";
+	int			nbFrames	= !check && argc > 2 ? std::atoi(argv[2]) : 120;
+	std::string outputPath	= argc > (check ? 2 : 3) ? argv[check ? 2 : 3] : "./";
+	const auto* sinkMode	= std::find_if(std::begin(gSinks), std::end(gSinks), [&sink](decltype(gSinks[0]) s) { return sink == s.name; });
+	if(sinkMode == std::end(gSinks) || nbFrames <= 0)
+	{
+		std::cerr << "usage : " << argv[0] << " [stub|ffmpeg|raw|mapped|compressed|null|shm] [nbFrames] [outputPath]" << std::endl;
+		std::cerr << "        " << argv[0] << " check [outputPath]" << std::endl;
+		return EXIT_FAILURE;
+	}
+	bool encoded = sinkMode->sink == SINK::ENCODER;
+	if(sink == "stub" && !installStubFFmpeg(outputPath + "/stub_ffmpeg"))
+		return EXIT_FAILURE;
+	if(!createHeadlessContext())
+		return EXIT_FAILURE;
+
+	// only the results on stdout
+	std::ostream results(std::cout.rdbuf());
+	std::cout.rdbuf(nullptr);
+
+	bool ok = true;
+	if(check)
+		ok = runChecks(results, outputPath);
+	else
+	{
+		results << "benchmark;resolution;preset;transport;sink;frames;init_ms;p50_ms;p90_ms;p99_ms;max_ms;capture_fps;sustained_fps;finish_ms" << std::endl;
+		for(const Resolution& res : gResolutions)
+			for(const auto& preset : gPresets)
+			{
+				if(sink != "ffmpeg" && preset.preset != PRESET::FASTEST_ENCODING)
+					continue; // nothing is encoded
+				for(const auto& transport : gTransports)
+				{
+					if(!encoded && transport.transport != TRANSPORT::STDIO)
+						continue; // nothing is piped
+					std::string line = benchmarkCapture(res, preset.preset, encoded ? preset.name : "-", transport.transport, encoded ? transport.name : "-",
+														sink, sinkMode->sink, nbFrames, outputPath);
+					ok &= !line.empty();
+					if(!line.empty())
+						results << line << std::endl;
+				}
+			}
+	}
+
+	if(sink == "stub")
+	{
+		std::remove((outputPath + "/stub_ffmpeg/ffmpeg").c_str());
+		std::remove((outputPath + "/stub_ffmpeg").c_str());
+	}
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
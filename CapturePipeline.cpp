@@ -0,0 +1,196 @@
+#include "CapturePipeline.h"
+#include "FrameBufferPool.h"
+
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+
+
+//===========================================================================================================
+
+CapturePipeline::CapturePipeline(WorkStealingPool& pool, unsigned int frames, size_t capacity)
+	: mPool(pool), mFrames(std::max(frames, 1u)), mSequence(0)
+{
+	for(Frame& frame : mFrames)
+	{
+		frame.sequence	= 0;
+		frame.pts		= -1;
+		frame.data		= FrameBufferPool::Get().acquire(capacity); // page-aligned, reused by the next session
+		frame.spare		= FrameBufferPool::Get().acquire(capacity);
+		frame.size		= 0;
+		frame.capacity	= capacity;
+		frame.hash		= 0;
+		frame.skipped	= false;
+		mFree.push_back(&frame);
+	}
+	for(Frame& frame : mFrames)
+	{
+		if(frame.data != nullptr && frame.spare != nullptr)
+			continue;
+		std::cerr<<"[CapturePipeline] can not allocate "<<mFrames.size()<<" frames of "<<capacity<<" bytes"<<std::endl;
+		for(Frame& allocated : mFrames)
+		{
+			FrameBufferPool::Get().release(allocated.data);
+			FrameBufferPool::Get().release(allocated.spare);
+		}
+		mFrames.clear();
+		mFree.clear();
+		break;
+	}
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+CapturePipeline::~CapturePipeline()
+{
+	wait();
+	for(Frame& frame : mFrames)
+	{
+		FrameBufferPool::Get().release(frame.data);
+		FrameBufferPool::Get().release(frame.spare);
+	}
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void CapturePipeline::addStage(const std::string& name, Stage stage, unsigned int parallelism, bool ordered)
+{
+	Node node;
+	node.name			= name;
+	node.stage			= std::move(stage);
+	node.parallelism	= ordered ? 1 : (parallelism != 0 ? parallelism : mPool.threadCount());
+	node.ordered		= ordered;
+	node.running		= 0;
+	node.next			= 0;
+	node.frames			= 0;
+	node.busyUs			= 0;
+	mNodes.push_back(std::move(node));
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+CapturePipeline::Frame* CapturePipeline::acquire(bool wait)
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	if(wait)
+		mReleased.wait(lock, [this]() { return !mFree.empty(); });
+	if(mFree.empty())
+		return nullptr;
+	Frame* frame = mFree.back();
+	mFree.pop_back();
+	return frame;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void CapturePipeline::push(Frame* frame, size_t size, long long pts)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	frame->sequence	= mSequence++;
+	frame->pts		= pts;
+	frame->size		= size;
+	frame->hash		= 0;
+	frame->skipped	= false;
+	enter(0, frame);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void CapturePipeline::cancel(Frame* frame)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mFree.push_back(frame);
+	mReleased.notify_all();
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void CapturePipeline::wait()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	mReleased.wait(lock, [this]() { return mFree.size() == mFrames.size(); });
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+unsigned int CapturePipeline::inFlight()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return (unsigned int)(mFrames.size() - mFree.size());
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+std::vector<CapturePipeline::StageStats> CapturePipeline::stats()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	std::vector<StageStats> stats;
+	for(const Node& node : mNodes)
+		stats.push_back({ node.name, node.frames, node.busyUs });
+	return stats;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void CapturePipeline::enter(unsigned int node, Frame* frame)
+{
+	if(node == mNodes.size())
+	{
+		// through the last stage
+		mFree.push_back(frame);
+		mReleased.notify_all();
+		return;
+	}
+	if(mNodes[node].ordered)
+		mNodes[node].pending[frame->sequence] = frame;
+	else
+		mNodes[node].ready.push_back(frame);
+	dispatch(node);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void CapturePipeline::dispatch(unsigned int node)
+{
+	Node& n = mNodes[node];
+	while(n.running < n.parallelism)
+	{
+		Frame* frame = nullptr;
+		if(n.ordered)
+		{
+			std::map<unsigned long long, Frame*>::iterator first = n.pending.begin();
+			if(first == n.pending.end() || first->first != n.next)
+				return; // the next frame is still in an earlier stage
+			frame = first->second;
+			n.pending.erase(first);
+			n.next++;
+		}
+		else
+		{
+			if(n.ready.empty())
+				return;
+			frame = n.ready.front();
+			n.ready.pop_front();
+		}
+		n.running++;
+		mPool.submit([this, node, frame]() { run(node, frame); });
+	}
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void CapturePipeline::run(unsigned int node, Frame* frame)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if(!frame->skipped)
+		mNodes[node].stage(*frame);
+	unsigned long long us = (unsigned long long)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	Node& n = mNodes[node];
+	n.running--;
+	n.frames++;
+	n.busyUs += us;
+	enter(node + 1, frame);
+	dispatch(node);
+}
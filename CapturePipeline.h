@@ -0,0 +1,122 @@
+#pragma once
+
+#include <map>
+#include <deque>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstddef>
+#include <utility>
+
+#include "WorkStealingPool.h"
+
+
+/**
+* Frames going through a chain of stages run on a work-stealing pool, so the per frame work (conversion, hashing, compression,
+* writing...) is spread over the cores instead of adding up on a single thread.
+*
+* The producer (the render thread reading the frames back) fills preallocated frames and pushes them, each then goes
+* through the stages in the order they were added. A stage runs on up to its parallelism frames at once, the frames
+* overtaking each other, unless it is ordered : it then takes the frames one at a time in the order they were pushed
+* (the write stage of a sink). The frames are released once through the last stage.
+*
+* Usage :
+* setup :		pipeline.addStage("transform", transform, 0, false); pipeline.addStage("write", write, 1, true);
+* producer :	Frame* frame = pipeline.acquire(true); fill(frame->data); pipeline.push(frame, size, pts);
+* producer :	pipeline.wait(); // all the pushed frames went through the stages
+*/
+class CapturePipeline
+{
+public:
+	/// A frame in flight, given to each stage in turn
+	struct Frame
+	{
+		unsigned long long	sequence;	///< push order
+		long long			pts;
+		unsigned char*		data;		///< the frame as left by the previous stages
+		size_t				size;
+		unsigned char*		spare;		///< buffer of the same capacity for the stages not working in place (see swap())
+		size_t				capacity;
+		unsigned long long	hash;		///< free for the stages (e.g. a hash computed in parallel then checked in order)
+		bool				skipped;	///< set by a stage : the next stages let the frame go through untouched
+
+		/// the stage wrote the frame into spare : it becomes data
+		void swap(size_t newSize) { std::swap(data, spare); size = newSize; }
+	};
+
+	typedef std::function<void(Frame& frame)> Stage;
+
+	/// Time spent by a stage
+	struct StageStats
+	{
+		std::string			name;
+		unsigned long long	frames;
+		unsigned long long	busyUs;		///< summed over the frames (more than the elapsed time with a parallel stage)
+	};
+
+public:
+	/// Preallocate frames frames of capacity bytes (from the FrameBufferPool, see allocated()), the stages run on the pool (not owned)
+	CapturePipeline(WorkStealingPool& pool, unsigned int frames, size_t capacity);
+	virtual ~CapturePipeline();	///< wait for the frames in flight
+
+	/// Append a stage (before the first push). parallelism : frames in this stage at once (0 : one per pool thread),
+	/// ordered : the frames enter it in push order, one at a time.
+	void addStage(const std::string& name, Stage stage, unsigned int parallelism, bool ordered);
+
+	/// A free frame to fill, nullptr if all of them are in flight and !wait
+	Frame* acquire(bool wait);
+
+	/// Send a frame from acquire() through the stages
+	void push(Frame* frame, size_t size, long long pts);
+
+	/// Give back a frame from acquire() without pushing it
+	void cancel(Frame* frame);
+
+	/// Wait until all the pushed frames went through the stages
+	void wait();
+
+	/// Frames acquired and not released yet
+	unsigned int inFlight();
+
+	unsigned int frames() const { return (unsigned int)mFrames.size(); }
+
+	/// Could the frames be allocated (the pipeline is not usable otherwise)
+	bool allocated() const { return !mFrames.empty(); }
+
+	std::vector<StageStats> stats();
+
+protected:
+	struct Node
+	{
+		std::string								name;
+		Stage									stage;
+		unsigned int							parallelism;
+		bool									ordered;
+		unsigned int							running;	///< frames in the stage now
+		std::deque<Frame*>						ready;		///< frames waiting for an unordered stage
+		std::map<unsigned long long, Frame*>	pending;	///< frames waiting for an ordered stage, by sequence
+		unsigned long long						next;		///< sequence of the next frame of an ordered stage
+		unsigned long long						frames;
+		unsigned long long						busyUs;
+	};
+
+	/// A frame is ready for the stage (mMutex locked)
+	void enter(unsigned int node, Frame* frame);
+
+	/// Submit the runnable frames of the stage to the pool (mMutex locked)
+	void dispatch(unsigned int node);
+
+	/// Pool task : run the stage on the frame then move it to the next one
+	void run(unsigned int node, Frame* frame);
+
+protected:
+	WorkStealingPool&			mPool;
+	std::vector<Frame>			mFrames;
+	std::vector<Frame*>			mFree;
+	std::vector<Node>			mNodes;
+	unsigned long long			mSequence;	///< of the next frame pushed
+	std::mutex					mMutex;
+	std::condition_variable		mReleased;	///< a frame is free again
+};
@@ -0,0 +1,179 @@
+#include "CaptureStats.h"
+
+
+//===========================================================================================================
+
+LatencyHistogram::Snapshot::Snapshot()
+	: count(0), totalUs(0), maxUs(0)
+{
+	for(unsigned long long& bucket : buckets)
+		bucket = 0;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+double LatencyHistogram::Snapshot::meanMs() const
+{
+	return count != 0 ? totalUs / (1000.0 * count) : 0;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+double LatencyHistogram::Snapshot::percentileMs(double p) const
+{
+	if(count == 0) return 0;
+	unsigned long long rank = (unsigned long long)(p / 100.0 * count + 0.5);
+	rank = rank < 1 ? 1 : rank > count ? count : rank;
+	unsigned long long seen = 0;
+	for(int i = 0; i < BUCKETS; i++)
+	{
+		seen += buckets[i];
+		if(seen >= rank)
+		{
+			unsigned long long upperUs = upperBound(i); // bound of the bucket as recorded
+			return double(i == BUCKETS - 1 || upperUs > maxUs ? maxUs : upperUs) / 1000.0; // the max is a tighter bound
+		}
+	}
+	return maxUs / 1000.0;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+LatencyHistogram::Snapshot LatencyHistogram::Snapshot::since(const Snapshot& previous) const
+{
+	Snapshot difference;
+	difference.count	= count - previous.count;
+	difference.totalUs	= totalUs - previous.totalUs;
+	difference.maxUs	= maxUs;
+	for(int i = 0; i < BUCKETS; i++)
+		difference.buckets[i] = buckets[i] - previous.buckets[i];
+	return difference;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+int LatencyHistogram::bucket(unsigned long long us)
+{
+	if(us < 4) return int(us);
+	int msb = 2;
+	while((us >> (msb + 1)) != 0 && msb < 64)
+		msb++;
+	int index = 4 * (msb - 1) + int((us >> (msb - 2)) & 3); // the 2 bits after the most significant one
+	return index < BUCKETS ? index : BUCKETS - 1;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+unsigned long long LatencyHistogram::upperBound(int bucket)
+{
+	if(bucket < 4) return (unsigned long long)bucket + 1;
+	int msb = bucket / 4 + 1;
+	return (unsigned long long)(5 + bucket % 4) << (msb - 2);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+LatencyHistogram::LatencyHistogram()
+	: mCount(0), mTotal(0), mMax(0)
+{
+	for(std::atomic<unsigned long long>& bucket : mBuckets)
+		bucket.store(0, std::memory_order_relaxed);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void LatencyHistogram::record(unsigned long long us)
+{
+	mBuckets[bucket(us)].fetch_add(1, std::memory_order_relaxed);
+	mTotal.fetch_add(us, std::memory_order_relaxed);
+	mCount.fetch_add(1, std::memory_order_relaxed);
+
+	unsigned long long max = mMax.load(std::memory_order_relaxed);
+	while(us > max && !mMax.compare_exchange_weak(max, us, std::memory_order_relaxed));
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const
+{
+	// not an atomic snapshot of the whole histogram : the count may be a few records off the buckets while recording
+	Snapshot values;
+	values.count	= mCount.load(std::memory_order_relaxed);
+	values.totalUs	= mTotal.load(std::memory_order_relaxed);
+	values.maxUs	= mMax.load(std::memory_order_relaxed);
+	for(int i = 0; i < BUCKETS; i++)
+		values.buckets[i] = mBuckets[i].load(std::memory_order_relaxed);
+	return values;
+}
+
+
+//===========================================================================================================
+
+CaptureStats::CaptureStats()
+	: seconds(0), framesCaptured(0), framesSkipped(0), framesDuplicate(0), framesDropped(0), framesWritten(0), bytesPiped(0)
+	, queueFullEvents(0), backpressureEvents(0), queueDepth(0), queueDepthMax(0), queueCapacity(0)
+{
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+CaptureStats CaptureStats::since(const CaptureStats& previous) const
+{
+	CaptureStats difference	= *this; // gauges
+	difference.seconds				= seconds - previous.seconds;
+	difference.framesCaptured		= framesCaptured - previous.framesCaptured;
+	difference.framesSkipped		= framesSkipped - previous.framesSkipped;
+	difference.framesDuplicate		= framesDuplicate - previous.framesDuplicate;
+	difference.framesDropped		= framesDropped - previous.framesDropped;
+	difference.framesWritten		= framesWritten - previous.framesWritten;
+	difference.bytesPiped			= bytesPiped - previous.bytesPiped;
+	difference.queueFullEvents		= queueFullEvents - previous.queueFullEvents;
+	difference.backpressureEvents	= backpressureEvents - previous.backpressureEvents;
+	difference.readback				= readback.since(previous.readback);
+	difference.conversion			= conversion.since(previous.conversion);
+	difference.write				= write.since(previous.write);
+	return difference;
+}
+
+
+//===========================================================================================================
+
+CaptureCounters::CaptureCounters()
+	: start(std::chrono::steady_clock::now())
+	, framesCaptured(0), framesSkipped(0), framesDuplicate(0), framesDropped(0), framesWritten(0), bytesPiped(0)
+	, queueFullEvents(0), backpressureEvents(0), backpressureUs(40000), queueDepth(0), queueDepthMax(0), queueCapacity(0)
+{
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+CaptureStats CaptureCounters::snapshot() const
+{
+	CaptureStats stats;
+	stats.seconds				= std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	stats.framesCaptured		= framesCaptured.load(std::memory_order_relaxed);
+	stats.framesSkipped			= framesSkipped.load(std::memory_order_relaxed);
+	stats.framesDuplicate		= framesDuplicate.load(std::memory_order_relaxed);
+	stats.framesDropped			= framesDropped.load(std::memory_order_relaxed);
+	stats.framesWritten			= framesWritten.load(std::memory_order_relaxed);
+	stats.bytesPiped			= bytesPiped.load(std::memory_order_relaxed);
+	stats.queueFullEvents		= queueFullEvents.load(std::memory_order_relaxed);
+	stats.backpressureEvents	= backpressureEvents.load(std::memory_order_relaxed);
+	stats.queueDepth			= queueDepth.load(std::memory_order_relaxed);
+	stats.queueDepthMax			= queueDepthMax.load(std::memory_order_relaxed);
+	stats.queueCapacity			= queueCapacity.load(std::memory_order_relaxed);
+	stats.readback				= readback.snapshot();
+	stats.conversion			= conversion.snapshot();
+	stats.write					= write.snapshot();
+	return stats;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void CaptureCounters::queue(unsigned int depth, unsigned int capacity)
+{
+	queueDepth.store(depth, std::memory_order_relaxed);
+	queueCapacity.store(capacity, std::memory_order_relaxed);
+	if(depth > queueDepthMax.load(std::memory_order_relaxed))
+		queueDepthMax.store(depth, std::memory_order_relaxed); // a single capture thread updates it
+}
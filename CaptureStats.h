@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+
+/**
+* Lock-free histogram of durations : a count per bucket of microseconds, 4 buckets per power of 2 (at most 25% wide).
+* record() is a few relaxed atomic increments, so it can be called on the capture hot path and from any thread.
+*/
+class LatencyHistogram
+{
+public:
+	/// buckets 0 to 3 : 0 to 3 us, then [2^k:2^k*5/4[, [2^k*5/4:2^k*6/4[, ... for k >= 2, last bucket : about 8 s and more
+	static const int BUCKETS = 92;
+
+	/// Bucket of a duration
+	static int bucket(unsigned long long us);
+
+	/// Lowest duration of the next bucket
+	static unsigned long long upperBound(int bucket);
+
+	/// Values of the histogram at a given time
+	struct Snapshot
+	{
+		unsigned long long count;
+		unsigned long long totalUs;
+		unsigned long long maxUs;	///< since the recorder creation (not a difference, see since())
+		unsigned long long buckets[BUCKETS];
+
+		Snapshot();
+
+		/// Mean duration in milliseconds (0 if empty)
+		double meanMs() const;
+
+		/// Upper bound in milliseconds of the bucket holding the p-th percentile (p in [0:100], 0 if empty)
+		double percentileMs(double p) const;
+
+		/// The durations recorded between previous and this snapshot
+		Snapshot since(const Snapshot& previous) const;
+	};
+
+	LatencyHistogram();
+
+	/// Record a duration
+	void record(unsigned long long us);
+
+	/// Record the time elapsed since start
+	void record(std::chrono::steady_clock::time_point start)
+	{
+		record((unsigned long long)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	Snapshot snapshot() const;
+
+protected:
+	std::atomic<unsigned long long>	mCount;
+	std::atomic<unsigned long long>	mTotal;
+	std::atomic<unsigned long long>	mMax;
+	std::atomic<unsigned long long>	mBuckets[BUCKETS];
+};
+
+
+/**
+* Statistics of the capture pipeline of a recorder (see FFmpegVideoRecorderProcess::getStats), cumulated since the recorder creation.
+* For periodic monitoring, keep the previous snapshot and look at current.since(previous).
+*/
+struct CaptureStats
+{
+	double				seconds;			///< since the recorder creation (interval length for a difference)
+	unsigned long long	framesCaptured;		///< capture() calls while recording
+	unsigned long long	framesSkipped;		///< skipped by the timestamped capture drop policy
+	unsigned long long	framesDuplicate;	///< skipped as identical to the previous frame
+	unsigned long long	framesDropped;		///< dropped by the writer queue overflow policy
+	unsigned long long	framesWritten;		///< taken by the frame sink (ffmpeg process, libav encoder, file...)
+	unsigned long long	bytesPiped;			///< bytes taken by the frame sink
+	unsigned long long	queueFullEvents;	///< frames captured while the writer queue was full (blocked or dropped)
+	unsigned long long	backpressureEvents;	///< writes to the encoder blocked longer than a frame period
+	unsigned int		queueDepth;			///< frames waiting in the writer queue at the last capture (gauge)
+	unsigned int		queueDepthMax;		///< highest queueDepth seen (since the recorder creation)
+	unsigned int		queueCapacity;		///< slots of the writer queue of the current session (0 without queue)
+
+	LatencyHistogram::Snapshot	readback;	///< glReadPixels (GPU conversion included) or mapping of a pixel buffer object
+	LatencyHistogram::Snapshot	conversion;	///< RGBA to YUV conversion (CPU kernel, or GPU pass submission)
+	LatencyHistogram::Snapshot	write;		///< write of a frame to the sink (pipe write to ffmpeg, libav encoding...)
+
+	CaptureStats();
+
+	/// The counters and the histograms of the interval between previous and this snapshot (the gauges are kept)
+	CaptureStats since(const CaptureStats& previous) const;
+
+	/// Frames captured per second over seconds
+	double captureFps() const { return seconds > 0 ? framesCaptured / seconds : 0; }
+
+	/// Frames written per second over seconds (lower than captureFps() when falling behind)
+	double writeFps() const { return seconds > 0 ? framesWritten / seconds : 0; }
+};
+
+
+/**
+* The atomic counters a recorder updates while capturing (from the capture thread, the writer threads and the worker pool).
+*/
+class CaptureCounters
+{
+public:
+	CaptureCounters();
+
+	/// Read all the counters (from any thread)
+	CaptureStats snapshot() const;
+
+	/// Update the queue gauges
+	void queue(unsigned int depth, unsigned int capacity);
+
+public:
+	std::chrono::steady_clock::time_point	start;
+	std::atomic<unsigned long long>	framesCaptured;
+	std::atomic<unsigned long long>	framesSkipped;
+	std::atomic<unsigned long long>	framesDuplicate;
+	std::atomic<unsigned long long>	framesDropped;
+	std::atomic<unsigned long long>	framesWritten;
+	std::atomic<unsigned long long>	bytesPiped;
+	std::atomic<unsigned long long>	queueFullEvents;
+	std::atomic<unsigned long long>	backpressureEvents;
+	std::atomic<unsigned long long>	backpressureUs;		///< a write longer than that is a backpressure event (a frame period)
+	std::atomic<unsigned int>		queueDepth;
+	std::atomic<unsigned int>		queueDepthMax;
+	std::atomic<unsigned int>		queueCapacity;
+	LatencyHistogram				readback;
+	LatencyHistogram				conversion;
+	LatencyHistogram				write;
+};
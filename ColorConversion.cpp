@@ -0,0 +1,679 @@
+#include "ColorConversion.h"
+
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+	#define COLOR_CONVERSION_X86 1
+	#include <emmintrin.h>	// SSE2
+	#include <immintrin.h>	// AVX2
+	#ifdef _MSC_VER
+		#include <intrin.h>	// __cpuid
+	#endif
+#else
+	#define COLOR_CONVERSION_X86 0
+#endif
+
+#if COLOR_CONVERSION_X86 && (defined(__GNUC__) || defined(__clang__))
+	#define COLOR_CONVERSION_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+	#define COLOR_CONVERSION_TARGET_AVX2
+#endif
+
+
+//===========================================================================================================
+// Fixed point BT.601 limited range, the offsets keep every intermediate sum in [0:65535] (unsigned 16 bits SIMD lanes)
+//  Y = ( 66 R + 129 G +  25 B + 128 + 16*256) >> 8
+//  U = (-38 R -  74 G + 112 B + 128 + 128*256) >> 8
+//  V = (112 R -  94 G -  18 B + 128 + 128*256) >> 8
+
+static inline unsigned char lumaScalar(int r, int g, int b)
+{
+	return (unsigned char)((66*r + 129*g + 25*b + 4224) >> 8);
+}
+
+static inline unsigned char chromaUScalar(int r, int g, int b)
+{
+	return (unsigned char)((-38*r - 74*g + 112*b + 32896) >> 8);
+}
+
+static inline unsigned char chromaVScalar(int r, int g, int b)
+{
+	return (unsigned char)((112*r - 94*g - 18*b + 32896) >> 8);
+}
+
+/// Convert the pixels [begin:width[ of a pair of rows (u is the interleaved UV row if nv12)
+static void convertRowsScalar(const unsigned char* row0, const unsigned char* row1, int begin, int width,
+							  unsigned char* y0, unsigned char* y1, unsigned char* u, unsigned char* v, bool nv12)
+{
+	for(int x = begin; x < width; x += 2)
+	{
+		const unsigned char* p00 = row0 + 4*x;
+		const unsigned char* p01 = p00 + 4;
+		const unsigned char* p10 = row1 + 4*x;
+		const unsigned char* p11 = p10 + 4;
+		y0[x]	= lumaScalar(p00[0], p00[1], p00[2]);
+		y0[x+1] = lumaScalar(p01[0], p01[1], p01[2]);
+		y1[x]	= lumaScalar(p10[0], p10[1], p10[2]);
+		y1[x+1] = lumaScalar(p11[0], p11[1], p11[2]);
+
+		int r = (p00[0] + p01[0] + p10[0] + p11[0] + 2) >> 2;
+		int g = (p00[1] + p01[1] + p10[1] + p11[1] + 2) >> 2;
+		int b = (p00[2] + p01[2] + p10[2] + p11[2] + 2) >> 2;
+		if(nv12)
+		{
+			u[x]	= chromaUScalar(r, g, b);
+			u[x+1]	= chromaVScalar(r, g, b);
+		}
+		else
+		{
+			u[x/2]	= chromaUScalar(r, g, b);
+			v[x/2]	= chromaVScalar(r, g, b);
+		}
+	}
+}
+
+
+#if COLOR_CONVERSION_X86
+//===========================================================================================================
+// SSE2 : 16 pixels of 2 rows per iteration
+
+/// Split 8 rgba pixels into 16 bits R, G and B lanes
+static inline void deinterleaveSSE2(const unsigned char* rgba, __m128i& r, __m128i& g, __m128i& b)
+{
+	const __m128i mask = _mm_set1_epi32(0xFF);
+	__m128i p0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba));
+	__m128i p1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + 16));
+	r = _mm_packs_epi32(_mm_and_si128(p0, mask),					_mm_and_si128(p1, mask));
+	g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 8), mask),	_mm_and_si128(_mm_srli_epi32(p1, 8), mask));
+	b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), mask),_mm_and_si128(_mm_srli_epi32(p1, 16), mask));
+}
+
+/// Weighted sum of 16 bits lanes (wrapping arithmetic is exact since the result fits in unsigned 16 bits) then >> 8
+static inline __m128i weightSSE2(__m128i r, __m128i g, __m128i b, short cr, short cg, short cb, short offset)
+{
+	__m128i sum = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(cr)), _mm_mullo_epi16(g, _mm_set1_epi16(cg)));
+	sum = _mm_add_epi16(sum, _mm_mullo_epi16(b, _mm_set1_epi16(cb)));
+	return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(offset)), 8);
+}
+
+/// Rounded average of the 2x2 blocks given the 16 bits sums of 2 rows for 16 pixels (lo : pixels 0-7, hi : pixels 8-15)
+static inline __m128i blockAverageSSE2(__m128i lo, __m128i hi)
+{
+	const __m128i ones = _mm_set1_epi16(1);
+	__m128i sums = _mm_packs_epi32(_mm_madd_epi16(lo, ones), _mm_madd_epi16(hi, ones));
+	return _mm_srli_epi16(_mm_add_epi16(sums, _mm_set1_epi16(2)), 2);
+}
+
+static void convertRowsSSE2(const unsigned char* row0, const unsigned char* row1, int width,
+							unsigned char* y0, unsigned char* y1, unsigned char* u, unsigned char* v, bool nv12)
+{
+	int x = 0;
+	for(; x + 16 <= width; x += 16)
+	{
+		__m128i r00, g00, b00, r01, g01, b01, r10, g10, b10, r11, g11, b11;
+		deinterleaveSSE2(row0 + 4*x,		r00, g00, b00);
+		deinterleaveSSE2(row0 + 4*x + 32,	r01, g01, b01);
+		deinterleaveSSE2(row1 + 4*x,		r10, g10, b10);
+		deinterleaveSSE2(row1 + 4*x + 32,	r11, g11, b11);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(y0 + x), _mm_packus_epi16(
+			weightSSE2(r00, g00, b00, 66, 129, 25, 4224), weightSSE2(r01, g01, b01, 66, 129, 25, 4224)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(y1 + x), _mm_packus_epi16(
+			weightSSE2(r10, g10, b10, 66, 129, 25, 4224), weightSSE2(r11, g11, b11, 66, 129, 25, 4224)));
+
+		__m128i r = blockAverageSSE2(_mm_add_epi16(r00, r10), _mm_add_epi16(r01, r11));
+		__m128i g = blockAverageSSE2(_mm_add_epi16(g00, g10), _mm_add_epi16(g01, g11));
+		__m128i b = blockAverageSSE2(_mm_add_epi16(b00, b10), _mm_add_epi16(b01, b11));
+		__m128i cu = _mm_packus_epi16(weightSSE2(r, g, b, -38, -74, 112, -32640), _mm_setzero_si128()); // 32896 as signed 16 bits
+		__m128i cv = _mm_packus_epi16(weightSSE2(r, g, b, 112, -94, -18, -32640), _mm_setzero_si128());
+		if(nv12)
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(u + x), _mm_unpacklo_epi8(cu, cv));
+		else
+		{
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(u + x/2), cu);
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(v + x/2), cv);
+		}
+	}
+	convertRowsScalar(row0, row1, x, width, y0, y1, u, v, nv12);
+}
+
+
+//===========================================================================================================
+// AVX2 : 16 pixels of 2 rows per iteration, deinterleaving 256 bits at once
+
+/// Split 16 rgba pixels into 16 bits R, G and B lanes (in pixels order)
+COLOR_CONVERSION_TARGET_AVX2
+static inline void deinterleaveAVX2(const unsigned char* rgba, __m256i& r, __m256i& g, __m256i& b)
+{
+	const __m256i mask = _mm256_set1_epi32(0xFF);
+	__m256i p0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rgba));
+	__m256i p1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rgba + 32));
+	// packs works per 128 bits lane : reorder the 64 bits blocks to get back the pixels order
+	r = _mm256_permute4x64_epi64(_mm256_packs_epi32(_mm256_and_si256(p0, mask),
+													_mm256_and_si256(p1, mask)), 0xD8);
+	g = _mm256_permute4x64_epi64(_mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(p0, 8), mask),
+													_mm256_and_si256(_mm256_srli_epi32(p1, 8), mask)), 0xD8);
+	b = _mm256_permute4x64_epi64(_mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(p0, 16), mask),
+													_mm256_and_si256(_mm256_srli_epi32(p1, 16), mask)), 0xD8);
+}
+
+COLOR_CONVERSION_TARGET_AVX2
+static inline __m256i weightAVX2(__m256i r, __m256i g, __m256i b, short cr, short cg, short cb, short offset)
+{
+	__m256i sum = _mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(cr)), _mm256_mullo_epi16(g, _mm256_set1_epi16(cg)));
+	sum = _mm256_add_epi16(sum, _mm256_mullo_epi16(b, _mm256_set1_epi16(cb)));
+	return _mm256_srli_epi16(_mm256_add_epi16(sum, _mm256_set1_epi16(offset)), 8);
+}
+
+/// 16 bits lanes (in pixels order) to 16 bytes
+COLOR_CONVERSION_TARGET_AVX2
+static inline __m128i packAVX2(__m256i v)
+{
+	return _mm_packus_epi16(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+}
+
+/// Rounded average of the 2x2 blocks given the 16 bits sums of 2 rows for 16 pixels : 8 lanes of 16 bits
+COLOR_CONVERSION_TARGET_AVX2
+static inline __m128i blockAverageAVX2(__m256i sum)
+{
+	__m256i pairs = _mm256_madd_epi16(sum, _mm256_set1_epi16(1));
+	__m128i sums  = _mm_packs_epi32(_mm256_castsi256_si128(pairs), _mm256_extracti128_si256(pairs, 1));
+	return _mm_srli_epi16(_mm_add_epi16(sums, _mm_set1_epi16(2)), 2);
+}
+
+COLOR_CONVERSION_TARGET_AVX2
+static void convertRowsAVX2(const unsigned char* row0, const unsigned char* row1, int width,
+							unsigned char* y0, unsigned char* y1, unsigned char* u, unsigned char* v, bool nv12)
+{
+	int x = 0;
+	for(; x + 16 <= width; x += 16)
+	{
+		__m256i r0, g0, b0, r1, g1, b1;
+		deinterleaveAVX2(row0 + 4*x, r0, g0, b0);
+		deinterleaveAVX2(row1 + 4*x, r1, g1, b1);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(y0 + x), packAVX2(weightAVX2(r0, g0, b0, 66, 129, 25, 4224)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(y1 + x), packAVX2(weightAVX2(r1, g1, b1, 66, 129, 25, 4224)));
+
+		__m128i r = blockAverageAVX2(_mm256_add_epi16(r0, r1));
+		__m128i g = blockAverageAVX2(_mm256_add_epi16(g0, g1));
+		__m128i b = blockAverageAVX2(_mm256_add_epi16(b0, b1));
+		__m128i cu = _mm_packus_epi16(weightSSE2(r, g, b, -38, -74, 112, -32640), _mm_setzero_si128());
+		__m128i cv = _mm_packus_epi16(weightSSE2(r, g, b, 112, -94, -18, -32640), _mm_setzero_si128());
+		if(nv12)
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(u + x), _mm_unpacklo_epi8(cu, cv));
+		else
+		{
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(u + x/2), cu);
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(v + x/2), cv);
+		}
+	}
+	convertRowsScalar(row0, row1, x, width, y0, y1, u, v, nv12);
+}
+#endif // COLOR_CONVERSION_X86
+
+
+//===========================================================================================================
+// 10 bits : rgb10_a2 pixels (R in the 10 low bits of each 32 bits word) to BT.601 limited range (Y 64-940, UV 64-960).
+// The exact coefficients in 1.15 fixed point (10 bits are captured not to lose precision), summed in 32 bits :
+//  Y = ( 8390 R + 16471 G +  3199 B + 16384 +  64*32768) >> 15
+//  U = (-4843 R -  9507 G + 14350 B + 16384 + 512*32768) >> 15
+//  V = (14350 R - 12016 G -  2334 B + 16384 + 512*32768) >> 15
+// the offsets keep every sum positive, chroma is computed from the rounded average of each 2x2 block as in 8 bits.
+// p010 holds the values in the 10 high bits of its 16 bits words, yuv420p10le in the 10 low bits.
+
+static inline unsigned short weight10Scalar(unsigned int p, int cr, int cg, int cb, int offset)
+{
+	int r = int(p & 0x3FF), g = int((p >> 10) & 0x3FF), b = int((p >> 20) & 0x3FF);
+	return (unsigned short)((cr*r + cg*g + cb*b + 16384 + offset) >> 15);
+}
+
+/// Convert the pixels [begin:width[ of a pair of rows (u is the interleaved UV row if p010)
+static void convertRows10Scalar(const unsigned int* row0, const unsigned int* row1, int begin, int width,
+								unsigned short* y0, unsigned short* y1, unsigned short* u, unsigned short* v, bool p010)
+{
+	int shift = p010 ? 6 : 0;
+	for(int x = begin; x < width; x += 2)
+	{
+		unsigned int p00 = row0[x], p01 = row0[x+1], p10 = row1[x], p11 = row1[x+1];
+		y0[x]	= (unsigned short)(weight10Scalar(p00, 8390, 16471, 3199, 64 << 15) << shift);
+		y0[x+1]	= (unsigned short)(weight10Scalar(p01, 8390, 16471, 3199, 64 << 15) << shift);
+		y1[x]	= (unsigned short)(weight10Scalar(p10, 8390, 16471, 3199, 64 << 15) << shift);
+		y1[x+1]	= (unsigned short)(weight10Scalar(p11, 8390, 16471, 3199, 64 << 15) << shift);
+
+		unsigned int block = 0;
+		for(int c = 0; c < 3; c++)
+		{
+			unsigned int sum = ((p00 >> 10*c) & 0x3FF) + ((p01 >> 10*c) & 0x3FF) + ((p10 >> 10*c) & 0x3FF) + ((p11 >> 10*c) & 0x3FF);
+			block |= ((sum + 2) >> 2) << 10*c;
+		}
+		unsigned short cu = weight10Scalar(block, -4843, -9507, 14350, 512 << 15);
+		unsigned short cv = weight10Scalar(block, 14350, -12016, -2334, 512 << 15);
+		if(p010)
+		{
+			u[x]	= (unsigned short)(cu << 6);
+			u[x+1]	= (unsigned short)(cv << 6);
+		}
+		else
+		{
+			u[x/2]	= cu;
+			v[x/2]	= cv;
+		}
+	}
+}
+
+#if COLOR_CONVERSION_X86
+//===========================================================================================================
+// SSE2 : 8 pixels of 2 rows per iteration, the weights are summed by _mm_madd_epi16 on (R, G) and (B, 1) 16 bits pairs
+
+/// A 32 bits lane per pixel : R and G as 16 bits pair, and B alone (10 bits each)
+static inline void split10SSE2(const unsigned int* rgb10a2, __m128i& rg, __m128i& b)
+{
+	const __m128i mask = _mm_set1_epi32(0x3FF);
+	__m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgb10a2));
+	rg = _mm_or_si128(_mm_and_si128(p, mask), _mm_and_si128(_mm_slli_epi32(p, 6), _mm_set1_epi32(0x3FF0000)));
+	b  = _mm_and_si128(_mm_srli_epi32(p, 20), mask);
+}
+
+static inline __m128i pair10SSE2(short lo, short hi)
+{
+	return _mm_set1_epi32(int((unsigned int)(unsigned short)lo | ((unsigned int)(unsigned short)hi << 16)));
+}
+
+/// Weighted sum of 4 pixels (B paired with 1 adds the rounding) in 32 bits lanes
+static inline __m128i weight10SSE2(__m128i rg, __m128i b, short cr, short cg, short cb, int offset)
+{
+	__m128i sum = _mm_madd_epi16(rg, pair10SSE2(cr, cg));
+	sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_or_si128(b, _mm_set1_epi32(0x10000)), pair10SSE2(cb, 16384)));
+	return _mm_srli_epi32(_mm_add_epi32(sum, _mm_set1_epi32(offset)), 15);
+}
+
+/// Sums of the pixels pairs of 2 x 4 lanes (pixels 0-3 and 4-7) : 4 lanes
+static inline __m128i pairSums10SSE2(__m128i lo, __m128i hi)
+{
+	__m128 a = _mm_castsi128_ps(lo), b = _mm_castsi128_ps(hi);
+	return _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))),
+						 _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))));
+}
+
+static void convertRows10SSE2(const unsigned int* row0, const unsigned int* row1, int width,
+							  unsigned short* y0, unsigned short* y1, unsigned short* u, unsigned short* v, bool p010)
+{
+	int x = 0;
+	for(; x + 8 <= width; x += 8)
+	{
+		__m128i rg00, b00, rg01, b01, rg10, b10, rg11, b11;
+		split10SSE2(row0 + x,		rg00, b00);
+		split10SSE2(row0 + x + 4,	rg01, b01);
+		split10SSE2(row1 + x,		rg10, b10);
+		split10SSE2(row1 + x + 4,	rg11, b11);
+
+		__m128i l0 = _mm_packs_epi32(weight10SSE2(rg00, b00, 8390, 16471, 3199, 64 << 15), weight10SSE2(rg01, b01, 8390, 16471, 3199, 64 << 15));
+		__m128i l1 = _mm_packs_epi32(weight10SSE2(rg10, b10, 8390, 16471, 3199, 64 << 15), weight10SSE2(rg11, b11, 8390, 16471, 3199, 64 << 15));
+		if(p010)
+		{
+			l0 = _mm_slli_epi16(l0, 6);
+			l1 = _mm_slli_epi16(l1, 6);
+		}
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(y0 + x), l0);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(y1 + x), l1);
+
+		// 2x2 blocks : the 16 bits halves of the (R, G) sums do not carry into each other (4 x 1023 at most)
+		__m128i rg = pairSums10SSE2(_mm_add_epi32(rg00, rg10), _mm_add_epi32(rg01, rg11));
+		__m128i b  = pairSums10SSE2(_mm_add_epi32(b00, b10), _mm_add_epi32(b01, b11));
+		rg = _mm_srli_epi16(_mm_add_epi16(rg, _mm_set1_epi16(2)), 2);
+		b  = _mm_srli_epi32(_mm_add_epi32(b, _mm_set1_epi32(2)), 2);
+		__m128i cu = weight10SSE2(rg, b, -4843, -9507, 14350, 512 << 15);
+		__m128i cv = weight10SSE2(rg, b, 14350, -12016, -2334, 512 << 15);
+		if(p010)
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(u + x), _mm_slli_epi16(_mm_unpacklo_epi16(_mm_packs_epi32(cu, cu), _mm_packs_epi32(cv, cv)), 6));
+		else
+		{
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(u + x/2), _mm_packs_epi32(cu, cu));
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(v + x/2), _mm_packs_epi32(cv, cv));
+		}
+	}
+	convertRows10Scalar(row0, row1, x, width, y0, y1, u, v, p010);
+}
+#endif // COLOR_CONVERSION_X86
+
+//===========================================================================================================
+// Box resampling : each output pixel is the average of the input pixels its area covers (rounded to whole pixels),
+// the rows of a box are summed per channel (16 bits up to 257 rows) then each box of columns is averaged in float
+// (the sums and the float operations are the same with any set, so are the bytes)
+
+/// Add 1 or 2 rows of bytes to the sums (or set them)
+template<typename T>
+static void accumulateRowsScalar(const unsigned char* row0, const unsigned char* row1, size_t begin, size_t bytes, T* sums, bool first)
+{
+	for(size_t i = begin; i < bytes; i++)
+	{
+		T sum = T(row0[i] + (row1 != nullptr ? row1[i] : 0));
+		sums[i] = first ? sum : T(sums[i] + sum);
+	}
+}
+
+/// Average the 4 channels sums of the columns of each box of a row (scales : 1 / area of each box)
+template<typename T>
+static void averageRowScalar(const T* sums, const int* columns, const float* scales, int width, unsigned char* out)
+{
+	for(int i = 0; i < width; i++)
+	{
+		int x0 = columns[i];
+		int x1 = std::max(columns[i + 1], x0 + 1); // upscaling : nearest column
+		for(int c = 0; c < 4; c++)
+		{
+			unsigned int sum = 0;
+			for(int x = x0; x < x1; x++)
+				sum += sums[4*x + c];
+			out[4*i + c] = (unsigned char)(int)(float(int(sum)) * scales[i] + 0.5f);
+		}
+	}
+}
+
+#if COLOR_CONVERSION_X86
+/// 16 bytes of 1 or 2 rows per iteration, widened to 2 x 8 unsigned 16 bits lanes
+static void accumulateRowsSSE2(const unsigned char* row0, const unsigned char* row1, size_t bytes, unsigned short* sums, bool first)
+{
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+	for(; i + 16 <= bytes; i += 16)
+	{
+		__m128i v0	= _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + i));
+		__m128i lo	= _mm_unpacklo_epi8(v0, zero);
+		__m128i hi	= _mm_unpackhi_epi8(v0, zero);
+		if(row1 != nullptr)
+		{
+			__m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + i));
+			lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(v1, zero));
+			hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(v1, zero));
+		}
+		__m128i* dst = reinterpret_cast<__m128i*>(sums + i);
+		if(!first)
+		{
+			lo = _mm_add_epi16(lo, _mm_loadu_si128(dst));
+			hi = _mm_add_epi16(hi, _mm_loadu_si128(dst + 1));
+		}
+		_mm_storeu_si128(dst, lo);
+		_mm_storeu_si128(dst + 1, hi);
+	}
+	accumulateRowsScalar(row0, row1, i, bytes, sums, first);
+}
+
+/// The 4 channels of a pixel widened to a 128 bits lane
+static void averageRowSSE2(const unsigned short* sums, const int* columns, const float* scales, int width, unsigned char* out)
+{
+	const __m128i	zero = _mm_setzero_si128();
+	const __m128	half = _mm_set1_ps(0.5f);
+	for(int i = 0; i < width; i++)
+	{
+		int x0 = columns[i];
+		int x1 = std::max(columns[i + 1], x0 + 1);
+		__m128i sum = zero;
+		for(int x = x0; x < x1; x++)
+			sum = _mm_add_epi32(sum, _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(sums + 4*x)), zero));
+		__m128i bytes = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(sum), _mm_set1_ps(scales[i])), half));
+		bytes = _mm_packus_epi16(_mm_packs_epi32(bytes, bytes), bytes);
+		int value = _mm_cvtsi128_si32(bytes);
+		std::memcpy(out + 4*i, &value, 4);
+	}
+}
+#endif // COLOR_CONVERSION_X86
+
+#if COLOR_CONVERSION_X86
+/// 16 sums per iteration averaged in float (as the scalar path)
+static void averageSSE2(const unsigned short* sums, size_t size, float scale, unsigned char* frame)
+{
+	const __m128i	zero = _mm_setzero_si128();
+	const __m128	half = _mm_set1_ps(0.5f);
+	const __m128	s	 = _mm_set1_ps(scale);
+	size_t i = 0;
+	for(; i + 16 <= size; i += 16)
+	{
+		__m128i words[2] = { _mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + i)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + i + 8)) };
+		__m128i packed[2];
+		for(int k = 0; k < 2; k++)
+		{
+			__m128i lo = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(words[k], zero)), s), half));
+			__m128i hi = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(words[k], zero)), s), half));
+			packed[k] = _mm_packs_epi32(lo, hi);
+		}
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(frame + i), _mm_packus_epi16(packed[0], packed[1]));
+	}
+	for(; i < size; i++)
+		frame[i] = (unsigned char)(int)(float(int(sums[i])) * scale + 0.5f);
+}
+#endif // COLOR_CONVERSION_X86
+
+/// Box resampling with sums of type T (unsigned short : boxes of at most 257 rows), sse2 : SSE2 kernels (unsigned short only)
+template<typename T>
+static void resizeRows(const unsigned char* src, int srcWidth, int srcHeight, unsigned char* dst, int dstWidth, int dstHeight, bool sse2)
+{
+	// column sums of the rows of the current box, box columns and 1 / box area for each box height (kept by the thread for the next frames)
+	static thread_local std::vector<T>		sums;
+	static thread_local std::vector<int>	columns;
+	static thread_local std::vector<float>	scales;
+	size_t	stride	= 4 * size_t(srcWidth);
+	int		maxRows	= std::max((srcHeight + dstHeight - 1) / dstHeight, 1);
+	sums.resize(stride);
+	columns.resize(size_t(dstWidth) + 1);
+	scales.resize(size_t(dstWidth) * maxRows);
+	for(int x = 0; x <= dstWidth; x++)
+		columns[x] = int((long long)x * srcWidth / dstWidth);
+	for(int rows = 1; rows <= maxRows; rows++)
+		for(int x = 0; x < dstWidth; x++)
+			scales[size_t(dstWidth) * (rows - 1) + x] = 1.0f / float(std::max(columns[x + 1] - columns[x], 1) * rows);
+
+	for(int y = 0; y < dstHeight; y++)
+	{
+		int first	= int((long long)y * srcHeight / dstHeight);
+		int last	= std::max(int((long long)(y + 1) * srcHeight / dstHeight), first + 1); // upscaling : nearest row
+		for(int row = first; row < last; row += 2)
+		{
+			const unsigned char* row0 = src + stride * row;
+			const unsigned char* row1 = row + 1 < last ? row0 + stride : nullptr;
+#if COLOR_CONVERSION_X86
+			if(sse2)
+				accumulateRowsSSE2(row0, row1, stride, reinterpret_cast<unsigned short*>(sums.data()), row == first);
+			else
+#endif
+				accumulateRowsScalar(row0, row1, 0, stride, sums.data(), row == first);
+		}
+
+		const float*	scale	= scales.data() + size_t(dstWidth) * (last - first - 1);
+		unsigned char*	out		= dst + 4 * size_t(dstWidth) * y;
+#if COLOR_CONVERSION_X86
+		if(sse2)
+			averageRowSSE2(reinterpret_cast<const unsigned short*>(sums.data()), columns.data(), scale, dstWidth, out);
+		else
+#endif
+			averageRowScalar(sums.data(), columns.data(), scale, dstWidth, out);
+	}
+}
+
+
+//===========================================================================================================
+
+ColorConversion::INSTRUCTION_SET ColorConversion::bestInstructionSet()
+{
+#if COLOR_CONVERSION_X86
+	static INSTRUCTION_SET best = []()
+	{
+	#ifdef _MSC_VER
+		int info[4] = {0, 0, 0, 0};
+		__cpuid(info, 1);
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool sse2	 = (info[3] & (1 << 26)) != 0;
+		__cpuidex(info, 7, 0);
+		bool avx2	 = osxsave && (info[1] & (1 << 5)) != 0 && (_xgetbv(0) & 6) == 6; // OS saves the ymm registers
+	#else
+		__builtin_cpu_init();
+		bool sse2	 = __builtin_cpu_supports("sse2") != 0;
+		bool avx2	 = __builtin_cpu_supports("avx2") != 0;
+	#endif
+		return avx2 ? INSTRUCTION_SET::AVX2 : (sse2 ? INSTRUCTION_SET::SSE2 : INSTRUCTION_SET::SCALAR);
+	}();
+	return best;
+#else
+	return INSTRUCTION_SET::SCALAR;
+#endif
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+const char* ColorConversion::name(INSTRUCTION_SET set)
+{
+	switch(set)
+	{
+	case INSTRUCTION_SET::SCALAR:	return "scalar";
+	case INSTRUCTION_SET::SSE2:		return "sse2";
+	case INSTRUCTION_SET::AVX2:		return "avx2";
+	default:						return name(bestInstructionSet());
+	}
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void ColorConversion::rgbaToYuv420p(const unsigned char* rgba, int width, int height, unsigned char* yuv, bool flip, INSTRUCTION_SET set)
+{
+	convert(rgba, width, height, yuv, flip, false, set);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void ColorConversion::rgbaToNv12(const unsigned char* rgba, int width, int height, unsigned char* yuv, bool flip, INSTRUCTION_SET set)
+{
+	convert(rgba, width, height, yuv, flip, true, set);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void ColorConversion::convert(const unsigned char* rgba, int width, int height, unsigned char* yuv, bool flip, bool nv12, INSTRUCTION_SET set)
+{
+	if(set == INSTRUCTION_SET::AUTO || set > bestInstructionSet())
+		set = bestInstructionSet();
+
+	size_t			w		= size_t(width);
+	size_t			stride	= 4 * w;
+	unsigned char*	yPlane	= yuv;
+	unsigned char*	uPlane	= yuv + w * height;
+	unsigned char*	vPlane	= uPlane + (w/2) * (height/2);
+
+	for(int row = 0; row + 1 < height; row += 2)
+	{
+		// rows counted from the top of the image
+		const unsigned char* src0 = rgba + stride * size_t(flip ? height - 1 - row : row);
+		const unsigned char* src1 = rgba + stride * size_t(flip ? height - 2 - row : row + 1);
+		unsigned char* y0 = yPlane + w * row;
+		unsigned char* y1 = y0 + w;
+		unsigned char* u  = nv12 ? uPlane + w * (row/2) : uPlane + (w/2) * (row/2);
+		unsigned char* v  = nv12 ? nullptr : vPlane + (w/2) * (row/2);
+
+		switch(set)
+		{
+#if COLOR_CONVERSION_X86
+		case INSTRUCTION_SET::AVX2:	convertRowsAVX2(src0, src1, width, y0, y1, u, v, nv12);		break;
+		case INSTRUCTION_SET::SSE2:	convertRowsSSE2(src0, src1, width, y0, y1, u, v, nv12);		break;
+#endif
+		default:					convertRowsScalar(src0, src1, 0, width, y0, y1, u, v, nv12);break;
+		}
+	}
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void ColorConversion::rgb10a2ToP010(const unsigned char* rgb10a2, int width, int height, unsigned char* yuv, bool flip, INSTRUCTION_SET set)
+{
+	convert10(rgb10a2, width, height, yuv, flip, true, set);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void ColorConversion::rgb10a2ToYuv420p10(const unsigned char* rgb10a2, int width, int height, unsigned char* yuv, bool flip, INSTRUCTION_SET set)
+{
+	convert10(rgb10a2, width, height, yuv, flip, false, set);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void ColorConversion::convert10(const unsigned char* rgb10a2, int width, int height, unsigned char* yuv, bool flip, bool p010, INSTRUCTION_SET set)
+{
+	if(set == INSTRUCTION_SET::AUTO || set > bestInstructionSet())
+		set = bestInstructionSet();
+
+	// 32 bits pixels and 16 bits samples (the frames are page-aligned buffers)
+	const unsigned int*	pixels	= reinterpret_cast<const unsigned int*>(rgb10a2);
+	size_t				w		= size_t(width);
+	unsigned short*		yPlane	= reinterpret_cast<unsigned short*>(yuv);
+	unsigned short*		uPlane	= yPlane + w * height;
+	unsigned short*		vPlane	= uPlane + (w/2) * (height/2);
+
+	for(int row = 0; row + 1 < height; row += 2)
+	{
+		// rows counted from the top of the image
+		const unsigned int* src0 = pixels + w * size_t(flip ? height - 1 - row : row);
+		const unsigned int* src1 = pixels + w * size_t(flip ? height - 2 - row : row + 1);
+		unsigned short* y0 = yPlane + w * row;
+		unsigned short* y1 = y0 + w;
+		unsigned short* u  = p010 ? uPlane + w * (row/2) : uPlane + (w/2) * (row/2);
+		unsigned short* v  = p010 ? nullptr : vPlane + (w/2) * (row/2);
+
+#if COLOR_CONVERSION_X86
+		if(set != INSTRUCTION_SET::SCALAR)
+		{
+			convertRows10SSE2(src0, src1, width, y0, y1, u, v, p010);
+			continue;
+		}
+#endif
+		convertRows10Scalar(src0, src1, 0, width, y0, y1, u, v, p010);
+	}
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void ColorConversion::resizeRgba(const unsigned char* src, int srcWidth, int srcHeight, unsigned char* dst, int dstWidth, int dstHeight, INSTRUCTION_SET set)
+{
+	if(set == INSTRUCTION_SET::AUTO || set > bestInstructionSet())
+		set = bestInstructionSet();
+
+	if((srcHeight + dstHeight - 1) / dstHeight <= 257) // 255 * 257 fits in 16 bits
+		resizeRows<unsigned short>(src, srcWidth, srcHeight, dst, dstWidth, dstHeight, set != INSTRUCTION_SET::SCALAR);
+	else
+		resizeRows<unsigned int>(src, srcWidth, srcHeight, dst, dstWidth, dstHeight, false);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void ColorConversion::accumulate(const unsigned char* frame, size_t size, unsigned short* sums, bool first, INSTRUCTION_SET set)
+{
+	if(set == INSTRUCTION_SET::AUTO || set > bestInstructionSet())
+		set = bestInstructionSet();
+#if COLOR_CONVERSION_X86
+	if(set != INSTRUCTION_SET::SCALAR)
+	{
+		accumulateRowsSSE2(frame, nullptr, size, sums, first);
+		return;
+	}
+#endif
+	accumulateRowsScalar(frame, static_cast<const unsigned char*>(nullptr), 0, size, sums, first);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void ColorConversion::average(const unsigned short* sums, size_t size, unsigned int count, unsigned char* frame, INSTRUCTION_SET set)
+{
+	if(set == INSTRUCTION_SET::AUTO || set > bestInstructionSet())
+		set = bestInstructionSet();
+	float scale = 1.0f / float(count != 0 ? count : 1);
+#if COLOR_CONVERSION_X86
+	if(set != INSTRUCTION_SET::SCALAR)
+	{
+		averageSSE2(sums, size, scale, frame);
+		return;
+	}
+#endif
+	for(size_t i = 0; i < size; i++)
+		frame[i] = (unsigned char)(int)(float(int(sums[i])) * scale + 0.5f);
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+
+
+/**
+* CPU conversion of the read back RGBA frames to YUV 4:2:0, flipping the rows in the same pass
+* (OpenGL rows are bottom-up), so ffmpeg receive planar frames and neither need -vf vflip nor swscale.
+* Also the 10 bits conversion of the frames read back as rgb10_a2 (HDR or high precision renders) to p010 or yuv420p10le,
+* the resampling of the RGBA frames to the resolution of an extra rendition (see resizeRgba)
+* and the bytewise average of several frames (any pixel format, see accumulate).
+*
+* BT.601 limited range in 8 bits fixed point (what ffmpeg and libyuv do by default), chroma is computed from the average of each 2x2 block.
+* The kernel is vectorized with SSE2 and AVX2, chosen at runtime according to the CPU, with a scalar fallback.
+* All the instruction sets produce exactly the same bytes.
+*
+* Width and height have to be even (see FFmpegVideoRecorderProcess::resolutionCheck).
+*/
+class ColorConversion
+{
+public:
+	/// Kernel implementation
+	enum class INSTRUCTION_SET
+	{
+		AUTO,	///< the best one supported by the CPU
+		SCALAR,	///< plain C++ (any CPU)
+		SSE2,	///< 16 pixels per iteration (any x86-64 CPU)
+		AVX2	///< 16 pixels per iteration with 256 bits deinterleaving (Haswell and later)
+	};
+
+	/// The best instruction set supported by this CPU (detected once)
+	static INSTRUCTION_SET bestInstructionSet();
+
+	/// Human readable name of an instruction set
+	static const char* name(INSTRUCTION_SET set);
+
+	/// Convert to planar yuv420p : Y plane (width x height) then U and V planes (width/2 x height/2).
+	/// If flip is true, the first rgba row is the bottom one (as read back by glReadPixels).
+	static void rgbaToYuv420p(const unsigned char* rgba, int width, int height, unsigned char* yuv, bool flip = true, INSTRUCTION_SET set = INSTRUCTION_SET::AUTO);
+
+	/// Convert to semi-planar nv12 : Y plane (width x height) then interleaved UV plane (width x height/2).
+	/// If flip is true, the first rgba row is the bottom one (as read back by glReadPixels).
+	static void rgbaToNv12(const unsigned char* rgba, int width, int height, unsigned char* yuv, bool flip = true, INSTRUCTION_SET set = INSTRUCTION_SET::AUTO);
+
+	/// Convert rgb10_a2 pixels (read back as GL_RGBA / GL_UNSIGNED_INT_2_10_10_10_REV : R in the 10 low bits of each 32 bits word)
+	/// to 10 bits semi-planar p010 : 16 bits little endian words holding the value in their 10 high bits, Y plane then interleaved UV plane.
+	/// BT.601 limited range with exact coefficients in 1.15 fixed point. SSE2 converts 8 pixels per iteration (AVX2 uses it too).
+	static void rgb10a2ToP010(const unsigned char* rgb10a2, int width, int height, unsigned char* yuv, bool flip = true, INSTRUCTION_SET set = INSTRUCTION_SET::AUTO);
+
+	/// Convert rgb10_a2 pixels to 10 bits planar yuv420p10le : 16 bits little endian words holding the value in their 10 low bits,
+	/// Y plane then U and V planes (see rgb10a2ToP010).
+	static void rgb10a2ToYuv420p10(const unsigned char* rgb10a2, int width, int height, unsigned char* yuv, bool flip = true, INSTRUCTION_SET set = INSTRUCTION_SET::AUTO);
+
+	/// Resample an rgba frame to another resolution (rows kept in the same order) : each output pixel is the average of the box of
+	/// input pixels it covers, so downscaling does not alias (upscaling repeats the nearest pixel). SSE2 sums the rows and averages
+	/// the boxes (AVX2 uses it too).
+	static void resizeRgba(const unsigned char* src, int srcWidth, int srcHeight, unsigned char* dst, int dstWidth, int dstHeight,
+						   INSTRUCTION_SET set = INSTRUCTION_SET::AUTO);
+
+	/// Add the bytes of a frame to sums (or set them if first), to average up to 257 frames (e.g. the motion blur of the skipped frames)
+	static void accumulate(const unsigned char* frame, size_t size, unsigned short* sums, bool first, INSTRUCTION_SET set = INSTRUCTION_SET::AUTO);
+
+	/// Rounded average of count frames added to sums by accumulate() into frame
+	static void average(const unsigned short* sums, size_t size, unsigned int count, unsigned char* frame, INSTRUCTION_SET set = INSTRUCTION_SET::AUTO);
+
+	/// Size in bytes of a yuv420p or nv12 frame
+	static size_t yuv420Size(int width, int height) { return size_t(width) * size_t(height) * 3 / 2; }
+
+	/// Size in bytes of a p010 or yuv420p10le frame
+	static size_t yuv420p10Size(int width, int height) { return 2 * yuv420Size(width, height); }
+
+protected:
+	static void convert(const unsigned char* rgba, int width, int height, unsigned char* yuv, bool flip, bool nv12, INSTRUCTION_SET set);
+	static void convert10(const unsigned char* rgb10a2, int width, int height, unsigned char* yuv, bool flip, bool p010, INSTRUCTION_SET set);
+};
@@ -0,0 +1,69 @@
+#include "FFmpegVideoRecorderProcess.h"
+
+#include <sstream>
+
+// the encoding options are shared with the offline tools : kept out of FFmpegVideoRecorderProcess.cpp so they link without OpenGL
+
+
+//===========================================================================================================
+
+const char* FFmpegVideoRecorderProcess::presetName(PRESET preset)
+{
+	switch ((int)preset)
+	{
+	case (int)PRESET::BALANCED:				return "medium";
+	case (int)PRESET::BEST_COMPRESSION:		return "veryslow";
+	case (int)PRESET::BETTER_COMPRESSION:	return "slow";
+	case (int)PRESET::FASTEST_ENCODING:		return "ultrafast";
+	case (int)PRESET::FASTER_ENCODING:		return "superfast";
+	case (int)PRESET::FAST_ENCODING:		return "faster";
+	default:								return "fast"; // fast is the only preset not available in enum but valid
+	}
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+const char* FFmpegVideoRecorderProcess::codecName(CODEC codec)
+{
+	return codec == CODEC::H265 ? "libx265" : "libx264";
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool FFmpegVideoRecorderProcess::highBitDepth(const std::string& pixFmt)
+{
+	return pixFmt == "p010le" || pixFmt == "yuv420p10le";
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+std::string FFmpegVideoRecorderProcess::encodingArguments(PRESET preset, unsigned int crf, bool lossless, const Bitrate& bitrate,
+														   CODEC codec, bool highBitDepth)
+{
+	std::stringstream args;
+	args << "-c:v " << codecName(codec) << " "	// libx264 by default (due to best perf/quality ratio and some specific additional options we may need: crf)
+		 << "-preset " << presetName(preset) << " ";
+
+	// if a bitrate is set, no auto optimization quality is needed as bitrate fix it
+	// if real bool lossless, do not use crf param otherwise use it
+	if(!(bitrate.use && bitrate.bitrate))
+	{
+		if(lossless)	args << (codec == CODEC::H265 ? "-x265-params lossless=1 " : "-qp 0 "); // x265 -qp 0 is not lossless
+		else			args << "-crf " << crf << " ";
+	}
+
+	// apply the selected bitrate param (individually set)
+	if(bitrate.use && bitrate.bitrate) args << "-b:v "		<< bitrate.bitrate << "k ";
+	if(bitrate.use && bitrate.maxrate) args << "-maxrate "	<< bitrate.maxrate << "k ";
+	if(bitrate.use && bitrate.minrate) args << "-minrate "	<< bitrate.minrate << "k ";
+	if(bitrate.use && bitrate.bufsize) args << "-bufsize "	<< bitrate.bufsize << "k ";
+
+	// 10 bits frames stay in 10 bits (the libx264/libx265 builds of ffmpeg encode both depths)
+	if(highBitDepth)
+		args << "-profile:v " << (codec == CODEC::H265 ? "main10 " : "high10 ") << "-pix_fmt yuv420p10le ";
+	else
+		args << "-pix_fmt yuv420p ";
+	if(codec == CODEC::H265)
+		args << "-tag:v hvc1 "; // the hevc tag the Apple players expect in mp4
+	return args.str();
+}
@@ -0,0 +1,259 @@
+#include "FFmpegLibavEncoder.h"
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+
+#ifdef HAS_LIBAV
+extern "C"
+{
+	#include <libavcodec/avcodec.h>
+	#include <libavformat/avformat.h>
+	#include <libavutil/imgutils.h>
+	#include <libavutil/opt.h>
+	#include <libswscale/swscale.h>
+}
+#endif
+
+
+//===========================================================================================================
+
+bool FFmpegLibavEncoder::available()
+{
+#ifdef HAS_LIBAV
+	return true;
+#else
+	return false;
+#endif
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+FFmpegLibavEncoder::FFmpegLibavEncoder()
+	: mFormat(nullptr), mCodec(nullptr), mStream(nullptr), mFrame(nullptr), mPacket(nullptr), mSws(nullptr), mPts(-1), mKeyframes(0)
+{
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+FFmpegLibavEncoder::~FFmpegLibavEncoder()
+{
+	close();
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool FFmpegLibavEncoder::open(const std::string& filePath, const Settings& settings)
+{
+#ifdef HAS_LIBAV
+	close();
+	mSettings	= settings;
+	mPts		= -1;
+	mKeyframes	= 0;
+
+	if(!settings.overwrite && std::ifstream(filePath.c_str()).is_open())
+	{
+		std::cerr<<"[FFmpegLibavEncoder] "<<filePath<<" already exist, do not overwrite it"<<std::endl;
+		return false;
+	}
+
+	const AVCodec* codec = avcodec_find_encoder_by_name(settings.encoder.c_str());
+	if(codec == nullptr)
+	{
+		std::cerr<<"[FFmpegLibavEncoder] libavcodec was built without "<<settings.encoder<<std::endl;
+		return false;
+	}
+	const char* format = settings.format.empty() ? nullptr : settings.format.c_str();
+	if(avformat_alloc_output_context2(&mFormat, nullptr, format, filePath.c_str()) < 0 || mFormat == nullptr)
+	{
+		std::cerr<<"[FFmpegLibavEncoder] can not guess the container of "<<filePath<<std::endl;
+		return false;
+	}
+
+	// same settings as the ffmpeg command line
+	bool nv12		= settings.inputPixFmt == "nv12";
+	bool tenBits	= settings.inputPixFmt == "yuv420p10le" || settings.inputPixFmt == "p010le";
+	bool x265		= settings.encoder == "libx265";
+	mStream			= avformat_new_stream(mFormat, nullptr);
+	mCodec			= avcodec_alloc_context3(codec);
+	mCodec->width	= settings.width;
+	mCodec->height	= settings.height;
+	mCodec->time_base	= av_make_q(1, settings.timeBase != 0 ? int(settings.timeBase) : settings.framerate);
+	mCodec->framerate	= av_make_q(settings.framerate, 1);
+	mCodec->pix_fmt		= tenBits ? AV_PIX_FMT_YUV420P10LE : (nv12 && !x265 ? AV_PIX_FMT_NV12 : AV_PIX_FMT_YUV420P); // 4:2:0 all, libx264 reads nv12 natively
+	mCodec->thread_count = 0; // auto detect
+	if(settings.bitrate) mCodec->bit_rate		 = int64_t(settings.bitrate) * 1000;
+	if(settings.maxrate) mCodec->rc_max_rate	 = int64_t(settings.maxrate) * 1000;
+	if(settings.minrate) mCodec->rc_min_rate	 = int64_t(settings.minrate) * 1000;
+	if(settings.bufsize) mCodec->rc_buffer_size = int(settings.bufsize) * 1000;
+	if(mFormat->oformat->flags & AVFMT_GLOBALHEADER)
+		mCodec->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+	AVDictionary* options = nullptr;
+	av_dict_set(&options, "preset", settings.preset.c_str(), 0);
+	if(tenBits)
+		av_dict_set(&options, "profile", x265 ? "main10" : "high10", 0);
+	if(settings.lossless)
+		av_dict_set(&options, x265 ? "x265-params" : "qp", x265 ? "lossless=1" : "0", 0); // x265 qp 0 is not lossless
+	else if(!settings.bitrate)
+		av_dict_set_int(&options, "crf", settings.crf, 0);
+	int error = avcodec_open2(mCodec, codec, &options);
+	av_dict_free(&options);
+	if(error < 0)
+	{
+		std::cerr<<"[FFmpegLibavEncoder] can not open "<<settings.encoder<<std::endl;
+		close();
+		return false;
+	}
+	avcodec_parameters_from_context(mStream->codecpar, mCodec);
+	if(x265)
+		mStream->codecpar->codec_tag = MKTAG('h', 'v', 'c', '1'); // as -tag:v hvc1
+	mStream->time_base = mCodec->time_base;
+
+	if(!(mFormat->oformat->flags & AVFMT_NOFILE) && avio_open(&mFormat->pb, filePath.c_str(), AVIO_FLAG_WRITE) < 0)
+	{
+		std::cerr<<"[FFmpegLibavEncoder] can not create "<<filePath<<std::endl;
+		close();
+		return false;
+	}
+	AVDictionary* muxerOptions = nullptr;
+	if(!settings.movflags.empty())
+		av_dict_set(&muxerOptions, "movflags", settings.movflags.c_str(), 0);
+	error = avformat_write_header(mFormat, &muxerOptions);
+	av_dict_free(&muxerOptions);
+	if(error < 0)
+	{
+		std::cerr<<"[FFmpegLibavEncoder] can not write the header of "<<filePath<<std::endl;
+		close();
+		return false;
+	}
+
+	mFrame			= av_frame_alloc();
+	mFrame->format	= mCodec->pix_fmt;
+	mFrame->width	= settings.width;
+	mFrame->height	= settings.height;
+	av_frame_get_buffer(mFrame, 0);
+	mPacket			= av_packet_alloc();
+
+	if(settings.inputPixFmt == "rgba")
+		mSws = sws_getContext(settings.width, settings.height, AV_PIX_FMT_RGBA,
+							  settings.width, settings.height, AV_PIX_FMT_YUV420P, SWS_BILINEAR, nullptr, nullptr, nullptr);
+	else if(settings.inputPixFmt == "p010le" || (nv12 && x265)) // neither libx264 nor libx265 read p010, libx265 does not read nv12
+		mSws = sws_getContext(settings.width, settings.height, tenBits ? AV_PIX_FMT_P010LE : AV_PIX_FMT_NV12,
+							  settings.width, settings.height, mCodec->pix_fmt, SWS_POINT, nullptr, nullptr, nullptr);
+	return true;
+#else
+	(void)filePath; (void)settings;
+	std::cerr<<"[FFmpegLibavEncoder] built without libavcodec/libavformat"<<std::endl;
+	return false;
+#endif
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool FFmpegLibavEncoder::encode(const void* frame, size_t size, long long pts)
+{
+#ifdef HAS_LIBAV
+	if(mFormat == nullptr || mFrame == nullptr) return false;
+	if(av_frame_make_writable(mFrame) < 0) return false;
+
+	const uint8_t*	src = static_cast<const uint8_t*>(frame);
+	int				w	= mSettings.width;
+	int				h	= mSettings.height;
+	if(mSws != nullptr && mSettings.inputPixFmt != "rgba")
+	{
+		// semi-planar : Y plane then interleaved UV plane (16 bits samples for p010)
+		size_t sample = mSettings.inputPixFmt == "p010le" ? 2 : 1;
+		if(size < size_t(w) * h * 3 / 2 * sample) return false;
+		const uint8_t*	srcData[4]	 = { src, src + size_t(w) * h * sample, nullptr, nullptr };
+		const int		srcStride[4] = { int(w * sample), int(w * sample), 0, 0 };
+		sws_scale(mSws, srcData, srcStride, 0, h, mFrame->data, mFrame->linesize);
+	}
+	else if(mSws != nullptr)
+	{
+		if(size < size_t(w) * h * 4) return false;
+		// rgba rows are bottom-up : start from the last row with a negative stride to flip
+		const uint8_t*	srcData[4]	 = { src + size_t(w) * 4 * (h - 1), nullptr, nullptr, nullptr };
+		const int		srcStride[4] = { -4 * w, 0, 0, 0 };
+		sws_scale(mSws, srcData, srcStride, 0, h, mFrame->data, mFrame->linesize);
+	}
+	else
+	{
+		size_t sample = mCodec->pix_fmt == AV_PIX_FMT_YUV420P10LE ? 2 : 1;
+		if(size < size_t(w) * h * 3 / 2 * sample) return false;
+		bool nv12 = mCodec->pix_fmt == AV_PIX_FMT_NV12;
+		const uint8_t*	srcData[4]	 = { src, src + size_t(w) * h * sample, nv12 ? nullptr : src + size_t(w) * h * 5 / 4 * sample, nullptr };
+		const int		srcStride[4] = { int(w * sample), int(nv12 ? w : w / 2 * sample), nv12 ? 0 : int(w / 2 * sample), 0 };
+		av_image_copy(mFrame->data, mFrame->linesize, srcData, srcStride, mCodec->pix_fmt, w, h);
+	}
+	// timestamped frames keep their pts (strictly increasing for the encoder), otherwise they are numbered
+	if(mSettings.timeBase != 0 && pts >= 0)
+		mPts = pts > mPts ? pts : mPts + 1;
+	else
+		mPts++;
+	mFrame->pts = mPts;
+
+	// forced keyframes at fixed times (fragments and segments start on them)
+	mFrame->pict_type = AV_PICTURE_TYPE_NONE;
+	if(mSettings.keyframeInterval != 0)
+	{
+		long long timeBase = mSettings.timeBase != 0 ? mSettings.timeBase : mSettings.framerate;
+		if(mPts >= mKeyframes * mSettings.keyframeInterval * timeBase)
+		{
+			mFrame->pict_type = AV_PICTURE_TYPE_I;
+			mKeyframes++;
+		}
+	}
+	return sendFrame(mFrame);
+#else
+	(void)frame; (void)size; (void)pts;
+	return false;
+#endif
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool FFmpegLibavEncoder::sendFrame(AVFrame* frame)
+{
+#ifdef HAS_LIBAV
+	if(avcodec_send_frame(mCodec, frame) < 0)
+		return false;
+	while(avcodec_receive_packet(mCodec, mPacket) == 0)
+	{
+		av_packet_rescale_ts(mPacket, mCodec->time_base, mStream->time_base);
+		mPacket->stream_index = mStream->index;
+		av_interleaved_write_frame(mFormat, mPacket); // take the packet reference
+	}
+	return true;
+#else
+	(void)frame;
+	return false;
+#endif
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegLibavEncoder::close()
+{
+#ifdef HAS_LIBAV
+	if(mFormat == nullptr) return;
+
+	// flush the frames delayed by the encoder (lookahead, b-frames)
+	if(mFrame != nullptr)
+	{
+		sendFrame(nullptr);
+		av_write_trailer(mFormat);
+	}
+	if(!(mFormat->oformat->flags & AVFMT_NOFILE))
+		avio_closep(&mFormat->pb);
+
+	sws_freeContext(mSws);
+	av_packet_free(&mPacket);
+	av_frame_free(&mFrame);
+	avcodec_free_context(&mCodec);
+	avformat_free_context(mFormat);
+	mSws	= nullptr;
+	mFormat = nullptr;
+	mStream = nullptr;
+#endif
+}
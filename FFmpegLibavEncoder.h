@@ -0,0 +1,78 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+struct AVFormatContext;
+struct AVCodecContext;
+struct AVStream;
+struct AVFrame;
+struct AVPacket;
+struct SwsContext;
+
+
+/**
+* In process libx264 (or libx265) encoder (libavcodec + libavformat) receiving the same raw frames the ffmpeg process would read from its stdin.
+* It avoids the pipe copy, the context switches and the fork/exec of the ffmpeg process.
+*
+* Only available if CMake found the libav* libraries (HAS_LIBAV), otherwise open() always fails.
+*/
+class FFmpegLibavEncoder
+{
+public:
+	/// What to encode and how (mirror the ffmpeg command line built by FFmpegVideoRecorderProcess::init())
+	struct Settings
+	{
+		int				width;
+		int				height;
+		int				framerate;		///< nominal frame rate (the frame rate of the file if timeBase is 0)
+		unsigned int	timeBase;		///< 0 : frames are numbered at framerate, otherwise encode() gets their pts in 1/timeBase seconds
+		std::string		inputPixFmt;	///< "rgba" (rows bottom-up, flipped here), "yuv420p", "nv12", "yuv420p10le" or "p010le" (rows top-down)
+		std::string		encoder;		///< "libx264" [default] or "libx265" (10 bits profile for the 10 bits input pixel formats)
+		std::string		preset;			///< libx264 preset name
+		unsigned int	crf;			///< Constant Rate Factor, not used if lossless or if a bitrate is given
+		bool			lossless;		///< -qp 0
+		unsigned int	bitrate;		///< in kbits, 0 to not use it (same for minrate, maxrate and bufsize)
+		unsigned int	minrate;
+		unsigned int	maxrate;
+		unsigned int	bufsize;
+		bool			overwrite;		///< fail if the file already exist and overwrite is false (-n)
+		unsigned int	keyframeInterval;	///< force a keyframe every keyframeInterval seconds (0 : libx264 decides)
+		std::string		format;			///< container name (empty : guessed from the file extension)
+		std::string		movflags;		///< mp4/mov muxer flags (-movflags, empty : none)
+
+		Settings() : encoder("libx264"), keyframeInterval(0) {}
+	};
+
+	/// Was the encoder built with libavcodec/libavformat
+	static bool available();
+
+	FFmpegLibavEncoder();
+	virtual ~FFmpegLibavEncoder();
+
+	/// Create the output file (container guessed from its extension) and open the encoder
+	bool open(const std::string& filePath, const Settings& settings);
+
+	/// Encode one raw frame of the input pixel format, presented at pts (in 1/timeBase seconds, ignored if timeBase is 0)
+	bool encode(const void* frame, size_t size, long long pts = -1);
+
+	/// Flush the delayed frames, write the trailer and close the file
+	void close();
+
+	bool isOpen() const { return mFormat != nullptr; }
+
+protected:
+	/// Send a frame (nullptr to flush) and mux all the packets the encoder gives back
+	bool sendFrame(AVFrame* frame);
+
+protected:
+	Settings			mSettings;
+	AVFormatContext*	mFormat;
+	AVCodecContext*		mCodec;
+	AVStream*			mStream;
+	AVFrame*			mFrame;		///< yuv frame given to the encoder
+	AVPacket*			mPacket;
+	SwsContext*			mSws;		///< rgba to yuv420p or p010le to yuv420p10le (nullptr if the input is already planar)
+	long long			mPts;		///< pts of the last frame encoded (frame index or timestamp)
+	long long			mKeyframes;	///< number of keyframes forced (-force_key_frames expr:gte(t,n_forced*keyframeInterval))
+};
@@ -0,0 +1,75 @@
+#include "FFmpegVideoRecorderManager.h"
+
+#include <iostream>
+#include <algorithm>// std::find
+
+
+//===========================================================================================================
+
+FFmpegVideoRecorderManager::FFmpegVideoRecorderManager(unsigned int workerThreads, unsigned int maxBlockingWriters)
+	: mPool(workerThreads, maxBlockingWriters)
+{
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+FFmpegVideoRecorderManager::~FFmpegVideoRecorderManager()
+{
+	std::vector<FFmpegVideoRecorderProcess*> remaining = recorders();
+	for(FFmpegVideoRecorderProcess* recorder : remaining)
+		destroyRecorder(recorder);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+FFmpegVideoRecorderProcess* FFmpegVideoRecorderManager::createRecorder(std::string path, FFmpegVideoRecorderProcess::BACKEND backend)
+{
+	FFmpegVideoRecorderProcess* recorder = new FFmpegVideoRecorderProcess(path, backend);
+	recorder->setWorkerPool(&mPool);
+	std::lock_guard<std::mutex> lock(mMutex);
+	mRecorders.push_back(recorder);
+	return recorder;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderManager::destroyRecorder(FFmpegVideoRecorderProcess* recorder)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		std::vector<FFmpegVideoRecorderProcess*>::iterator found = std::find(mRecorders.begin(), mRecorders.end(), recorder);
+		if(found == mRecorders.end())
+		{
+			std::cerr<<"[FFmpegVideoRecorderManager] not a recorder of this manager"<<std::endl;
+			return;
+		}
+		mRecorders.erase(found);
+	}
+	delete recorder; // finish and wait for its files
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+std::vector<FFmpegVideoRecorderProcess*> FFmpegVideoRecorderManager::recorders()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mRecorders;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderManager::finishAll()
+{
+	for(FFmpegVideoRecorderProcess* recorder : recorders())
+		recorder->finish();
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool FFmpegVideoRecorderManager::waitAllWritten(int timeoutMs)
+{
+	bool written = true;
+	for(FFmpegVideoRecorderProcess* recorder : recorders())
+		written = recorder->waitFileWritten(std::string(), timeoutMs) && written;
+	return written;
+}
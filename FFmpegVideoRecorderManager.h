@@ -0,0 +1,56 @@
+#pragma once
+
+#include "FFmpegVideoRecorderProcess.h"
+#include "WorkerPool.h"
+
+#include <vector>
+#include <mutex>
+
+
+/**
+* Owns several concurrent recorders (one per viewport, window or OpenGL context) sharing a single worker pool
+* which converts and pipes their frames : the CPU used scales with the number of streams and the pool size,
+* instead of one writer thread per recorder mostly blocked on its pipe.
+*
+* Each recorder is used as a standalone one : capture() and finish() are called with its OpenGL context current.
+*
+* Example:
+*	FFmpegVideoRecorderManager manager(4);
+*	FFmpegVideoRecorderProcess* left  = manager.createRecorder("videos/");	left->setOutputBaseFileName("left_");
+*	FFmpegVideoRecorderProcess* right = manager.createRecorder("videos/");	right->setOutputBaseFileName("right_");
+* then in each paintGL :
+*	left->capture(width(), height());
+*/
+class FFmpegVideoRecorderManager
+{
+public:
+	/// Start a pool of workerThreads threads (0 : one per hardware thread), at most maxBlockingWriters of them piping frames at once
+	/// (0 : all but one), so the frames of the other recorders are still converted while their consumers stall
+	FFmpegVideoRecorderManager(unsigned int workerThreads = 0, unsigned int maxBlockingWriters = 0);
+
+	/// Finish and delete the recorders still owned (see destroyRecorder)
+	virtual ~FFmpegVideoRecorderManager();
+
+	/// A new recorder converting and piping its frames on the shared pool
+	FFmpegVideoRecorderProcess* createRecorder(std::string path = "./", FFmpegVideoRecorderProcess::BACKEND backend = FFmpegVideoRecorderProcess::BACKEND::PIPE);
+
+	/// Finish (its OpenGL context has to be current if it reads back asynchronously) and delete a recorder of this manager
+	void destroyRecorder(FFmpegVideoRecorderProcess* recorder);
+
+	/// The recorders owned by the manager
+	std::vector<FFmpegVideoRecorderProcess*> recorders();
+
+	/// Finish all the recorders (see destroyRecorder for the OpenGL context)
+	void finishAll();
+
+	/// Wait (at most timeoutMs for each recorder, forever if negative) for all the videos of all the recorders to be fully written
+	bool waitAllWritten(int timeoutMs = -1);
+
+	/// The pool shared by the recorders
+	WorkerPool& workerPool() { return mPool; }
+
+protected:
+	WorkerPool									mPool;		///< declared first : destroyed after the recorders
+	std::mutex									mMutex;
+	std::vector<FFmpegVideoRecorderProcess*>	mRecorders;
+};
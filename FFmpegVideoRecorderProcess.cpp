@@ -1,4 +1,14 @@
 #include "FFmpegVideoRecorderProcess.h"
+#include "ColorConversion.h"
+#include "FrameBufferPool.h"
+#include "PipeTransport.h"
+#include "SharedMemoryRing.h"
+#include "MappedRawFile.h"
+#include "FrameHash.h"
+#include "WorkerPool.h"
+#include "CapturePipeline.h"
+#include "Mp4Segmenter.h"
+#include "PresetController.h"
 
 #include <iostream>
 #include <sstream>
@@ -7,7 +17,20 @@
 #include <algorithm>// std::for_each
 #include <cstdio>	// FOPEN, FWRITE , FCLOSE ...
 #include <cstdlib>	// PUTENV, GETENV ...
+#include <cstring>	// memcpy
 #include <numeric>	// accumulate string using operator +
+#include <thread>	// writer thread
+#include <mutex>	// ffmpeg discovery cache
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <set>
+#include <memory>	// frames shared by the pool tasks
+#include <chrono>
+
+#ifndef WIN32
+#include <sys/stat.h>// mkdir
+#endif
 
 
 #ifdef WIN32
@@ -21,21 +44,82 @@
 #define OS_PUT_ENV(VAR_C_STR_CHAR_STAR, VALUE_C_STR_CHAR_STAR) _putenv_s(VAR_C_STR_CHAR_STAR, VALUE_C_STR_CHAR_STAR);
 #define OS_SEPARATOR		';'
 #define OS_EXTENSION		".exe"
-#define OS_POPEN(X,Y)		_popen(X,"wb")
+#define OS_POPEN(X)			_popen(X,"wb")
 #define OS_PCLOSE(X)		_pclose(X)
-#define OS_FWRITE(X,Y,Z,W)	fwrite(X, Y, Z, W);
 #define OS_MKDIR(X)			CreateDirectoryA(path.c_str(),NULL)
 #else
 #define OS_GET_ENV(VAR_C_STR_CHAR_STAR, OUT_CHAR_STAR)			OUT_CHAR_STAR = getenv(VAR_C_STR_CHAR_STAR);
-#define OS_PUT_ENV(VAR_C_STR_CHAR_STAR, VALUE_C_STR_CHAR_STAR)  putenv( std::string(VALUE_C_STR_CHAR_STAR).insert(0, std::string(VAR_C_STR_CHAR_STAR)+"=").c_str() )
+#define OS_PUT_ENV(VAR_C_STR_CHAR_STAR, VALUE_C_STR_CHAR_STAR)  setenv(VAR_C_STR_CHAR_STAR, VALUE_C_STR_CHAR_STAR, 1)
 #define OS_SEPARATOR		':'
 #define OS_EXTENSION		""
-#define OS_POPEN(x,y)		popen(#X,"wb")
+#define OS_POPEN(X)			popen(X,"w")
 #define OS_PCLOSE(X)		pclose(X)
-#define OS_FWRITE(X,Y,Z,W)	fwrite(X, Z, Y, W);
 #define OS_MKDIR(X)			mkdir(X,S_IRUSR|S_IWUSR|S_IXUSR)
 #endif
 
+#ifdef HAS_QT
+#define GL_HAS_SYNC_OBJECTS()		OPENGL_HAS_SYNC_OBJECTS
+#define GL_HAS_SHADER_CONVERSION()	OPENGL_HAS_SHADER_CONVERSION
+#else
+#define GL_HAS_SYNC_OBJECTS()		hasSyncObjects()
+#define GL_HAS_SHADER_CONVERSION()	hasShaderConversion()
+#endif
+
+//===========================================================================================================
+
+// Full screen triangle without any vertex buffer
+static const char* gConversionVertexShader =
+	"#version 150\n"
+	"void main()\n"
+	"{\n"
+	"	vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);\n"
+	"	gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);\n"
+	"}\n";
+
+// Render the frame in a single channel target of W x (H + H/2) :
+//  the H first rows are the Y plane, the H/2 last rows hold the U and V planes side by side (yuv420p) or interleaved (nv12).
+// Rows are written top-down (vertical flip) with BT.601 limited range coefficients (as ffmpeg does by default).
+static const char* gConversionFragmentShader =
+	"#version 150\n"
+	"uniform sampler2D	uFrame;	// captured rgba frame (rows bottom-up as read from OpenGL)\n"
+	"uniform ivec2		uSize;	// even frame resolution\n"
+	"uniform int		uNV12;	// 1 : interleaved UV plane, 0 : U plane then V plane\n"
+	"out vec4 oColor;\n"
+	"vec3 fetch(int x, int row) { return texelFetch(uFrame, ivec2(x, uSize.y - 1 - row), 0).rgb; }\n"
+	"void main()\n"
+	"{\n"
+	"	ivec2 p = ivec2(gl_FragCoord.xy);\n"
+	"	if(p.y < uSize.y)\n"
+	"	{\n"
+	"		oColor = vec4(dot(fetch(p.x, p.y), vec3(0.257, 0.504, 0.098)) + 16.0/255.0);\n"
+	"		return;\n"
+	"	}\n"
+	"	int cy = p.y - uSize.y;\n"
+	"	int cx = uNV12 != 0 ? p.x / 2 : (p.x < uSize.x / 2 ? p.x : p.x - uSize.x / 2);\n"
+	"	bool u = uNV12 != 0 ? (p.x % 2) == 0 : p.x < uSize.x / 2;\n"
+	"	vec3 c = 0.25 * (fetch(2*cx, 2*cy) + fetch(2*cx+1, 2*cy) + fetch(2*cx, 2*cy+1) + fetch(2*cx+1, 2*cy+1));\n"
+	"	oColor = vec4(dot(c, u ? vec3(-0.148, -0.291, 0.439) : vec3(0.439, -0.368, -0.071)) + 128.0/255.0);\n"
+	"}\n";
+
+// ffmpeg executable resolved once for the process (reset when PATH is appended)
+static std::mutex	gFFmpegMutex;
+static std::string	gFFmpegPath;
+
+// timestamped frames are presented in 1/gTimeBase seconds (milliseconds as mkv/flv : finer steps make ffmpeg
+// guess an absurd nominal frame rate and raise the h264 level accordingly)
+static const unsigned int gTimeBase = 1000;
+
+// output files chosen by the recorders of the process and not fully written yet :
+// several recorders may share a path and a base name, the name is taken before ffmpeg creates the file
+static std::mutex				gFilesMutex;
+static std::set<std::string>	gReservedFiles;
+
+static void releaseFilePathName(const std::string& filePathName)
+{
+	std::lock_guard<std::mutex> lock(gFilesMutex);
+	gReservedFiles.erase(filePathName);
+}
+
 //===========================================================================================================
 
 class FFmpegVideoRecorderProcess::Private
@@ -44,13 +128,13 @@ public:
 	// needed for pipe creation and frame capture
 	bool	mFound;		///< is the ffmpeg process found
 	bool    mStarted;	///< is the ffmpeg process already started
-	int*	mFramedata;	///< the frame buffer used to catch the frames from oprnGL renderer
-	FILE*   mFFmpeg;	///< the file stream used to put frames buffers into ffmpeg process
+	unsigned char*	mFramedata;	///< the frame buffer used to catch the frames from oprnGL renderer (from the FrameBufferPool)
+	FrameSink*		mSink;		///< where the frames of the current session go (ffmpeg process, libav encoder, file...) nullptr if not opened
 
 	// needed for default ffmpeg cmd line creation
 	std::string mPath;		///< the output video path (directory)
 	std::string mBaseName;	///< the pattern used to create the output video file
-	static int  mId;		///< the increasing number to complete the creation of the output video file
+	int			mId;		///< the increasing number to complete the creation of the output video file
 	int			mWidth;		///< the Width resolution for capture
 	int			mHeight;	///< the height resolution for capture
 
@@ -59,24 +143,718 @@ public:
 	PRESET		 mPreset;	///< the ffmpeg preset use to auto handle encoding
 	unsigned int mCRF;		///< ffmpeg option to set the quality [0:lossless - 51:worse] default 23 ->only applies to 8-bit x264 (yuv420p) and 10-bit x264 (yuv420p101e)
 	bool		 mLossless; ///< ffmpeg option to encode without losing anything : -qp 0 (if set, will disable crf for auto ffmpeg efficiency)
+	CODEC		 mCodec;	///< libx264 or libx265
+
+	// preset and crf following the measured encoder throughput
+	bool			 mAdaptive;			///< adapt them (wanted)
+	PRESET			 mFastestPreset;	///< range of the adaptive presets
+	PRESET			 mSlowestPreset;
+	unsigned int	 mMaxCrfRaise;		///< highest crf raise once the fastest preset is not enough
+	PresetController mController;		///< chooses the level (kept across the sessions)
+
+	Bitrate		 mBitrate;	///< ffmpeg bitrate options (see Bitrate)
+
+	// in process encoding
+	BACKEND				mBackend;	///< pipe to an ffmpeg process or encode with libav
+
+	// output of the frames
+	SINK				mSinkMode;		///< where the frames go (wanted)
+	unsigned int		mSinkFrames;	///< slots of the shared memory ring or frames preallocated at once by the mapped file (0 : default)
+	std::function<FrameSink*(const FrameSink::Format&, const std::string&)>	mSinkFactory;	///< custom sink (replace mSinkMode if set)
+
+	// asynchronous read back (ring of pixel buffer objects)
+	bool				mAsyncReadback;	///< read back through the PBO ring instead of a blocking glReadPixels
+	unsigned int		mPboCount;		///< number of PBO in the ring (wanted)
+	std::vector<GLuint>	mPbos;			///< the PBO ring (empty if not yet created for the current capture)
+	std::vector<GLsync>	mFences;		///< fence of each PBO, signaled once its glReadPixels is done
+	size_t				mPboFrameSize;	///< bytes of one frame in the ring (the resolution may change before the ring is drained)
+	unsigned int		mPboHead;		///< index of the next PBO to fill
+	unsigned int		mPboPending;	///< number of filled PBO waiting to be sent (the oldest is at mPboHead-mPboPending)
+
+	// GPU color conversion
+	CONVERSION			mConversion;		///< where to convert the frames (wanted)
+	CONVERSION			mSessionConversion;	///< where the frames of the current session are converted (set by init)
+	GLuint				mConvSource;		///< texture receiving a copy of the captured frame
+	GLuint				mConvTarget;		///< single channel texture receiving the YUV planes
+	GLuint				mConvFbo;			///< framebuffer object rendering into mConvTarget
+	GLuint				mConvProgram;		///< the conversion shader program
+	GLuint				mConvVao;			///< empty vertex array object (needed to draw with a core profile)
+	int					mConvWidth;			///< resolution of the conversion textures
+	int					mConvHeight;
+	unsigned char*		mConverted;			///< frame converted by the CPU (if it can not be converted straight into a writer thread queue slot)
+
+	// capture source other than the bound read framebuffer (set by captureFramebuffer() or captureTexture() for one capture)
+	bool				mSourceFramebuffer;	///< read from mSourceFbo instead of the bound read framebuffer
+	GLuint				mSourceFbo;			///< framebuffer object read (0 : the default framebuffer)
+	unsigned int		mSourceAttachment;	///< its color attachment read
+	GLuint				mSourceTexture;		///< texture read (0 : none), attached to mReadFbo for the read back
+	GLuint				mReadFbo;			///< framebuffer object the textures are read back through
+
+	// raw pipe transport (Linux)
+	TRANSPORT			mTransportMode;		///< how the frames are piped to the ffmpeg process
+	size_t				mPipeSize;			///< requested pipe capacity (0 for one frame)
+
+	// standby ffmpeg process started by warmUp()
+	std::string			mStandbyCommand;		///< command line of the standby process (its output file included)
+	std::string			mStandbyFile;			///< output file path name reserved for the standby process
+	TRANSPORT			mStandbyTransportMode;	///< transport the standby process was spawned with
+	FFmpegPipeSink*		mStandbySink;			///< the standby process (nullptr if none)
+
+	// dedicated writer thread
+	bool				mThreadedWriter;	///< write the frames to ffmpeg from mWriter thread instead of capture()
+	unsigned int		mQueueDepth;		///< number of preallocated frames of the writer thread queue
+	OVERFLOW_POLICY		mOverflowPolicy;	///< what to do with a captured frame when the queue is full
+	FrameQueue*			mQueue;				///< frames waiting for the writer thread (nullptr if capture() writes itself)
+	std::thread			mWriter;			///< the thread piping the queued frames to ffmpeg
+	WorkerPool*			mPool;				///< shared pool converting and piping the queued frames instead of mWriter (not owned)
+	WorkerPool::Strand*	mStrand;			///< runs the tasks of the current session in order on mPool
+	unsigned long long	mDropped;			///< frames skipped by the drop policy or dropped by the queues of the previous sessions (since last init)
+
+	// staged pipeline : read back by capture(), transformed then written in order on a work-stealing pool
+	bool				mPipelined;			///< run the frames through mPipeline (wanted)
+	unsigned int		mTransformThreads;	///< frames transformed at once (0 : one per hardware thread)
+	unsigned int		mPipelineFrames;	///< frames in flight in the pipeline (0 : transform threads + 2)
+	std::function<void(unsigned char*, size_t, long long)>	mFrameTransform;	///< user transform of the frames read back (transform stage)
+	WorkStealingPool*	mStealingPool;		///< runs the stages (created by the first pipelined session, kept for the next ones)
+	CapturePipeline*	mPipeline;			///< frames of the current session (nullptr if not pipelined)
+
+	// timestamped capture (variable frame rate)
+	unsigned int		mFrameRate;			///< frame rate of the video if the frames are not timestamped
+	bool				mTimestamped;		///< timestamp the frames when captured (wanted)
+	unsigned int		mMaxFrameRate;		///< frames captured closer than 1/mMaxFrameRate are skipped (0 : no limit)
+	bool				mSessionTimestamped;///< are the frames of the current session timestamped (set by init)
+	std::chrono::steady_clock::time_point mClockStart;	///< capture time of the first frame of the session (pts 0)
+	long long			mLastPts;			///< pts of the last frame kept (-1 before the first one)
+	long long			mMinInterval;		///< current minimal pts interval between kept frames (adapted to the writer thread queue)
+	std::vector<long long>	mPboPts;		///< pts of the frame read back in each PBO of the ring
+
+	// output frame rate scheduler (samples the render loop on the monotonic clock, implies timestamped frames)
+	unsigned int		mOutputFrameRate;		///< output frames per second (wanted, 0 : every captured frame is a candidate)
+	float				mShutter;				///< fraction of an output period before each output time whose frames are blurred into it
+	unsigned int		mSessionOutputFrameRate;///< output frame rate of the current session (set by init)
+	long long			mNextSlot;				///< index of the next output time not sampled yet
+	std::vector<unsigned short>	mBlurSums;		///< sums of the frames read back in the shutter of the next output frame
+	unsigned int		mBlurFrames;			///< number of frames in mBlurSums
+
+	// duplicate frames skipping (needs timestamped frames : the previous frame is extended up to the next one)
+	bool				mSkipDuplicates;		///< skip the frames identical to the previous one (wanted)
+	unsigned int		mMaxDuplicateDuration;	///< a duplicate frame is still sent if the last frame sent is older (in ms)
+	bool				mSessionSkipDuplicates;	///< are the duplicate frames skipped in the current session (set by init)
+	unsigned long long	mLastHash;				///< hash of the last frame checked
+	long long			mLastSentPts;			///< pts of the last frame not skipped as a duplicate
+	unsigned long long	mHashedFrames;			///< frames checked since the last init
+	unsigned long long	mDuplicateFrames;		///< frames skipped as duplicates since the last init
+
+	// fragmented or segmented output
+	SEGMENTATION		mSegmentation;		///< how the video is written (wanted)
+	unsigned int		mSegmentSeconds;	///< maximal duration of a segment (0 : no limit)
+	size_t				mMaxSegmentBytes;	///< maximal size of a segment (0 : no limit)
+	unsigned int		mKeepSegments;		///< number of completed segments kept on disk (0 : all)
+	Mp4Segmenter*		mSegmenter;			///< cuts the stream of the current session into segments (nullptr if not SEGMENTS)
+	Mp4Segmenter*		mStandbySegmenter;	///< segmenter of the standby process
+
+	// extra renditions of the capture (resampled from the same read back, each encoded by its own process or encoder)
+	/// a rendition wanted
+	struct Rendition
+	{
+		int				width;		///< 0 : from height and the aspect ratio of the capture
+		int				height;		///< 0 : from width and the aspect ratio of the capture
+		PRESET			preset;
+		unsigned int	crf;
+		std::string		path;		///< output directory (ending with '/')
+		std::string		baseName;
+	};
+	/// a rendition of the current session
+	struct RenditionOutput
+	{
+		int				width;
+		int				height;
+		std::string		file;
+		FrameQueue*		queue;		///< resampled frames waiting for the writer
+		std::thread		writer;
+		FrameSink*		sink;
+	};
+	std::vector<Rendition>			mRenditions;
+	std::vector<RenditionOutput*>	mRenditionOutputs;	///< of the current session (empty if none)
+	std::vector<std::string>		mRenditionFiles;	///< of the current or last session
+	CaptureCounters					mRenditionStats;	///< updated by the capture thread (resampling) and the renditions writers
+	unsigned long long				mRenditionDropped;	///< frames dropped by the renditions queues of the ended sessions
+
+	// runtime statistics
+	CaptureCounters		mStats;				///< updated by the capture thread, the writer threads and the worker pool
+	unsigned long long	mQueueDropped;		///< frames dropped by the writer queues of the ended sessions (and by the pipelines)
+	unsigned long long	mQueueFull;			///< reservations which found the writer queues of the ended sessions (or the pipelines) full
+
+	/// a finished session closed by the reaper thread (encoding and muxing the remaining frames may take seconds)
+	struct Closing
+	{
+		std::string			file;
+		FrameQueue*			queue;
+		std::thread			writer;
+		WorkerPool::Strand*	strand;
+		unsigned char*		converted;	///< conversion buffer of the strand
+		FrameSink*			sink;
+		Mp4Segmenter*		segmenter;
+	};
+
+	// asynchronous session teardown
+	bool					mAsyncFinish;		///< finish() hands the session to the reaper thread instead of waiting for it
+	std::string				mSessionFile;		///< output file of the current session
+	std::thread				mReaper;			///< closes the finished sessions (started on the first asynchronous finish)
+	std::mutex				mReapMutex;
+	std::condition_variable	mReapCondition;		///< a session to close or the reaper to stop
+	std::condition_variable	mWrittenCondition;	///< a file has been fully written
+	std::deque<Closing*>	mClosing;			///< sessions waiting for the reaper
+	std::multiset<std::string>	mPendingFiles;	///< files of the finished sessions not fully written yet
+	bool					mReaperStop;
+	std::function<void(const std::string&)>	mWrittenCallback;	///< called once a file is fully written
+
+	/// the preset and the crf of the next encoder : the level of the controller (configured with the current settings) or the ones asked for
+	void encoderLevel(PRESET& preset, unsigned int& crf)
+	{
+		preset	= mPreset;
+		crf		= mCRF;
+		if(!mAdaptive) return;
+		mController.configure((unsigned int)mFastestPreset, (unsigned int)mSlowestPreset, mCRF, mLossless ? 0 : mMaxCrfRaise, (unsigned int)mPreset);
+		unsigned int level = 0;
+		mController.level(level, crf);
+		preset = PRESET(level);
+	}
+
+	/// is a capture output (ffmpeg process, libav encoder or another sink) opened
+	bool opened() const
+	{
+		return mSink != nullptr;
+	}
+
+	/// where to build the next frame to output : a sink buffer taken without copy if possible (e.g. spliced to the pipe), otherwise fallback
+	unsigned char* frameBuffer(unsigned char* fallback)
+	{
+		unsigned char* buffer = mSink != nullptr ? mSink->frameBuffer() : nullptr;
+		return buffer != nullptr ? buffer : fallback;
+	}
+
+	/// is a standby ffmpeg process waiting for init()
+	bool hasStandby() const
+	{
+		return mStandbySink != nullptr;
+	}
+
+	/// are the frames encoded into a video by the backend (otherwise they go raw to another sink)
+	bool encoded() const
+	{
+		return mSinkMode == SINK::ENCODER && !mSinkFactory;
+	}
+
+	/// how the video is written (segments need named pipes, otherwise the fragmented mp4 is kept as a single file)
+	SEGMENTATION segmentation() const
+	{
+		if(!encoded()) return SEGMENTATION::NONE;
+		return mSegmentation == SEGMENTATION::SEGMENTS && !Mp4Segmenter::available() ? SEGMENTATION::FRAGMENTED : mSegmentation;
+	}
+
+	/// seconds between the forced keyframes starting the fragments (0 : left to the encoder)
+	unsigned int keyframeInterval() const
+	{
+		if(segmentation() == SEGMENTATION::NONE) return 0;
+		return mSegmentSeconds % 2 != 0 ? 1 : 2; // segments of a whole number of fragments
+	}
+
+	/// start cutting into segments the stream muxed into the named pipe of a playlist (nullptr if it failed)
+	Mp4Segmenter* startSegmenter(const std::string& playlist)
+	{
+		Mp4Segmenter* segmenter = new Mp4Segmenter();
+		if(segmenter->open(playlist, mSegmentSeconds * 1000, mMaxSegmentBytes, mKeepSegments))
+			return segmenter;
+		delete segmenter;
+		return nullptr;
+	}
+
+	/// start the ffmpeg command line reading the frames of format from its stdin (with the transport mode), nullptr if it failed
+	FFmpegPipeSink* spawn(const std::string& cmd, const FrameSink::Format& format)
+	{
+		FFmpegPipeSink* sink = new FFmpegPipeSink();
+		if(sink->open(cmd, format, mTransportMode != TRANSPORT::STDIO, mTransportMode == TRANSPORT::VMSPLICE, mPipeSize))
+			return sink;
+		delete sink;
+		return nullptr;
+	}
+
+	/// create the sink of a session whose frames are not encoded (custom, raw, mapped or compressed file, null or shared memory ring), nullptr if it failed
+	FrameSink* createSink(const FrameSink::Format& format, const std::string& filePath)
+	{
+		if(mSinkFactory)
+			return mSinkFactory(format, filePath);
+		switch(mSinkMode)
+		{
+		case SINK::RAW_FILE:
+			{
+				RawFileSink* sink = new RawFileSink();
+				if(sink->open(filePath, format, mOverwrite))
+					return sink;
+				delete sink;
+				return nullptr;
+			}
+		case SINK::SHARED_MEMORY:
+			{
+				SharedMemorySink* sink = new SharedMemorySink();
+				if(sink->open("/" + filePath.substr(filePath.find_last_of('/') + 1), format, mSinkFrames != 0 ? mSinkFrames : 4))
+					return sink;
+				delete sink;
+				return nullptr;
+			}
+		case SINK::COMPRESSED_FILE:
+			{
+				CompressedFileSink* sink = new CompressedFileSink();
+				if(sink->open(filePath, format, mOverwrite, mSinkFrames != 0 ? mSinkFrames : 2 * format.frameRate))
+					return sink;
+				delete sink;
+				return nullptr;
+			}
+		case SINK::MAPPED_FILE:
+			{
+				MappedFileSink* sink = new MappedFileSink();
+				if(sink->open(filePath, format, mOverwrite, mSinkFrames != 0 ? mSinkFrames : 64))
+					return sink;
+				delete sink;
+				return nullptr;
+			}
+		case SINK::NONE:
+			return new NullSink();
+		default:
+			return nullptr;
+		}
+	}
+
+	/// stop the standby process without any frame and remove what it may have created
+	void releaseStandby()
+	{
+		if(!hasStandby()) return;
+		mStandbySink->close();
+		delete mStandbySink;
+		delete mStandbySegmenter; // after the process : it closed the pipe
+		mStandbySink		= nullptr;
+		mStandbySegmenter	= nullptr;
+		std::remove(mStandbyFile.c_str()); // the name was free when reserved
+		releaseFilePathName(mStandbyFile);
+		mStandbyCommand.clear();
+		mStandbyFile.clear();
+	}
+
+	/// give a ready to encode frame (presented at pts, -1 if not timestamped) to the sink of a session
+	static void output(FrameSink* sink, const void* data, size_t size, long long pts, CaptureCounters* stats)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		bool written = sink->write(data, size, pts);
+
+		// a write blocked longer than a frame period : the encoder does not keep up
+		unsigned long long us = (unsigned long long)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+		stats->write.record(us);
+		if(written) // not lost by the sink (full shared memory ring, closed pipe...)
+		{
+			stats->framesWritten.fetch_add(1, std::memory_order_relaxed);
+			stats->bytesPiped.fetch_add(size, std::memory_order_relaxed);
+		}
+		if(us > stats->backpressureUs.load(std::memory_order_relaxed))
+			stats->backpressureEvents.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/// give a ready to encode frame to the current session
+	void output(const void* data, size_t size, long long pts)
+	{
+		output(mSink, data, size, pts, &mStats);
+	}
+
+	/// writer thread loop : pipe the queued frames to the session output until the queue is closed and empty
+	/// (bound to its session, it may still drain while the next session starts)
+	static void writeQueuedFrames(FrameQueue* queue, FrameSink* sink, CaptureCounters* stats)
+	{
+		int slot = -1;
+		while( (slot = queue->acquire()) >= 0 )
+		{
+			output(sink, queue->data(slot), queue->size(slot), queue->pts(slot), stats);
+			queue->release(slot);
+		}
+	}
 
-	/** Forces libx264 to build video in a way, that it could be streamed over 500kbit/s line considering device buffer of 1000kbits.
-	*	Very useful for web - setting this to bitrate and 2x bitrate gives good results. */
-	struct Bitrate
+	/// do the frames need a timestamp (asked for, or to extend the frame before skipped duplicates)
+	bool timestamped() const
 	{
-		bool use;			  ///< induce use 3 bitrate ffmpeg parameters
-		unsigned int bitrate; ///< in kbits
-		unsigned int minrate; ///< in kbits
-		unsigned int maxrate; ///< in kbits
-		unsigned int bufsize; ///< in kbits
+		return mTimestamped || mSkipDuplicates || mOutputFrameRate != 0;
+	}
+
+	/// is the frame captured at pts identical to the previous one (and the previous frame sent recently enough to be extended)
+	bool duplicate(const void* data, size_t size, long long pts)
+	{
+		return duplicate(FrameHash::hash(data, size), pts);
+	}
+
+	/// is the frame of this hash captured at pts identical to the previous one (the frames are checked in order)
+	bool duplicate(unsigned long long hash, long long pts)
+	{
+		bool same = mHashedFrames++ != 0 && hash == mLastHash && pts - mLastSentPts < (long long)mMaxDuplicateDuration;
+		mLastHash = hash;
+		if(same)
+		{
+			mDuplicateFrames++;
+			mStats.framesDuplicate.fetch_add(1, std::memory_order_relaxed);
+			return true;
+		}
+		mLastSentPts = pts;
+		return false;
+	}
+
+	/// the frames read back are converted by the CPU (CPU_*)
+	static bool cpuConversion(CONVERSION conversion)
+	{
+		return conversion == CONVERSION::CPU_YUV420P || conversion == CONVERSION::CPU_NV12 || tenBits(conversion);
+	}
+
+	/// the frames are read back in rgb10_a2 and converted to 10 bits
+	static bool tenBits(CONVERSION conversion)
+	{
+		return conversion == CONVERSION::CPU_P010 || conversion == CONVERSION::CPU_YUV420P10;
+	}
+
+	/// convert a frame read back (CPU_*), return the size of the converted frame
+	static size_t convertFrame(CONVERSION conversion, const unsigned char* data, int width, int height, unsigned char* converted)
+	{
+		switch(conversion)
+		{
+		case CONVERSION::CPU_NV12:		ColorConversion::rgbaToNv12(data, width, height, converted);			break;
+		case CONVERSION::CPU_P010:		ColorConversion::rgb10a2ToP010(data, width, height, converted);			break;
+		case CONVERSION::CPU_YUV420P10:	ColorConversion::rgb10a2ToYuv420p10(data, width, height, converted);	break;
+		default:						ColorConversion::rgbaToYuv420p(data, width, height, converted);			break;
+		}
+		return tenBits(conversion) ? ColorConversion::yuv420p10Size(width, height) : ColorConversion::yuv420Size(width, height);
+	}
+
+	/// frame of a session between its pool tasks (the tasks of the session strand run in order)
+	struct PooledFrame
+	{
+		int						slot;	///< -1 : dropped by the overflow policy
+		const unsigned char*	data;	///< to output : queued or converted
+		size_t					size;
+	};
+
+	/// pool task : take the oldest queued frame of a session, if any, and convert it (if the CPU converts)
+	static void convertQueuedFrame(FrameQueue* queue, FrameSink* sink, CONVERSION conversion, int width, int height, unsigned char* converted,
+								   CaptureCounters* stats, PooledFrame* frame)
+	{
+		frame->slot = queue->tryAcquire();
+		if(frame->slot < 0)
+			return;
+		frame->data = queue->data(frame->slot);
+		frame->size = queue->size(frame->slot);
+		if(cpuConversion(conversion))
+		{
+			unsigned char* yuv = sink->frameBuffer();
+			yuv = yuv != nullptr ? yuv : converted;
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			frame->size = convertFrame(conversion, frame->data, width, height, yuv);
+			stats->conversion.record(start);
+			frame->data = yuv;
+		}
+	}
+
+	/// blocking pool task : pipe the frame taken by convertQueuedFrame (a stalled consumer holds one of the WorkerPool::maxBlocking() workers)
+	static void writeQueuedFrame(FrameQueue* queue, FrameSink* sink, CaptureCounters* stats, const PooledFrame* frame)
+	{
+		if(frame->slot < 0)
+			return; // dropped by the overflow policy
+		output(sink, frame->data, frame->size, queue->pts(frame->slot), stats);
+		queue->release(frame->slot);
+	}
+
+	/// a frame has been queued : with the worker pool, post the tasks converting and writing it
+	void queued()
+	{
+		if(mStrand == nullptr) return;
+		FrameQueue*			queue		= mQueue;
+		FrameSink*			sink		= mSink;
+		CONVERSION			conversion	= mSessionConversion;
+		int					width		= mWidth;
+		int					height		= mHeight;
+		unsigned char*		converted	= mConverted;
+		CaptureCounters*	stats		= &mStats;
+		std::shared_ptr<PooledFrame> frame = std::make_shared<PooledFrame>();
+		mStrand->post([=]() { convertQueuedFrame(queue, sink, conversion, width, height, converted, stats, frame.get()); });
+		mStrand->post([=]() { writeQueuedFrame(queue, sink, stats, frame.get()); }, true);
+	}
+
+	/// create the pipeline of the current session : the transform stage runs the user transform, hashes the frame (duplicates skipped)
+	/// and converts it (CPU_*) on up to mTransformThreads frames at once, the write stage checks the duplicates and outputs the frames in order
+	void startPipeline(size_t capacity)
+	{
+		unsigned int transformThreads = mTransformThreads != 0 ? mTransformThreads : std::max(std::thread::hardware_concurrency(), 1u);
+		if(mStealingPool == nullptr || mStealingPool->threadCount() != transformThreads + 1)
+		{
+			delete mStealingPool; // the pipelines of the previous sessions are deleted (drained) by endSession()
+			mStealingPool = new WorkStealingPool(transformThreads + 1); // a worker blocked by the sink does not stall the transforms
+		}
+		mPipeline = new CapturePipeline(*mStealingPool, mPipelineFrames != 0 ? mPipelineFrames : transformThreads + 2, capacity);
+
+		std::function<void(unsigned char*, size_t, long long)> transform = mFrameTransform;
+		bool				hash		= mSessionSkipDuplicates;
+		CONVERSION			conversion	= mSessionConversion;
+		int					width		= mWidth;
+		int					height		= mHeight;
+		CaptureCounters*	stats		= &mStats;
+		mPipeline->addStage("transform", [=](CapturePipeline::Frame& frame)
+		{
+			if(transform)
+				transform(frame.data, frame.size, frame.pts);
+			if(hash)
+				frame.hash = FrameHash::hash(frame.data, frame.size);
+			if(cpuConversion(conversion))
+			{
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				size_t size = convertFrame(conversion, frame.data, width, height, frame.spare);
+				stats->conversion.record(start);
+				frame.swap(size);
+			}
+		}, transformThreads, false);
+
+		FrameSink* sink = mSink;
+		mPipeline->addStage("write", [this, hash, sink, stats](CapturePipeline::Frame& frame)
+		{
+			// the duplicate state is only touched here (one frame at a time, in order) until endSession() drained the pipeline
+			if(hash && duplicate(frame.hash, frame.pts))
+				return;
+			output(sink, frame.data, frame.size, frame.pts, stats);
+		}, 1, true);
+	}
+
+	/// a frame to read back into from the pipeline (nullptr if it has to be dropped)
+	CapturePipeline::Frame* pipelineFrame()
+	{
+		CapturePipeline::Frame* frame = mPipeline->acquire(false);
+		if(frame == nullptr)
+		{
+			mQueueFull++;
+			mStats.queueFullEvents.store(mQueueFull, std::memory_order_relaxed);
+			if(mOverflowPolicy == OVERFLOW_POLICY::BLOCK)
+				frame = mPipeline->acquire(true);
+			else
+			{
+				// the frames in flight are already being transformed : DROP_OLDEST drops the new one too
+				mDropped++;
+				mQueueDropped++;
+				mStats.framesDropped.store(mQueueDropped, std::memory_order_relaxed);
+			}
+		}
+		return frame;
+	}
+
+	/// resample a frame read back (rgba at the capture resolution) into the queue of each rendition, captured at pts
+	void feedRenditions(const void* rgba, long long pts)
+	{
+		for(RenditionOutput* rendition : mRenditionOutputs)
+		{
+			mRenditionStats.framesCaptured.fetch_add(1, std::memory_order_relaxed);
+			int slot = rendition->queue->reserve(); // skipped if the frame has to be dropped
+			if(slot < 0)
+				continue;
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			ColorConversion::resizeRgba(static_cast<const unsigned char*>(rgba), mWidth, mHeight, rendition->queue->data(slot), rendition->width, rendition->height);
+			mRenditionStats.conversion.record(start);
+			rendition->queue->commit(slot, rendition->queue->slotSize(), pts);
+		}
+		if(!mRenditionOutputs.empty())
+			mRenditionStats.framesDropped.store(mRenditionDropped + renditionsDropped(), std::memory_order_relaxed);
+	}
+
+	/// frames dropped by the queues of the renditions of the current session
+	unsigned long long renditionsDropped() const
+	{
+		unsigned long long dropped = 0;
+		for(const RenditionOutput* rendition : mRenditionOutputs)
+			dropped += rendition->queue->dropped();
+		return dropped;
+	}
+
+	/// what the output frame rate scheduler does with a frame
+	enum class SAMPLING
+	{
+		SKIP,	///< not needed : returned before any OpenGL call
+		BLUR,	///< in the shutter before the next output time : read back and averaged into the next output frame
+		SAMPLE	///< the first frame at or after an output time : the output frame of that time
 	};
-	Bitrate mBitrate;
 
-	Private(std::string path)
+	/// schedule the frame captured at pts (moved to its output time if sampled) : the output times are the multiples of 1/mSessionOutputFrameRate
+	/// since the first frame, whatever the render rate (a render slower than the output rate leaves gaps, the frames keep their time)
+	SAMPLING schedule(long long& pts)
+	{
+		long long slot = pts * mSessionOutputFrameRate / gTimeBase;
+		if(slot >= mNextSlot)
+		{
+			mNextSlot	= slot + 1;
+			pts			= slot * gTimeBase / mSessionOutputFrameRate;
+			return SAMPLING::SAMPLE;
+		}
+		double period = double(gTimeBase) / mSessionOutputFrameRate;
+		if(!mBlurSums.empty() && pts >= mNextSlot * period - mShutter * period && mBlurFrames < 256) // 257 frames at most in 16 bits sums
+			return SAMPLING::BLUR;
+		return SAMPLING::SKIP;
+	}
+
+	/// capture time of a frame of the current session, in 1/gTimeBase seconds since its first frame (strictly increasing)
+	long long timestamp()
+	{
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if(mLastPts < 0)
+		{
+			mClockStart = now;
+			return 0;
+		}
+		long long pts = std::chrono::duration_cast<std::chrono::milliseconds>(now - mClockStart).count();
+		return pts > mLastPts ? pts : mLastPts + 1;
+	}
+
+	/// drop policy of the timestamped frames : keep the frame captured at pts or skip it.
+	/// The kept frames are spread evenly and keep their capture time, so the video plays at wall-clock speed whatever is skipped.
+	/// The minimal interval starts at 1/mMaxFrameRate, grows while the writer thread queue is more than half full and relaxes once it drained.
+	bool keepFrame(long long pts)
+	{
+		long long wanted = mMaxFrameRate != 0 ? gTimeBase / mMaxFrameRate : 0;
+		if((mQueue != nullptr || mPipeline != nullptr) && mLastPts >= 0)
+		{
+			unsigned int pending	= mQueue != nullptr ? mQueue->pending() : mPipeline->inFlight();
+			unsigned int depth		= mQueue != nullptr ? mQueue->depth() : mPipeline->frames();
+			if(2 * pending > depth)
+			{
+				// shed frames : at most 2/3 of the rate of the last kept frames (down to 1 fps)
+				long long interval = std::max(mMinInterval, pts - mLastPts);
+				mMinInterval = std::min(interval + interval / 2, (long long)gTimeBase);
+			}
+			else if(pending == 0)
+				mMinInterval = mMinInterval * 3 / 4;
+		}
+		mMinInterval = std::max(mMinInterval, wanted);
+
+		if(mLastPts >= 0 && pts - mLastPts < mMinInterval)
+			return false;
+		mLastPts = pts;
+		return true;
+	}
+
+	/// drain the writer thread queue then close the session sink (wait for ffmpeg, flush the libav encoder...)
+	static void close(Closing* closing)
+	{
+		if(closing->queue != nullptr)
+		{
+			closing->queue->close();
+			if(closing->writer.joinable())
+				closing->writer.join();
+			if(closing->strand != nullptr)
+				delete closing->strand; // wait for the tasks of the session
+			delete closing->queue;
+		}
+		if(closing->converted != nullptr)
+			FrameBufferPool::Get().release(closing->converted);
+		if(closing->sink != nullptr)
+		{
+			closing->sink->close(); // wait for ffmpeg to encode the remaining frames, flush the libav encoder...
+			delete closing->sink;
+		}
+		if(closing->segmenter != nullptr)
+		{
+			closing->segmenter->close(); // complete the last segment and the playlist
+			delete closing->segmenter;
+		}
+		std::cout<<"[FFmpegVideoRecorderProcess] FINISH, check video at : "<<closing->file<<std::endl;
+	}
+
+	/// close a finished session now (wait) or on the reaper thread
+	void reap(Closing* closing, bool wait)
+	{
+		std::string file = closing->file;
+		if(wait)
+		{
+			close(closing);
+			delete closing;
+			written(file, false);
+			return;
+		}
+		std::lock_guard<std::mutex> lock(mReapMutex);
+		mPendingFiles.insert(file);
+		mClosing.push_back(closing);
+		if(!mReaper.joinable())
+			mReaper = std::thread(&Private::reapClosedSessions, this);
+		mReapCondition.notify_one();
+	}
+
+	/// the file of a finished session is fully written : wake up the waiters and call back
+	void written(const std::string& file, bool pending)
+	{
+		releaseFilePathName(file);
+		std::unique_lock<std::mutex> lock(mReapMutex);
+		if(pending)
+			mPendingFiles.erase(mPendingFiles.find(file));
+		mWrittenCondition.notify_all();
+		std::function<void(const std::string&)> callback = mWrittenCallback;
+		lock.unlock();
+		if(callback)
+			callback(file);
+	}
+
+	/// reaper thread loop : close the finished sessions in order until stopped (and none is left)
+	void reapClosedSessions()
+	{
+		std::unique_lock<std::mutex> lock(mReapMutex);
+		while(true)
+		{
+			mReapCondition.wait(lock, [this]() { return mReaperStop || !mClosing.empty(); });
+			if(mClosing.empty())
+				return;
+			Closing* closing = mClosing.front();
+			mClosing.pop_front();
+			lock.unlock();
+
+			std::string file = closing->file;
+			close(closing);
+			delete closing;
+			written(file, true);
+			lock.lock();
+		}
+	}
+
+	/// close the sessions still handed to the reaper thread and stop it
+	void stopReaper()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mReapMutex);
+			mReaperStop = true;
+			mReapCondition.notify_one();
+		}
+		if(mReaper.joinable())
+			mReaper.join();
+	}
+
+	Private(std::string path, BACKEND backend)
 		: mPath( path.at(path.length()-1) != '/' ? path.append("/") : path ) 
-		, mFFmpeg(nullptr),			mFramedata(nullptr),	mStarted(false),	mFound(true)// because we willl check it after for the first init
-		, mBaseName("ibr_video_"),	mWidth(800),			mHeight(600)
-		, mCRF(23),					mLossless(false),		mOverwrite(true),	mPreset(PRESET::BALANCED)
+		, mSink(nullptr),			mFramedata(nullptr),	mStarted(false),	mFound(true)// because we willl check it after for the first init
+		, mBaseName("ibr_video_"),	mId(0),					mWidth(800),		mHeight(600)
+		, mCRF(23),					mLossless(false),		mOverwrite(true),	mPreset(PRESET::BALANCED),	mCodec(CODEC::H264)
+		, mAdaptive(false),			mFastestPreset(PRESET::FASTEST_ENCODING),	mSlowestPreset(PRESET::BEST_COMPRESSION),	mMaxCrfRaise(6)
+		, mBackend(backend),		mSinkMode(SINK::ENCODER),	mSinkFrames(0)
+		, mAsyncReadback(false),	mPboCount(3),			mPboFrameSize(0),	mPboHead(0),	mPboPending(0)
+		, mConversion(CONVERSION::NONE),	mSessionConversion(CONVERSION::NONE)
+		, mConvSource(0), mConvTarget(0), mConvFbo(0), mConvProgram(0), mConvVao(0), mConvWidth(0), mConvHeight(0), mConverted(nullptr)
+		, mSourceFramebuffer(false),	mSourceFbo(0),		mSourceAttachment(0),	mSourceTexture(0),	mReadFbo(0)
+		, mTransportMode(TRANSPORT::STDIO),	mPipeSize(0)
+		, mStandbyTransportMode(TRANSPORT::STDIO),	mStandbySink(nullptr)
+		, mThreadedWriter(false),	mQueueDepth(4),			mOverflowPolicy(OVERFLOW_POLICY::BLOCK),	mQueue(nullptr)
+		, mPool(nullptr),			mStrand(nullptr),		mDropped(0)
+		, mPipelined(false),		mTransformThreads(0),	mPipelineFrames(0),	mStealingPool(nullptr),	mPipeline(nullptr)
+		, mFrameRate(25),			mTimestamped(false),	mMaxFrameRate(0),	mSessionTimestamped(false),	mLastPts(-1),	mMinInterval(0)
+		, mOutputFrameRate(0),		mShutter(0.f),			mSessionOutputFrameRate(0),	mNextSlot(0),	mBlurFrames(0)
+		, mSkipDuplicates(false),	mMaxDuplicateDuration(1000),	mSessionSkipDuplicates(false),	mLastHash(0),	mLastSentPts(-1),	mHashedFrames(0),	mDuplicateFrames(0)
+		, mSegmentation(SEGMENTATION::NONE),	mSegmentSeconds(60),	mMaxSegmentBytes(0),	mKeepSegments(0),	mSegmenter(nullptr),	mStandbySegmenter(nullptr)
+		, mRenditionDropped(0)
+		, mQueueDropped(0)
+		, mQueueFull(0)
+		, mAsyncFinish(false),		mReaperStop(false)
 		//, mBitrate({false,0,0,0,0}) // c++11 initialization list (only for MSVC12 and latter version)
 	{
 		// init the bitrate structure
@@ -87,21 +865,29 @@ public:
 		mBitrate.bufsize = 0;
 	}
 };
-int FFmpegVideoRecorderProcess::Private::mId = 0;
 
 
 //===========================================================================================================
 
 
-FFmpegVideoRecorderProcess::FFmpegVideoRecorderProcess(std::string path) 
-	: d(new Private(path))
+FFmpegVideoRecorderProcess::FFmpegVideoRecorderProcess(std::string path, BACKEND backend) 
+	: d(new Private(path, backend))
 {
 	GLFunctions::init();
+	if(backend == BACKEND::LIBAV && !FFmpegLibavEncoder::available())
+	{
+		std::cerr<<"[FFmpegVideoRecorderProcess] built without libavcodec/libavformat, fall back to the ffmpeg process pipe"<<std::endl;
+		d->mBackend = BACKEND::PIPE;
+	}
 }
 
 FFmpegVideoRecorderProcess::~FFmpegVideoRecorderProcess()
 {
 	finish();
+	d->stopReaper(); // wait for the files of the finished sessions
+	coolDown();
+	delete d->mStealingPool;
+	delete d;
 }
 
 //------------------------------------------------------------------------------------------------------------
@@ -160,7 +946,7 @@ void FFmpegVideoRecorderProcess::putEnvVar(std::string var, std::vector<std::str
 
 //------------------------------------------------------------------------------------------------------------
 
-bool FFmpegVideoRecorderProcess::checkFFmpegFound(unsigned int& outNbFound, bool verbose, bool tryOpen)
+bool FFmpegVideoRecorderProcess::checkFFmpegFound(unsigned int& outNbFound, bool verbose, bool tryOpen, std::string* outFirstFound)
 {
 	outNbFound = 0;
 
@@ -192,6 +978,8 @@ bool FFmpegVideoRecorderProcess::checkFFmpegFound(unsigned int& outNbFound, bool
 		if( f.is_open() )
 		{
 			if(verbose) std::cout<<"[FFmpegVideoRecorderProcess] FOUND :"<< ffmpegFilePath << "\n";
+			if(outFirstFound != nullptr && outNbFound == 0)
+				*outFirstFound = ffmpegFilePath;
 			outNbFound++;
 		}
 		else if(verbose) 
@@ -204,166 +992,1326 @@ bool FFmpegVideoRecorderProcess::checkFFmpegFound(unsigned int& outNbFound, bool
 
 //------------------------------------------------------------------------------------------------------------
 
-std::string FFmpegVideoRecorderProcess::formatFileName(bool increment)
+std::string FFmpegVideoRecorderProcess::resolveFFmpeg()
 {
-	std::stringstream fileName;
-	fileName << d->mBaseName << std::setfill('0') << std::setw(2) << (increment ? ++d->mId : d->mId) <<".mp4";
-	return fileName.str();
+	std::lock_guard<std::mutex> lock(gFFmpegMutex);
+	if(!gFFmpegPath.empty())
+		return gFFmpegPath;
+
+	unsigned int	nbFFmpegFound	= 0;
+	std::string		ffmpeg;
+	checkFFmpegFound(nbFFmpegFound, false, false, &ffmpeg);
+	if(0 == nbFFmpegFound || nbFFmpegFound > 1)
+	{
+		if(!checkFFmpegFound(nbFFmpegFound, true)) // display list of research path with status (verbosity info)
+			return std::string();
+		std::cerr<<"[FFmpegVideoRecorderProcess] Too many version of FFmpeg found but continue with "<<ffmpeg<<"..."<<std::endl;
+	}
+	return gFFmpegPath = ffmpeg;
 }
 
 //------------------------------------------------------------------------------------------------------------
 
-bool FFmpegVideoRecorderProcess::resolutionCheck(int width, int height)
+std::string FFmpegVideoRecorderProcess::latchConversion()
 {
-	if( (width % 2 != 0 && d->mWidth != width-1 ) || (width % 2 == 0 && d->mWidth != width) )			 // width changed
-		d->mWidth = width % 2 != 0 ? width - 1 : width;
-	else if( (height % 2 != 0 && d->mHeight != height-1 ) || (height % 2 == 0 && d->mHeight != height) ) // height changed
-		d->mHeight = height % 2 != 0 ? height - 1 : height;
-	else
-		return false;
-	return true;
+	d->mSessionConversion = d->mConversion;
+	if((d->mSessionConversion == CONVERSION::GPU_YUV420P || d->mSessionConversion == CONVERSION::GPU_NV12) && !GL_HAS_SHADER_CONVERSION())
+	{
+		std::cerr<<"[FFmpegVideoRecorderProcess] GPU conversion needs OpenGL 3.2, let ffmpeg convert the frames..."<<std::endl;
+		d->mSessionConversion = CONVERSION::NONE;
+	}
+	if(d->mSessionConversion == CONVERSION::CPU_P010 && (d->timestamped() || (d->mSinkMode == SINK::RAW_FILE && !d->mSinkFactory)))
+		d->mSessionConversion = CONVERSION::CPU_YUV420P10; // the same 10 bits planar : ffmpeg has no nut tag for p010
+	switch ((int)d->mSessionConversion)
+	{
+	case (int)CONVERSION::GPU_YUV420P:
+	case (int)CONVERSION::CPU_YUV420P:	return "yuv420p";
+	case (int)CONVERSION::GPU_NV12:
+	case (int)CONVERSION::CPU_NV12:		return "nv12";
+	case (int)CONVERSION::CPU_P010:		return "p010le";
+	case (int)CONVERSION::CPU_YUV420P10:return "yuv420p10le";
+	default:							return "rgba";
+	}
 }
 
-//------------------------------------------------------------------------------------------------------------
-//---------------------------- set/get ffmpeg options ----------------------------------------------------
 //------------------------------------------------------------------------------------------------------------
 
-void FFmpegVideoRecorderProcess::appendEnvVarPath(std::string envVarPath)
+std::string FFmpegVideoRecorderProcess::freeFilePathName()
 {
-	if(envVarPath.empty()) return;
-	std::vector<std::string> envVarPathList;
-	envVarPathList.push_back(envVarPath);
-	putEnvVar("PATH", envVarPathList);
+	bool exist = false;
+	std::string outFilePathName;
+	std::lock_guard<std::mutex> lock(gFilesMutex);
+	do {
+		outFilePathName = d->mPath + formatFileName();
+		std::ifstream f(outFilePathName.c_str(), std::ios::binary);
+		exist = f.is_open() || gReservedFiles.count(outFilePathName) != 0; // or about to be created by another recorder
+		f.close();
+	}while(exist);
+	gReservedFiles.insert(outFilePathName); // until the file is written
+	return outFilePathName;
 }
 
 //------------------------------------------------------------------------------------------------------------
 
-void FFmpegVideoRecorderProcess::appendEnvVarPath(std::vector<std::string> envVarPathList)
+std::string FFmpegVideoRecorderProcess::ffmpegCommand(const std::string& ffmpeg, const std::string& inputPixFmt, const std::string& outFilePathName)
 {
-	putEnvVar("PATH", envVarPathList);
+	PRESET preset;
+	unsigned int crf;
+	d->encoderLevel(preset, crf);
+	return ffmpegCommand(ffmpeg, inputPixFmt, outFilePathName, d->mWidth, d->mHeight, preset, crf, d->mLossless, d->mBitrate, d->segmentation());
 }
 
 //------------------------------------------------------------------------------------------------------------
 
-void FFmpegVideoRecorderProcess::setOutputPath(std::string path)
+std::string FFmpegVideoRecorderProcess::ffmpegCommand(const std::string& ffmpeg, const std::string& inputPixFmt, const std::string& outFilePathName,
+													  int width, int height, PRESET preset, unsigned int crf, bool lossless, const Bitrate& bitrate,
+													  SEGMENTATION segmentation)
 {
-	if(path.empty())
-	{
-		std::cerr<<"[FFmpegVideoRecorderProcess] empty path given at : " << __FILE__ << ":" << __LINE__ << std::endl;
-		path = "./";
-		std::cerr<<"[FFmpegVideoRecorderProcess] set default path to "<< path << std::endl;			
-	}
+	// https://trac.ffmpeg.org/wiki/Encode/H.264
+	// ffmpeg command line telling to expect raw frames, reading frames from stdin
+	// (timestamped frames come in a NUT stream giving the resolution, the pixel format and the pts of each frame)
+	bool segments = segmentation == SEGMENTATION::SEGMENTS;
+	std::stringstream cmd;
+	cmd <<	"\"" << ffmpeg << "\" ";
+	// input options
+	if(d->timestamped())
+		cmd <<	"-f nut -i - "
+			<<	"-vsync vfr ";				// keep the capture timestamps (mp4 would otherwise duplicate/drop frames to a constant rate)
 	else
-	{
-		OS_MKDIR(path.c_str());
-	}
-	d->mPath = path.at(path.length()-1) != '/' ? path.append("/") : path;
+		cmd <<	"-s " << width << "x" << height << " "
+			<<	"-framerate " << d->mFrameRate << " -f rawvideo -vcodec rawvideo -pix_fmt " << inputPixFmt << " -i - ";
+	// output options
+	cmd		<<  "-threads 0 "				// threads 0 mean [auto detect]
+			<<  (inputPixFmt == "rgba" ? "-vf vflip " : "") // videoFlip verticaly (OpenGL rows are bottom-up)
+			<<  (d->mOverwrite || segments ? "-y " : "-n ")// overwrite output file if exist or immediatly exit ffmpeg (the named pipe of the segments exists)
+			<<  encodingArguments(preset, crf, lossless, bitrate, d->mCodec, highBitDepth(inputPixFmt));
+	// fragments starting with a keyframe, written as soon as complete (to the file, or to the segmenter through its named pipe)
+	if(segmentation != SEGMENTATION::NONE)
+		cmd <<	"-force_key_frames \"expr:gte(t,n_forced*" << d->keyframeInterval() << ")\" "
+			<<	"-movflags +frag_keyframe+empty_moov+default_base_moof ";
+	if(segments)
+		cmd <<	"-f mp4 " << Mp4Segmenter::fifoPath(outFilePathName);
+	else
+		cmd <<	outFilePathName;
+	return cmd.str();
 }
 
 //------------------------------------------------------------------------------------------------------------
 
-std::string FFmpegVideoRecorderProcess::getOutputPath()
+std::string FFmpegVideoRecorderProcess::formatFileName(bool increment)
 {
-	return d->mPath;
+	std::stringstream fileName;
+	fileName << d->mBaseName << std::setfill('0') << std::setw(2) << (increment ? ++d->mId : d->mId);
+	if(d->mSinkMode == SINK::RAW_FILE && !d->mSinkFactory)
+		fileName << ".nut";
+	else if(d->mSinkMode == SINK::MAPPED_FILE && !d->mSinkFactory)
+		fileName << ".raw";
+	else if(d->mSinkMode == SINK::COMPRESSED_FILE && !d->mSinkFactory)
+		fileName << ".vcq";
+	else if(d->mSinkMode != SINK::ENCODER && !d->mSinkFactory)
+		; // nothing written (the name of the shared memory ring)
+	else
+		fileName << (d->segmentation() == SEGMENTATION::SEGMENTS ? ".m3u8" : ".mp4"); // the playlist of the segments
+	return fileName.str();
 }
 
 //------------------------------------------------------------------------------------------------------------
 
-void FFmpegVideoRecorderProcess::setOutputBaseFileName(std::string base)
+bool FFmpegVideoRecorderProcess::resolutionCheck(int width, int height)
 {
-	d->mBaseName = base;
+	// both sizes are updated at once (otherwise a change of both would start an intermediate video)
+	int evenWidth	= width % 2 != 0 ? width - 1 : width;
+	int evenHeight	= height % 2 != 0 ? height - 1 : height;
+	if(d->mWidth == evenWidth && d->mHeight == evenHeight)
+		return false;
+	// the frames still in the read back ring are converted and written at the size they were read back with
+	releaseReadbackRing();
+	d->mWidth	= evenWidth;
+	d->mHeight	= evenHeight;
+	return true;
 }
 
 //------------------------------------------------------------------------------------------------------------
 
-std::string FFmpegVideoRecorderProcess::getOutputFileName()
+size_t FFmpegVideoRecorderProcess::frameSize()
 {
-	return formatFileName(false);
+	size_t pixels = size_t(d->mWidth) * size_t(d->mHeight);
+	if(Private::tenBits(d->mSessionConversion))
+		return 3 * pixels;
+	return d->mSessionConversion == CONVERSION::NONE ? 4 * pixels : pixels + pixels / 2;
 }
 
 //------------------------------------------------------------------------------------------------------------
 
-std::string FFmpegVideoRecorderProcess::getOutputVideoFilePath()
+size_t FFmpegVideoRecorderProcess::readbackSize()
 {
-	return d->mPath + formatFileName(false);
+	bool gpu = d->mSessionConversion == CONVERSION::GPU_YUV420P || d->mSessionConversion == CONVERSION::GPU_NV12;
+	return gpu ? frameSize() : 4 * size_t(d->mWidth) * size_t(d->mHeight);
 }
 
 //------------------------------------------------------------------------------------------------------------
 
-void FFmpegVideoRecorderProcess::overwriteOutput(bool overwrite)
+FrameSink::Format FFmpegVideoRecorderProcess::sinkFormat(const std::string& pixFmt)
 {
-	d->mOverwrite = overwrite;
+	FrameSink::Format format;
+	format.width		= d->mWidth;
+	format.height		= d->mHeight;
+	format.pixFmt		= pixFmt;
+	format.frameSize	= frameSize();
+	format.frameRate	= d->mFrameRate;
+	format.timeBase		= d->timestamped() ? gTimeBase : 0;
+	return format;
 }
 
 //------------------------------------------------------------------------------------------------------------
 
-bool FFmpegVideoRecorderProcess::overwriteOutput()
+void FFmpegVideoRecorderProcess::readFrame(int x, int y, void* dst)
 {
-	return d->mOverwrite;
-}
-
-//------------------------------------------------------------------------------------------------------------
+	if(!d->mSourceFramebuffer && d->mSourceTexture == 0)
+	{
+		readFramebuffer(x, y, dst);
+		return;
+	}
 
-void FFmpegVideoRecorderProcess::setQuality(unsigned int crf)
-{
-	d->mCRF = crf < 0 ? 0 : (crf > 51 ? 51 : crf);
-}
+#if OPENGL_HAS_SHADER_CONVERSION
+	// bind the source for this read back only (skipped frames do not touch OpenGL), the renderer bindings are restored after
+	GLint previousReadFbo = 0, previousReadBuffer = 0;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousReadFbo);
+	if(d->mSourceTexture != 0)
+	{
+		if(d->mReadFbo == 0)
+			glGenFramebuffers(1, &d->mReadFbo);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, d->mReadFbo);
+		glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, d->mSourceTexture, 0);
+	}
+	else
+	{
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, d->mSourceFbo);
+		glGetIntegerv(GL_READ_BUFFER, &previousReadBuffer); // state of the framebuffer object itself
+		if(d->mSourceFbo != 0)
+			glReadBuffer(GL_COLOR_ATTACHMENT0 + d->mSourceAttachment);
+	}
 
-//------------------------------------------------------------------------------------------------------------
+	readFramebuffer(x, y, dst);
 
-unsigned int FFmpegVideoRecorderProcess::getQuality()
-{
-	return d->mCRF;
+	if(d->mSourceTexture != 0)
+		glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0); // do not keep the texture alive
+	else if(d->mSourceFbo != 0)
+		glReadBuffer(previousReadBuffer);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, previousReadFbo);
+#endif
 }
 
 //------------------------------------------------------------------------------------------------------------
 
-void FFmpegVideoRecorderProcess::setPreset(FFmpegVideoRecorderProcess::PRESET preset)
+void FFmpegVideoRecorderProcess::readFramebuffer(int x, int y, void* dst)
 {
-	d->mPreset = preset;
-}
+	if(d->mSessionConversion != CONVERSION::GPU_YUV420P && d->mSessionConversion != CONVERSION::GPU_NV12)
+	{
+		// 10 bits per channel (RGB10_A2 or half float framebuffers) for the 10 bits conversions
+		GLenum type = Private::tenBits(d->mSessionConversion) ? GL_UNSIGNED_INT_2_10_10_10_REV : GL_UNSIGNED_BYTE;
+		glReadPixels(x, y, d->mWidth, d->mHeight, GL_RGBA, type, dst);
+		return;
+	}
 
-//------------------------------------------------------------------------------------------------------------
+#if OPENGL_HAS_SHADER_CONVERSION
+	GLint previousReadFbo = 0, previousDrawFbo = 0, previousAlignment = 4;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousReadFbo);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousDrawFbo);
+	glGetIntegerv(GL_PACK_ALIGNMENT, &previousAlignment);
 
-FFmpegVideoRecorderProcess::PRESET FFmpegVideoRecorderProcess::getPreset()
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	bool converted = convertOnGpu(x, y);
+	d->mStats.conversion.record(start);
+	if(converted)
+	{
+		// dst may be an offset in the bound pixel buffer object : do not dereference it
+		size_t	w = size_t(d->mWidth), h = size_t(d->mHeight);
+		char*	planes = reinterpret_cast<char*>(dst);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		if(d->mSessionConversion == CONVERSION::GPU_NV12)
+			glReadPixels(0, 0, d->mWidth, d->mHeight + d->mHeight/2, GL_RED, GL_UNSIGNED_BYTE, planes); // Y then UV : contiguous
+		else
+		{
+			glReadPixels(0,				0,			d->mWidth,	 d->mHeight,	GL_RED, GL_UNSIGNED_BYTE, planes);				// Y
+			glReadPixels(0,				d->mHeight, d->mWidth/2, d->mHeight/2,	GL_RED, GL_UNSIGNED_BYTE, planes + w*h);		// U
+			glReadPixels(d->mWidth/2,	d->mHeight, d->mWidth/2, d->mHeight/2,	GL_RED, GL_UNSIGNED_BYTE, planes + w*h + w*h/4);// V
+		}
+		glPixelStorei(GL_PACK_ALIGNMENT, previousAlignment);
+	}
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, previousReadFbo);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previousDrawFbo);
+#endif
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool FFmpegVideoRecorderProcess::convertOnGpu(int x, int y)
+{
+#if OPENGL_HAS_SHADER_CONVERSION
+	// (re)create the conversion resources if needed
+	if(d->mConvWidth != d->mWidth || d->mConvHeight != d->mHeight)
+	{
+		releaseGpuConversion();
+
+		GLuint shaders[2] = { glCreateShader(GL_VERTEX_SHADER), glCreateShader(GL_FRAGMENT_SHADER) };
+		const char* sources[2] = { gConversionVertexShader, gConversionFragmentShader };
+		d->mConvProgram = glCreateProgram();
+		for(int i = 0; i < 2; i++)
+		{
+			GLint compiled = GL_FALSE;
+			glShaderSource(shaders[i], 1, &sources[i], nullptr);
+			glCompileShader(shaders[i]);
+			glGetShaderiv(shaders[i], GL_COMPILE_STATUS, &compiled);
+			if(compiled != GL_TRUE)
+			{
+				char log[1024] = {0};
+				glGetShaderInfoLog(shaders[i], sizeof(log), nullptr, log);
+				std::cerr<<"[FFmpegVideoRecorderProcess] conversion shader compilation failed : "<<log<<std::endl;
+			}
+			glAttachShader(d->mConvProgram, shaders[i]);
+			glDeleteShader(shaders[i]); // only flagged, deleted with the program
+		}
+		GLint linked = GL_FALSE;
+		glLinkProgram(d->mConvProgram);
+		glGetProgramiv(d->mConvProgram, GL_LINK_STATUS, &linked);
+		if(linked != GL_TRUE)
+		{
+			char log[1024] = {0};
+			glGetProgramInfoLog(d->mConvProgram, sizeof(log), nullptr, log);
+			std::cerr<<"[FFmpegVideoRecorderProcess] conversion shader link failed : "<<log<<std::endl;
+			releaseGpuConversion();
+			return false;
+		}
+
+		GLint previousTexture = 0;
+		glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+		GLuint textures[2] = {0, 0};
+		glGenTextures(2, textures);
+		d->mConvSource = textures[0];
+		d->mConvTarget = textures[1];
+		glBindTexture(GL_TEXTURE_2D, d->mConvSource);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, d->mWidth, d->mHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glBindTexture(GL_TEXTURE_2D, d->mConvTarget);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, d->mWidth, d->mHeight + d->mHeight/2, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glBindTexture(GL_TEXTURE_2D, previousTexture);
+
+		glGenFramebuffers(1, &d->mConvFbo);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, d->mConvFbo);
+		glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, d->mConvTarget, 0);
+		if(glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		{
+			std::cerr<<"[FFmpegVideoRecorderProcess] conversion framebuffer incomplete"<<std::endl;
+			releaseGpuConversion();
+			return false;
+		}
+		glGenVertexArrays(1, &d->mConvVao);
+		d->mConvWidth  = d->mWidth;
+		d->mConvHeight = d->mHeight;
+	}
+
+	// save the states we are going to change
+	GLint previousActive = 0, previousTexture = 0, previousProgram = 0, previousVao = 0, previousViewport[4] = {0,0,0,0};
+	glGetIntegerv(GL_ACTIVE_TEXTURE, &previousActive);
+	glActiveTexture(GL_TEXTURE0);
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+	glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVao);
+	glGetIntegerv(GL_VIEWPORT, previousViewport);
+	const GLenum capabilities[] = { GL_BLEND, GL_DEPTH_TEST, GL_STENCIL_TEST, GL_SCISSOR_TEST, GL_CULL_FACE };
+	GLboolean enabled[sizeof(capabilities)/sizeof(GLenum)];
+	for(size_t i = 0; i < sizeof(capabilities)/sizeof(GLenum); i++)
+	{
+		enabled[i] = glIsEnabled(capabilities[i]);
+		glDisable(capabilities[i]);
+	}
+
+	// sample the captured texture as is if it is complete without mipmaps (texelFetch would return black otherwise),
+	// else copy the frame from the read framebuffer (stay on the GPU), then render the planes
+	GLint filter = 0;
+	if(d->mSourceTexture != 0)
+	{
+		glBindTexture(GL_TEXTURE_2D, d->mSourceTexture);
+		glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, &filter);
+	}
+	if(filter != GL_NEAREST && filter != GL_LINEAR)
+	{
+		glBindTexture(GL_TEXTURE_2D, d->mConvSource);
+		glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, x, y, d->mWidth, d->mHeight);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, d->mConvFbo);
+	glViewport(0, 0, d->mWidth, d->mHeight + d->mHeight/2);
+	glUseProgram(d->mConvProgram);
+	glUniform1i(glGetUniformLocation(d->mConvProgram, "uFrame"), 0);
+	glUniform2i(glGetUniformLocation(d->mConvProgram, "uSize"), d->mWidth, d->mHeight);
+	glUniform1i(glGetUniformLocation(d->mConvProgram, "uNV12"), d->mSessionConversion == CONVERSION::GPU_NV12 ? 1 : 0);
+	glBindVertexArray(d->mConvVao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	// restore (except the framebuffer bindings : we still have to read back from ours)
+	glBindVertexArray(previousVao);
+	glUseProgram(previousProgram);
+	glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+	glBindTexture(GL_TEXTURE_2D, previousTexture);
+	glActiveTexture(previousActive);
+	for(size_t i = 0; i < sizeof(capabilities)/sizeof(GLenum); i++)
+		if(enabled[i])
+			glEnable(capabilities[i]);
+	return true;
+#else
+	return false;
+#endif
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::releaseGpuConversion()
+{
+#if OPENGL_HAS_SHADER_CONVERSION
+	if(d->mConvProgram)	glDeleteProgram(d->mConvProgram);
+	if(d->mConvFbo)		glDeleteFramebuffers(1, &d->mConvFbo);
+	if(d->mConvVao)		glDeleteVertexArrays(1, &d->mConvVao);
+	if(d->mConvSource)	glDeleteTextures(1, &d->mConvSource);
+	if(d->mConvTarget)	glDeleteTextures(1, &d->mConvTarget);
+	d->mConvProgram = d->mConvFbo = d->mConvVao = d->mConvSource = d->mConvTarget = 0;
+	d->mConvWidth	= d->mConvHeight = 0;
+#endif
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::writeFrame(const void* data, size_t size, long long pts)
+{
+	d->feedRenditions(data, pts);
+
+	// the pipeline stages check the duplicates, convert and write the frame
+	if(d->mPipeline != nullptr)
+	{
+		if(CapturePipeline::Frame* frame = d->pipelineFrame())
+		{
+			std::memcpy(frame->data, data, size);
+			d->mPipeline->push(frame, size, pts);
+		}
+		return;
+	}
+
+	// an unchanged scene is neither converted, piped nor encoded : the previous frame lasts until the next different one
+	if(d->mSessionSkipDuplicates && d->duplicate(data, size, pts))
+		return;
+
+	// (with the worker pool the frame is queued as read back, a worker converts it)
+	if(Private::cpuConversion(d->mSessionConversion) && d->mStrand == nullptr)
+	{
+		// convert straight into a queue slot (if any, and unless the frame has to be dropped)
+		int				slot	= d->mQueue != nullptr ? d->mQueue->reserve() : -1;
+		unsigned char*	yuv		= slot >= 0 ? d->mQueue->data(slot) : d->frameBuffer(d->mConverted);
+		if(d->mQueue != nullptr && slot < 0)
+			return;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		Private::convertFrame(d->mSessionConversion, static_cast<const unsigned char*>(data), d->mWidth, d->mHeight, yuv);
+		d->mStats.conversion.record(start);
+		if(slot >= 0)
+		{
+			d->mQueue->commit(slot, frameSize(), pts);
+			return;
+		}
+		data = yuv;
+		size = frameSize();
+	}
+
+	if(d->mQueue != nullptr)
+	{
+		if(d->mQueue->push(data, size, pts)) // may drop according to the overflow policy
+			d->queued();
+	}
+	else
+		d->output(data, size, pts);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::readbackAsync(int x, int y, long long pts)
+{
+#if OPENGL_HAS_SYNC_OBJECTS
+	size_t frameSize = readbackSize();
+
+	// (re)create the ring if needed (first frame or options changed)
+	if(d->mPbos.size() != d->mPboCount || d->mPboFrameSize != frameSize)
+	{
+		releaseReadbackRing();
+		d->mPbos.resize(d->mPboCount, 0);
+		d->mFences.resize(d->mPboCount, nullptr);
+		d->mPboPts.resize(d->mPboCount, -1);
+		d->mPboFrameSize = frameSize;
+		glGenBuffers(d->mPboCount, d->mPbos.data());
+		for(GLuint pbo : d->mPbos)
+		{
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+			glBufferData(GL_PIXEL_PACK_BUFFER, frameSize, nullptr, GL_STREAM_READ);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+
+	// ring full : we have no other choice than waiting for the oldest frame
+	if(d->mPboPending == d->mPboCount)
+		sendPendingFrame(true);
+
+	GLint previousPbo = 0;
+	glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &previousPbo);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, d->mPbos[d->mPboHead]);
+	readFrame(x, y, nullptr); // return immediately, the copy is done by the driver
+	d->mFences[d->mPboHead] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	d->mPboPts[d->mPboHead] = pts;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, previousPbo);
+
+	d->mPboHead = (d->mPboHead + 1) % d->mPboCount;
+	d->mPboPending++;
+
+	// send (in order) all the frames already available
+	while(d->mPboPending > 1 && sendPendingFrame(false));
+#else
+	std::cerr<<"[FFmpegVideoRecorderProcess] asynchronous read back needs OpenGL 3.2 (see opengl_functions.h)"<<std::endl;
+#endif
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool FFmpegVideoRecorderProcess::sendPendingFrame(bool wait)
+{
+#if OPENGL_HAS_SYNC_OBJECTS
+	if(d->mPboPending == 0) return false;
+	unsigned int tail = (d->mPboHead + d->mPboCount - d->mPboPending) % d->mPboCount;
+
+	// the first wait flush the commands, otherwise the fence may never be signaled
+	GLenum status = glClientWaitSync(d->mFences[tail], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	while(wait && status == GL_TIMEOUT_EXPIRED)
+		status = glClientWaitSync(d->mFences[tail], 0, 1000000000); // 1s
+	if(status == GL_TIMEOUT_EXPIRED)
+		return false;
+	if(status == GL_WAIT_FAILED)
+		std::cerr<<"[FFmpegVideoRecorderProcess] failed to wait for the read back fence, map the frame anyway..."<<std::endl;
+
+	glDeleteSync(d->mFences[tail]);
+	d->mFences[tail] = nullptr;
+
+	GLint previousPbo = 0;
+	glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &previousPbo);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, d->mPbos[tail]);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	void* frame = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, d->mPboFrameSize, GL_MAP_READ_BIT);
+	d->mStats.readback.record(start);
+	if(frame != nullptr)
+	{
+		if(d->opened())
+			writeFrame(frame, d->mPboFrameSize, d->mPboPts[tail]);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	else
+		std::cerr<<"[FFmpegVideoRecorderProcess] failed to map the read back buffer, frame lost..."<<std::endl;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, previousPbo);
+
+	d->mPboPending--;
+	return true;
+#else
+	return false;
+#endif
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::releaseReadbackRing()
+{
+#if OPENGL_HAS_SYNC_OBJECTS
+	if(d->mPbos.empty()) return;
+
+	while(d->mPboPending > 0)
+		sendPendingFrame(true);
+
+	glDeleteBuffers(GLsizei(d->mPbos.size()), d->mPbos.data());
+	d->mPbos.clear();
+	d->mFences.clear();
+	d->mPboPts.clear();
+	d->mPboFrameSize = 0;
+	d->mPboHead		 = 0;
+#endif
+}
+
+//------------------------------------------------------------------------------------------------------------
+//---------------------------- set/get ffmpeg options ----------------------------------------------------
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::appendEnvVarPath(std::string envVarPath)
+{
+	if(envVarPath.empty()) return;
+	std::vector<std::string> envVarPathList;
+	envVarPathList.push_back(envVarPath);
+	appendEnvVarPath(envVarPathList);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::appendEnvVarPath(std::vector<std::string> envVarPathList)
+{
+	putEnvVar("PATH", envVarPathList);
+
+	// ffmpeg will be looked for again in the new PATH
+	std::lock_guard<std::mutex> lock(gFFmpegMutex);
+	gFFmpegPath.clear();
+	d->mFound = true;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::setOutputPath(std::string path)
+{
+	if(path.empty())
+	{
+		std::cerr<<"[FFmpegVideoRecorderProcess] empty path given at : " << __FILE__ << ":" << __LINE__ << std::endl;
+		path = "./";
+		std::cerr<<"[FFmpegVideoRecorderProcess] set default path to "<< path << std::endl;			
+	}
+	else
+	{
+		OS_MKDIR(path.c_str());
+	}
+	d->mPath = path.at(path.length()-1) != '/' ? path.append("/") : path;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+std::string FFmpegVideoRecorderProcess::getOutputPath()
+{
+	return d->mPath;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::setOutputBaseFileName(std::string base)
+{
+	d->mBaseName = base;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+std::string FFmpegVideoRecorderProcess::getOutputFileName()
+{
+	return formatFileName(false);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+std::string FFmpegVideoRecorderProcess::getOutputVideoFilePath()
+{
+	return d->mPath + formatFileName(false);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::overwriteOutput(bool overwrite)
+{
+	d->mOverwrite = overwrite;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool FFmpegVideoRecorderProcess::overwriteOutput()
+{
+	return d->mOverwrite;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::setQuality(unsigned int crf)
+{
+	d->mCRF = crf < 0 ? 0 : (crf > 51 ? 51 : crf);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+unsigned int FFmpegVideoRecorderProcess::getQuality()
+{
+	return d->mCRF;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::setPreset(FFmpegVideoRecorderProcess::PRESET preset)
+{
+	d->mPreset = preset;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+FFmpegVideoRecorderProcess::PRESET FFmpegVideoRecorderProcess::getPreset()
+{
+	return d->mPreset;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::adaptivePreset(bool adaptive, PRESET fastest, PRESET slowest, unsigned int maxCrfRaise)
+{
+	d->mAdaptive		= adaptive;
+	d->mFastestPreset	= fastest;
+	d->mSlowestPreset	= slowest;
+	d->mMaxCrfRaise		= maxCrfRaise;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool FFmpegVideoRecorderProcess::adaptivePreset()
+{
+	return d->mAdaptive;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+FFmpegVideoRecorderProcess::PRESET FFmpegVideoRecorderProcess::getAdaptivePreset()
+{
+	if(d->mStarted && d->mAdaptive)
+		return PRESET(d->mController.preset()); // the level of the encoder, the settings may have changed since init()
+	PRESET preset;
+	unsigned int crf;
+	d->encoderLevel(preset, crf);
+	return preset;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+unsigned int FFmpegVideoRecorderProcess::getAdaptiveQuality()
+{
+	if(d->mStarted && d->mAdaptive)
+		return d->mController.crf();
+	PRESET preset;
+	unsigned int crf;
+	d->encoderLevel(preset, crf);
+	return crf;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::setCodec(CODEC codec)
+{
+	d->mCodec = codec;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+FFmpegVideoRecorderProcess::CODEC FFmpegVideoRecorderProcess::getCodec()
+{
+	return d->mCodec;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::lossless(bool qp)
+{
+	d->mLossless = qp;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool FFmpegVideoRecorderProcess::lossless()
+{
+	return d->mLossless;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::setBitrate(unsigned int bufsize, unsigned int maxrate, unsigned int minrate, unsigned int bitrate, bool use)
+{
+	d->mBitrate.bitrate = bitrate;
+	d->mBitrate.minrate = minrate;
+	d->mBitrate.maxrate = maxrate;
+	d->mBitrate.bufsize = bufsize;
+	d->mBitrate.use	 = use;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::setBitrate(unsigned int& bufsize, unsigned int& maxrate, unsigned int& minrate, unsigned int& bitrate, bool use)
+{
+	bitrate = d->mBitrate.bitrate;
+	minrate = d->mBitrate.minrate;
+	maxrate = d->mBitrate.maxrate;
+	bufsize = d->mBitrate.bufsize;
+	use		= d->mBitrate.use;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::asyncReadback(bool async, unsigned int ringSize)
+{
+	d->mAsyncReadback = async;
+	d->mPboCount	  = ringSize < 2 ? 2 : ringSize;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool FFmpegVideoRecorderProcess::asyncReadback()
+{
+	return d->mAsyncReadback;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+FFmpegVideoRecorderProcess::BACKEND FFmpegVideoRecorderProcess::getBackend()
+{
+	return d->mBackend;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::setTransport(TRANSPORT transport, size_t pipeSize)
+{
+	d->mTransportMode	= transport;
+	d->mPipeSize		= pipeSize;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+FFmpegVideoRecorderProcess::TRANSPORT FFmpegVideoRecorderProcess::getTransport()
+{
+	return d->mTransportMode;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::setConversion(CONVERSION conversion)
+{
+	d->mConversion = conversion;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+FFmpegVideoRecorderProcess::CONVERSION FFmpegVideoRecorderProcess::getConversion()
+{
+	return d->mConversion;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::threadedWriter(bool threaded, unsigned int queueDepth, OVERFLOW_POLICY policy)
+{
+	d->mThreadedWriter	= threaded;
+	d->mQueueDepth		= queueDepth < 2 ? 2 : queueDepth;
+	d->mOverflowPolicy	= policy;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool FFmpegVideoRecorderProcess::threadedWriter()
+{
+	return d->mThreadedWriter;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::setSegmentation(SEGMENTATION mode, unsigned int segmentSeconds, size_t maxSegmentBytes, unsigned int keepSegments)
+{
+	d->releaseStandby(); // its file name and its segmenter may not match anymore
+	d->mSegmentation	= mode;
+	d->mSegmentSeconds	= segmentSeconds;
+	d->mMaxSegmentBytes	= maxSegmentBytes;
+	d->mKeepSegments	= keepSegments;
+	if(mode == SEGMENTATION::SEGMENTS && !Mp4Segmenter::available())
+		std::cerr<<"[FFmpegVideoRecorderProcess] segments need named pipes, write a single fragmented mp4..."<<std::endl;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+FFmpegVideoRecorderProcess::SEGMENTATION FFmpegVideoRecorderProcess::getSegmentation()
+{
+	return d->mSegmentation;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::setSink(SINK sink, unsigned int frames)
+{
+	if((sink == SINK::SHARED_MEMORY && !SharedMemoryRing::available()) || (sink == SINK::MAPPED_FILE && !MappedRawFile::available()))
+	{
+		std::cerr<<"[FFmpegVideoRecorderProcess] shared memory ring and mapped file only available on POSIX systems, keep the current sink..."<<std::endl;
+		return;
+	}
+	d->mSinkMode	= sink;
+	d->mSinkFrames	= frames;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+FFmpegVideoRecorderProcess::SINK FFmpegVideoRecorderProcess::getSink()
+{
+	return d->mSinkMode;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::setSinkFactory(std::function<FrameSink*(const FrameSink::Format& format, const std::string& filePath)> factory)
+{
+	d->mSinkFactory = factory;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+CaptureStats FFmpegVideoRecorderProcess::getStats()
+{
+	return d->mStats.snapshot();
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+unsigned long long FFmpegVideoRecorderProcess::droppedFrames()
+{
+	return d->mDropped + (d->mQueue != nullptr ? d->mQueue->dropped() : 0);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::setFrameRate(unsigned int fps)
+{
+	d->mFrameRate = fps == 0 ? 25 : fps;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+unsigned int FFmpegVideoRecorderProcess::getFrameRate()
+{
+	return d->mFrameRate;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::timestampedCapture(bool timestamped, unsigned int maxFrameRate)
+{
+	d->mTimestamped		= timestamped;
+	d->mMaxFrameRate	= maxFrameRate;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool FFmpegVideoRecorderProcess::timestampedCapture()
+{
+	return d->mTimestamped;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::skipDuplicateFrames(bool skip, unsigned int maxDurationMs)
 {
-	return d->mPreset;
+	d->mSkipDuplicates			= skip;
+	d->mMaxDuplicateDuration	= maxDurationMs;
 }
 
 //------------------------------------------------------------------------------------------------------------
 
-void FFmpegVideoRecorderProcess::lossless(bool qp)
+bool FFmpegVideoRecorderProcess::skipDuplicateFrames()
 {
-	d->mLossless = qp;
+	return d->mSkipDuplicates;
 }
 
 //------------------------------------------------------------------------------------------------------------
 
-bool FFmpegVideoRecorderProcess::lossless()
+unsigned long long FFmpegVideoRecorderProcess::duplicateFrames()
 {
-	return d->mLossless;
+	return d->mDuplicateFrames;
 }
 
 //------------------------------------------------------------------------------------------------------------
 
-void FFmpegVideoRecorderProcess::setBitrate(unsigned int bufsize, unsigned int maxrate, unsigned int minrate, unsigned int bitrate, bool use)
+double FFmpegVideoRecorderProcess::duplicateFrameRatio()
 {
-	d->mBitrate.bitrate = bitrate;
-	d->mBitrate.minrate = minrate;
-	d->mBitrate.maxrate = maxrate;
-	d->mBitrate.bufsize = bufsize;
-	d->mBitrate.use	 = use;
+	return d->mHashedFrames != 0 ? double(d->mDuplicateFrames) / double(d->mHashedFrames) : 0.0;
 }
 
 //------------------------------------------------------------------------------------------------------------
 
-void FFmpegVideoRecorderProcess::setBitrate(unsigned int& bufsize, unsigned int& maxrate, unsigned int& minrate, unsigned int& bitrate, bool use)
+void FFmpegVideoRecorderProcess::pipelinedCapture(bool pipelined, unsigned int transformThreads, unsigned int frames)
 {
-	bitrate = d->mBitrate.bitrate;
-	minrate = d->mBitrate.minrate;
-	maxrate = d->mBitrate.maxrate;
-	bufsize = d->mBitrate.bufsize;
-	use		= d->mBitrate.use;
+	d->mPipelined		= pipelined;
+	d->mTransformThreads	= transformThreads;
+	d->mPipelineFrames	= frames;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool FFmpegVideoRecorderProcess::pipelinedCapture()
+{
+	return d->mPipelined;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::setFrameTransform(std::function<void(unsigned char* frame, size_t size, long long pts)> transform)
+{
+	d->mFrameTransform = transform;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+unsigned int FFmpegVideoRecorderProcess::addRendition(int width, int height, PRESET preset, unsigned int crf, std::string outputPath, std::string baseFileName)
+{
+	Private::Rendition rendition;
+	rendition.width		= width - width % 2;
+	rendition.height	= height - height % 2;
+	rendition.preset	= preset;
+	rendition.crf		= crf;
+	rendition.path		= outputPath.empty() || outputPath.back() == '/' ? outputPath : outputPath + "/";
+	rendition.baseName	= baseFileName;
+	d->mRenditions.push_back(rendition);
+	return (unsigned int)d->mRenditions.size() - 1;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::clearRenditions()
+{
+	d->mRenditions.clear();
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+std::vector<std::string> FFmpegVideoRecorderProcess::getRenditionFilePaths()
+{
+	return d->mRenditionFiles;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+CaptureStats FFmpegVideoRecorderProcess::getRenditionStats()
+{
+	return d->mRenditionStats.snapshot();
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+FFmpegLibavEncoder::Settings FFmpegVideoRecorderProcess::libavSettings(const std::string& inputPixFmt, PRESET preset, unsigned int crf)
+{
+	FFmpegLibavEncoder::Settings settings;
+	settings.width			= d->mWidth;
+	settings.height			= d->mHeight;
+	settings.framerate		= int(d->mFrameRate);
+	settings.timeBase		= d->timestamped() ? gTimeBase : 0;
+	settings.inputPixFmt	= inputPixFmt;
+	settings.encoder		= codecName(d->mCodec);
+	settings.preset			= presetName(preset);
+	settings.crf			= crf;
+	settings.lossless		= d->mLossless;
+	settings.bitrate		= d->mBitrate.use ? d->mBitrate.bitrate : 0;
+	settings.minrate		= d->mBitrate.use ? d->mBitrate.minrate : 0;
+	settings.maxrate		= d->mBitrate.use ? d->mBitrate.maxrate : 0;
+	settings.bufsize		= d->mBitrate.use ? d->mBitrate.bufsize : 0;
+	settings.overwrite		= d->mOverwrite || d->segmentation() == SEGMENTATION::SEGMENTS; // the named pipe of the segments exists
+	settings.keyframeInterval = d->keyframeInterval();
+	if(d->segmentation() != SEGMENTATION::NONE)
+	{
+		settings.format		= "mp4";
+		settings.movflags	= "+frag_keyframe+empty_moov+default_base_moof";
+	}
+	return settings;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+FrameSink* FFmpegVideoRecorderProcess::adaptiveEncoder(FrameSink* encoder, const std::string& ffmpeg, const std::string& inputPixFmt,
+													   const FrameSink::Format& format, const std::string& outFilePathName)
+{
+	PRESET preset;
+	unsigned int crf;
+	d->encoderLevel(preset, crf);
+
+	// the encoders of the other levels get the settings of the session (not the ones changed meanwhile)
+	AdaptiveEncoderSink::EncoderFactory factory;
+	if(d->mBackend == BACKEND::PIPE)
+	{
+		// the command line of the session with the encoding arguments of the level, muxing into another named pipe of the segmenter
+		std::string command		= ffmpegCommand(ffmpeg, inputPixFmt, outFilePathName);
+		std::string arguments	= encodingArguments(preset, crf, d->mLossless, d->mBitrate, d->mCodec, highBitDepth(inputPixFmt));
+		std::string fifo		= Mp4Segmenter::fifoPath(outFilePathName);
+		bool		lossless	= d->mLossless;
+		Bitrate		bitrate		= d->mBitrate;
+		CODEC		codec		= d->mCodec;
+		bool		rawPipe		= d->mTransportMode != TRANSPORT::STDIO;
+		bool		zeroCopy	= d->mTransportMode == TRANSPORT::VMSPLICE;
+		size_t		pipeSize	= d->mPipeSize;
+		factory = [=](unsigned int preset, unsigned int crf, const std::string& stream) -> FrameSink*
+		{
+			std::string cmd = command;
+			cmd.replace(cmd.find(arguments), arguments.size(), encodingArguments(PRESET(preset), crf, lossless, bitrate, codec, highBitDepth(inputPixFmt)));
+			cmd.replace(cmd.rfind(fifo), fifo.size(), stream);
+			std::cout<<"[FFmpegVideoRecorderProcess] adaptive preset : command called: "<< cmd <<std::endl;
+			FFmpegPipeSink* sink = new FFmpegPipeSink();
+			if(sink->open(cmd, format, rawPipe, zeroCopy, pipeSize))
+				return sink;
+			delete sink;
+			return nullptr;
+		};
+	}
+	else
+	{
+		FFmpegLibavEncoder::Settings settings = libavSettings(inputPixFmt, preset, crf);
+		factory = [=](unsigned int preset, unsigned int crf, const std::string& stream) -> FrameSink*
+		{
+			FFmpegLibavEncoder::Settings level = settings;
+			level.preset	= presetName(PRESET(preset));
+			level.crf		= crf;
+			std::cout<<"[FFmpegVideoRecorderProcess] adaptive preset : "<< level.preset <<" crf "<< crf <<" encoding into "<< stream <<std::endl;
+			LibavEncoderSink* sink = new LibavEncoderSink();
+			if(sink->open(stream, level))
+				return sink;
+			delete sink;
+			return nullptr;
+		};
+	}
+
+	std::cout<<"[FFmpegVideoRecorderProcess] adaptive preset : start with "<< presetName(preset) <<" crf "<< crf <<std::endl;
+	AdaptiveEncoderSink* sink = new AdaptiveEncoderSink();
+	sink->open(encoder, format, factory, &d->mController, &d->mStats, d->keyframeInterval(), d->mSegmenter, Mp4Segmenter::fifoPath(outFilePathName));
+	return sink;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::startRenditions()
+{
+	d->mRenditionFiles.clear();
+	if(d->mRenditions.empty())
+		return;
+	if(readbackSize() != size_t(d->mWidth) * d->mHeight * 4 || Private::tenBits(d->mSessionConversion))
+	{
+		std::cerr<<"[FFmpegVideoRecorderProcess] the renditions need the frames read back in 8 bits rgba (not converted on the GPU nor in 10 bits), none is recorded"<<std::endl;
+		return;
+	}
+	std::string ffmpeg = d->mBackend == BACKEND::PIPE ? resolveFFmpeg() : std::string();
+	if(d->mBackend == BACKEND::PIPE && ffmpeg.empty())
+	{
+		std::cerr<<"[FFmpegVideoRecorderProcess] FFMPEG NOT FOUND, no rendition is recorded"<<std::endl;
+		return;
+	}
+
+	// named after the main video : same number, and the resolution in the base name unless given
+	for(const Private::Rendition& rendition : d->mRenditions)
+	{
+		Private::RenditionOutput* output = new Private::RenditionOutput();
+		output->width	= rendition.width != 0 ? rendition.width : (rendition.height != 0 ? int((long long)rendition.height * d->mWidth / d->mHeight) : d->mWidth);
+		output->height	= rendition.height != 0 ? rendition.height : (rendition.width != 0 ? int((long long)rendition.width * d->mHeight / d->mWidth) : d->mHeight);
+		output->width	= std::max(output->width - output->width % 2, 2);
+		output->height	= std::max(output->height - output->height % 2, 2);
+		std::stringstream file;
+		file << (rendition.path.empty() ? d->mPath : rendition.path)
+			 << (rendition.baseName.empty() ? d->mBaseName + std::to_string(output->width) + "x" + std::to_string(output->height) + "_" : rendition.baseName)
+			 << std::setfill('0') << std::setw(2) << d->mId << ".mp4";
+		output->file = file.str();
+		{
+			std::lock_guard<std::mutex> lock(gFilesMutex);
+			gReservedFiles.insert(output->file); // until the file is written
+		}
+
+		// the frames are piped or given as read back (rgba, bottom-up) : flipped and converted by the encoder
+		FrameSink::Format format = sinkFormat("rgba");
+		format.width		= output->width;
+		format.height		= output->height;
+		format.frameSize	= size_t(output->width) * output->height * 4;
+		Bitrate bitrate		= {false, 0, 0, 0, 0};
+		if(d->mBackend == BACKEND::PIPE)
+		{
+			std::string cmd = ffmpegCommand(ffmpeg, "rgba", output->file, output->width, output->height, rendition.preset, rendition.crf, false, bitrate,
+											SEGMENTATION::NONE);
+			std::cout<<"[FFmpegVideoRecorderProcess] init : rendition command called: "<< cmd <<std::endl;
+			output->sink = d->spawn(cmd, format);
+		}
+		else
+		{
+			FFmpegLibavEncoder::Settings settings;
+			settings.width			= output->width;
+			settings.height			= output->height;
+			settings.framerate		= int(d->mFrameRate);
+			settings.timeBase		= format.timeBase;
+			settings.inputPixFmt	= "rgba";
+			settings.encoder		= codecName(d->mCodec);
+			settings.preset			= presetName(rendition.preset);
+			settings.crf			= rendition.crf;
+			settings.overwrite		= d->mOverwrite;
+			LibavEncoderSink* encoder = new LibavEncoderSink();
+			if(encoder->open(output->file, settings))
+				output->sink = encoder;
+			else
+			{
+				delete encoder;
+				output->sink = nullptr;
+			}
+		}
+		if(output->sink == nullptr)
+		{
+			std::cerr<<"[FFmpegVideoRecorderProcess] can not start the rendition "<<output->file<<std::endl;
+			releaseFilePathName(output->file);
+			delete output;
+			continue;
+		}
+		output->queue	= new FrameQueue(format.frameSize, d->mQueueDepth, d->mOverflowPolicy);
+		if(!output->queue->allocated())
+		{
+			std::cerr<<"[FFmpegVideoRecorderProcess] can not allocate the frames of the rendition "<<output->file<<std::endl;
+			output->sink->close();
+			delete output->sink;
+			delete output->queue;
+			releaseFilePathName(output->file);
+			delete output;
+			continue;
+		}
+		output->writer	= std::thread(&Private::writeQueuedFrames, output->queue, output->sink, &d->mRenditionStats);
+		d->mRenditionOutputs.push_back(output);
+		d->mRenditionFiles.push_back(output->file);
+	}
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::setOutputFrameRate(unsigned int fps, float shutter)
+{
+	d->mOutputFrameRate	= std::min(fps, gTimeBase);
+	d->mShutter			= std::max(0.f, std::min(shutter, 1.f));
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+unsigned int FFmpegVideoRecorderProcess::getOutputFrameRate()
+{
+	return d->mOutputFrameRate;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::blurFrame(int x, int y, bool output, long long pts)
+{
+	// read back synchronously (the frames of the shutter are averaged on the CPU), after the frames pending in the read back ring
+	if(output)
+		while(sendPendingFrame(true));
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	readFrame(x, y, d->mFramedata);
+	d->mStats.readback.record(start);
+
+	start = std::chrono::steady_clock::now();
+	ColorConversion::accumulate(d->mFramedata, readbackSize(), d->mBlurSums.data(), d->mBlurFrames++ == 0);
+	if(output)
+		ColorConversion::average(d->mBlurSums.data(), readbackSize(), d->mBlurFrames, d->mFramedata);
+	d->mStats.conversion.record(start);
+	if(!output)
+		return;
+	d->mBlurFrames = 0;
+	writeFrame(d->mFramedata, readbackSize(), pts);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::setWorkerPool(WorkerPool* pool)
+{
+	d->mPool = pool;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+WorkerPool* FFmpegVideoRecorderProcess::getWorkerPool()
+{
+	return d->mPool;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::asyncFinish(bool async)
+{
+	d->mAsyncFinish = async;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool FFmpegVideoRecorderProcess::asyncFinish()
+{
+	return d->mAsyncFinish;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::setFileWrittenCallback(std::function<void(const std::string& filePath)> callback)
+{
+	std::lock_guard<std::mutex> lock(d->mReapMutex);
+	d->mWrittenCallback = callback;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool FFmpegVideoRecorderProcess::isFileWritten(const std::string& filePath)
+{
+	if(d->mStarted && (filePath.empty() || filePath == d->mSessionFile))
+		return false; // still recording
+	return waitFileWritten(filePath, 0);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool FFmpegVideoRecorderProcess::waitFileWritten(const std::string& filePath, int timeoutMs)
+{
+	std::unique_lock<std::mutex> lock(d->mReapMutex);
+	auto written = [&]() { return filePath.empty() ? d->mPendingFiles.empty() : d->mPendingFiles.count(filePath) == 0; };
+	if(timeoutMs < 0)
+	{
+		d->mWrittenCondition.wait(lock, written);
+		return true;
+	}
+	return d->mWrittenCondition.wait_for(lock, std::chrono::milliseconds(timeoutMs), written);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool FFmpegVideoRecorderProcess::warmUp(int width, int height)
+{
+	if(d->mStarted) return false;
+	d->releaseStandby();
+	resolutionCheck(width, height);
+
+	// map the frame buffers in the pool (handed back by the init() acquire)
+	latchConversion();
+	FrameBufferPool::Get().release(FrameBufferPool::Get().acquire(readbackSize()));
+	if(Private::cpuConversion(d->mSessionConversion))
+		FrameBufferPool::Get().release(FrameBufferPool::Get().acquire(frameSize()));
+
+	if(d->mBackend != BACKEND::PIPE || !d->encoded())
+		return true; // nothing to spawn
+
+	std::string ffmpeg = resolveFFmpeg();
+	d->mFound = !ffmpeg.empty();
+	if(!d->mFound)
+	{
+		std::cerr<<"[FFmpegVideoRecorderProcess] FFMPEG NOT FOUND, AVOID THE VIDEO CAPTURE..."<<std::endl;
+		return false;
+	}
+
+	// reserve the output file and start ffmpeg : it waits for the first frame on its stdin
+	d->mStandbyFile			= freeFilePathName();
+	if(d->segmentation() == SEGMENTATION::SEGMENTS && (d->mStandbySegmenter = d->startSegmenter(d->mStandbyFile)) == nullptr)
+	{
+		releaseFilePathName(d->mStandbyFile);
+		d->mStandbyFile.clear();
+		return false;
+	}
+	d->mStandbyCommand		= ffmpegCommand(ffmpeg, latchConversion(), d->mStandbyFile);
+	d->mStandbyTransportMode= d->mTransportMode;
+	std::cout<<"[FFmpegVideoRecorderProcess] warmUp : standby command: "<< d->mStandbyCommand <<std::endl;
+	d->mStandbySink			= d->spawn(d->mStandbyCommand, sinkFormat(latchConversion()));
+	return d->hasStandby();
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::coolDown()
+{
+	d->releaseStandby();
 }
 
 //------------------------------------------------------------------------------------------------------------
@@ -387,82 +2335,149 @@ void FFmpegVideoRecorderProcess::init(int width, int height, std::string outputP
 
 bool FFmpegVideoRecorderProcess::init()
 {
-	if(d->mStarted || !d->mFound) return false;
+	bool pipe = d->encoded() && d->mBackend == BACKEND::PIPE;
+	if(d->mStarted || (pipe && !d->mFound)) return false;
 
-	// Check system can find the ffmpeg cmd
-	unsigned int nbFFmpegFound	= 0;
-	d->mFound = checkFFmpegFound(nbFFmpegFound);
-	if( 0 == nbFFmpegFound || nbFFmpegFound > 1 )
+	// Check system can find the ffmpeg cmd (once for the process, not needed to encode in process)
+	std::string ffmpeg;
+	if(pipe)
 	{
-		if(!checkFFmpegFound(nbFFmpegFound, true)) // display list of research path with status (verbosity info)
+		ffmpeg		= resolveFFmpeg();
+		d->mFound	= !ffmpeg.empty();
+		if(!d->mFound)
 		{
 			std::cerr<<"[FFmpegVideoRecorderProcess] FFMPEG NOT FOUND, AVOID THE VIDEO CAPTURE..."<<std::endl;
 			return false;
 		}
-		else
+	}
+
+	// the pixel format we will pipe (frames converted on the GPU are already flipped)
+	std::string inputPixFmt = latchConversion();
+	FrameSink::Format format = sinkFormat(inputPixFmt);
+
+	// hand over the standby ffmpeg process started by warmUp() if it was started with the same command line
+	std::string outFilePathName;
+	if(pipe && d->hasStandby())
+	{
+		if(d->mStandbyTransportMode == d->mTransportMode && d->mStandbyCommand == ffmpegCommand(ffmpeg, inputPixFmt, d->mStandbyFile))
 		{
-			std::cerr<<"[FFmpegVideoRecorderProcess] Too many version of FFmpeg found but continue..."<<std::endl;
+			std::cout<<"[FFmpegVideoRecorderProcess] init : hand over the standby process: "<< d->mStandbyCommand <<std::endl;
+			outFilePathName		= d->mStandbyFile;
+			d->mSink			= d->mStandbySink;
+			d->mSegmenter		= d->mStandbySegmenter;
+			d->mStandbySink		= nullptr;
+			d->mStandbySegmenter= nullptr;
 		}
+		else
+			d->releaseStandby(); // settings changed since warmUp()
 	}
 
-	// apply the selected param preset
-	std::string preset("fast"); // fast is the only preset not available in enum but valid
-	switch ((int)d->mPreset)
+	if(!d->encoded())
 	{
-	case (int)PRESET::BALANCED:				preset = "medium ";		break;
-	case (int)PRESET::BEST_COMPRESSION:		preset = "veryslow ";	break;
-	case (int)PRESET::BETTER_COMPRESSION:	preset = "slow ";		break;
-	case (int)PRESET::FASTEST_ENCODING:		preset = "ultrafast ";	break;
-	case (int)PRESET::FASTER_ENCODING:		preset = "faster ";		break;
-	case (int)PRESET::FAST_ENCODING:		preset = "superfast ";	break;
-	default: break;
+		// raw frames to a file, a shared memory ring or a custom sink
+		outFilePathName = freeFilePathName();
+		d->mSink = d->createSink(format, outFilePathName);
+		if(d->mSink == nullptr)
+			std::cerr<<"[FFmpegVideoRecorderProcess] can not open the frame sink of "<<outFilePathName<<std::endl;
+	}
+	else if(pipe && !d->opened())
+	{
+		// create an non already existing output file path name video
+		outFilePathName = freeFilePathName();
+		if(d->segmentation() == SEGMENTATION::SEGMENTS && (d->mSegmenter = d->startSegmenter(outFilePathName)) == nullptr)
+		{
+			releaseFilePathName(outFilePathName);
+			return false;
+		}
+		std::string cmd = ffmpegCommand(ffmpeg, inputPixFmt, outFilePathName);
+		std::cout<<"[FFmpegVideoRecorderProcess] init : command called: "<< cmd <<std::endl;
+		d->mSink = d->spawn(cmd, format);
+	}
+	else if(!pipe)
+	{
+		// same options as the command line, given to the in process encoder
+		outFilePathName = freeFilePathName();
+		if(d->segmentation() == SEGMENTATION::SEGMENTS && (d->mSegmenter = d->startSegmenter(outFilePathName)) == nullptr)
+		{
+			releaseFilePathName(outFilePathName);
+			return false;
+		}
+		PRESET preset;
+		unsigned int crf;
+		d->encoderLevel(preset, crf);
+		FFmpegLibavEncoder::Settings settings = libavSettings(inputPixFmt, preset, crf);
+		LibavEncoderSink* encoder = new LibavEncoderSink();
+		if(encoder->open(d->mSegmenter != nullptr ? Mp4Segmenter::fifoPath(outFilePathName) : outFilePathName, settings))
+			d->mSink = encoder;
+		else
+			delete encoder;
 	}
 
-	// apply the selected bitrate param (individually set)
-	std::stringstream bitrateParam;
-	bitrateParam	
-		<< (d->mBitrate.use && d->mBitrate.bitrate ? ("-b:v "		+ d->mBitrate.bitrate+std::string("k ")) : std::string())
-		<< (d->mBitrate.use && d->mBitrate.maxrate ? ("-maxrate "	+ d->mBitrate.maxrate+std::string("k ")) : std::string())
-		<< (d->mBitrate.use && d->mBitrate.minrate ? ("-maxrate "	+ d->mBitrate.minrate+std::string("k ")) : std::string())
-		<< (d->mBitrate.use && d->mBitrate.bufsize ? ("-bufsize "	+ d->mBitrate.bufsize+std::string("k ")) : std::string());
-
-	// apply the selected lossless param
-	std::stringstream lossless;
-	if(d->mBitrate.use && d->mBitrate.bitrate) // if bitrate flag set to true and value < 0, no auto optimization quality is needed as bitrate fix it
-		lossless << d->mLossless ? "-qp 0 " : ("-crf "+d->mCRF+std::string(" ")); //if real bool lossless, do not use crf param otherwise use it
-
-	// create an non already existing output file path name video
-	bool exist = false;
-	std::string outFilePathName;
-	do {
-		outFilePathName = d->mPath + formatFileName();
-		std::ifstream f(outFilePathName.c_str(), std::ios::binary);
-		exist = f.is_open();
-		f.close();
-	}while(exist);
-
+	if(d->mSegmenter != nullptr && !d->opened())
+	{
+		delete d->mSegmenter; // nothing will write to its pipe
+		d->mSegmenter = nullptr;
+	}
 
-	// https://trac.ffmpeg.org/wiki/Encode/H.264
-	// ffmpeg command line telling to expect raw rgba, reading frames from stdin
-	std::stringstream cmd;
-	cmd <<	"ffmpeg "
-		// input options
-			<<	"-s " << d->mWidth << "x" << d->mHeight << " "
-			<<	"-framerate 25 -f rawvideo -vcodec rawvideo -pix_fmt rgba -i - "
-		// output options
-			<<  "-c:v libx264 "				// force the use of libx264 (due to best perf/quality ratio and some specific additional options we may need: crf)
-			<<  "-threads 0 -vf vflip "		// threads 0 mean [auto detect]  and videoFlip verticaly
-			<<  (d->mOverwrite ? "-y " : "-n ")// overwrite output file if exist or immediatly exit ffmpeg
-			<<  "-preset " << preset
-			<<  lossless.str()
-			<<  bitrateParam.str()
-			<<  "-pix_fmt yuv420p " //rgb24
-			<<  outFilePathName;
-	std::cout<<"[FFmpegVideoRecorderProcess] init : command called: "<< cmd.str() <<std::endl;
-
-    // open pipe to ffmpeg's stdin in binary write mode
-	d->mFFmpeg = OS_POPEN(cmd.str().c_str());
-    d->mFramedata	= new int[d->mWidth*d->mHeight];
+	// the preset follows the measured throughput : the encoder is replaced at the keyframe boundaries, or the session measured for the next one
+	if(d->mAdaptive && d->encoded() && d->opened())
+		d->mSink = adaptiveEncoder(d->mSink, ffmpeg, inputPixFmt, format, outFilePathName);
+
+	d->mSessionTimestamped	= d->timestamped();
+	d->mSessionOutputFrameRate = d->mOutputFrameRate;
+	d->mNextSlot			= 0;
+	d->mBlurFrames			= 0;
+	d->mBlurSums.clear(); // no motion blur
+	if(d->mOutputFrameRate != 0 && d->mShutter > 0 && Private::tenBits(d->mSessionConversion))
+		std::cerr<<"[FFmpegVideoRecorderProcess] the motion blur averages 8 bits frames, not done with a 10 bits conversion"<<std::endl;
+	else if(d->mOutputFrameRate != 0 && d->mShutter > 0)
+		d->mBlurSums.resize(readbackSize());
+	d->mSessionSkipDuplicates = d->mSkipDuplicates;
+	d->mLastPts				= -1;
+	d->mMinInterval			= 0;
+	d->mHashedFrames		= 0;
+	d->mDuplicateFrames		= 0;
+
+	// buffers sized in bytes of what is read back, reused across sessions and recorders by the pool
+	d->mSessionFile	= outFilePathName;
+	d->mFramedata	= FrameBufferPool::Get().acquire(readbackSize());
+	d->mDropped		= 0;
+	if(Private::cpuConversion(d->mSessionConversion))
+		d->mConverted = FrameBufferPool::Get().acquire(frameSize());
+	bool allocated	= d->mFramedata != nullptr && (d->mConverted != nullptr || !Private::cpuConversion(d->mSessionConversion));
+
+	// frames will be piped from the writer thread (the queue preallocate all its frames now)
+	if(allocated && d->mPipelined && d->opened())
+	{
+		d->startPipeline(std::max(readbackSize(), frameSize())); // or go through the stages of a pipeline
+		allocated = d->mPipeline->allocated();
+	}
+	else if(allocated && d->mPool != nullptr && d->opened())
+	{
+		// or converted and piped by the shared worker pool : the queue keeps them as read back
+		d->mQueue	= new FrameQueue(readbackSize(), d->mQueueDepth, d->mOverflowPolicy);
+		allocated	= d->mQueue->allocated();
+		if(allocated)
+			d->mStrand = new WorkerPool::Strand(*d->mPool);
+	}
+	else if(allocated && d->mThreadedWriter && d->opened())
+	{
+		d->mQueue	= new FrameQueue(frameSize(), d->mQueueDepth, d->mOverflowPolicy);
+		allocated	= d->mQueue->allocated();
+		if(allocated)
+			d->mWriter = std::thread(&Private::writeQueuedFrames, d->mQueue, d->mSink, &d->mStats);
+	}
+	if(!allocated)
+	{
+		std::cerr<<"[FFmpegVideoRecorderProcess] can not allocate the frame buffers, AVOID THE VIDEO CAPTURE..."<<std::endl;
+		endSession(true); // close what was opened for the session
+		return false;
+	}
+	if(d->opened())
+		startRenditions();
+	d->mStats.queue(0, d->mQueue != nullptr ? d->mQueue->depth() : d->mPipeline != nullptr ? d->mPipeline->frames() : 0);
+	d->mStats.backpressureUs.store(1000000 / std::max(d->mFrameRate, 1u), std::memory_order_relaxed);
+	d->mRenditionStats.backpressureUs.store(d->mStats.backpressureUs.load(std::memory_order_relaxed), std::memory_order_relaxed);
 	std::cout<<"[FFmpegVideoRecorderProcess] START capturing video in : "<<getOutputVideoFilePath()<<std::endl;
 	return d->mStarted	= true;
 }
@@ -472,36 +2487,230 @@ bool FFmpegVideoRecorderProcess::init()
 void FFmpegVideoRecorderProcess::capture(int width, int height, int x, int y)
 {
 	// check if we need to auto stop to create another video due to the changed resolution
+	// (the previous video is completed on the reaper thread while the next one starts)
 	if(d->mStarted && resolutionCheck(width, height))
-		finish();
+		endSession(false);
 
 	if(!d->mStarted)
 		init();
 
-	if(d->mFFmpeg != nullptr)
+	if(d->opened())
+	{
+		d->mStats.framesCaptured.fetch_add(1, std::memory_order_relaxed);
+		if(d->mPipeline != nullptr)
+			d->mStats.queue(d->mPipeline->inFlight(), d->mPipeline->frames());
+		if(d->mQueue != nullptr)
+		{
+			d->mStats.queue(d->mQueue->pending(), d->mQueue->depth());
+			d->mStats.framesDropped.store(d->mQueueDropped + d->mQueue->dropped(), std::memory_order_relaxed);
+			d->mStats.queueFullEvents.store(d->mQueueFull + d->mQueue->full(), std::memory_order_relaxed);
+		}
+
+		// timestamp the frame now (before any read back) and skip it without touching OpenGL if the drop policy says so
+		long long pts = -1;
+		if(d->mSessionTimestamped)
+		{
+			pts = d->timestamp();
+			Private::SAMPLING sampling = d->mSessionOutputFrameRate != 0 ? d->schedule(pts) : Private::SAMPLING::SAMPLE;
+			if(sampling == Private::SAMPLING::SKIP)
+			{
+				d->mStats.framesSkipped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			if(sampling == Private::SAMPLING::BLUR)
+			{
+				blurFrame(x, y, false, pts);
+				return;
+			}
+			if(!d->keepFrame(pts))
+			{
+				d->mDropped++;
+				d->mBlurFrames = 0; // the shutter of a dropped frame is lost with it
+				d->mStats.framesSkipped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			if(d->mBlurFrames != 0)
+			{
+				blurFrame(x, y, true, pts);
+				return;
+			}
+		}
+
+		if(d->mAsyncReadback && GL_HAS_SYNC_OBJECTS())
+			readbackAsync(x, y, pts);
+		else
+		{
+			releaseReadbackRing(); // async read back just disabled : send the pending frames first to keep the order
+			if(d->mPipeline != nullptr)
+			{
+				// read back straight into a pipeline frame (skipped if the frame has to be dropped), the stages do the rest
+				if(CapturePipeline::Frame* frame = d->pipelineFrame())
+				{
+					std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+					readFrame(x, y, frame->data);
+					d->mStats.readback.record(start);
+					d->feedRenditions(frame->data, pts);
+					d->mPipeline->push(frame, readbackSize(), pts);
+				}
+			}
+			else if(d->mQueue != nullptr && readbackSize() == d->mQueue->slotSize())
+			{
+				// read back straight into a queue slot (skipped if the frame has to be dropped)
+				int slot = d->mQueue->reserve();
+				if(slot >= 0)
+				{
+					std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+					readFrame(x, y, d->mQueue->data(slot));
+					d->mStats.readback.record(start);
+					d->feedRenditions(d->mQueue->data(slot), pts);
+					if(d->mSessionSkipDuplicates && d->duplicate(d->mQueue->data(slot), d->mQueue->slotSize(), pts))
+						d->mQueue->cancel(slot);
+					else
+					{
+						d->mQueue->commit(slot, d->mQueue->slotSize(), pts);
+						d->queued();
+					}
+				}
+			}
+			else
+			{
+				// read back straight into a pipe buffer if it goes to ffmpeg as is
+				unsigned char* frame = readbackSize() == frameSize() ? d->frameBuffer(d->mFramedata) : d->mFramedata;
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				readFrame(x, y, frame);
+				d->mStats.readback.record(start);
+				writeFrame(frame, readbackSize(), pts);
+			}
+		}
+	}
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::captureFramebuffer(GLuint framebuffer, unsigned int colorAttachment, int width, int height, int x, int y)
+{
+	if(!GL_HAS_SHADER_CONVERSION())
+	{
+		std::cerr<<"[FFmpegVideoRecorderProcess] capturing a framebuffer object needs OpenGL 3.0 (see opengl_functions.h)"<<std::endl;
+		return;
+	}
+	d->mSourceFramebuffer	= true;
+	d->mSourceFbo			= framebuffer;
+	d->mSourceAttachment	= colorAttachment;
+	capture(width, height, x, y);
+	d->mSourceFramebuffer	= false;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::captureTexture(GLuint texture, int width, int height)
+{
+	if(!GL_HAS_SHADER_CONVERSION())
 	{
-		glReadPixels(x, y, d->mWidth, d->mHeight, GL_RGBA, GL_UNSIGNED_BYTE, d->mFramedata);
-		OS_FWRITE(d->mFramedata, sizeof(int)*d->mWidth*d->mHeight, 1, d->mFFmpeg);
+		std::cerr<<"[FFmpegVideoRecorderProcess] capturing a texture needs OpenGL 3.0 (see opengl_functions.h)"<<std::endl;
+		return;
 	}
+	d->mSourceTexture = texture;
+	capture(width, height);
+	d->mSourceTexture = 0;
 }
 
 //------------------------------------------------------------------------------------------------------------
 
 void FFmpegVideoRecorderProcess::finish()
 {
-	if(d->mFFmpeg != nullptr)
-    {
-		OS_PCLOSE(d->mFFmpeg);
-		d->mFFmpeg = nullptr;
-		std::cout<<"[FFmpegVideoRecorderProcess] FINISH, check video at : "<<getOutputVideoFilePath()<<std::endl;
-    }
+	endSession(!d->mAsyncFinish);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FFmpegVideoRecorderProcess::endSession(bool wait)
+{
+	// do not lose the frames still in the read back ring
+	releaseReadbackRing();
+	releaseGpuConversion();
+#if OPENGL_HAS_SHADER_CONVERSION
+	if(d->mReadFbo)
+		glDeleteFramebuffers(1, &d->mReadFbo);
+	d->mReadFbo = 0;
+#endif
+
+	// nor the frames in the pipeline stages (they run with the state of the session)
+	if(d->mPipeline != nullptr)
+	{
+		delete d->mPipeline; // wait for them
+		d->mPipeline = nullptr;
+	}
+
+	// the writer thread, the ffmpeg process or the libav encoder of the session are closed together (may be on the reaper thread)
+	if(d->mQueue != nullptr || d->opened())
+	{
+		if(d->mSessionSkipDuplicates)
+			std::cout<<"[FFmpegVideoRecorderProcess] "<<d->mDuplicateFrames<<" duplicate frames skipped out of "<<d->mHashedFrames
+					 <<" ("<<int(100 * duplicateFrameRatio() + 0.5)<<"%)"<<std::endl;
+		Private::Closing* closing = new Private::Closing();
+		closing->file		= d->mSessionFile;
+		closing->queue		= d->mQueue;
+		closing->writer		= std::move(d->mWriter);
+		closing->strand		= d->mStrand;
+		if(d->mStrand != nullptr)
+		{
+			closing->converted	= d->mConverted; // still used by the strand tasks
+			d->mConverted		= nullptr;
+		}
+		closing->sink		= d->mSink;
+		closing->segmenter	= d->mSegmenter;
+		if(d->mQueue != nullptr)
+		{
+			d->mQueue->close(); // no more frame pushed : the dropped count is final
+			d->mDropped += d->mQueue->dropped();
+			d->mQueueDropped += d->mQueue->dropped();
+			d->mQueueFull += d->mQueue->full();
+			d->mStats.framesDropped.store(d->mQueueDropped, std::memory_order_relaxed);
+			d->mStats.queueFullEvents.store(d->mQueueFull, std::memory_order_relaxed);
+		}
+		d->mQueue		= nullptr;
+		d->mStrand		= nullptr;
+		d->mSink		= nullptr;
+		d->mSegmenter	= nullptr;
+		d->mStats.queue(0, 0);
+		d->reap(closing, wait);
+	}
+	else if(!d->mSessionFile.empty())
+		releaseFilePathName(d->mSessionFile); // nothing was opened to write it
+	d->mSessionFile.clear();
+
+	// each rendition is closed like the main output
+	d->mRenditionDropped += d->renditionsDropped();
+	d->mRenditionStats.framesDropped.store(d->mRenditionDropped, std::memory_order_relaxed);
+	for(Private::RenditionOutput* rendition : d->mRenditionOutputs)
+	{
+		rendition->queue->close();
+		Private::Closing* closing = new Private::Closing();
+		closing->file		= rendition->file;
+		closing->queue		= rendition->queue;
+		closing->writer		= std::move(rendition->writer);
+		closing->strand		= nullptr;
+		closing->converted	= nullptr;
+		closing->sink		= rendition->sink;
+		closing->segmenter	= nullptr;
+		d->reap(closing, wait);
+		delete rendition;
+	}
+	d->mRenditionOutputs.clear();
 
     if(d->mFramedata != nullptr || d->mFramedata != NULL)
     {
-        delete [] d->mFramedata;
+        FrameBufferPool::Get().release(d->mFramedata);
         d->mFramedata = nullptr;
     }
 
+	if(d->mConverted != nullptr)
+	{
+		FrameBufferPool::Get().release(d->mConverted);
+		d->mConverted = nullptr;
+	}
+
     if(d->mStarted)
         d->mStarted = false;
 }
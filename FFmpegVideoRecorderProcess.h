@@ -2,6 +2,13 @@
 
 #include <vector>
 #include <string>
+#include <functional>
+
+#include "FrameQueue.h"
+#include "CaptureStats.h"
+#include "FrameSink.h"
+
+class WorkerPool;
 
 #ifdef HAS_QT
 	#include <QtOpenGL>
@@ -11,12 +18,9 @@
 	//  according to OPENGL_VERSION_* preprocessors
 	#include "opengl_functions.h"
 #else
-	#ifdef WIN32
-		#include <windows.h>
-	#endif
-	#include <GL/gl.h>
 	// Emulate the class to be coherent with Qt5 opengl impl
-	class GLFunctions { public: void init(){}; };
+	//  loading by hand the few functions we need after OpenGL 1.1
+	#include "opengl_fallback_functions.h"
 #endif
 
 
@@ -62,6 +66,75 @@ public:
 		BEST_COMPRESSION	///< -preset veryslow
 	};
 
+	/** Forces libx264 to build video in a way, that it could be streamed over 500kbit/s line considering device buffer of 1000kbits.
+	*	Very useful for web - setting this to bitrate and 2x bitrate gives good results. */
+	struct Bitrate
+	{
+		bool use;			  ///< induce use 3 bitrate ffmpeg parameters
+		unsigned int bitrate; ///< in kbits
+		unsigned int minrate; ///< in kbits
+		unsigned int maxrate; ///< in kbits
+		unsigned int bufsize; ///< in kbits
+	};
+
+	/// Which encoder receives the captured frames
+	enum class BACKEND
+	{
+		PIPE,	///< pipe the raw frames to an ffmpeg process (needs the ffmpeg executable)
+		LIBAV	///< encode in process with libavcodec/libavformat (needs the libraries at build time, otherwise fall back to PIPE)
+	};
+
+	/// How the raw frames go through the pipe to the ffmpeg process (BACKEND::PIPE)
+	enum class TRANSPORT
+	{
+		STDIO,		///< popen and fwrite [default]
+		WRITEV,		///< Linux : spawn ffmpeg on a raw pipe enlarged with F_SETPIPE_SZ and write the frames with writev (otherwise STDIO)
+		VMSPLICE	///< as WRITEV, but splice the frames read back or converted in page-aligned buffers to the pipe without copy
+	};
+
+	/// Where the captured RGBA frame is converted to the pixel format given to the encoder
+	enum class CONVERSION
+	{
+		NONE,			///< read back rgba, ffmpeg flips and converts it (4 bytes per pixel through the pipe)
+		GPU_YUV420P,	///< a shader converts to planar yuv420p and flips before the read back (1.5 bytes per pixel)
+		GPU_NV12,		///< a shader converts to semi-planar nv12 and flips before the read back (1.5 bytes per pixel)
+		CPU_YUV420P,	///< read back rgba, a SIMD kernel converts to planar yuv420p and flips before the pipe (1.5 bytes per pixel)
+		CPU_NV12,		///< read back rgba, a SIMD kernel converts to semi-planar nv12 and flips before the pipe (1.5 bytes per pixel)
+		CPU_P010,		///< read back 10 bits rgb10_a2 (RGB10_A2 or half float framebuffers, clamped to [0:1]), a SIMD kernel converts
+						///< to 10 bits semi-planar p010 and flips before the pipe (3 bytes per pixel), encoded in 10 bits (see CODEC).
+						///< Timestamped sessions and .nut files get CPU_YUV420P10 instead (ffmpeg has no nut tag for p010)
+		CPU_YUV420P10	///< as CPU_P010 but converted to 10 bits planar yuv420p10le (3 bytes per pixel)
+	};
+
+	/// Which codec encodes the video (the 10 bits conversions select its 10 bits profile : x264 high10, x265 main10)
+	enum class CODEC
+	{
+		H264,	///< libx264 [default]
+		H265	///< libx265 (better compression for the same quality, slower)
+	};
+
+	/// What the writer thread queue do when ffmpeg does not consume the frames fast enough (BLOCK, DROP_NEWEST, DROP_OLDEST)
+	typedef FrameQueue::OVERFLOW_POLICY OVERFLOW_POLICY;
+
+	/// How the encoded video is written to the disk
+	enum class SEGMENTATION
+	{
+		NONE,		///< a single mp4, unreadable until finish() wrote its index [default]
+		FRAGMENTED,	///< a single fragmented mp4, readable up to its last fragment while it is recorded
+		SEGMENTS	///< rolling fragmented mp4 segments sharing an init section, listed in an m3u8 playlist (see Mp4Segmenter)
+	};
+
+	/// Where the captured frames go (see FrameSink)
+	enum class SINK
+	{
+		ENCODER,			///< encoded into the output video by the BACKEND (ffmpeg process or libav encoder) [default]
+		RAW_FILE,			///< written without encoding into a .nut file of rawvideo (see RawFileSink)
+		MAPPED_FILE,		///< read back straight into a preallocated memory-mapped .raw file, without encoding nor copy (see MappedRawFile)
+		COMPRESSED_FILE,	///< compressed without loss on all the cores into a .vcq file (see CompressedFileSink, decoded by the Transcoder tool)
+		NONE,				///< discarded : measures the capture side alone (see NullSink)
+		SHARED_MEMORY		///< published in a POSIX shared memory ring read in place by another local process (see SharedMemoryRing)
+	};
+
 private:
     // internal data
 	class Private;
@@ -79,8 +152,36 @@ protected:
 	void putEnvVar(std::string var, std::vector<std::string> values);
 
 	/// Before starting, we should check the system can call ffmpeg programm or not
-	bool checkFFmpegFound(unsigned int& outNbFound, bool verbose = false, bool tryOpen = false);
+	/// outFirstFound (if any) receives the first ffmpeg executable found in the PATH
+	bool checkFFmpegFound(unsigned int& outNbFound, bool verbose = false, bool tryOpen = false, std::string* outFirstFound = nullptr);
+
+	/// The ffmpeg executable found in the PATH, looked for once for the process (empty if not found)
+	std::string resolveFFmpeg();
+
+	/// Latch the conversion of the next session (falling back to NONE if not available) and return the pixel format piped
+	std::string latchConversion();
+
+	/// Find a non already existing output file path name video (incrementing the number)
+	std::string freeFilePathName();
+
+	/// The ffmpeg command line reading the raw frames from stdin and encoding them into outFilePathName
+	std::string ffmpegCommand(const std::string& ffmpeg, const std::string& inputPixFmt, const std::string& outFilePathName);
 	
+	/// The ffmpeg command line of a video of another resolution, quality or segmentation than the current settings
+	std::string ffmpegCommand(const std::string& ffmpeg, const std::string& inputPixFmt, const std::string& outFilePathName,
+							  int width, int height, PRESET preset, unsigned int crf, bool lossless, const Bitrate& bitrate, SEGMENTATION segmentation);
+
+	/// The libav encoder settings of the session (same options as the ffmpeg command line) with a preset and a crf
+	FFmpegLibavEncoder::Settings libavSettings(const std::string& inputPixFmt, PRESET preset, unsigned int crf);
+
+	/// Wrap the encoder of the session starting into an AdaptiveEncoderSink replacing it by encoders of the levels of the preset controller
+	/// (outFilePathName : the output of the session, a playlist with SEGMENTS). Return the sink of the session.
+	FrameSink* adaptiveEncoder(FrameSink* encoder, const std::string& ffmpeg, const std::string& inputPixFmt, const FrameSink::Format& format,
+							   const std::string& outFilePathName);
+
+	/// Open the renditions of the session starting (named with the number of its main video)
+	void startRenditions();
+
 	/// Will generate a video filename based on mBaseName and mId
 	std::string formatFileName(bool increment = true);
 
@@ -88,11 +189,72 @@ protected:
 	/// The resolution sizes need to be divisible by 2 in order to use   '-pix_fmt yuv420p'   option with ffmpeg
 	bool resolutionCheck(int width, int height);
 
+	/// Size in bytes of a frame piped to ffmpeg for the current session (according to the resolution and the conversion)
+	size_t frameSize();
+
+	/// Size in bytes of a frame read back from OpenGL for the current session (rgba unless converted on the GPU)
+	size_t readbackSize();
+
+	/// What the frames of the session are, as given to its sink (pixFmt is the input pixel format of latchConversion())
+	FrameSink::Format sinkFormat(const std::string& pixFmt);
+
+	/// Read back the current frame (converted if needed) into dst (or at the dst offset of the bound pixel buffer object)
+	/// from the framebuffer object or texture given to captureFramebuffer() or captureTexture(), or from the bound read framebuffer
+	void readFrame(int x, int y, void* dst);
+
+	/// readFrame() from the bound read framebuffer
+	void readFramebuffer(int x, int y, void* dst);
+
+	/// Render the frame of the read framebuffer through the conversion shader into our framebuffer object
+	/// (which is left bound as read framebuffer to read back the planes, previous bindings are restored by readFrame)
+	bool convertOnGpu(int x, int y);
+
+	/// Delete the GPU conversion textures, framebuffer and shaders
+	void releaseGpuConversion();
+
+	/// Transmit a whole read back frame to the ffmpeg process (converting it first if the conversion is done by the CPU)
+	/// pts is its capture time in milliseconds (-1 if the session is not timestamped)
+	void writeFrame(const void* data, size_t size, long long pts);
+
+	/// Start the asynchronous read back of the current frame (captured at pts) into the next pixel buffer object of the ring
+	/// and send the older frames whose fences have already signaled
+	void readbackAsync(int x, int y, long long pts);
+
+	/// Map the oldest pending pixel buffer object and send it to ffmpeg.
+	/// If wait is false, return false without blocking when its fence has not signaled yet.
+	bool sendPendingFrame(bool wait);
+
+	/// Send all the pending frames of the pixel buffer objects ring then delete it
+	void releaseReadbackRing();
+
+	/// Read back the current frame of the shutter of the next output frame and add it to the blur sums.
+	/// If output, it is the output frame (captured at pts) : the average of the sums is written.
+	void blurFrame(int x, int y, bool output, long long pts);
+
+	/// Stop the current session : drain the read back ring, then close its writer thread and its ffmpeg process or libav encoder,
+	/// waiting for the file to be fully written or handing it to the reaper thread
+	void endSession(bool wait);
+
 public:
     // constructor/destructor
-    FFmpegVideoRecorderProcess(std::string path = "./");
+    FFmpegVideoRecorderProcess(std::string path = "./", BACKEND backend = BACKEND::PIPE);
     virtual ~FFmpegVideoRecorderProcess();
 
+	/// The libx264 preset name of a PRESET
+	static const char* presetName(PRESET preset);
+
+	/// The libavcodec encoder name of a CODEC
+	static const char* codecName(CODEC codec);
+
+	/// Is pixFmt (piped to ffmpeg) a 10 bits format (p010le or yuv420p10le)
+	static bool highBitDepth(const std::string& pixFmt);
+
+	/// The ffmpeg output options applying the codec, the preset, the quality (crf or lossless), the bitrate settings and the output
+	/// pixel format (yuv420p, or yuv420p10le with the 10 bits profile of the codec if highBitDepth)
+	/// (shared by the ffmpeg command line, the libav backend and the offline tools)
+	static std::string encodingArguments(PRESET preset, unsigned int crf, bool lossless, const Bitrate& bitrate,
+										 CODEC codec = CODEC::H264, bool highBitDepth = false);
+
 	/// append PATH environnement variable (to find ffmpeg executable)
     void appendEnvVarPath(std::string envVarPath);
     
@@ -139,6 +301,30 @@ public:
 	/// The way to handle the resulted encoded video (FASTEST=>faster encoding : BEST_COMPRESSION very slow encoding)
 	PRESET getPreset();
 	
+	/// Adapt the preset and the crf to the measured encoder throughput instead of keeping setPreset() and setQuality() (see PresetController) :
+	/// the encoding gets faster as soon as it falls behind the capture (writes to the encoder blocked longer than a frame period, writer queue
+	/// filling up, frames dropped), and slower presets are tried for a better compression while it keeps up easily. The levels go from fastest
+	/// to slowest, starting at getPreset() with getQuality(), and the crf is raised up to maxCrfRaise once the fastest preset is not enough
+	/// (not with lossless). With SEGMENTS the encoder is replaced at a keyframe boundary by one of the new level (its first segment is a
+	/// discontinuity of the playlist), otherwise the level measured over a video is used by the next one. The renditions keep their preset.
+	/// Only taken into account at the next init(), the level reached is kept across the videos while these settings do not change.
+	void adaptivePreset(bool adaptive, PRESET fastest = PRESET::FASTEST_ENCODING, PRESET slowest = PRESET::BEST_COMPRESSION, unsigned int maxCrfRaise = 6);
+
+	/// Do the preset and the crf follow the measured encoder throughput
+	bool adaptivePreset();
+
+	/// Preset of the adaptive level : the one of the current encoder, or the one the next video starts with (getPreset() if not adaptive)
+	PRESET getAdaptivePreset();
+
+	/// Crf of the adaptive level (getQuality() if not adaptive)
+	unsigned int getAdaptiveQuality();
+
+	/// The codec of the next videos (H264 [default] or H265), in 10 bits with the CPU_P010 and CPU_YUV420P10 conversions
+	void setCodec(CODEC codec);
+
+	/// The codec of the next videos
+	CODEC getCodec();
+
 	/// Do not lost data information => induce biger result file size
 	/// If set to true, the quality crf will not be used (for letting ffmpeg auto set it according to selected pixel format)
 	void lossless(bool qp);
@@ -156,6 +342,189 @@ public:
 	/// If one of params is set to 0, the specific param will be not used
 	void setBitrate(unsigned int& bufsize, unsigned int& maxrate, unsigned int& minrate, unsigned int& bitrate, bool use);
 
+	/// Read back the frames asynchronously through a ring of ringSize pixel buffer objects guarded by fences (OpenGL 3.2 or ARB_sync).
+	/// capture() does not stall on glReadPixels anymore : a frame is sent to ffmpeg once its fence has signaled (at most ringSize-1 captures later).
+	/// finish() drains the ring, so it has to be called while the OpenGL context is current.
+	void asyncReadback(bool async, unsigned int ringSize = 3);
+
+	/// Do capture() read back the frames asynchronously through a ring of pixel buffer objects
+	bool asyncReadback();
+
+	/// The encoder receiving the captured frames (chosen at construction)
+	BACKEND getBackend();
+
+	/// Choose how the frames are piped to ffmpeg (STDIO [default], WRITEV or VMSPLICE, both Linux only).
+	/// pipeSize is the requested pipe capacity in bytes (0 for one frame), capped by /proc/sys/fs/pipe-max-size for unprivileged users.
+	/// Frames go through writev instead of vmsplice when they come from the writer thread queue or a mapped pixel buffer object.
+	/// Only taken into account at the next init().
+	void setTransport(TRANSPORT transport, size_t pipeSize = 0);
+
+	/// How the frames are piped to ffmpeg
+	TRANSPORT getTransport();
+
+	/// Choose where the frames are converted to YUV 4:2:0 : by ffmpeg (NONE [default]), by a shader before the read back (GPU_*, needs OpenGL 3.2)
+	/// or by a SIMD kernel between the read back and the pipe (CPU_*, does not touch any OpenGL state).
+	/// Converting before the pipe cut by 2.67 the bytes piped (and read back for GPU_*). Only taken into account at the next init().
+	/// CPU_P010 and CPU_YUV420P10 keep 10 bits per channel (instead of 8 bytes per pixel of a half float read back, 3 are piped),
+	/// the renditions and the motion blur of setOutputFrameRate() need 8 bits frames and are not done with them.
+	void setConversion(CONVERSION conversion);
+
+	/// Where the frames are converted to YUV 4:2:0
+	CONVERSION getConversion();
+
+	/// Write the frames to ffmpeg from a dedicated thread instead of capture(), so a slow encoder does not block the render loop.
+	/// The thread is fed by a queue of queueDepth preallocated frames, the policy tells what to do when the queue is full.
+	/// Only taken into account at the next init().
+	void threadedWriter(bool threaded, unsigned int queueDepth = 4, OVERFLOW_POLICY policy = OVERFLOW_POLICY::BLOCK);
+
+	/// Do the frames are written to ffmpeg from a dedicated thread
+	bool threadedWriter();
+
+	/// Convert (CPU_* conversions) and pipe the frames on a worker pool shared with other recorders (see FFmpegVideoRecorderManager)
+	/// instead of capture() or a dedicated writer thread. The frames go through a queue of the threadedWriter() depth and policy.
+	/// The writes to the sink are blocking tasks of the pool : a stalled consumer holds at most one of its WorkerPool::maxBlocking() workers.
+	/// The pool is not owned and has to outlive the recorder. nullptr [default] to stop using it. Only taken into account at the next init().
+	void setWorkerPool(WorkerPool* pool);
+
+	/// The worker pool converting and piping the frames (nullptr if none)
+	WorkerPool* getWorkerPool();
+
+	/// Run the frames through a staged pipeline (see CapturePipeline) instead of the writer thread or worker pool : capture() only reads
+	/// the frame back, then the transform stage (setFrameTransform, duplicate hash, CPU_* conversion) runs on up to transformThreads frames
+	/// at once (0 : one per hardware thread) on a work-stealing pool, and the write stage gives them to the sink in capture order.
+	/// frames : frames in flight (0 : transformThreads + 2), the threadedWriter() policy tells what to do when all are (DROP_OLDEST drops the new one).
+	/// finish() waits for the frames in flight. Only taken into account at the next init().
+	void pipelinedCapture(bool pipelined, unsigned int transformThreads = 0, unsigned int frames = 0);
+
+	/// Do the frames go through the staged pipeline
+	bool pipelinedCapture();
+
+	/// Function run on each frame read back (rgba, or yuv converted on the GPU) before its conversion, in the transform stage
+	/// of the pipelined capture (from the pool threads, several frames at once). An empty function [default] for none.
+	void setFrameTransform(std::function<void(unsigned char* frame, size_t size, long long pts)> transform);
+
+	/// Record an extra video of the same capture at another resolution and quality (e.g. a low resolution preview next to a full
+	/// resolution archive) without reading the frames back twice : each frame read back is resampled on the CPU (SIMD box filter,
+	/// see ColorConversion::resizeRgba) into the queue of the rendition (threadedWriter() depth and policy), whose writer thread pipes
+	/// it to its own ffmpeg process (or libav encoder). width or height 0 keeps the aspect ratio of the capture (made even).
+	/// The video is named baseFileName (default : the output base file name + "<width>x<height>_") with the number of the main video,
+	/// in outputPath (default : the output path). The renditions need the frames read back in rgba (not with the GPU_* conversions).
+	/// Only taken into account at the next init(). Return the index of the rendition.
+	unsigned int addRendition(int width, int height, PRESET preset, unsigned int crf, std::string outputPath = "", std::string baseFileName = "");
+
+	/// Remove all the renditions (from the next init())
+	void clearRenditions();
+
+	/// Output video file paths of the renditions of the current (or last) session
+	std::vector<std::string> getRenditionFilePaths();
+
+	/// Statistics of the renditions since the recorder creation (frames resampled, dropped and written, resampling and write latency)
+	CaptureStats getRenditionStats();
+
+	/// Write the video as a fragmented mp4 or as rolling segments instead of a single mp4, for long (24/7) captures.
+	/// The fragments start with a keyframe forced every 2 seconds (every second if segmentSeconds is odd).
+	/// SEGMENTS : the output video file is an m3u8 playlist, a segment is cut between two fragments before it lasts more than segmentSeconds (0 : 60)
+	/// or before it exceeds maxSegmentBytes (0 : no limit), and only the keepSegments last completed segments are kept on disk (0 : all).
+	/// The encoder is never restarted and no frame is dropped. SEGMENTS needs named pipes (POSIX), otherwise FRAGMENTED is used.
+	/// Discard the standby process of warmUp(). Only taken into account at the next init().
+	void setSegmentation(SEGMENTATION mode, unsigned int segmentSeconds = 60, size_t maxSegmentBytes = 0, unsigned int keepSegments = 0);
+
+	/// How the encoded video is written to the disk
+	SEGMENTATION getSegmentation();
+
+	/// Choose where the frames go : encoded into a video [default], written raw to a file, discarded, or published in a shared memory ring
+	/// named "/" + getOutputFileName() (one per session, see SharedMemoryRing for the consumer side).
+	/// frames : slots of the shared memory ring (default 4), frames preallocated at once by the mapped file (default 64)
+	/// or frames between two keyframes of the compressed file (default 2 seconds), 0 for the default.
+	/// Only the ENCODER sink is segmented or uses a standby process. Only taken into account at the next init().
+	void setSink(SINK sink, unsigned int frames = 0);
+
+	/// Where the frames go
+	SINK getSink();
+
+	/// Give the frames to a custom sink instead of the SINK ones : the factory creates the sink of each session from the format of its frames
+	/// and its output file path name (reserved, with the extension of the current SINK), and returns nullptr if it failed.
+	/// The recorder owns and deletes the sinks. An empty function [default] to stop using it. Only taken into account at the next init().
+	void setSinkFactory(std::function<FrameSink*(const FrameSink::Format& format, const std::string& filePath)> factory);
+
+	/// Statistics of the capture pipeline since the recorder creation : frames captured, skipped, dropped and written, bytes piped,
+	/// read back, conversion and write latency histograms, writer queue depth and encoder backpressure events.
+	/// Recorded with relaxed atomic counters (no lock while capturing), it can be called from any thread :
+	/// poll it periodically and look at stats.since(previousStats) to alert when the capture falls behind.
+	CaptureStats getStats();
+
+	/// Number of frames skipped by the timestamped capture drop policy or dropped by the writer thread queue overflow policy since the last init()
+	unsigned long long droppedFrames();
+
+	/// Frame rate of the video when the frames are not timestamped (default 25). Only taken into account at the next init().
+	void setFrameRate(unsigned int fps);
+
+	/// Frame rate of the video when the frames are not timestamped
+	unsigned int getFrameRate();
+
+	/// Timestamp each frame when capture() is called and encode it at that time, so the video plays at wall-clock speed
+	/// whatever the render loop rate or its stutters (variable frame rate, piped to ffmpeg in a NUT stream).
+	/// Frames captured closer than 1/maxFrameRate (0 : no limit) are skipped before any read back. With the threaded writer,
+	/// frames are also skipped evenly while its queue is more than half full instead of being dropped by the overflow policy.
+	/// Only taken into account at the next init().
+	void timestampedCapture(bool timestamped, unsigned int maxFrameRate = 0);
+
+	/// Are the frames timestamped when captured
+	bool timestampedCapture();
+
+	/// Sample the render loop at fps output frames per second on the monotonic clock, whatever the render rate (e.g. a 30 fps video
+	/// of a 144 fps render loop) : capture() returns at once, without touching OpenGL, on the frames the output timeline does not need,
+	/// and the first frame captured at or after each output time is encoded at that time (implies timestamped frames, see timestampedCapture).
+	/// shutter in [0:1] : fraction of an output period before each output time whose frames are read back too and averaged
+	/// into the output frame (motion blur, read back synchronously), 0 for none. fps 0 [default] to keep every frame captured.
+	/// Only taken into account at the next init().
+	void setOutputFrameRate(unsigned int fps, float shutter = 0.f);
+
+	/// Output frames per second of the scheduler (0 if every frame captured is kept)
+	unsigned int getOutputFrameRate();
+
+	/// Skip the frames identical to the previous one (compared by a SIMD hash of the read back frame, see FrameHash) :
+	/// they are neither converted, piped nor encoded and the previous frame lasts until the next different one in the video.
+	/// Implies timestamped frames (see timestampedCapture). A duplicate frame is still sent if the last frame sent is
+	/// older than maxDurationMs, so a static scene keeps a frame every maxDurationMs (and at most that is lost at the end).
+	/// Only taken into account at the next init().
+	void skipDuplicateFrames(bool skip, unsigned int maxDurationMs = 1000);
+
+	/// Are the frames identical to the previous one skipped
+	bool skipDuplicateFrames();
+
+	/// Number of frames skipped as duplicates since the last init()
+	unsigned long long duplicateFrames();
+
+	/// Ratio of the frames skipped as duplicates over the frames checked since the last init() (0 if none)
+	double duplicateFrameRatio();
+
+	/// finish() returns immediately if true : the remaining frames are encoded and the file completed by a reaper thread
+	/// (see isFileWritten, waitFileWritten and setFileWrittenCallback). Otherwise [default] finish() waits for it.
+	/// A video stopped by a resolution change in capture() is always completed by the reaper thread.
+	void asyncFinish(bool async);
+
+	/// Do finish() return without waiting for the file to be written
+	bool asyncFinish();
+
+	/// Called (from the reaper thread, or from finish() if it waits) once the file of a finished video is fully written
+	void setFileWrittenCallback(std::function<void(const std::string& filePath)> callback);
+
+	/// Is the video file fully written (false while it is recorded or completed by the reaper thread). Empty path for all the videos.
+	bool isFileWritten(const std::string& filePath);
+
+	/// Wait (at most timeoutMs, or forever if negative) for the file of a finished video to be fully written. Empty path for all the videos.
+	/// Return false on timeout.
+	bool waitFileWritten(const std::string& filePath, int timeoutMs = -1);
+
+	/// Prepare the next init() to start recording without delay : resolve ffmpeg (once for the process), map the frame buffers,
+	/// reserve the output file and spawn a standby ffmpeg process for this resolution and the current settings.
+	/// init() (or the first capture()) hands it over if nothing changed meanwhile, otherwise it is discarded.
+	bool warmUp(int width, int height);
+
+	/// Discard the standby ffmpeg process of warmUp() (if any)
+	void coolDown();
+
 	/// resume all plausible common params for quick setting in 1 function call
 	void init(int width, int height, std::string outputPath, std::string baseFileName, bool overWriteFile, PRESET preset, unsigned int crfQuality);
 	
@@ -168,6 +537,15 @@ public:
 	/// catch renderer opengl frame buffer and transmit to ffmpeg process
     virtual void capture(int width, int height, int x = 0, int y = 0);
 
+	/// capture() reading the color attachment colorAttachment (GL_COLOR_ATTACHMENT0 + colorAttachment) of the framebuffer object
+	/// framebuffer instead of the bound read framebuffer, so an offscreen (or windowless) renderer does not have to blit its frame
+	/// into the default framebuffer. Bound only during the read back (asynchronous too), the renderer bindings are left as they were.
+	virtual void captureFramebuffer(GLuint framebuffer, unsigned int colorAttachment, int width, int height, int x = 0, int y = 0);
+
+	/// capture() reading the level 0 of the 2D texture texture (a normalized color format), through a framebuffer object of ours.
+	/// The GPU conversion samples it directly (no copy) if it has no mipmap filtering.
+	virtual void captureTexture(GLuint texture, int width, int height);
+
 	/// stop the video capture and delete buffer and close ffmpeg process
     virtual void finish();
 };
@@ -175,6 +553,7 @@ public:
 
 
 /** The sinfleton version of FFmpegVideoRecorderProcess, to ease the use of it in a simple context
+* (FFmpegVideoRecorderProcess has no shared state : several recorders can be used at once, see FFmpegVideoRecorderManager)
 *
 * Example:
 * key::videoRecord ? 
@@ -0,0 +1,241 @@
+#include "FrameBufferPool.h"
+
+#include <iostream>
+
+#ifdef WIN32
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+	#include <unistd.h>
+#endif
+
+static const size_t HUGE_PAGE_SIZE = 2 << 20; // 2 MiB, the common x86-64 huge page
+
+
+//===========================================================================================================
+
+FrameBufferPool& FrameBufferPool::Get()
+{
+	static FrameBufferPool pool;
+	return pool;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+FrameBufferPool::FrameBufferPool()
+	: mHugePages(HUGE_PAGES::NONE), mMaxCached(size_t(1) << 30), mMapped(0), mCached(0), mHighWaterMark(0)
+{
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+FrameBufferPool::~FrameBufferPool()
+{
+	for(auto& buffer : mBuffers)
+		unmap(buffer.first, buffer.second);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+unsigned char* FrameBufferPool::acquire(size_t size)
+{
+	if(size == 0) size = 1;
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	// best fit in cache, but do not waste a buffer more than twice bigger
+	auto cached = mCache.lower_bound(size);
+	if(cached != mCache.end() && cached->first <= 2 * size)
+	{
+		unsigned char* buffer = cached->second;
+		mCached -= cached->first;
+		mCache.erase(cached);
+		return buffer;
+	}
+
+	size_t	capacity = size;
+	bool	huge	 = false;
+	unsigned char* buffer = map(capacity, huge);
+	if(buffer == nullptr)
+	{
+		std::cerr<<"[FrameBufferPool] failed to map "<<size<<" bytes"<<std::endl;
+		return nullptr;
+	}
+	Buffer info = { capacity, huge };
+	mBuffers[buffer] = info;
+	mMapped += capacity;
+	if(mMapped > mHighWaterMark)
+		mHighWaterMark = mMapped;
+	return buffer;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FrameBufferPool::release(void* buffer)
+{
+	if(buffer == nullptr) return;
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	auto found = mBuffers.find(static_cast<unsigned char*>(buffer));
+	if(found == mBuffers.end())
+	{
+		std::cerr<<"[FrameBufferPool] release of a buffer not coming from the pool"<<std::endl;
+		return;
+	}
+	if(mCached + found->second.capacity <= mMaxCached)
+	{
+		mCache.insert(std::make_pair(found->second.capacity, found->first));
+		mCached += found->second.capacity;
+	}
+	else
+	{
+		mMapped -= found->second.capacity;
+		unmap(found->first, found->second);
+		mBuffers.erase(found);
+	}
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FrameBufferPool::trim()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	for(auto& cached : mCache)
+	{
+		auto found = mBuffers.find(cached.second);
+		mMapped -= found->second.capacity;
+		unmap(found->first, found->second);
+		mBuffers.erase(found);
+	}
+	mCache.clear();
+	mCached = 0;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FrameBufferPool::setHugePages(HUGE_PAGES hugePages)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mHugePages = hugePages;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+FrameBufferPool::HUGE_PAGES FrameBufferPool::getHugePages()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mHugePages;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FrameBufferPool::setMaxCachedBytes(size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mMaxCached = bytes;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+size_t FrameBufferPool::getMaxCachedBytes()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mMaxCached;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+size_t FrameBufferPool::mappedBytes()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mMapped;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+size_t FrameBufferPool::inUseBytes()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mMapped - mCached;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+size_t FrameBufferPool::highWaterMark()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mHighWaterMark;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FrameBufferPool::resetHighWaterMark()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mHighWaterMark = mMapped;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+unsigned char* FrameBufferPool::map(size_t& capacity, bool& huge)
+{
+	huge = false;
+#ifdef WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	size_t page = info.dwPageSize;
+	if(mHugePages == HUGE_PAGES::EXPLICIT && GetLargePageMinimum() > 0) // needs the SeLockMemoryPrivilege
+	{
+		size_t large = GetLargePageMinimum();
+		size_t hugeCapacity = (capacity + large - 1) / large * large;
+		void* buffer = VirtualAlloc(nullptr, hugeCapacity, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+		if(buffer != nullptr)
+		{
+			capacity = hugeCapacity;
+			huge	 = true;
+			return static_cast<unsigned char*>(buffer);
+		}
+	}
+	capacity = (capacity + page - 1) / page * page;
+	return static_cast<unsigned char*>(VirtualAlloc(nullptr, capacity, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+#else
+	size_t page = size_t(sysconf(_SC_PAGESIZE));
+	#ifdef MAP_HUGETLB
+	if(mHugePages == HUGE_PAGES::EXPLICIT)
+	{
+		size_t hugeCapacity = (capacity + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+		void* buffer = mmap(nullptr, hugeCapacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if(buffer != MAP_FAILED)
+		{
+			capacity = hugeCapacity;
+			huge	 = true;
+			return static_cast<unsigned char*>(buffer);
+		}
+		// no huge pages reserved (vm.nr_hugepages) : regular pages
+	}
+	#endif
+	if(mHugePages != HUGE_PAGES::NONE && capacity >= HUGE_PAGE_SIZE)
+		capacity = (capacity + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE; // let the whole buffer be covered by huge pages
+	else
+		capacity = (capacity + page - 1) / page * page;
+	void* buffer = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(buffer == MAP_FAILED)
+		return nullptr;
+	#ifdef MADV_HUGEPAGE
+	if(mHugePages != HUGE_PAGES::NONE)
+		madvise(buffer, capacity, MADV_HUGEPAGE);
+	#endif
+	return static_cast<unsigned char*>(buffer);
+#endif
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FrameBufferPool::unmap(unsigned char* buffer, const Buffer& info)
+{
+#ifdef WIN32
+	(void)info;
+	VirtualFree(buffer, 0, MEM_RELEASE);
+#else
+	munmap(buffer, info.capacity);
+#endif
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+
+
+/**
+* Process wide pool of page-aligned frame buffers, shared by every recorder instance.
+*
+* init()/finish() (and so every restart due to a resolution change) acquire and release their frame buffers here :
+* released buffers are cached and handed back to the next acquire of a fitting size instead of going back to the OS.
+* Buffers are mapped straight from the OS (page-aligned, suitable for zero-copy transports),
+* optionally backed by transparent or explicit huge pages.
+*
+* The high-water mark (peak of bytes mapped, in use or cached) helps to budget RAM on long-running capture nodes.
+*
+* Example:
+* FrameBufferPool::Get().setHugePages(FrameBufferPool::HUGE_PAGES::TRANSPARENT);
+* FrameBufferPool::Get().setMaxCachedBytes(256 << 20);
+* ... record ...
+* std::cout << FrameBufferPool::Get().highWaterMark() << std::endl;
+*/
+class FrameBufferPool
+{
+public:
+	/// How the buffers are backed
+	enum class HUGE_PAGES
+	{
+		NONE,			///< regular pages [default]
+		TRANSPARENT,	///< regular mapping advised to use transparent huge pages (Linux madvise MADV_HUGEPAGE)
+		EXPLICIT		///< reserved huge pages (Linux MAP_HUGETLB, Windows MEM_LARGE_PAGES), falling back to regular pages if none available
+	};
+
+	/// The shared pool
+	static FrameBufferPool& Get();
+
+	/// Get a page-aligned buffer of at least size bytes (a cached one if any fits)
+	unsigned char* acquire(size_t size);
+
+	/// Give back a buffer from acquire() (cached for reuse unless the cache limit is reached)
+	void release(void* buffer);
+
+	/// Free all the cached buffers
+	void trim();
+
+	/// Back the next mapped buffers with huge pages
+	void setHugePages(HUGE_PAGES hugePages);
+	HUGE_PAGES getHugePages();
+
+	/// Maximum bytes kept in cache by release() [default 1 GiB]
+	void setMaxCachedBytes(size_t bytes);
+	size_t getMaxCachedBytes();
+
+	/// Bytes currently mapped (in use + cached)
+	size_t mappedBytes();
+
+	/// Bytes currently handed out by acquire()
+	size_t inUseBytes();
+
+	/// Peak of mappedBytes() since creation or the last resetHighWaterMark()
+	size_t highWaterMark();
+	void resetHighWaterMark();
+
+protected:
+	FrameBufferPool();
+	virtual ~FrameBufferPool();
+
+	struct Buffer
+	{
+		size_t	capacity;	///< mapped bytes (rounded to the page size)
+		bool	huge;		///< mapped with explicit huge pages
+	};
+
+	/// Map / unmap from the OS
+	unsigned char*	map(size_t& capacity, bool& huge);
+	void			unmap(unsigned char* buffer, const Buffer& info);
+
+protected:
+	std::mutex								mMutex;
+	HUGE_PAGES								mHugePages;
+	size_t									mMaxCached;
+	std::map<unsigned char*, Buffer>		mBuffers;	///< every mapped buffer
+	std::multimap<size_t, unsigned char*>	mCache;		///< released buffers by capacity
+	size_t									mMapped;
+	size_t									mCached;
+	size_t									mHighWaterMark;
+};
@@ -0,0 +1,352 @@
+#include "FrameCodec.h"
+
+#include <cstring>	// memcpy, memcmp
+#include <algorithm>
+#include <thread>
+
+static const char gMagic[4] = "VCQ";
+
+// QOI operations (https://qoiformat.org/qoi-specification.pdf)
+static const unsigned char OP_INDEX	= 0x00;	///< 00iiiiii : index of a recently seen pixel
+static const unsigned char OP_DIFF	= 0x40;	///< 01rrggbb : r, g and b differences with the previous pixel in [-2, 1]
+static const unsigned char OP_LUMA	= 0x80;	///< 10gggggg rrrrbbbb : g difference in [-32, 31], r and b ones relative to it in [-8, 7]
+static const unsigned char OP_RUN	= 0xC0;	///< 11rrrrrr : the previous pixel repeated 1 to 62 times
+static const unsigned char OP_RGB	= 0xFE;	///< r, g, b follow (same a)
+static const unsigned char OP_RGBA	= 0xFF;	///< r, g, b, a follow
+static const size_t MAX_RUN			= 62;
+
+//------------------------------------------------------------------------------------------------------------
+
+static inline unsigned int load32(const unsigned char* p)			{ unsigned int v; std::memcpy(&v, p, 4); return v; }
+static inline unsigned long long load64(const unsigned char* p)	{ unsigned long long v; std::memcpy(&v, p, 8); return v; }
+static inline void store32(unsigned char* p, unsigned int v)		{ std::memcpy(p, &v, 4); }
+
+// byte wise a - b and a + b of the 4 bytes of a pixel (modulo 256, without carry between the bytes)
+static const unsigned int HIGH = 0x80808080u;
+static inline unsigned int subBytes(unsigned int a, unsigned int b) { return ((a | HIGH) - (b & ~HIGH)) ^ ((a ^ ~b) & HIGH); }
+static inline unsigned int addBytes(unsigned int a, unsigned int b) { return ((a & ~HIGH) + (b & ~HIGH)) ^ ((a ^ b) & HIGH); }
+
+static inline unsigned int channel(unsigned int pixel, int c)	{ return (pixel >> (8 * c)) & 0xFF; }
+static inline unsigned int hashIndex(unsigned int pixel)
+{
+	return (channel(pixel, 0) * 3 + channel(pixel, 1) * 5 + channel(pixel, 2) * 7 + channel(pixel, 3) * 11) % 64;
+}
+static inline unsigned int makePixel(unsigned int r, unsigned int g, unsigned int b, unsigned int a)
+{
+	return (r & 0xFF) | ((g & 0xFF) << 8) | ((b & 0xFF) << 16) | ((a & 0xFF) << 24);
+}
+
+static inline unsigned char* putRun(unsigned char* out, size_t run)
+{
+	for(; run > 0; run -= std::min(run, MAX_RUN))
+		*out++ = (unsigned char)(OP_RUN | (std::min(run, MAX_RUN) - 1));
+	return out;
+}
+
+
+//===========================================================================================================
+
+FrameCodec::FrameCodec(unsigned int stripes, unsigned int keyframeInterval)
+	: mStripes(stripes != 0 ? stripes : std::max(std::thread::hardware_concurrency(), 1u)), mKeyframeInterval(keyframeInterval), mFrames(0)
+{
+	mStripeData.resize(mStripes);
+	mStripeSize.resize(mStripes);
+	if(mStripes > 1)
+	{
+		mPool.reset(new WorkerPool(mStripes));
+		for(unsigned int i = 0; i < mStripes; i++)
+			mStrands.emplace_back(new WorkerPool::Strand(*mPool));
+	}
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+FrameCodec::~FrameCodec()
+{
+	mStrands.clear(); // before their pool
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+size_t FrameCodec::encode(const unsigned char* frame, size_t size, std::vector<unsigned char>& out)
+{
+	bool keyframe = mReference.size() != size || mKeyframeInterval == 1 || (mKeyframeInterval != 0 && mFrames >= mKeyframeInterval);
+	if(keyframe)
+	{
+		mFrames = 0;
+		mReference.resize(mKeyframeInterval != 1 ? size : 0);
+	}
+	const unsigned char* reference = keyframe ? nullptr : mReference.data();
+	bool keepReference = mKeyframeInterval != 1;
+	size_t pixels = size / 4;
+
+	forEachStripe(mStripes, [&](unsigned int i)
+	{
+		size_t first, last;
+		stripeRange(i, mStripes, pixels, first, last);
+		std::vector<unsigned char>& data = mStripeData[i];
+		if(data.size() < (last - first) * 5)
+			data.resize((last - first) * 5); // only grows : the worst case is a OP_RGBA per pixel
+		mStripeSize[i] = encodeStripe(frame + 4 * first, reference != nullptr ? reference + 4 * first : nullptr, last - first, data.data());
+		if(keepReference) // the reference of the next frame
+			std::memcpy(mReference.data() + 4 * first, frame + 4 * first, 4 * (last - first));
+	});
+
+	// header, stripe sizes, stripes, then the bytes left of a size not a multiple of 4
+	size_t tail		= size - pixels * 4;
+	size_t total	= sizeof(FrameHeader) + mStripes * sizeof(unsigned int) + tail;
+	for(size_t stripeSize : mStripeSize)
+		total += stripeSize;
+	if(out.size() < total)
+		out.resize(total);
+	FrameHeader header;
+	std::memcpy(header.magic, gMagic, sizeof(gMagic));
+	header.flags	= keyframe ? KEYFRAME : 0;
+	header.size		= size;
+	header.stripes	= mStripes;
+	header.sequence	= mFrames;
+	unsigned char* o = out.data();
+	std::memcpy(o, &header, sizeof(header));
+	o += sizeof(header);
+	for(size_t stripeSize : mStripeSize)
+	{
+		unsigned int bytes = (unsigned int)stripeSize;
+		std::memcpy(o, &bytes, sizeof(bytes));
+		o += sizeof(bytes);
+	}
+	for(unsigned int i = 0; i < mStripes; i++)
+	{
+		std::memcpy(o, mStripeData[i].data(), mStripeSize[i]);
+		o += mStripeSize[i];
+	}
+	std::memcpy(o, frame + pixels * 4, tail);
+	if(keepReference)
+		std::memcpy(mReference.data() + pixels * 4, frame + pixels * 4, tail);
+	out.resize(total);
+	mFrames++;
+	return total;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool FrameCodec::decode(const unsigned char* data, size_t size, std::vector<unsigned char>& frame)
+{
+	FrameHeader header;
+	if(size < sizeof(header))
+		return false;
+	std::memcpy(&header, data, sizeof(header));
+	if(std::memcmp(header.magic, gMagic, sizeof(gMagic)) != 0 || header.stripes == 0
+	   || size < sizeof(header) + header.stripes * sizeof(unsigned int) + header.size % 4)
+		return false;
+	bool keyframe = (header.flags & KEYFRAME) != 0;
+	if(!keyframe && (frame.size() != header.size || header.sequence != mFrames))
+		return false; // not the frame following the previous one
+	if(keyframe)
+		frame.resize(size_t(header.size));
+
+	// offset of each stripe
+	std::vector<size_t> offsets(header.stripes + 1);
+	offsets[0] = sizeof(header) + header.stripes * sizeof(unsigned int);
+	for(unsigned int i = 0; i < header.stripes; i++)
+	{
+		unsigned int bytes;
+		std::memcpy(&bytes, data + sizeof(header) + i * sizeof(unsigned int), sizeof(bytes));
+		offsets[i + 1] = offsets[i] + bytes;
+	}
+	size_t pixels	= size_t(header.size / 4);
+	size_t tail		= size_t(header.size) - pixels * 4;
+	if(offsets[header.stripes] + tail != size)
+		return false;
+
+	std::vector<char> decoded(header.stripes, 0);
+	forEachStripe(header.stripes, [&](unsigned int i)
+	{
+		size_t first, last;
+		stripeRange(i, header.stripes, pixels, first, last);
+		decoded[i] = decodeStripe(data + offsets[i], offsets[i + 1] - offsets[i], !keyframe, last - first, frame.data() + 4 * first);
+	});
+	std::memcpy(frame.data() + pixels * 4, data + offsets[header.stripes], tail);
+
+	bool ok	= std::find(decoded.begin(), decoded.end(), 0) == decoded.end();
+	mFrames	= ok ? header.sequence + 1 : 0;
+	return ok;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FrameCodec::reset()
+{
+	mFrames = 0;
+	mReference.clear();
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool FrameCodec::isKeyframe(const unsigned char* data, size_t size)
+{
+	FrameHeader header;
+	if(size < sizeof(header)) return false;
+	std::memcpy(&header, data, sizeof(header));
+	return (header.flags & KEYFRAME) != 0;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+size_t FrameCodec::maxEncodedSize(size_t size, unsigned int stripes)
+{
+	return sizeof(FrameHeader) + stripes * sizeof(unsigned int) + size / 4 * 5 + size % 4;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FrameCodec::stripeRange(unsigned int i, unsigned int stripes, size_t pixels, size_t& first, size_t& last)
+{
+	// multiples of 16 pixels (a cache line of rgba) except the end of the last stripe
+	first	= pixels * i / stripes / 16 * 16;
+	last	= i + 1 == stripes ? pixels : pixels * (i + 1) / stripes / 16 * 16;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FrameCodec::forEachStripe(unsigned int count, const std::function<void(unsigned int)>& task)
+{
+	if(mStrands.empty())
+	{
+		for(unsigned int i = 0; i < count; i++)
+			task(i);
+		return;
+	}
+	for(unsigned int i = 0; i < count; i++)
+		mStrands[i % mStrands.size()]->post([&task, i]() { task(i); });
+	for(std::unique_ptr<WorkerPool::Strand>& strand : mStrands)
+		strand->wait();
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+size_t FrameCodec::encodeStripe(const unsigned char* frame, const unsigned char* reference, size_t pixels, unsigned char* out)
+{
+	unsigned int index[64] = {0};
+	unsigned int previous = 0;
+	unsigned char* o = out;
+	size_t run = 0;
+	for(size_t i = 0; i < pixels; i++)
+	{
+		unsigned int pixel = load32(frame + 4 * i);
+		if(reference != nullptr)
+			pixel = subBytes(pixel, load32(reference + 4 * i));
+		if(pixel == previous)
+		{
+			run++;
+			if(pixel == 0 && reference != nullptr)
+			{
+				// still part of the scene : skip the unchanged pixels 2 at a time
+				size_t next = i + 1;
+				while(next + 2 <= pixels && load64(frame + 4 * next) == load64(reference + 4 * next))
+					next += 2;
+				run	+= next - (i + 1);
+				i	= next - 1;
+			}
+			continue;
+		}
+		o	= putRun(o, run);
+		run	= 0;
+
+		unsigned int h = hashIndex(pixel);
+		if(index[h] == pixel)
+			*o++ = (unsigned char)(OP_INDEX | h);
+		else
+		{
+			index[h] = pixel;
+			int dr = (signed char)(channel(pixel, 0) - channel(previous, 0));
+			int dg = (signed char)(channel(pixel, 1) - channel(previous, 1));
+			int db = (signed char)(channel(pixel, 2) - channel(previous, 2));
+			int drg = dr - dg, dbg = db - dg;
+			if(channel(pixel, 3) != channel(previous, 3))
+			{
+				o[0] = OP_RGBA;
+				store32(o + 1, pixel);
+				o += 5;
+			}
+			else if(dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+				*o++ = (unsigned char)(OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+			else if(dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7)
+			{
+				o[0] = (unsigned char)(OP_LUMA | (dg + 32));
+				o[1] = (unsigned char)((drg + 8) << 4 | (dbg + 8));
+				o += 2;
+			}
+			else
+			{
+				o[0] = OP_RGB;
+				o[1] = (unsigned char)channel(pixel, 0);
+				o[2] = (unsigned char)channel(pixel, 1);
+				o[3] = (unsigned char)channel(pixel, 2);
+				o += 4;
+			}
+		}
+		previous = pixel;
+	}
+	o = putRun(o, run);
+	return size_t(o - out);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool FrameCodec::decodeStripe(const unsigned char* data, size_t size, bool delta, size_t pixels, unsigned char* frame)
+{
+	unsigned int index[64] = {0};
+	unsigned int pixel = 0;
+	const unsigned char* in		= data;
+	const unsigned char* end	= data + size;
+	for(size_t i = 0; i < pixels; )
+	{
+		if(in >= end)
+			return false;
+		unsigned char op = *in++;
+		size_t run = 1;
+		if(op == OP_RGB || op == OP_RGBA)
+		{
+			size_t bytes = op == OP_RGB ? 3 : 4;
+			if(size_t(end - in) < bytes)
+				return false;
+			pixel = makePixel(in[0], in[1], in[2], op == OP_RGB ? channel(pixel, 3) : in[3]);
+			in += bytes;
+			index[hashIndex(pixel)] = pixel;
+		}
+		else if((op & 0xC0) == OP_INDEX)
+			pixel = index[op];
+		else if((op & 0xC0) == OP_DIFF)
+		{
+			pixel = makePixel(channel(pixel, 0) + ((op >> 4) & 3) - 2, channel(pixel, 1) + ((op >> 2) & 3) - 2,
+							  channel(pixel, 2) + (op & 3) - 2, channel(pixel, 3));
+			index[hashIndex(pixel)] = pixel;
+		}
+		else if((op & 0xC0) == OP_LUMA)
+		{
+			if(in >= end)
+				return false;
+			int dg = (op & 0x3F) - 32;
+			pixel = makePixel(channel(pixel, 0) + dg + (*in >> 4) - 8, channel(pixel, 1) + dg, channel(pixel, 2) + dg + (*in & 0x0F) - 8,
+							  channel(pixel, 3));
+			in++;
+			index[hashIndex(pixel)] = pixel;
+		}
+		else
+		{
+			run = (op & 0x3F) + 1;
+			if(i + run > pixels)
+				return false;
+		}
+
+		unsigned char* p = frame + 4 * i;
+		if(!delta)
+			for(size_t k = 0; k < run; k++)
+				store32(p + 4 * k, pixel);
+		else if(pixel != 0) // otherwise the pixels of the previous frame are left as is
+			for(size_t k = 0; k < run; k++)
+				store32(p + 4 * k, addBytes(load32(p + 4 * k), pixel));
+		i += run;
+	}
+	return in == end;
+}
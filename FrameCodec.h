@@ -0,0 +1,85 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <functional>
+
+#include "WorkerPool.h"
+
+
+/**
+* Lightweight lossless frame compressor, to cut the disk bandwidth of raw captures (4K60 rgba is about 2 GB/s).
+*
+* The frame is seen as 4 bytes pixels (any pixel format, the rgba frames compress best) cut into horizontal stripes
+* compressed in parallel on a worker pool, each with the operations of QOI (https://qoiformat.org : run of the previous pixel,
+* index of a recently seen pixel, small differences with the previous pixel, or the pixel as is).
+* Between keyframes, the pixels compressed are the differences with the previous frame (byte wise), so the still parts
+* of the scene become long runs of zeros, found 8 bytes at a time.
+*
+* A compressed frame is a FrameHeader, the compressed bytes of each stripe, then the last size % 4 bytes as is.
+* The decoder keeps the previous frame to add the differences back, so the frames are decoded in order from a keyframe.
+* The stripes are decoded in parallel too.
+*/
+class FrameCodec
+{
+public:
+	static const unsigned int VERSION = 1;
+
+	/// Start of each compressed frame (native endianness)
+	struct FrameHeader
+	{
+		char				magic[4];		///< "VCQ"
+		unsigned int		flags;			///< KEYFRAME
+		unsigned long long	size;			///< bytes of the decompressed frame
+		unsigned int		stripes;		///< followed by the compressed bytes of each stripe (unsigned int each)
+		unsigned int		sequence;		///< frames since the keyframe (0 for a keyframe)
+	};
+	static const unsigned int KEYFRAME = 1;
+
+	/// stripes : compressed in parallel (0 : one per hardware thread). keyframeInterval : frames between two frames compressed alone
+	/// (1 : every frame, 0 : only the first one and after a size change).
+	FrameCodec(unsigned int stripes = 0, unsigned int keyframeInterval = 60);
+	virtual ~FrameCodec();
+
+	/// Compress the frame of size bytes into out (resized), return the compressed size
+	size_t encode(const unsigned char* frame, size_t size, std::vector<unsigned char>& out);
+
+	/// Decompress a frame given by encode() into frame (resized, it has to hold the previous frame unless data is a keyframe).
+	/// Return false if data is corrupted or a frame in between was skipped.
+	bool decode(const unsigned char* data, size_t size, std::vector<unsigned char>& frame);
+
+	/// Start again from a keyframe
+	void reset();
+
+	/// Is data (given by encode()) a keyframe
+	static bool isKeyframe(const unsigned char* data, size_t size);
+
+	/// Largest compressed size of a frame of size bytes in stripes stripes
+	static size_t maxEncodedSize(size_t size, unsigned int stripes);
+
+	unsigned int stripes() const { return mStripes; }
+
+protected:
+	/// Pixels [first, last) of stripe i out of stripes of a frame of pixels pixels
+	static void stripeRange(unsigned int i, unsigned int stripes, size_t pixels, size_t& first, size_t& last);
+
+	/// Run task(i) for i in [0, count) in parallel on the pool and wait for them
+	void forEachStripe(unsigned int count, const std::function<void(unsigned int)>& task);
+
+	/// QOI operations of pixels pixels of frame (differences with reference if not nullptr), return the bytes written to out
+	static size_t encodeStripe(const unsigned char* frame, const unsigned char* reference, size_t pixels, unsigned char* out);
+
+	/// Inverse of encodeStripe into frame (where the previous pixels are if delta), false if the data does not match pixels
+	static bool decodeStripe(const unsigned char* data, size_t size, bool delta, size_t pixels, unsigned char* frame);
+
+protected:
+	unsigned int								mStripes;
+	unsigned int								mKeyframeInterval;
+	unsigned int								mFrames;		///< encoded or decoded since the last keyframe
+	std::vector<unsigned char>					mReference;		///< previous frame given to encode
+	std::vector<std::vector<unsigned char>>		mStripeData;	///< compressed stripes before they are joined
+	std::vector<size_t>							mStripeSize;
+	std::unique_ptr<WorkerPool>					mPool;			///< nullptr with a single stripe
+	std::vector<std::unique_ptr<WorkerPool::Strand>> mStrands;	///< one per stripe
+};
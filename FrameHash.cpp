@@ -0,0 +1,218 @@
+#include "FrameHash.h"
+
+#include <cstring>	// memcpy
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+	#define FRAME_HASH_X86 1
+	#include <emmintrin.h>	// SSE2
+	#include <immintrin.h>	// AVX2
+#else
+	#define FRAME_HASH_X86 0
+#endif
+
+#if FRAME_HASH_X86 && (defined(__GNUC__) || defined(__clang__))
+	#define FRAME_HASH_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+	#define FRAME_HASH_TARGET_AVX2
+#endif
+
+
+//===========================================================================================================
+// xxHash primes
+
+static const unsigned long long PRIME32_1 = 0x9E3779B1ULL;
+static const unsigned long long PRIME32_2 = 0x85EBCA77ULL;
+static const unsigned long long PRIME32_3 = 0xC2B2AE3DULL;
+static const unsigned long long PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static const unsigned long long PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const unsigned long long PRIME64_3 = 0x165667B19E3779F9ULL;
+static const unsigned long long PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+static const unsigned long long PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+static const size_t STRIPE_SIZE			= 64;	// 8 lanes of 64 bits
+static const size_t STRIPES_PER_BLOCK	= 16;	// scramble every 1 KiB
+
+/// Keys of the lanes : stripe s of a block uses keys [s:s+8[, the scramble uses keys [16:24[
+struct FrameHashKeys
+{
+	unsigned long long values[STRIPES_PER_BLOCK + 8];
+	FrameHashKeys()
+	{
+		unsigned long long state = PRIME64_5; // splitmix64
+		for(unsigned long long& value : values)
+		{
+			unsigned long long z = (state += 0x9E3779B97F4A7C15ULL);
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+			value = z ^ (z >> 31);
+		}
+	}
+};
+
+static inline unsigned long long read64(const unsigned char* p)
+{
+	unsigned long long value;
+	std::memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static inline unsigned long long avalanche(unsigned long long h)
+{
+	h ^= h >> 33;	h *= PRIME64_2;
+	h ^= h >> 29;	h *= PRIME64_3;
+	return h ^ (h >> 32);
+}
+
+
+//===========================================================================================================
+// Scalar
+
+static inline void accumulateScalar(unsigned long long* acc, const unsigned char* stripe, const unsigned long long* keys)
+{
+	for(int i = 0; i < 8; i++)
+	{
+		unsigned long long data	= read64(stripe + 8*i);
+		unsigned long long key	= data ^ keys[i];
+		acc[i ^ 1]	+= data;
+		acc[i]		+= (key & 0xFFFFFFFFULL) * (key >> 32);
+	}
+}
+
+static inline void scrambleScalar(unsigned long long* acc, const unsigned long long* keys)
+{
+	for(int i = 0; i < 8; i++)
+		acc[i] = ((acc[i] ^ (acc[i] >> 47)) ^ keys[i]) * PRIME32_1;
+}
+
+static void stripesScalar(unsigned long long* acc, const unsigned char* data, size_t stripes, const unsigned long long* keys)
+{
+	for(size_t n = 0; n < stripes; n++)
+	{
+		size_t s = n % STRIPES_PER_BLOCK;
+		accumulateScalar(acc, data + STRIPE_SIZE * n, keys + s);
+		if(s == STRIPES_PER_BLOCK - 1)
+			scrambleScalar(acc, keys + STRIPES_PER_BLOCK);
+	}
+}
+
+
+#if FRAME_HASH_X86
+//===========================================================================================================
+// SSE2 : 2 lanes per register
+
+static void stripesSSE2(unsigned long long* acc, const unsigned char* data, size_t stripes, const unsigned long long* keys)
+{
+	__m128i a[4];
+	for(int j = 0; j < 4; j++)
+		a[j] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(acc + 2*j));
+	const __m128i prime = _mm_set1_epi32(int(PRIME32_1));
+
+	for(size_t n = 0; n < stripes; n++)
+	{
+		size_t s = n % STRIPES_PER_BLOCK;
+		const unsigned char* stripe = data + STRIPE_SIZE * n;
+		for(int j = 0; j < 4; j++)
+		{
+			__m128i d	= _mm_loadu_si128(reinterpret_cast<const __m128i*>(stripe + 16*j));
+			__m128i k	= _mm_xor_si128(d, _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + s + 2*j)));
+			__m128i p	= _mm_mul_epu32(k, _mm_srli_epi64(k, 32));
+			a[j] = _mm_add_epi64(a[j], _mm_add_epi64(p, _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2)))); // the neighbour lane data
+		}
+		if(s == STRIPES_PER_BLOCK - 1)
+		{
+			for(int j = 0; j < 4; j++)
+			{
+				__m128i x	= _mm_xor_si128(_mm_xor_si128(a[j], _mm_srli_epi64(a[j], 47)),
+											_mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + STRIPES_PER_BLOCK + 2*j)));
+				__m128i lo	= _mm_mul_epu32(x, prime);
+				__m128i hi	= _mm_mul_epu32(_mm_srli_epi64(x, 32), prime);
+				a[j] = _mm_add_epi64(lo, _mm_slli_epi64(hi, 32));
+			}
+		}
+	}
+
+	for(int j = 0; j < 4; j++)
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(acc + 2*j), a[j]);
+}
+
+
+//===========================================================================================================
+// AVX2 : 4 lanes per register
+
+FRAME_HASH_TARGET_AVX2
+static void stripesAVX2(unsigned long long* acc, const unsigned char* data, size_t stripes, const unsigned long long* keys)
+{
+	__m256i a[2];
+	for(int j = 0; j < 2; j++)
+		a[j] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc + 4*j));
+	const __m256i prime = _mm256_set1_epi32(int(PRIME32_1));
+
+	for(size_t n = 0; n < stripes; n++)
+	{
+		size_t s = n % STRIPES_PER_BLOCK;
+		const unsigned char* stripe = data + STRIPE_SIZE * n;
+		for(int j = 0; j < 2; j++)
+		{
+			__m256i d	= _mm256_loadu_si256(reinterpret_cast<const __m256i*>(stripe + 32*j));
+			__m256i k	= _mm256_xor_si256(d, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + s + 4*j)));
+			__m256i p	= _mm256_mul_epu32(k, _mm256_srli_epi64(k, 32));
+			a[j] = _mm256_add_epi64(a[j], _mm256_add_epi64(p, _mm256_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2))));
+		}
+		if(s == STRIPES_PER_BLOCK - 1)
+		{
+			for(int j = 0; j < 2; j++)
+			{
+				__m256i x	= _mm256_xor_si256(_mm256_xor_si256(a[j], _mm256_srli_epi64(a[j], 47)),
+											   _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + STRIPES_PER_BLOCK + 4*j)));
+				__m256i lo	= _mm256_mul_epu32(x, prime);
+				__m256i hi	= _mm256_mul_epu32(_mm256_srli_epi64(x, 32), prime);
+				a[j] = _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32));
+			}
+		}
+	}
+
+	for(int j = 0; j < 2; j++)
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + 4*j), a[j]);
+}
+#endif // FRAME_HASH_X86
+
+
+//===========================================================================================================
+
+unsigned long long FrameHash::hash(const void* data, size_t size, INSTRUCTION_SET set)
+{
+	static const FrameHashKeys keys; // thread safe initialization
+	if(set == INSTRUCTION_SET::AUTO || set > ColorConversion::bestInstructionSet())
+		set = ColorConversion::bestInstructionSet();
+
+	unsigned long long acc[8] = { PRIME32_3, PRIME64_1, PRIME64_2, PRIME64_3, PRIME64_4, PRIME32_2, PRIME64_5, PRIME32_1 };
+	const unsigned char* bytes	 = static_cast<const unsigned char*>(data);
+	size_t				 stripes = size / STRIPE_SIZE;
+
+	switch(set)
+	{
+#if FRAME_HASH_X86
+	case INSTRUCTION_SET::AVX2:	stripesAVX2(acc, bytes, stripes, keys.values);		break;
+	case INSTRUCTION_SET::SSE2:	stripesSSE2(acc, bytes, stripes, keys.values);		break;
+#endif
+	default:					stripesScalar(acc, bytes, stripes, keys.values);	break;
+	}
+
+	// last partial stripe, zero padded (the size is mixed in below)
+	size_t tail = size - stripes * STRIPE_SIZE;
+	if(tail != 0)
+	{
+		unsigned char last[STRIPE_SIZE] = {0};
+		std::memcpy(last, bytes + stripes * STRIPE_SIZE, tail);
+		accumulateScalar(acc, last, keys.values + stripes % STRIPES_PER_BLOCK);
+	}
+
+	// merge the lanes
+	unsigned long long h = (unsigned long long)size * PRIME64_1;
+	for(int i = 0; i < 8; i++)
+	{
+		h ^= avalanche(acc[i] ^ keys.values[i]);
+		h  = ((h << 27) | (h >> 37)) * PRIME64_1 + PRIME64_4;
+	}
+	return avalanche(h);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "ColorConversion.h"
+
+#include <cstddef>
+
+
+/**
+* Fast 64 bits hash of a whole frame, to detect a frame identical to the previous one without keeping a copy of it.
+*
+* The frame is consumed by stripes of 64 bytes with the accumulation loop of XXH3 (8 lanes of 64 bits : each lane adds
+* the 32x32 bits product of its data xored with a position dependent key, and its neighbour adds the raw data),
+* scrambled every 1 KiB, then the lanes are avalanched together. It is not the XXH3 digest, only its structure.
+*
+* The loop is vectorized with SSE2 and AVX2, chosen at runtime according to the CPU (same detection as ColorConversion),
+* with a scalar fallback. All the instruction sets produce exactly the same hash.
+*/
+class FrameHash
+{
+public:
+	typedef ColorConversion::INSTRUCTION_SET INSTRUCTION_SET;
+
+	/// Hash size bytes of data
+	static unsigned long long hash(const void* data, size_t size, INSTRUCTION_SET set = INSTRUCTION_SET::AUTO);
+};
@@ -0,0 +1,246 @@
+#include "FrameQueue.h"
+#include "FrameBufferPool.h"
+
+#include <iostream>
+#include <cstring>	// memcpy
+
+
+//===========================================================================================================
+
+FrameQueue::IndexRing::IndexRing(unsigned int capacity)
+	: mCells(0), mMask(0), mPushPos(0), mPopPos(0)
+{
+	size_t size = 2;
+	while(size < capacity)
+		size <<= 1;
+	std::vector<Cell> cells(size);
+	mCells.swap(cells);
+	mMask = size - 1;
+	for(size_t i = 0; i < size; i++)
+		mCells[i].seq.store(i, std::memory_order_relaxed);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool FrameQueue::IndexRing::push(unsigned int index)
+{
+	Cell* cell = nullptr;
+	size_t pos = mPushPos.load(std::memory_order_relaxed);
+	while(true)
+	{
+		cell = &mCells[pos & mMask];
+		size_t seq = cell->seq.load(std::memory_order_acquire);
+		std::ptrdiff_t dif = std::ptrdiff_t(seq) - std::ptrdiff_t(pos);
+		if(dif == 0)
+		{
+			if(mPushPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if(dif < 0)
+			return false; // full
+		else
+			pos = mPushPos.load(std::memory_order_relaxed);
+	}
+	cell->index = index;
+	cell->seq.store(pos + 1, std::memory_order_release);
+	return true;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+unsigned int FrameQueue::IndexRing::size() const
+{
+	size_t pushed	= mPushPos.load(std::memory_order_relaxed);
+	size_t popped	= mPopPos.load(std::memory_order_relaxed);
+	return pushed > popped ? (unsigned int)(pushed - popped) : 0;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool FrameQueue::IndexRing::pop(unsigned int& index)
+{
+	Cell* cell = nullptr;
+	size_t pos = mPopPos.load(std::memory_order_relaxed);
+	while(true)
+	{
+		cell = &mCells[pos & mMask];
+		size_t seq = cell->seq.load(std::memory_order_acquire);
+		std::ptrdiff_t dif = std::ptrdiff_t(seq) - std::ptrdiff_t(pos + 1);
+		if(dif == 0)
+		{
+			if(mPopPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if(dif < 0)
+			return false; // empty
+		else
+			pos = mPopPos.load(std::memory_order_relaxed);
+	}
+	index = cell->index;
+	cell->seq.store(pos + mMask + 1, std::memory_order_release);
+	return true;
+}
+
+
+//===========================================================================================================
+
+FrameQueue::FrameQueue(size_t slotSize, unsigned int depth, OVERFLOW_POLICY policy)
+	: mPolicy(policy), mSlotSize(slotSize)
+	, mReady(depth < 2 ? 2 : depth), mFree(depth < 2 ? 2 : depth)
+	, mClosed(false), mDropped(0), mFull(0), mConsumerSleeping(false), mProducerSleeping(false)
+{
+	if(depth < 2) // one slot for the consumer and at least one for the producer
+		depth = 2;
+	for(unsigned int i = 0; i < depth; i++)
+	{
+		unsigned char* slot = FrameBufferPool::Get().acquire(slotSize); // page-aligned, reused by the next session
+		if(slot == nullptr)
+		{
+			std::cerr<<"[FrameQueue] can not allocate "<<depth<<" slots of "<<slotSize<<" bytes"<<std::endl;
+			for(unsigned char* allocated : mSlots)
+				FrameBufferPool::Get().release(allocated);
+			mSlots.clear();
+			return;
+		}
+		mSlots.push_back(slot);
+		mSizes.push_back(0);
+		mPts.push_back(-1);
+		mFree.push(i);
+	}
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+FrameQueue::~FrameQueue()
+{
+	for(unsigned char* slot : mSlots)
+		FrameBufferPool::Get().release(slot);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+int FrameQueue::reserve()
+{
+	unsigned int slot = 0;
+	if(mFree.pop(slot))
+		return slot;
+	mFull++;
+
+	switch(mPolicy)
+	{
+	case OVERFLOW_POLICY::DROP_NEWEST:
+		mDropped++;
+		return -1;
+
+	case OVERFLOW_POLICY::DROP_OLDEST:
+		if(mReady.pop(slot)) // steal the oldest frame the consumer did not take yet
+		{
+			mDropped++;
+			return slot;
+		}
+		break; // the consumer is holding the only one : wait for it
+
+	default: break;
+	}
+
+	std::unique_lock<std::mutex> lock(mMutex);
+	mProducerSleeping = true;
+	std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with wakeUp() : the flag is seen or the freed slot is
+	while(!mFree.pop(slot))
+		mCondition.wait(lock);
+	mProducerSleeping = false;
+	return slot;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FrameQueue::commit(int slot, size_t size, long long pts)
+{
+	mSizes[slot] = size;
+	mPts[slot]	 = pts;
+	mReady.push(slot);
+	wakeUp(mConsumerSleeping);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FrameQueue::cancel(int slot)
+{
+	mFree.push(slot); // only the producer waits for a free slot, and it is the caller
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool FrameQueue::push(const void* data, size_t size, long long pts)
+{
+	int slot = reserve();
+	if(slot < 0)
+		return false;
+	std::memcpy(mSlots[slot], data, size < mSlotSize ? size : mSlotSize);
+	commit(slot, size < mSlotSize ? size : mSlotSize, pts);
+	return true;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FrameQueue::close()
+{
+	mClosed = true;
+	std::lock_guard<std::mutex> lock(mMutex);
+	mCondition.notify_all();
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+int FrameQueue::acquire()
+{
+	unsigned int slot = 0;
+	if(mReady.pop(slot))
+		return slot;
+
+	std::unique_lock<std::mutex> lock(mMutex);
+	mConsumerSleeping = true;
+	std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with wakeUp() : the flag is seen or the committed frame is
+	bool found = false;
+	while(!(found = mReady.pop(slot)))
+	{
+		if(mClosed)
+		{
+			found = mReady.pop(slot); // the last frame may have been committed just before closing
+			break;
+		}
+		mCondition.wait(lock);
+	}
+	mConsumerSleeping = false;
+	return found ? int(slot) : -1;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+int FrameQueue::tryAcquire()
+{
+	unsigned int slot = 0;
+	return mReady.pop(slot) ? int(slot) : -1;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FrameQueue::release(int slot)
+{
+	mFree.push(slot);
+	wakeUp(mProducerSleeping);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void FrameQueue::wakeUp(std::atomic<bool>& sleeping)
+{
+	// the push is ordered before the flag is read (store-load : the release store of the ring does not prevent it), and the
+	// sleeping side holds the mutex from setting its flag until it waits : either it sees the push or it is notified
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if(sleeping)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mCondition.notify_all();
+	}
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+
+
+/**
+* Bounded queue of preallocated frame slots between one producer (the render thread)
+* and one consumer (the thread writing the frames to the encoder).
+*
+* Slots are preallocated once, so pushing a frame only cost its copy into a slot
+* (or even nothing more than the read back if the producer fills the slot in place using reserve()/commit()).
+* Slot indices go through 2 lock-free rings (ready and free slots), a mutex is only taken to put to sleep
+* (and to wake up) the consumer when the queue is empty or the producer when the queue is full (BLOCK policy).
+*
+* Usage :
+* producer :	int slot = queue.reserve(); if(slot >= 0) { fill(queue.data(slot)); queue.commit(slot, size); }
+* consumer :	int slot; while( (slot = queue.acquire()) >= 0 ) { write(queue.data(slot), queue.size(slot)); queue.release(slot); }
+* producer :	queue.close(); // acquire() return -1 once the remaining frames are consumed
+*/
+class FrameQueue
+{
+public:
+	/// What to do when the producer push a frame while all the slots are used
+	enum class OVERFLOW_POLICY
+	{
+		BLOCK,			///< wait for the consumer to release a slot (no frame lost)
+		DROP_NEWEST,	///< discard the pushed frame
+		DROP_OLDEST		///< discard the oldest frame not yet taken by the consumer and queue the new one
+	};
+
+protected:
+	/// Lock-free bounded ring of slot indices (Vyukov MPMC queue : the producer may pop ready slots to drop them)
+	class IndexRing
+	{
+	public:
+		IndexRing(unsigned int capacity);
+		bool push(unsigned int index);
+		bool pop(unsigned int& index);
+		unsigned int size() const; ///< approximate number of queued indices
+
+	protected:
+		struct Cell
+		{
+			std::atomic<size_t> seq;
+			unsigned int		index;
+		};
+		std::vector<Cell>	mCells;
+		size_t				mMask;
+		std::atomic<size_t> mPushPos;
+		std::atomic<size_t> mPopPos;
+	};
+
+public:
+	/// Preallocate depth slots of slotSize bytes (see allocated())
+	FrameQueue(size_t slotSize, unsigned int depth, OVERFLOW_POLICY policy = OVERFLOW_POLICY::BLOCK);
+	virtual ~FrameQueue();
+
+	// producer side
+
+	/// Get a free slot to fill according to the overflow policy. Return -1 if the frame has to be dropped.
+	int reserve();
+
+	/// Queue a filled slot (of size bytes, presented at pts) for the consumer
+	void commit(int slot, size_t size, long long pts = -1);
+
+	/// Give back a reserved slot without queuing it (its frame turned out to be useless)
+	void cancel(int slot);
+
+	/// Shortcut to reserve, copy and commit a frame. Return false if the frame has been dropped.
+	bool push(const void* data, size_t size, long long pts = -1);
+
+	/// No more frames will be pushed : wake up the consumer to let it end once the queue is empty
+	void close();
+
+	// consumer side
+
+	/// Wait for the next frame slot, return -1 if the queue is closed and empty
+	int acquire();
+
+	/// Next frame slot if any, -1 otherwise (never waits)
+	int tryAcquire();
+
+	/// Give back a consumed slot
+	void release(int slot);
+
+	// both sides
+
+	unsigned char*	data(int slot)		{ return mSlots[slot]; }
+	size_t			size(int slot)		{ return mSizes[slot]; }
+	long long		pts(int slot)		{ return mPts[slot]; }
+	size_t			slotSize() const	{ return mSlotSize; }
+	unsigned int	depth() const		{ return (unsigned int)mSlots.size(); }
+
+	/// Could the slots be allocated (the queue is not usable otherwise)
+	bool			allocated() const	{ return !mSlots.empty(); }
+
+	/// Number of frames committed and not yet taken by the consumer (approximate while both sides run)
+	unsigned int	pending() const		{ return mReady.size(); }
+
+	/// Number of frames dropped by the overflow policy since creation
+	unsigned long long dropped() const	{ return mDropped.load(); }
+
+	/// Number of reserve() calls which found no free slot (then blocked or dropped) since creation
+	unsigned long long full() const		{ return mFull.load(); }
+
+protected:
+	void wakeUp(std::atomic<bool>& sleeping);
+
+protected:
+	OVERFLOW_POLICY				mPolicy;
+	size_t						mSlotSize;
+	std::vector<unsigned char*> mSlots;
+	std::vector<size_t>			mSizes;
+	std::vector<long long>		mPts;		///< presentation timestamp of each slot (-1 if not timestamped)
+	IndexRing					mReady;		///< filled slots, in push order
+	IndexRing					mFree;		///< slots available for the producer
+
+	std::atomic<bool>			mClosed;
+	std::atomic<unsigned long long> mDropped;
+	std::atomic<unsigned long long> mFull;
+
+	// only used to sleep when there is nothing to do
+	std::mutex					mMutex;
+	std::condition_variable		mCondition;
+	std::atomic<bool>			mConsumerSleeping;
+	std::atomic<bool>			mProducerSleeping;
+};
@@ -0,0 +1,559 @@
+#include "FrameSink.h"
+#include "PipeTransport.h"
+#include "NutMuxer.h"
+#include "SharedMemoryRing.h"
+#include "MappedRawFile.h"
+#include "Mp4Segmenter.h"
+#include "PresetController.h"
+
+#include <iostream>
+#include <fstream>
+#include <cstring>	// memcpy, strncpy
+#include <chrono>
+#include <cmath>	// floor
+#include <algorithm>// std::max
+
+#ifdef WIN32
+#define OS_POPEN(X)			_popen(X,"wb")
+#define OS_PCLOSE(X)		_pclose(X)
+#else
+#define OS_POPEN(X)			popen(X,"w")
+#define OS_PCLOSE(X)		pclose(X)
+#endif
+
+
+//===========================================================================================================
+
+FFmpegPipeSink::FFmpegPipeSink()
+	: mStdio(nullptr), mTransport(nullptr), mNut(nullptr)
+{
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+FFmpegPipeSink::~FFmpegPipeSink()
+{
+	close();
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool FFmpegPipeSink::open(const std::string& command, const Format& format, bool rawPipe, bool zeroCopy, size_t pipeSize)
+{
+	close();
+	if(rawPipe && PipeTransport::available())
+	{
+		// raw pipe to ffmpeg's stdin, no stdio buffering
+		mTransport = new PipeTransport();
+		if(!mTransport->open(command, format.frameSize, zeroCopy, pipeSize))
+		{
+			delete mTransport;
+			mTransport = nullptr;
+		}
+	}
+	else
+	{
+		if(rawPipe)
+			std::cerr<<"[FFmpegPipeSink] raw pipe transport only available on Linux, use popen..."<<std::endl;
+		// open pipe to ffmpeg's stdin in binary write mode
+		mStdio = OS_POPEN(command.c_str());
+	}
+	if(!isOpen())
+		return false;
+
+	// timestamped frames : start the NUT stream (ffmpeg waits for its input anyway)
+	if(format.timeBase != 0)
+	{
+		mNut = new NutMuxer(format.width, format.height, format.pixFmt, format.timeBase);
+		const std::vector<unsigned char>& header = mNut->fileHeader();
+		pipeBytes(header.data(), header.size());
+	}
+	return true;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+unsigned char* FFmpegPipeSink::frameBuffer()
+{
+	return mTransport != nullptr && mTransport->zeroCopy() ? mTransport->frameBuffer() : nullptr;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool FFmpegPipeSink::write(const void* data, size_t size, long long pts)
+{
+	if(mNut != nullptr) // the frame header carries the pts, the frame itself is piped as is
+	{
+		const std::vector<unsigned char>& header = mNut->frameHeader(pts, size);
+		if(!pipeBytes(header.data(), header.size()))
+			return false;
+	}
+	return pipeBytes(data, size);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool FFmpegPipeSink::close()
+{
+	int status = 0;
+	if(mStdio != nullptr)
+		status = OS_PCLOSE(mStdio);
+	if(mTransport != nullptr)
+	{
+		status = mTransport->close(); // wait for ffmpeg to encode the remaining frames
+		delete mTransport;
+	}
+	delete mNut;
+	mStdio		= nullptr;
+	mTransport	= nullptr;
+	mNut		= nullptr;
+	return status == 0;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool FFmpegPipeSink::pipeBytes(const void* data, size_t size)
+{
+	if(mTransport != nullptr)
+		return mTransport->write(data, size);
+	return std::fwrite(data, size, 1, mStdio) == 1;
+}
+
+
+//===========================================================================================================
+
+bool LibavEncoderSink::open(const std::string& filePath, const FFmpegLibavEncoder::Settings& settings)
+{
+	return mEncoder.open(filePath, settings);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool LibavEncoderSink::write(const void* data, size_t size, long long pts)
+{
+	return mEncoder.encode(data, size, pts);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool LibavEncoderSink::close()
+{
+	mEncoder.close();
+	return true;
+}
+
+
+//===========================================================================================================
+
+AdaptiveEncoderSink::AdaptiveEncoderSink()
+	: mEncoder(nullptr), mController(nullptr), mStats(nullptr), mSegmenter(nullptr), mSingle(true), mKeyframeInterval(2)
+	, mFrames(0), mNextBoundary(0), mSettling(false), mSwitches(0)
+{
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+AdaptiveEncoderSink::~AdaptiveEncoderSink()
+{
+	close();
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool AdaptiveEncoderSink::open(FrameSink* encoder, const Format& format, EncoderFactory factory, PresetController* controller, const CaptureCounters* stats,
+							   unsigned int keyframeInterval, Mp4Segmenter* segmenter, const std::string& fifo)
+{
+	close();
+	if(encoder == nullptr)
+		return false;
+	mEncoder			= encoder;
+	mFifo				= fifo;
+	mFormat				= format;
+	mFactory			= std::move(factory);
+	mController			= controller;
+	mStats				= stats;
+	mSegmenter			= segmenter;
+	mSingle				= segmenter == nullptr;
+	mKeyframeInterval	= keyframeInterval != 0 ? keyframeInterval : 2;
+	mFrames				= 0;
+	mNextBoundary		= mKeyframeInterval;
+	mLast				= stats->snapshot();
+	mSession			= CaptureStats();
+	mSettling			= false;
+	mSwitches			= 0;
+	return true;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+unsigned char* AdaptiveEncoderSink::frameBuffer()
+{
+	return mEncoder != nullptr ? mEncoder->frameBuffer() : nullptr;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool AdaptiveEncoderSink::write(const void* data, size_t size, long long pts)
+{
+	if(mEncoder == nullptr)
+		return false;
+
+	// keyframe boundary : measure the interval since the previous one, the frame starts the encoder of a new level
+	// (within half a frame period, as the encoder rounds the timestamps to its frame rate when forcing the keyframes)
+	double period	= 1.0 / std::max(mFormat.frameRate, 1u);
+	double time		= mFormat.timeBase != 0 ? double(pts) / mFormat.timeBase : mFrames * period;
+	mFrames++;
+	FrameSink*	previous = nullptr;
+	std::string	previousFifo;
+	if(time + period / 2 >= mNextBoundary)
+	{
+		mNextBoundary = (std::floor((time + period / 2) / mKeyframeInterval) + 1) * mKeyframeInterval;
+		CaptureStats now = mStats->snapshot();
+		if(mSingle)
+			mSession = now.since(mLast);
+		else
+		{
+			if(mSegmenter != nullptr && !mSettling && mController->update(now.since(mLast)))
+				previous = switchEncoder(previousFifo);
+			mLast = now;
+		}
+		mSettling = previous != nullptr;
+	}
+	bool written = mEncoder->write(data, size, pts);
+
+	// the frame may have been built in a buffer of the previous encoder (copied by the write) : closed once written
+	if(previous != nullptr)
+		retire(previous, previousFifo);
+	return written;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool AdaptiveEncoderSink::close()
+{
+	if(mCloser.joinable())
+		mCloser.join();
+	if(mEncoder == nullptr)
+		return true;
+	bool closed = mEncoder->close();
+	delete mEncoder;
+	mEncoder = nullptr;
+	if(mSegmenter != nullptr)
+		mSegmenter->endStream(mFifo);
+	if(mSingle)
+		mController->update(mSession); // for the next session
+	return closed;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+FrameSink* AdaptiveEncoderSink::switchEncoder(std::string& previousFifo)
+{
+	unsigned int preset = 0, crf = 0;
+	mController->level(preset, crf);
+	std::string fifo	= mSegmenter->nextStream();
+	FrameSink* encoder	= !fifo.empty() ? mFactory(preset, crf, fifo) : nullptr;
+	if(encoder == nullptr)
+	{
+		std::cerr<<"[AdaptiveEncoderSink] can not start an encoder of preset "<<preset<<" crf "<<crf<<", keep the current one"<<std::endl;
+		if(!fifo.empty())
+			mSegmenter->endStream(fifo); // read empty after the current stream
+		mSegmenter = nullptr;
+		return nullptr;
+	}
+	FrameSink* previous	= mEncoder;
+	previousFifo		= mFifo;
+	mEncoder			= encoder;
+	mFifo				= fifo;
+	mSwitches++;
+	return previous;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void AdaptiveEncoderSink::retire(FrameSink* encoder, const std::string& fifo)
+{
+	// it completes its frames meanwhile (the one replaced before is done by now : a keyframe interval went by)
+	if(mCloser.joinable())
+		mCloser.join();
+	Mp4Segmenter* segmenter = mSegmenter;
+	mCloser = std::thread([encoder, fifo, segmenter]()
+	{
+		encoder->close();
+		delete encoder;
+		segmenter->endStream(fifo); // the reader goes on with the stream of the next encoder
+	});
+}
+
+
+//===========================================================================================================
+
+RawFileSink::RawFileSink()
+	: mFile(nullptr), mNut(nullptr), mFrames(0)
+{
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+RawFileSink::~RawFileSink()
+{
+	close();
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool RawFileSink::open(const std::string& filePath, const Format& format, bool overwrite)
+{
+	close();
+	if(!overwrite && std::ifstream(filePath.c_str(), std::ios::binary).is_open())
+	{
+		std::cerr<<"[RawFileSink] "<<filePath<<" already exists"<<std::endl;
+		return false;
+	}
+	mFile = std::fopen(filePath.c_str(), "wb");
+	if(mFile == nullptr)
+	{
+		std::cerr<<"[RawFileSink] can not create "<<filePath<<std::endl;
+		return false;
+	}
+	std::setvbuf(mFile, nullptr, _IONBF, 0); // whole frames : the stdio buffer would only add a copy
+
+	// frames of a constant frame rate session are numbered at the frame rate
+	mNut	= new NutMuxer(format.width, format.height, format.pixFmt, format.timeBase != 0 ? format.timeBase : format.frameRate);
+	mFrames	= 0;
+	const std::vector<unsigned char>& header = mNut->fileHeader();
+	return writeBytes(header.data(), header.size());
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool RawFileSink::write(const void* data, size_t size, long long pts)
+{
+	const std::vector<unsigned char>& header = mNut->frameHeader(pts >= 0 ? pts : mFrames, size);
+	mFrames++;
+	return writeBytes(header.data(), header.size()) && writeBytes(data, size);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool RawFileSink::close()
+{
+	bool ok = mFile == nullptr || std::fclose(mFile) == 0;
+	delete mNut;
+	mFile	= nullptr;
+	mNut	= nullptr;
+	return ok;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool RawFileSink::writeBytes(const void* data, size_t size)
+{
+	return std::fwrite(data, size, 1, mFile) == 1;
+}
+
+
+//===========================================================================================================
+
+MappedFileSink::MappedFileSink()
+	: mFile(new MappedRawFile()), mFrames(0)
+{
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+MappedFileSink::~MappedFileSink()
+{
+	close();
+	delete mFile;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool MappedFileSink::open(const std::string& filePath, const Format& format, bool overwrite, unsigned int chunkFrames)
+{
+	mFrames = 0;
+	return mFile->create(filePath, overwrite, chunkFrames, format.frameSize, format.width, format.height, format.pixFmt,
+						 format.timeBase, format.frameRate);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+unsigned char* MappedFileSink::frameBuffer()
+{
+	return mFile->reserve(); // the same slot until it is written
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool MappedFileSink::write(const void* data, size_t size, long long pts)
+{
+	unsigned char* slot = mFile->reserve();
+	long long frame = mFrames++;
+	if(slot == nullptr || size > mFile->header()->frameSize)
+		return false; // the file can not grow anymore
+	if(data != slot)
+		std::memcpy(slot, data, size);
+	mFile->commit(size, pts >= 0 ? pts : frame);
+	return true;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool MappedFileSink::close()
+{
+	mFile->close();
+	return true;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool MappedFileSink::isOpen() const
+{
+	return mFile->isOpen();
+}
+
+
+//===========================================================================================================
+
+CompressedFileSink::CompressedFileSink()
+	: mFile(nullptr), mCodec(nullptr), mFrames(0), mRawBytes(0), mCompressedBytes(0), mEncodeMs(0)
+{
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+CompressedFileSink::~CompressedFileSink()
+{
+	close();
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool CompressedFileSink::open(const std::string& filePath, const Format& format, bool overwrite, unsigned int keyframeInterval, unsigned int stripes)
+{
+	close();
+	if(!overwrite && std::ifstream(filePath.c_str(), std::ios::binary).is_open())
+	{
+		std::cerr<<"[CompressedFileSink] "<<filePath<<" already exists"<<std::endl;
+		return false;
+	}
+	mFile = std::fopen(filePath.c_str(), "wb");
+	if(mFile == nullptr)
+	{
+		std::cerr<<"[CompressedFileSink] can not create "<<filePath<<std::endl;
+		return false;
+	}
+	std::setvbuf(mFile, nullptr, _IONBF, 0); // whole frames : the stdio buffer would only add a copy
+
+	FileHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, "VCAPQOI", sizeof(header.magic));
+	header.version		= FrameCodec::VERSION;
+	header.width		= format.width;
+	header.height		= format.height;
+	std::strncpy(header.pixFmt, format.pixFmt.c_str(), sizeof(header.pixFmt) - 1);
+	header.timeBase		= format.timeBase;
+	header.frameRate	= format.frameRate;
+	header.frameSize	= format.frameSize;
+	mCodec				= new FrameCodec(stripes, keyframeInterval);
+	mFrames				= 0;
+	mRawBytes			= 0;
+	mCompressedBytes	= sizeof(header);
+	mEncodeMs			= 0;
+	return std::fwrite(&header, sizeof(header), 1, mFile) == 1;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool CompressedFileSink::write(const void* data, size_t size, long long pts)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	FrameRecord record;
+	record.size	= mCodec->encode(static_cast<const unsigned char*>(data), size, mCompressed);
+	record.pts	= pts >= 0 ? pts : mFrames;
+	mFrames++;
+	mEncodeMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	mRawBytes			+= size;
+	mCompressedBytes	+= sizeof(record) + record.size;
+	return std::fwrite(&record, sizeof(record), 1, mFile) == 1 && std::fwrite(mCompressed.data(), size_t(record.size), 1, mFile) == 1;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool CompressedFileSink::close()
+{
+	bool ok = mFile == nullptr || std::fclose(mFile) == 0;
+	delete mCodec;
+	mFile	= nullptr;
+	mCodec	= nullptr;
+	return ok;
+}
+
+
+//===========================================================================================================
+
+SharedMemorySink::SharedMemorySink()
+	: mRing(new SharedMemoryRing()), mReserved(nullptr), mFrames(0)
+{
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+SharedMemorySink::~SharedMemorySink()
+{
+	close();
+	delete mRing;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool SharedMemorySink::open(const std::string& name, const Format& format, unsigned int slotCount)
+{
+	mReserved	= nullptr;
+	mFrames		= 0;
+	return mRing->create(name, slotCount, format.frameSize, format.width, format.height, format.pixFmt, format.timeBase, format.frameRate);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+unsigned char* SharedMemorySink::frameBuffer()
+{
+	mReserved = mRing->reserve(); // the same slot until it is written
+	return mReserved;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool SharedMemorySink::write(const void* data, size_t size, long long pts)
+{
+	unsigned char* slot = mReserved != nullptr ? mReserved : mRing->reserve();
+	mReserved = nullptr;
+	long long frame = mFrames++;
+	if(slot == nullptr || size > mRing->header()->frameSize)
+	{
+		mRing->drop(); // the consumer is late (or absent)
+		return false;
+	}
+	if(data != slot)
+		std::memcpy(slot, data, size);
+	mRing->publish(size, pts >= 0 ? pts : frame);
+	return true;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool SharedMemorySink::close()
+{
+	mRing->close();
+	mReserved = nullptr;
+	return true;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool SharedMemorySink::isOpen() const
+{
+	return mRing->isOpen();
+}
@@ -0,0 +1,329 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+#include <cstdio>
+#include <functional>
+#include <thread>
+
+#include "FFmpegLibavEncoder.h"
+#include "FrameCodec.h"
+#include "CaptureStats.h"
+
+class PipeTransport;
+class NutMuxer;
+class SharedMemoryRing;
+class MappedRawFile;
+class Mp4Segmenter;
+class PresetController;
+
+
+/**
+* Where the frames of a recording session go once read back (and converted) : FFmpegVideoRecorderProcess only talks to this interface.
+*
+* A sink receives the frames in order from a single thread at a time (capture(), the writer thread or a worker pool strand),
+* then close() once the session is over (possibly on the reaper thread). Sinks able to take a frame without copy hand out
+* the buffer where to build it with frameBuffer(). See FFmpegVideoRecorderProcess::setSinkFactory to plug another one.
+*/
+class FrameSink
+{
+public:
+	/// What the frames of a session are
+	struct Format
+	{
+		int				width;
+		int				height;
+		std::string		pixFmt;		///< "rgba" (rows bottom-up), "yuv420p" or "nv12" (rows top-down)
+		size_t			frameSize;	///< bytes of a frame
+		unsigned int	frameRate;	///< nominal frame rate (the frame rate of the video if timeBase is 0)
+		unsigned int	timeBase;	///< 0 : constant frame rate (pts is -1), otherwise the pts are in 1/timeBase seconds
+
+		Format() : width(0), height(0), frameSize(0), frameRate(25), timeBase(0) {}
+	};
+
+	virtual ~FrameSink() {}
+
+	/// Buffer of frameSize bytes where to build the next frame so write() takes it without copy (nullptr : any buffer)
+	virtual unsigned char* frameBuffer() { return nullptr; }
+
+	/// Take a frame of size bytes presented at pts (-1 if not timestamped). Return false if it is lost.
+	virtual bool write(const void* data, size_t size, long long pts) = 0;
+
+	/// No more frames : complete the output (may wait for an encoder). Return false if it failed.
+	virtual bool close() { return true; }
+};
+
+
+/**
+* The ffmpeg process encoding the frames read from its stdin : popen, or a raw pipe with the Linux transport (see PipeTransport).
+* Timestamped frames go in a NUT stream (see NutMuxer), others as headerless rawvideo.
+*/
+class FFmpegPipeSink : public FrameSink
+{
+public:
+	FFmpegPipeSink();
+	virtual ~FFmpegPipeSink(); ///< close
+
+	/// Spawn the ffmpeg command line (it waits for the first frame). rawPipe : through PipeTransport if available (zeroCopy : vmsplice),
+	/// otherwise popen. pipeSize : requested raw pipe capacity in bytes (0 for one frame).
+	bool open(const std::string& command, const Format& format, bool rawPipe, bool zeroCopy, size_t pipeSize);
+
+	virtual unsigned char* frameBuffer();
+	virtual bool write(const void* data, size_t size, long long pts);
+
+	/// Close the pipe and wait for ffmpeg to encode the remaining frames
+	virtual bool close();
+
+	bool isOpen() const { return mStdio != nullptr || mTransport != nullptr; }
+
+protected:
+	bool pipeBytes(const void* data, size_t size);
+
+protected:
+	FILE*			mStdio;		///< popen stream (nullptr with the raw pipe)
+	PipeTransport*	mTransport;	///< raw pipe (nullptr with popen)
+	NutMuxer*		mNut;		///< wraps the timestamped frames (nullptr for rawvideo)
+};
+
+
+/**
+* The in process libav encoder (see FFmpegLibavEncoder).
+*/
+class LibavEncoderSink : public FrameSink
+{
+public:
+	/// Create the output file and open the encoder
+	bool open(const std::string& filePath, const FFmpegLibavEncoder::Settings& settings);
+
+	virtual bool write(const void* data, size_t size, long long pts);
+
+	/// Flush the delayed frames and write the trailer
+	virtual bool close();
+
+	bool isOpen() const { return mEncoder.isOpen(); }
+
+protected:
+	FFmpegLibavEncoder	mEncoder;
+};
+
+
+/**
+* An encoder whose preset and crf follow a PresetController, from the throughput measured on the counters of the session.
+*
+* With a segmenter, the controller is updated at each keyframe boundary (every keyframeInterval seconds of video) : when it changes level,
+* the frame of the boundary starts a new encoder of that level (ffmpeg process or libav encoder, from the factory) muxing into the next
+* stream of the segmenter (see Mp4Segmenter::nextStream), while the previous encoder completes its frames on a thread of its own.
+* No frame is lost or waits for an encoder to finish. The interval following a change measures the encoder start, it is not used.
+* Without segmenter (a single file) the encoder is kept for the whole session and the controller is updated once at close()
+* with the interval from open() to the last boundary, for the next session.
+*/
+class AdaptiveEncoderSink : public FrameSink
+{
+public:
+	/// Start an encoder of the preset (index of FFmpegVideoRecorderProcess::PRESET) and crf muxing to the named pipe fifo, nullptr if it failed
+	typedef std::function<FrameSink*(unsigned int preset, unsigned int crf, const std::string& fifo)> EncoderFactory;
+
+	AdaptiveEncoderSink();
+	virtual ~AdaptiveEncoderSink(); ///< close
+
+	/// Take the encoder of the current level of controller (opened, owned from now on), muxing to fifo if segmenter is given.
+	/// stats : the counters of the session (frames written, write times, writer queue), keyframeInterval : in seconds (0 : 2).
+	/// Nothing is owned but the encoders.
+	bool open(FrameSink* encoder, const Format& format, EncoderFactory factory, PresetController* controller, const CaptureCounters* stats,
+			  unsigned int keyframeInterval, Mp4Segmenter* segmenter, const std::string& fifo);
+
+	/// The buffer of the current encoder
+	virtual unsigned char* frameBuffer();
+	virtual bool write(const void* data, size_t size, long long pts);
+
+	/// Close the encoders (the current one, and the replaced one if still completing its frames)
+	virtual bool close();
+
+	bool isOpen() const { return mEncoder != nullptr; }
+
+	/// Encoders replaced since open()
+	unsigned int switches() const { return mSwitches; }
+
+protected:
+	/// Replace the encoder by one of the current level of the controller, return the previous one and its named pipe (nullptr if it failed)
+	FrameSink* switchEncoder(std::string& previousFifo);
+
+	/// Close a replaced encoder on mCloser, then end its stream
+	void retire(FrameSink* encoder, const std::string& fifo);
+
+protected:
+	FrameSink*				mEncoder;		///< current encoder (nullptr if closed)
+	std::string				mFifo;			///< where it muxes to
+	Format					mFormat;
+	EncoderFactory			mFactory;
+	PresetController*		mController;
+	const CaptureCounters*	mStats;
+	Mp4Segmenter*			mSegmenter;		///< nullptr : the encoder is not replaced anymore
+	bool					mSingle;		///< a single file : the encoder is never replaced, the session is measured as a whole
+	unsigned int			mKeyframeInterval;
+	long long				mFrames;		///< frames written (video time of the frames of a constant frame rate session)
+	double					mNextBoundary;	///< video time of the next keyframe boundary in seconds
+	CaptureStats			mLast;			///< counters at the last boundary (at open() for a single file)
+	CaptureStats			mSession;		///< a single file : the interval from open() to the last boundary
+	bool					mSettling;		///< the encoder was just replaced : the next interval is not measured
+	std::thread				mCloser;		///< completes the replaced encoder
+	unsigned int			mSwitches;
+};
+
+
+/**
+* The frames written as is to a file, without encoding : the cheapest way to the disk (at the cost of its bandwidth).
+* The file is a NUT stream of rawvideo (timestamps, resolution and pixel format included), which ffmpeg reads as is
+* (e.g. ffmpeg -i capture.nut -vf vflip out.mp4 for rgba frames). Its buffering is left to the kernel page cache.
+*/
+class RawFileSink : public FrameSink
+{
+public:
+	RawFileSink();
+	virtual ~RawFileSink(); ///< close
+
+	/// Create the file (failing if it exists and overwrite is false)
+	bool open(const std::string& filePath, const Format& format, bool overwrite);
+
+	virtual bool write(const void* data, size_t size, long long pts);
+	virtual bool close();
+
+	bool isOpen() const { return mFile != nullptr; }
+
+protected:
+	bool writeBytes(const void* data, size_t size);
+
+protected:
+	FILE*				mFile;
+	NutMuxer*			mNut;
+	long long			mFrames;	///< frames written (pts of the frames of a constant frame rate session)
+};
+
+
+/**
+* The frames read back or converted straight into a preallocated memory-mapped file (see MappedRawFile) :
+* lossless capture without encoding nor copy, limited by the disk bandwidth only.
+*/
+class MappedFileSink : public FrameSink
+{
+public:
+	MappedFileSink();
+	virtual ~MappedFileSink(); ///< close
+
+	/// Create the file (failing if it exists and overwrite is false), growing by chunkFrames frames
+	bool open(const std::string& filePath, const Format& format, bool overwrite, unsigned int chunkFrames);
+
+	virtual unsigned char* frameBuffer();
+	virtual bool write(const void* data, size_t size, long long pts);
+
+	/// Truncate the file to the frames written and unmap it
+	virtual bool close();
+
+	bool isOpen() const;
+
+protected:
+	MappedRawFile*		mFile;
+	long long			mFrames;	///< frames written (pts of the frames of a constant frame rate session)
+};
+
+
+/**
+* The frames compressed without loss (see FrameCodec) then written to a file : a raw capture at a fraction of the disk bandwidth.
+* The file is a FileHeader, then for each frame a FrameRecord followed by its compressed bytes.
+* The Transcoder tool decodes it to feed ffmpeg (a frame is decoded from the previous keyframe).
+*/
+class CompressedFileSink : public FrameSink
+{
+public:
+	/// Start of the file (native endianness)
+	struct FileHeader
+	{
+		char				magic[8];		///< "VCAPQOI"
+		unsigned int		version;
+		int					width;
+		int					height;
+		char				pixFmt[16];		///< "rgba" (rows bottom-up), "yuv420p" or "nv12" (rows top-down)
+		unsigned int		timeBase;		///< pts in 1/timeBase seconds (0 : pts is the frame index at frameRate)
+		unsigned int		frameRate;
+		unsigned long long	frameSize;		///< bytes of a decompressed frame
+	};
+
+	/// Before the compressed bytes of each frame
+	struct FrameRecord
+	{
+		long long			pts;
+		unsigned long long	size;			///< compressed bytes following
+	};
+
+	CompressedFileSink();
+	virtual ~CompressedFileSink(); ///< close
+
+	/// Create the file (failing if it exists and overwrite is false), with a keyframe every keyframeInterval frames
+	/// compressed by stripes on stripes threads (0 : one per hardware thread)
+	bool open(const std::string& filePath, const Format& format, bool overwrite, unsigned int keyframeInterval, unsigned int stripes = 0);
+
+	virtual bool write(const void* data, size_t size, long long pts);
+	virtual bool close();
+
+	bool isOpen() const { return mFile != nullptr; }
+
+	unsigned long long	rawBytes() const		{ return mRawBytes; }
+	unsigned long long	compressedBytes() const	{ return mCompressedBytes; }	///< records included
+	double				encodeMs() const		{ return mEncodeMs; }			///< total time spent compressing
+
+protected:
+	FILE*						mFile;
+	FrameCodec*					mCodec;
+	std::vector<unsigned char>	mCompressed;
+	long long					mFrames;	///< frames written (pts of the frames of a constant frame rate session)
+	unsigned long long			mRawBytes;
+	unsigned long long			mCompressedBytes;
+	double						mEncodeMs;
+};
+
+
+/**
+* Discard the frames : measures the capture side alone (read back, conversion, queues) with nothing downstream.
+*/
+class NullSink : public FrameSink
+{
+public:
+	NullSink() : mFrames(0), mBytes(0) {}
+
+	virtual bool write(const void* data, size_t size, long long pts) { (void)data; (void)pts; mFrames++; mBytes += size; return true; }
+
+	unsigned long long frames() const	{ return mFrames; }
+	unsigned long long bytes() const	{ return mBytes; }
+
+protected:
+	unsigned long long	mFrames;
+	unsigned long long	mBytes;
+};
+
+
+/**
+* Publish the frames in a POSIX shared memory ring another local process reads in place (see SharedMemoryRing).
+* The frames are built straight into the ring (no copy on either side), and dropped while the ring is full.
+*/
+class SharedMemorySink : public FrameSink
+{
+public:
+	SharedMemorySink();
+	virtual ~SharedMemorySink(); ///< close
+
+	/// Create the shared memory name ("/something") holding slotCount frames
+	bool open(const std::string& name, const Format& format, unsigned int slotCount);
+
+	virtual unsigned char* frameBuffer();
+	virtual bool write(const void* data, size_t size, long long pts);
+
+	/// Mark the stream over and remove the name (an attached consumer can still read the last frames)
+	virtual bool close();
+
+	bool isOpen() const;
+
+protected:
+	SharedMemoryRing*	mRing;
+	unsigned char*		mReserved;	///< slot handed out by frameBuffer() and not written yet
+	long long			mFrames;	///< frames given (pts of the frames of a constant frame rate session)
+};
@@ -0,0 +1,256 @@
+#include "MappedRawFile.h"
+
+#include <iostream>
+#include <fstream>
+#include <cstring>	// memcpy, strncpy, memcmp
+
+#ifndef WIN32
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+#if defined(__linux__) && !defined(MADV_POPULATE_WRITE)
+	#define MADV_POPULATE_WRITE 23 // Linux 5.14, ignored (EINVAL) by older kernels
+#endif
+
+static const char gMagic[8] = "VCAPRAW";
+
+
+//===========================================================================================================
+
+bool MappedRawFile::available()
+{
+#ifndef WIN32
+	return true;
+#else
+	return false;
+#endif
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+MappedRawFile::MappedRawFile()
+	: mFd(-1), mHeader(nullptr), mMapSize(0), mDataOffset(0), mFrameStride(0), mCapacity(0), mChunkFrames(0), mPopulated(0), mWritable(false)
+{
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+MappedRawFile::~MappedRawFile()
+{
+	close();
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool MappedRawFile::create(const std::string& filePath, bool overwrite, unsigned int chunkFrames, size_t frameSize, int width, int height,
+						   const std::string& pixFmt, unsigned int timeBase, unsigned int frameRate)
+{
+#ifndef WIN32
+	close();
+	if(chunkFrames == 0 || frameSize == 0) return false;
+	if(!overwrite && std::ifstream(filePath.c_str(), std::ios::binary).is_open())
+	{
+		std::cerr<<"[MappedRawFile] "<<filePath<<" already exists"<<std::endl;
+		return false;
+	}
+	mFd = ::open(filePath.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if(mFd < 0)
+	{
+		std::cerr<<"[MappedRawFile] can not create "<<filePath<<std::endl;
+		return false;
+	}
+
+	// frames start on a page (the read back may be done by DMA into them), their header follows on a cache line
+	size_t page		= size_t(sysconf(_SC_PAGESIZE));
+	mPath			= filePath;
+	mWritable		= true;
+	mChunkFrames	= chunkFrames;
+	mPopulated		= 0;
+	mDataOffset		= (sizeof(Header) + page - 1) / page * page;
+	mFrameStride	= ((frameSize + 63) / 64 * 64 + sizeof(FrameHeader) + page - 1) / page * page;
+	if(!map(chunkFrames))
+	{
+		close();
+		std::remove(filePath.c_str());
+		return false;
+	}
+
+	Header header;
+	std::memset(&header, 0, sizeof(header));
+	header.version		= VERSION;
+	header.dataOffset	= (unsigned int)mDataOffset;
+	header.width		= width;
+	header.height		= height;
+	std::strncpy(header.pixFmt, pixFmt.c_str(), sizeof(header.pixFmt) - 1);
+	header.timeBase		= timeBase;
+	header.frameRate	= frameRate;
+	header.frameSize	= frameSize;
+	header.frameStride	= mFrameStride;
+	header.frameCount	= 0;
+	std::memcpy(header.magic, gMagic, sizeof(gMagic));
+	std::memcpy(mHeader, &header, sizeof(header));
+	return true;
+#else
+	(void)filePath; (void)overwrite; (void)chunkFrames; (void)frameSize; (void)width; (void)height; (void)pixFmt; (void)timeBase; (void)frameRate;
+	std::cerr<<"[MappedRawFile] only available on POSIX systems"<<std::endl;
+	return false;
+#endif
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+unsigned char* MappedRawFile::reserve()
+{
+	if(mHeader == nullptr || !mWritable) return nullptr;
+	unsigned long long index = mHeader->frameCount;
+	if(index >= mCapacity && !map(mCapacity + mChunkFrames))
+		return nullptr;
+#ifdef __linux__
+	if(index == mPopulated)
+	{
+		// fault the slot in at once (a frame is thousands of fresh pages) rather than page by page while the frame is read back into it
+		madvise(slot(index), size_t(mFrameStride), MADV_POPULATE_WRITE);
+		mPopulated = index + 1;
+	}
+#endif
+	return slot(index);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void MappedRawFile::commit(size_t size, long long pts)
+{
+	unsigned long long index = mHeader->frameCount;
+	FrameHeader* header	= frameHeader(index);
+	header->pts			= pts;
+	header->size		= size;
+	mHeader->frameCount	= index + 1;
+#ifdef __linux__
+	// start writing the frame back now (without waiting) rather than letting the dirty pages pile up until a stall of the writeback
+	sync_file_range(mFd, off_t(mDataOffset + index * mFrameStride), off_t(mFrameStride), SYNC_FILE_RANGE_WRITE);
+#endif
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool MappedRawFile::open(const std::string& filePath)
+{
+#ifndef WIN32
+	close();
+	mFd = ::open(filePath.c_str(), O_RDONLY);
+	if(mFd < 0)
+	{
+		std::cerr<<"[MappedRawFile] can not open "<<filePath<<std::endl;
+		return false;
+	}
+	struct stat status;
+	void* memory = fstat(mFd, &status) == 0 && size_t(status.st_size) >= sizeof(Header)
+				 ? mmap(nullptr, size_t(status.st_size), PROT_READ, MAP_SHARED, mFd, 0) : MAP_FAILED;
+	const Header* header = static_cast<const Header*>(memory);
+	if(memory == MAP_FAILED || std::memcmp(header->magic, gMagic, sizeof(gMagic)) != 0 || header->version != VERSION
+	   || header->frameStride == 0 || header->dataOffset > (unsigned long long)status.st_size)
+	{
+		std::cerr<<"[MappedRawFile] "<<filePath<<" is not a raw capture of version "<<VERSION<<std::endl;
+		if(memory != MAP_FAILED)
+			munmap(memory, size_t(status.st_size));
+		::close(mFd);
+		mFd = -1;
+		return false;
+	}
+	madvise(memory, size_t(status.st_size), MADV_SEQUENTIAL);
+	mPath			= filePath;
+	mWritable		= false;
+	mHeader			= static_cast<Header*>(memory);
+	mMapSize		= size_t(status.st_size);
+	mDataOffset		= header->dataOffset;
+	mFrameStride	= header->frameStride;
+	mCapacity		= (mMapSize - mDataOffset) / mFrameStride;
+	return true;
+#else
+	(void)filePath;
+	return false;
+#endif
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+const unsigned char* MappedRawFile::frame(unsigned long long index, size_t& size, long long& pts) const
+{
+	if(mHeader == nullptr || index >= mHeader->frameCount || index >= mCapacity)
+		return nullptr; // a crash may leave a count beyond the slots written to the disk
+	const FrameHeader* header = frameHeader(index);
+	size	= size_t(header->size);
+	pts		= header->pts;
+	return slot(index);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void MappedRawFile::close()
+{
+#ifndef WIN32
+	if(mHeader != nullptr)
+	{
+		unsigned long long frames = mHeader->frameCount;
+		munmap(mHeader, mMapSize);
+		if(mWritable && ftruncate(mFd, off_t(mDataOffset + frames * mFrameStride)) != 0) // give back the unused preallocation
+			std::cerr<<"[MappedRawFile] can not truncate "<<mPath<<" to its "<<frames<<" frames"<<std::endl;
+	}
+	if(mFd >= 0)
+		::close(mFd);
+	mFd			= -1;
+	mHeader		= nullptr;
+	mMapSize	= 0;
+	mCapacity	= 0;
+	mWritable	= false;
+#endif
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool MappedRawFile::map(unsigned long long frames)
+{
+#ifndef WIN32
+	size_t size = size_t(mDataOffset + frames * mFrameStride);
+	int error = posix_fallocate(mFd, 0, off_t(size)); // real blocks : writing a page of a full disk would be a SIGBUS
+	if(error != 0)
+	{
+		std::cerr<<"[MappedRawFile] can not preallocate "<<size<<" bytes for "<<mPath<<" (disk full?), frames dropped..."<<std::endl;
+		return false;
+	}
+
+	void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, mFd, 0);
+	if(memory == MAP_FAILED)
+	{
+		std::cerr<<"[MappedRawFile] can not map "<<size<<" bytes of "<<mPath<<std::endl;
+		return false;
+	}
+	if(mHeader != nullptr)
+		munmap(mHeader, mMapSize);
+	madvise(memory, size, MADV_SEQUENTIAL);
+	mHeader		= static_cast<Header*>(memory);
+	mMapSize	= size;
+	mCapacity	= frames;
+	return true;
+#else
+	(void)frames;
+	return false;
+#endif
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+unsigned char* MappedRawFile::slot(unsigned long long index) const
+{
+	return reinterpret_cast<unsigned char*>(mHeader) + mDataOffset + index * mFrameStride;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+MappedRawFile::FrameHeader* MappedRawFile::frameHeader(unsigned long long index) const
+{
+	return reinterpret_cast<FrameHeader*>(slot(index) + (mHeader->frameSize + 63) / 64 * 64);
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+
+/**
+* Raw frames file preallocated and mapped in memory (mmap) : the frames are read back or converted straight into the file pages,
+* so a capture costs no encoding and no copy, only the disk bandwidth (the writeback of each frame is started once committed).
+*
+* The file starts with a Header page (resolution, pixel format, frame geometry and count), followed by one page-aligned slot per frame :
+* the frame bytes, then a FrameHeader (pts and size). The file grows by preallocated chunks of frames (posix_fallocate, so a full disk
+* is an error when growing instead of a SIGBUS when writing), and is truncated to the frames written when closed.
+* frameCount is updated after each frame : a file cut short by a crash is readable up to its last complete frame.
+*
+* The same class reads the file back (see open()). POSIX only (see available()).
+*/
+class MappedRawFile
+{
+public:
+	static const unsigned int VERSION = 1;
+
+	/// The first page of the file (fixed size types, native endianness)
+	struct Header
+	{
+		char				magic[8];		///< "VCAPRAW"
+		unsigned int		version;
+		unsigned int		dataOffset;		///< bytes from the start of the file to the first frame (a page)
+		int					width;
+		int					height;
+		char				pixFmt[16];		///< "rgba" (rows bottom-up), "yuv420p" or "nv12" (rows top-down)
+		unsigned int		timeBase;		///< pts in 1/timeBase seconds (0 : pts is the frame index at frameRate)
+		unsigned int		frameRate;
+		unsigned long long	frameSize;		///< maximal bytes of a frame
+		unsigned long long	frameStride;	///< bytes between two frames (page aligned, FrameHeader included)
+		unsigned long long	frameCount;		///< frames written
+	};
+
+	/// After the bytes of each frame (at frameSize rounded up to 64 bytes from the start of its slot)
+	struct FrameHeader
+	{
+		long long			pts;
+		unsigned long long	size;
+	};
+
+	/// Is the mapped file implemented on this system
+	static bool available();
+
+	MappedRawFile();
+	virtual ~MappedRawFile(); ///< close
+
+	// writer side
+
+	/// Create (or replace if overwrite) the file for frames of at most frameSize bytes, preallocated chunkFrames frames at a time
+	bool create(const std::string& filePath, bool overwrite, unsigned int chunkFrames, size_t frameSize, int width, int height,
+				const std::string& pixFmt, unsigned int timeBase, unsigned int frameRate);
+
+	/// Where to build the next frame in the mapping (the file grows if needed), nullptr if it can not grow
+	unsigned char* reserve();
+
+	/// Count the frame built in the reserved slot
+	void commit(size_t size, long long pts);
+
+	// reader side
+
+	/// Map an existing file read only
+	bool open(const std::string& filePath);
+
+	/// Bytes of the frame index (and its size and pts), nullptr if out of range
+	const unsigned char* frame(unsigned long long index, size_t& size, long long& pts) const;
+
+	// both sides
+
+	/// Unmap the file (truncated to its frames if written here)
+	void close();
+
+	bool				isOpen() const		{ return mHeader != nullptr; }
+	const Header*		header() const		{ return mHeader; }
+	unsigned long long	frameCount() const	{ return mHeader != nullptr ? mHeader->frameCount : 0; }
+
+protected:
+	/// Map the first frames slots of the file (growing it first if writable)
+	bool map(unsigned long long frames);
+
+	unsigned char*	slot(unsigned long long index) const;
+	FrameHeader*	frameHeader(unsigned long long index) const;
+
+protected:
+	std::string			mPath;
+	int					mFd;
+	Header*				mHeader;		///< start of the mapping (nullptr if closed)
+	size_t				mMapSize;
+	unsigned long long	mDataOffset;	///< copies of the header geometry (needed to map it)
+	unsigned long long	mFrameStride;
+	unsigned long long	mCapacity;		///< frames slots mapped
+	unsigned int		mChunkFrames;	///< frames preallocated at once
+	unsigned long long	mPopulated;		///< frames slots faulted in ahead of the read back
+	bool				mWritable;
+};
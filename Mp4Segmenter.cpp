@@ -0,0 +1,603 @@
+#include "Mp4Segmenter.h"
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>	// setfill, setw
+#include <cstring>	// memcmp
+#include <cstdio>	// fopen, remove, rename
+#include <algorithm>// std::min, std::max
+
+#ifndef WIN32
+	#include <sys/stat.h>	// mkfifo
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <cerrno>
+#endif
+
+
+//===========================================================================================================
+// mp4 boxes (ISO/IEC 14496-12)
+
+static inline unsigned int read32(const unsigned char* p)
+{
+	return (unsigned int)p[0] << 24 | (unsigned int)p[1] << 16 | (unsigned int)p[2] << 8 | (unsigned int)p[3];
+}
+
+static inline unsigned long long read64(const unsigned char* p)
+{
+	return (unsigned long long)read32(p) << 32 | read32(p + 4);
+}
+
+/// Size of the box header at data (0 if incomplete) and size of the whole box (0 : up to the end)
+static size_t boxHeader(const unsigned char* data, size_t available, unsigned long long& boxSize)
+{
+	if(available < 8) return 0;
+	boxSize = read32(data);
+	if(boxSize != 1) return 8;
+	if(available < 16) return 0;
+	boxSize = read64(data + 8); // largesize
+	return 16;
+}
+
+/// Call visit(type, payload, payloadSize) for each child box of a container payload
+template<typename Visitor>
+static void forEachBox(const unsigned char* data, size_t size, Visitor visit)
+{
+	size_t offset = 0;
+	while(offset < size)
+	{
+		unsigned long long boxSize = 0;
+		size_t header = boxHeader(data + offset, size - offset, boxSize);
+		if(header == 0) return;
+		if(boxSize == 0) boxSize = size - offset;
+		if(boxSize < header || boxSize > size - offset) return; // corrupted
+		visit(data + offset + 4, data + offset + header, size_t(boxSize) - header);
+		offset += size_t(boxSize);
+	}
+}
+
+static inline bool isType(const unsigned char* type, const char* name)
+{
+	return std::memcmp(type, name, 4) == 0;
+}
+
+/// The playlist path without its extension (prefix of its files)
+static std::string basePath(const std::string& playlistPath)
+{
+	std::string::size_type dot		= playlistPath.find_last_of('.');
+	std::string::size_type slash	= playlistPath.find_last_of("/\\");
+	return dot != std::string::npos && (slash == std::string::npos || dot > slash) ? playlistPath.substr(0, dot) : playlistPath;
+}
+
+/// The file name of a path (relative to its directory, as listed in the playlist)
+static std::string fileName(const std::string& path)
+{
+	std::string::size_type slash = path.find_last_of("/\\");
+	return slash != std::string::npos ? path.substr(slash + 1) : path;
+}
+
+/// The path of a file named name in the directory of path
+static std::string siblingPath(const std::string& path, const std::string& name)
+{
+	std::string::size_type slash = path.find_last_of("/\\");
+	return slash != std::string::npos ? path.substr(0, slash + 1) + name : name;
+}
+
+
+//===========================================================================================================
+
+bool Mp4Segmenter::available()
+{
+#ifndef WIN32
+	return true;
+#else
+	return false;
+#endif
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+std::string Mp4Segmenter::fifoPath(const std::string& playlistPath)
+{
+	return playlistPath + ".fifo";
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+std::string Mp4Segmenter::segmentPath(const std::string& playlistPath, unsigned int index)
+{
+	std::stringstream path;
+	path << basePath(playlistPath) << "_" << std::setfill('0') << std::setw(5) << index << ".mp4";
+	return path.str();
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+std::string Mp4Segmenter::initPath(const std::string& playlistPath, unsigned int index)
+{
+	std::stringstream path;
+	path << basePath(playlistPath) << "_init";
+	if(index != 0)
+		path << "_" << index;
+	path << ".mp4";
+	return path.str();
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+Mp4Segmenter::Mp4Segmenter()
+	: mMaxDuration(0), mTargetDuration(0), mMaxBytes(0), mKeepSegments(0), mOpen(false), mStreamCount(0), mClosing(false)
+	, mInitCount(0), mTimescale(0), mDefaultDuration(0), mFragmentStart(0), mFragmentDuration(0)
+	, mSegment(nullptr), mSegmentBytes(0), mSegmentStart(0), mSegmentEnd(0), mIndex(0), mFirstIndex(0)
+	, mDiscontinuity(false), mSegmentDiscontinuity(false), mDiscontinuities(0)
+{
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+Mp4Segmenter::~Mp4Segmenter()
+{
+	close();
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool Mp4Segmenter::open(const std::string& playlistPath, unsigned int maxDurationMs, size_t maxBytes, unsigned int keepSegments)
+{
+#ifndef WIN32
+	close();
+	mPlaylist		= playlistPath;
+	mFifo			= fifoPath(playlistPath);
+	mMaxDuration	= maxDurationMs != 0 ? maxDurationMs : DEFAULT_DURATION;
+	mTargetDuration	= (unsigned int)std::max((mMaxDuration + 500) / 1000, 1ULL); // the players reload the playlist every target duration
+	mMaxBytes		= maxBytes;
+	mKeepSegments	= keepSegments;
+	mInit.clear();
+	mInitName.clear();
+	mInitCount		= 0;
+	mFragment.clear();
+	mTimescale		= 0;
+	mDefaultDuration= 0;
+	mIndex			= 0;
+	mFirstIndex		= 0;
+	mDiscontinuity	= false;
+	mDiscontinuities= 0;
+	mSegments.clear();
+	mStreamCount	= 0;
+	mClosing		= false;
+
+	if(!openStream(mFifo))
+		return false;
+	mOpen	= true;
+	mReader = std::thread(&Mp4Segmenter::run, this);
+	return true;
+#else
+	(void)playlistPath; (void)maxDurationMs; (void)maxBytes; (void)keepSegments;
+	std::cerr<<"[Mp4Segmenter] named pipes are not available on this system"<<std::endl;
+	return false;
+#endif
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void Mp4Segmenter::close()
+{
+#ifndef WIN32
+	if(!mOpen) return;
+
+	// the muxers are done : the reader gets the end of their streams once our write ends are closed too
+	{
+		std::lock_guard<std::mutex> lock(mStreamMutex);
+		mClosing = true;
+		for(Stream& stream : mStreams)
+		{
+			if(stream.writeFd >= 0)
+				::close(stream.writeFd);
+			stream.writeFd = -1;
+		}
+		mStreamCondition.notify_all();
+	}
+	if(mReader.joinable())
+		mReader.join();
+	mOpen = false;
+
+	if(mSegment != nullptr)
+		closeSegment();
+	if(mIndex != 0)
+		writePlaylist(true);
+	else
+		for(unsigned int i = 0; i < mInitCount; i++) // nothing to play (e.g. a standby muxer discarded)
+			std::remove(initPath(mPlaylist, i).c_str());
+#endif
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+std::string Mp4Segmenter::nextStream()
+{
+#ifndef WIN32
+	std::lock_guard<std::mutex> lock(mStreamMutex);
+	if(!mOpen || mClosing)
+		return std::string();
+	std::stringstream fifo;
+	fifo << mFifo << "." << mStreamCount;
+	if(!openStream(fifo.str()))
+		return std::string();
+	mStreamCondition.notify_all();
+	return fifo.str();
+#else
+	return std::string();
+#endif
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void Mp4Segmenter::endStream(const std::string& fifo)
+{
+#ifndef WIN32
+	std::lock_guard<std::mutex> lock(mStreamMutex);
+	for(Stream& stream : mStreams)
+	{
+		if(stream.fifo == fifo && stream.writeFd >= 0)
+		{
+			::close(stream.writeFd);
+			stream.writeFd = -1;
+		}
+	}
+#else
+	(void)fifo;
+#endif
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool Mp4Segmenter::openStream(const std::string& fifo)
+{
+#ifndef WIN32
+	std::remove(fifo.c_str()); // left by a crashed session
+	if(mkfifo(fifo.c_str(), S_IRUSR | S_IWUSR) != 0)
+	{
+		std::cerr<<"[Mp4Segmenter] can not create the named pipe "<<fifo<<" : "<<std::strerror(errno)<<std::endl;
+		return false;
+	}
+	// open both ends now : nothing blocks, and the reader waits for the muxer instead of seeing an empty stream
+	Stream stream;
+	stream.fifo		= fifo;
+	stream.readFd	= ::open(fifo.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	stream.writeFd	= stream.readFd >= 0 ? ::open(fifo.c_str(), O_WRONLY | O_CLOEXEC) : -1;
+	if(stream.writeFd < 0)
+	{
+		std::cerr<<"[Mp4Segmenter] can not open the named pipe "<<fifo<<" : "<<std::strerror(errno)<<std::endl;
+		if(stream.readFd >= 0) ::close(stream.readFd);
+		std::remove(fifo.c_str());
+		return false;
+	}
+	fcntl(stream.readFd, F_SETFL, fcntl(stream.readFd, F_GETFL) & ~O_NONBLOCK);
+	mStreams.push_back(stream);
+	mStreamCount++;
+	return true;
+#else
+	(void)fifo;
+	return false;
+#endif
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void Mp4Segmenter::run()
+{
+#ifndef WIN32
+	while(true)
+	{
+		int fd = -1;
+		{
+			std::unique_lock<std::mutex> lock(mStreamMutex);
+			mStreamCondition.wait(lock, [this]() { return !mStreams.empty() || mClosing; });
+			if(mStreams.empty())
+				return;
+			fd = mStreams.front().readFd;
+		}
+		read(fd);
+		mFragment.clear(); // a moof whose mdat never came
+
+		std::lock_guard<std::mutex> lock(mStreamMutex);
+		::close(fd);
+		std::remove(mStreams.front().fifo.c_str());
+		mStreams.pop_front();
+	}
+#endif
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void Mp4Segmenter::read(int fd)
+{
+#ifndef WIN32
+	std::vector<unsigned char> buffer;
+	size_t	begin	= 0;	// first byte of buffer not consumed yet
+	bool	skip	= false;// the current box is not needed : drop its bytes as they come
+	unsigned long long skipLeft = 0;
+	unsigned char chunk[65536];
+	while(true)
+	{
+		ssize_t count = ::read(fd, chunk, sizeof(chunk));
+		if(count < 0 && errno == EINTR) continue;
+		if(count <= 0) break; // end of the stream (or error)
+
+		size_t offset = 0;
+		if(skip)
+		{
+			size_t dropped = size_t(std::min<unsigned long long>(skipLeft, (unsigned long long)count));
+			skipLeft -= dropped;
+			offset	  = dropped;
+			skip	  = skipLeft != 0;
+		}
+		buffer.insert(buffer.end(), chunk + offset, chunk + count);
+
+		// split the complete top level boxes
+		while(!skip)
+		{
+			unsigned long long boxSize = 0;
+			size_t header = boxHeader(buffer.data() + begin, buffer.size() - begin, boxSize);
+			if(header == 0) break;
+			const unsigned char* type = buffer.data() + begin + 4;
+			bool needed = isType(type, "ftyp") || isType(type, "moov") || isType(type, "moof") || isType(type, "mdat");
+			if(boxSize == 0 || boxSize < header)
+			{
+				std::cerr<<"[Mp4Segmenter] unexpected box in the stream, stop segmenting"<<std::endl;
+				skip	 = true;
+				skipLeft = ~0ULL;
+				break;
+			}
+			if(!needed && buffer.size() - begin < boxSize)
+			{
+				// mfra, sidx... : not kept, do not buffer them
+				skipLeft = boxSize - (buffer.size() - begin);
+				skip	 = true;
+				begin	 = buffer.size();
+				break;
+			}
+			if(buffer.size() - begin < boxSize) break;
+			if(needed)
+				box(buffer.data() + begin, size_t(boxSize));
+			begin += size_t(boxSize);
+		}
+		// drop the consumed bytes
+		buffer.erase(buffer.begin(), buffer.begin() + begin);
+		begin = 0;
+	}
+#endif
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void Mp4Segmenter::box(const unsigned char* data, size_t size)
+{
+	const unsigned char* type = data + 4;
+	if(isType(type, "ftyp"))
+	{
+		if(!mInit.empty())
+		{
+			// another muxer took over : its fragments go to a segment of their own
+			if(mSegment != nullptr)
+				closeSegment();
+			mDiscontinuity = true;
+		}
+		mInit.assign(data, data + size);
+	}
+	else if(isType(type, "moov"))
+	{
+		mInit.insert(mInit.end(), data, data + size);
+		parseMovie(data + 8, size - 8);
+		writeInit();
+	}
+	else if(isType(type, "moof"))
+	{
+		mFragment.assign(data, data + size);
+		parseFragment(data + 8, size - 8);
+	}
+	else if(isType(type, "mdat") && !mFragment.empty())
+	{
+		mFragment.insert(mFragment.end(), data, data + size);
+		writeFragment();
+	}
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void Mp4Segmenter::parseMovie(const unsigned char* data, size_t size)
+{
+	// moov/trak/mdia/mdhd : timescale of the (single) track
+	forEachBox(data, size, [this](const unsigned char* type, const unsigned char* trak, size_t trakSize)
+	{
+		if(!isType(type, "trak")) return;
+		forEachBox(trak, trakSize, [this](const unsigned char* type, const unsigned char* mdia, size_t mdiaSize)
+		{
+			if(!isType(type, "mdia")) return;
+			forEachBox(mdia, mdiaSize, [this](const unsigned char* type, const unsigned char* mdhd, size_t mdhdSize)
+			{
+				if(!isType(type, "mdhd")) return;
+				size_t offset = mdhd[0] == 1 ? 4 + 16 : 4 + 8; // version 1 : 64 bits creation and modification times
+				if(mdhdSize >= offset + 4)
+					mTimescale = read32(mdhd + offset);
+			});
+		});
+	});
+	// moov/mvex/trex : default sample duration
+	forEachBox(data, size, [this](const unsigned char* type, const unsigned char* mvex, size_t mvexSize)
+	{
+		if(!isType(type, "mvex")) return;
+		forEachBox(mvex, mvexSize, [this](const unsigned char* type, const unsigned char* trex, size_t trexSize)
+		{
+			if(isType(type, "trex") && trexSize >= 4 + 12 + 4)
+				mDefaultDuration = read32(trex + 4 + 8);
+		});
+	});
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void Mp4Segmenter::writeInit()
+{
+	std::string path = initPath(mPlaylist, mInitCount++);
+	FILE* file = std::fopen(path.c_str(), "wb");
+	if(file == nullptr || std::fwrite(mInit.data(), 1, mInit.size(), file) != mInit.size())
+	{
+		std::cerr<<"[Mp4Segmenter] can not write the init section "<<path<<std::endl;
+		mInitName.clear();
+	}
+	else
+		mInitName = fileName(path);
+	if(file != nullptr)
+		std::fclose(file);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void Mp4Segmenter::parseFragment(const unsigned char* data, size_t size)
+{
+	mFragmentStart		= 0;
+	mFragmentDuration	= 0;
+	forEachBox(data, size, [this](const unsigned char* type, const unsigned char* traf, size_t trafSize)
+	{
+		if(!isType(type, "traf")) return;
+		unsigned int defaultDuration = mDefaultDuration;
+		forEachBox(traf, trafSize, [&](const unsigned char* type, const unsigned char* p, size_t boxSize)
+		{
+			if(boxSize < 4) return;
+			unsigned int flags = read32(p) & 0xFFFFFF;
+			if(isType(type, "tfhd"))
+			{
+				size_t offset = 4 + 4;			// track_ID
+				if(flags & 0x01) offset += 8;	// base_data_offset
+				if(flags & 0x02) offset += 4;	// sample_description_index
+				if((flags & 0x08) && boxSize >= offset + 4)
+					defaultDuration = read32(p + offset);
+			}
+			else if(isType(type, "tfdt"))
+			{
+				if(p[0] == 1 && boxSize >= 12)	mFragmentStart = read64(p + 4);
+				else if(boxSize >= 8)			mFragmentStart = read32(p + 4);
+			}
+			else if(isType(type, "trun") && boxSize >= 8)
+			{
+				unsigned int samples	= read32(p + 4);
+				size_t		 offset		= 8;
+				if(flags & 0x001) offset += 4;	// data_offset
+				if(flags & 0x004) offset += 4;	// first_sample_flags
+				size_t		 stride		= ((flags & 0x100) ? 4 : 0) + ((flags & 0x200) ? 4 : 0) + ((flags & 0x400) ? 4 : 0) + ((flags & 0x800) ? 4 : 0);
+				if(!(flags & 0x100))
+					mFragmentDuration += (unsigned long long)samples * defaultDuration;
+				else
+					for(unsigned int i = 0; i < samples && offset + 4 <= boxSize; i++, offset += stride)
+						mFragmentDuration += read32(p + offset);
+			}
+		});
+	});
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void Mp4Segmenter::writeFragment()
+{
+	// cut between two fragments (each starts with a keyframe), before the segment would round above the target duration
+	if(mSegment != nullptr)
+	{
+		unsigned long long duration = mSegmentEnd - mSegmentStart + mFragmentDuration;
+		bool tooLong	= mTimescale != 0 && duration * 1000 >= (mTargetDuration * 1000ULL + 500) * mTimescale;
+		bool tooBig		= mMaxBytes != 0 && mSegmentBytes + mFragment.size() > mMaxBytes;
+		if(tooLong || tooBig)
+			closeSegment();
+	}
+
+	if(mSegment == nullptr)
+	{
+		std::string path = segmentPath(mPlaylist, mIndex);
+		mSegment = std::fopen(path.c_str(), "wb");
+		if(mSegment == nullptr)
+		{
+			std::cerr<<"[Mp4Segmenter] can not create "<<path<<", fragment lost"<<std::endl;
+			mFragment.clear();
+			return;
+		}
+		mSegmentInit	= mInitName;
+		mSegmentBytes	= 0;
+		mSegmentStart	= mFragmentStart;
+		mSegmentDiscontinuity = mDiscontinuity;
+		mDiscontinuity	= false;
+	}
+	std::fwrite(mFragment.data(), 1, mFragment.size(), mSegment);
+	std::fflush(mSegment); // readable up to its last fragment while it is written
+	mSegmentBytes	+= mFragment.size();
+	mSegmentEnd		= mFragmentStart + mFragmentDuration;
+	mFragment.clear();
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void Mp4Segmenter::closeSegment()
+{
+	std::fclose(mSegment);
+	mSegment = nullptr;
+
+	Segment segment;
+	segment.name		= fileName(segmentPath(mPlaylist, mIndex++));
+	segment.init		= mSegmentInit;
+	segment.duration	= mTimescale != 0 ? double(mSegmentEnd - mSegmentStart) / mTimescale : 0.0;
+	segment.discontinuity = mSegmentDiscontinuity;
+	mSegments.push_back(segment);
+
+	// retention : delete the oldest segments, and their init section once no segment listed uses it
+	while(mKeepSegments != 0 && mSegments.size() > mKeepSegments)
+	{
+		std::remove(segmentPath(mPlaylist, mFirstIndex++).c_str());
+		if(mSegments.front().discontinuity)
+			mDiscontinuities++;
+		std::string init = mSegments.front().init;
+		mSegments.pop_front();
+		if(!init.empty() && init != mSegments.front().init)
+			std::remove(siblingPath(mPlaylist, init).c_str());
+	}
+	writePlaylist(false);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void Mp4Segmenter::writePlaylist(bool ended)
+{
+	std::stringstream playlist;
+	playlist << "#EXTM3U\n"
+			 << "#EXT-X-VERSION:7\n"
+			 << "#EXT-X-TARGETDURATION:" << mTargetDuration << "\n"
+			 << "#EXT-X-MEDIA-SEQUENCE:" << mFirstIndex << "\n";
+	if(mDiscontinuities != 0)
+		playlist << "#EXT-X-DISCONTINUITY-SEQUENCE:" << mDiscontinuities << "\n";
+	if(mKeepSegments == 0)
+		playlist << "#EXT-X-PLAYLIST-TYPE:EVENT\n";
+	playlist << std::fixed << std::setprecision(3);
+	const std::string* init = nullptr; // init section of the previous segment listed
+	for(const Segment& segment : mSegments)
+	{
+		if(segment.discontinuity)
+			playlist << "#EXT-X-DISCONTINUITY\n";
+		if(init == nullptr || *init != segment.init)
+			playlist << "#EXT-X-MAP:URI=\"" << segment.init << "\"\n";
+		init = &segment.init;
+		playlist << "#EXTINF:" << segment.duration << ",\n" << segment.name << "\n";
+	}
+	if(ended)
+		playlist << "#EXT-X-ENDLIST\n";
+
+	// replace it at once : a reader never sees a partial playlist
+	std::string temporary = mPlaylist + ".tmp";
+	FILE* file = std::fopen(temporary.c_str(), "wb");
+	if(file == nullptr)
+	{
+		std::cerr<<"[Mp4Segmenter] can not write the playlist "<<mPlaylist<<std::endl;
+		return;
+	}
+	std::string content = playlist.str();
+	std::fwrite(content.data(), 1, content.size(), file);
+	std::fclose(file);
+	std::rename(temporary.c_str(), mPlaylist.c_str());
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdio>
+
+
+/**
+* Cut a fragmented mp4 stream into rolling segments listed in an m3u8 playlist, while it is written.
+*
+* The muxer (an ffmpeg process or the libav encoder) writes a single fragmented mp4 (-movflags +frag_keyframe+empty_moov+default_base_moof)
+* into a named pipe read by a thread of the segmenter : each fragment starts with a keyframe, so a segment is cut between two fragments
+* before it would exceed its maximal duration or its maximal size. The init boxes of the stream (ftyp + moov) are written once to an init
+* section file (EXT-X-MAP of the playlist), each segment holds its fragments (moof + mdat) keeping the timestamps of the stream :
+* the encoder is never restarted and no frame is lost.
+*
+* The playlist is rewritten (atomically) each time a segment is completed, the oldest segments are deleted beyond the retention limit.
+* Its target duration is the maximal duration of a segment (fixed for the whole playlist). Named pipes are POSIX only (see available()).
+*
+* Another muxer can take over the stream (e.g. an encoder restarted with other settings) : nextStream() gives it a named pipe of its own,
+* read once the previous muxer closed its pipe and endStream() was called for it. Its first segment is marked as a discontinuity
+* in the playlist with the init section of the new muxer (new init boxes and timestamps), so the muxers may overlap without waiting for each other.
+*/
+class Mp4Segmenter
+{
+public:
+	/// Can the segmenter be used on this system (named pipes)
+	static bool available();
+
+	/// The named pipe the muxer has to write the fragmented mp4 stream to, for a playlist
+	static std::string fifoPath(const std::string& playlistPath);
+
+	/// The file of the index-th segment of a playlist
+	static std::string segmentPath(const std::string& playlistPath, unsigned int index);
+
+	/// The init section file (ftyp + moov) of the index-th muxer of a playlist
+	static std::string initPath(const std::string& playlistPath, unsigned int index);
+
+	Mp4Segmenter();
+	virtual ~Mp4Segmenter(); ///< close
+
+	/// Create the named pipe of playlistPath and start reading it. A segment is cut before it lasts more than maxDurationMs
+	/// (rounded to the second, the target duration of the playlist, 0 : DEFAULT_DURATION) or exceeds maxBytes (0 : no limit),
+	/// a segment has at least one fragment. Only the keepSegments last completed segments are kept (0 : all).
+	bool open(const std::string& playlistPath, unsigned int maxDurationMs, size_t maxBytes, unsigned int keepSegments);
+
+	/// Once the muxer closed the pipe : complete the last segment, end the playlist and remove the named pipe
+	void close();
+
+	/// Create the named pipe of the next muxer of the stream, read after the pipes of the previous ones (empty if it failed)
+	std::string nextStream();
+
+	/// The muxer of the named pipe fifo (fifoPath() or from nextStream()) closed it : the reader goes on with the next pipe
+	void endStream(const std::string& fifo);
+
+	bool isOpen() const { return mOpen; }
+
+	/// Number of segments created (deleted ones included)
+	unsigned int segmentCount() const { return mIndex; }
+
+	static const unsigned int DEFAULT_DURATION = 60000;	///< maximal duration of a segment without limit given (ms)
+
+protected:
+	/// A completed segment listed in the playlist
+	struct Segment
+	{
+		std::string	name;			///< file name (relative to the playlist)
+		std::string	init;			///< file name of its init section (EXT-X-MAP)
+		double		duration;		///< in seconds
+		bool		discontinuity;	///< first segment of a muxer taking over the stream
+	};
+
+	/// The named pipe of a muxer
+	struct Stream
+	{
+		std::string	fifo;
+		int			readFd;
+		int			writeFd;	///< held until endStream() so the reader does not see the end of the stream before the muxer opened the pipe
+	};
+
+	/// Create and open both ends of a named pipe (mStreamMutex locked)
+	bool openStream(const std::string& fifo);
+
+	/// Reader thread loop : read the pipes of the muxers in turn until close()
+	void run();
+
+	/// Split the stream of a pipe into its top level boxes until its muxer closes it
+	void read(int fd);
+
+	/// Handle a top level box of the stream
+	void box(const unsigned char* data, size_t size);
+
+	/// Read the timescale and the default sample duration of the track from the moov box
+	void parseMovie(const unsigned char* data, size_t size);
+
+	/// Write the init boxes of the stream to the init section file of its muxer
+	void writeInit();
+
+	/// Read the decode time and the duration of the pending fragment from its moof box
+	void parseFragment(const unsigned char* data, size_t size);
+
+	/// Write the pending fragment (moof + mdat) to the current segment, cutting it before if needed
+	void writeFragment();
+
+	/// Complete the current segment and apply the retention limit
+	void closeSegment();
+
+	/// Rewrite the playlist (ended once the stream is over)
+	void writePlaylist(bool ended);
+
+protected:
+	std::string					mPlaylist;
+	std::string					mFifo;
+	unsigned long long			mMaxDuration;		///< in ms
+	unsigned int				mTargetDuration;	///< in seconds (EXT-X-TARGETDURATION)
+	size_t						mMaxBytes;			///< 0 : no limit
+	unsigned int				mKeepSegments;		///< 0 : keep all
+	bool						mOpen;
+	std::deque<Stream>			mStreams;			///< pipes not completely read yet, the first one is read
+	unsigned int				mStreamCount;		///< pipes created (names the next one)
+	bool						mClosing;			///< no more pipe will come
+	std::mutex					mStreamMutex;
+	std::condition_variable		mStreamCondition;	///< a pipe created or close()
+	std::thread					mReader;
+
+	// stream state (reader thread, then close())
+	std::vector<unsigned char>	mInit;				///< ftyp + moov of the current muxer
+	std::string					mInitName;			///< its init section file (relative to the playlist, empty until written)
+	unsigned int				mInitCount;			///< init sections written (names the next one)
+	std::vector<unsigned char>	mFragment;			///< pending moof + mdat
+	unsigned int				mTimescale;			///< ticks per second of the track (0 : unknown)
+	unsigned int				mDefaultDuration;	///< default sample duration of the track (trex)
+	unsigned long long			mFragmentStart;		///< decode time of the pending fragment in ticks
+	unsigned long long			mFragmentDuration;	///< in ticks
+	FILE*						mSegment;			///< segment being written (nullptr between two segments)
+	size_t						mSegmentBytes;
+	unsigned long long			mSegmentStart;		///< decode time of the first fragment of the segment in ticks
+	unsigned long long			mSegmentEnd;
+	std::string					mSegmentInit;		///< init section of the current segment
+	unsigned int				mIndex;				///< index of the next segment
+	unsigned int				mFirstIndex;		///< index of the first segment listed in the playlist
+	bool						mDiscontinuity;		///< the next segment starts the stream of another muxer
+	bool						mSegmentDiscontinuity;	///< the current segment does
+	unsigned int				mDiscontinuities;	///< discontinuities of the segments deleted (EXT-X-DISCONTINUITY-SEQUENCE)
+	std::deque<Segment>			mSegments;			///< completed segments listed in the playlist
+};
@@ -0,0 +1,179 @@
+#include "NutMuxer.h"
+
+// startcodes of the NUT packets
+#define NUT_STARTCODE(ID, CODE)	((((unsigned long long)('N') << 8 | (unsigned long long)(ID)) << 48) + (CODE))
+static const unsigned long long MAIN_STARTCODE		= NUT_STARTCODE('M', 0x7A561F5F04ADULL);
+static const unsigned long long STREAM_STARTCODE	= NUT_STARTCODE('S', 0x11405BF2F9DBULL);
+static const unsigned long long SYNCPOINT_STARTCODE	= NUT_STARTCODE('K', 0xE4ADEECA4569ULL);
+
+// frame flags
+static const unsigned int FLAG_KEY			= 1;
+static const unsigned int FLAG_CODED_PTS	= 8;
+static const unsigned int FLAG_SIZE_MSB		= 32;
+static const unsigned int FLAG_CHECKSUM		= 64;
+static const unsigned int FLAG_INVALID		= 8192;
+
+static const unsigned int	MAX_DISTANCE	= 32768;	// a syncpoint is written before each frame anyway
+static const unsigned int	MSB_PTS_SHIFT	= 7;		// pts are always fully coded
+static const unsigned char	FRAME_CODE		= 1;		// keyframe of stream 0, full pts, size coded in data_size_msb, checksum
+
+
+//===========================================================================================================
+
+NutMuxer::NutMuxer(int width, int height, const std::string& pixFmt, unsigned int timeBase)
+	: mWidth(width), mHeight(height), mTimeBase(timeBase), mPosition(0), mLastSyncpoint(0)
+{
+	// fourcc recognized by the ffmpeg rawvideo decoder
+	if(pixFmt == "yuv420p")		mFourcc = "I420";
+	else if(pixFmt == "nv12")	mFourcc = "NV12";
+	else if(pixFmt == "yuv420p10le")	mFourcc = std::string("Y3\x0B\x0A", 4); // (p010 has none)
+	else						mFourcc = "RGBA";
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+const std::vector<unsigned char>& NutMuxer::fileHeader()
+{
+	const char id[] = "nut/multimedia container";
+	mHeader.assign(id, id + sizeof(id)); // with its terminating zero
+
+	std::vector<unsigned char> main;
+	putV(main, 3);				// version
+	putV(main, 1);				// stream_count
+	putV(main, MAX_DISTANCE);
+	putV(main, 1);				// time_base_count
+	putV(main, 1);				// time_base_num
+	putV(main, mTimeBase);		// time_base_denom
+	// frame codes : 0 invalid, all the others (but 'N') the single one we use
+	putV(main, FLAG_INVALID);	putV(main, 6);	putS(main, 0);	putV(main, 1);	putV(main, 0);	putV(main, 0);	putV(main, 0);	putV(main, 1);
+	putV(main, FLAG_KEY | FLAG_CODED_PTS | FLAG_SIZE_MSB | FLAG_CHECKSUM);
+	putV(main, 6);				// fields : pts, mul, stream, size, reserved, count
+	putS(main, 0);				// pts delta (not used, pts coded)
+	putV(main, 1);				// data_size_mul
+	putV(main, 0);				// stream
+	putV(main, 0);				// data_size_lsb (data size = data_size_msb)
+	putV(main, 0);				// reserved_count
+	putV(main, 254);			// count : codes 1 to 255 except 'N'
+	putV(main, 0);				// header_count_minus1 : no elision header
+	putPacket(mHeader, MAIN_STARTCODE, main);
+
+	std::vector<unsigned char> stream;
+	putV(stream, 0);			// stream_id
+	putV(stream, 0);			// stream_class : video
+	putV(stream, 4);			// fourcc
+	stream.insert(stream.end(), mFourcc.begin(), mFourcc.end());
+	putV(stream, 0);			// time_base_id
+	putV(stream, MSB_PTS_SHIFT);
+	putV(stream, mTimeBase);	// max_pts_distance (frames carry a checksum anyway)
+	putV(stream, 0);			// decode_delay
+	putV(stream, 0);			// stream_flags
+	putV(stream, 0);			// codec_specific_data
+	putV(stream, mWidth);
+	putV(stream, mHeight);
+	putV(stream, 0);			// sample_width (unknown aspect ratio)
+	putV(stream, 0);			// sample_height
+	putV(stream, 0);			// colorspace_type
+	putPacket(mHeader, STREAM_STARTCODE, stream);
+
+	mPosition += mHeader.size();
+	return mHeader;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+const std::vector<unsigned char>& NutMuxer::frameHeader(long long pts, size_t size)
+{
+	mHeader.clear();
+
+	// a syncpoint before each frame : ffmpeg requires the frame headers to be less than max_distance bytes after it
+	std::vector<unsigned char> syncpoint;
+	putV(syncpoint, (unsigned long long)pts);	// global_key_pts (single time base)
+	putV(syncpoint, mLastSyncpoint != 0 ? (mPosition - mLastSyncpoint) / 16 : 0); // back_ptr_div16
+	mLastSyncpoint = mPosition;
+	putPacket(mHeader, SYNCPOINT_STARTCODE, syncpoint);
+
+	size_t frameStart = mHeader.size();
+	mHeader.push_back(FRAME_CODE);
+	putV(mHeader, (unsigned long long)pts + (1ULL << MSB_PTS_SHIFT)); // coded_pts : full pts
+	putV(mHeader, size);										   // data_size_msb
+	put32(mHeader, crc(mHeader.data() + frameStart, mHeader.size() - frameStart));
+
+	mPosition += mHeader.size() + size;
+	return mHeader;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+unsigned int NutMuxer::crc(const unsigned char* data, size_t size)
+{
+	struct Table
+	{
+		unsigned int values[256];
+		Table()
+		{
+			for(unsigned int i = 0; i < 256; i++)
+			{
+				unsigned int c = i << 24;
+				for(int j = 0; j < 8; j++)
+					c = (c & 0x80000000u) ? (c << 1) ^ 0x04C11DB7u : (c << 1);
+				values[i] = c;
+			}
+		}
+	};
+	static const Table table; // thread safe initialization (frames may be muxed by several writer threads)
+
+	unsigned int c = 0;
+	for(size_t i = 0; i < size; i++)
+		c = (c << 8) ^ table.values[(c >> 24) ^ data[i]];
+	return c;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void NutMuxer::putV(std::vector<unsigned char>& out, unsigned long long value)
+{
+	// 7 bits per byte, most significant first, all but the last byte with their high bit set
+	int shift = 0;
+	while(shift < 63 && (value >> (shift + 7)) != 0)
+		shift += 7;
+	for(; shift > 0; shift -= 7)
+		out.push_back((unsigned char)(0x80 | ((value >> shift) & 0x7F)));
+	out.push_back((unsigned char)(value & 0x7F));
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void NutMuxer::putS(std::vector<unsigned char>& out, long long value)
+{
+	putV(out, value > 0 ? 2 * (unsigned long long)value - 1 : 2 * (unsigned long long)(-value));
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void NutMuxer::put32(std::vector<unsigned char>& out, unsigned int value)
+{
+	for(int shift = 24; shift >= 0; shift -= 8)
+		out.push_back((unsigned char)(value >> shift));
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void NutMuxer::put64(std::vector<unsigned char>& out, unsigned long long value)
+{
+	put32(out, (unsigned int)(value >> 32));
+	put32(out, (unsigned int)value);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void NutMuxer::putPacket(std::vector<unsigned char>& out, unsigned long long startcode, const std::vector<unsigned char>& content)
+{
+	size_t start = out.size();
+	size_t forward = content.size() + 4; // content and its checksum
+	put64(out, startcode);
+	putV(out, forward);
+	if(forward > 4096)
+		put32(out, crc(out.data() + start, out.size() - start));
+	out.insert(out.end(), content.begin(), content.end());
+	put32(out, crc(content.data(), content.size()));
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+
+/**
+* Minimal NUT muxer (https://ffmpeg.org/~michael/nut.txt) of a single raw video stream,
+* used to pipe timestamped frames to ffmpeg ("-f nut -i -") instead of headerless rawvideo at a constant frame rate.
+*
+* It only builds the bytes to write around the frames : the file header once, then before each frame
+* a syncpoint and a frame header carrying the presentation timestamp and the frame size (every frame is a keyframe).
+* The frame data itself is written as is (so it can still be spliced without copy).
+*/
+class NutMuxer
+{
+public:
+	/// pixFmt : "rgba", "yuv420p", "nv12" or "yuv420p10le". Timestamps are given in 1/timeBase seconds.
+	NutMuxer(int width, int height, const std::string& pixFmt, unsigned int timeBase);
+
+	/// Bytes starting the stream : file id string, main header and stream header
+	const std::vector<unsigned char>& fileHeader();
+
+	/// Bytes to write just before a frame of size bytes presented at pts (in 1/timeBase seconds)
+	const std::vector<unsigned char>& frameHeader(long long pts, size_t size);
+
+protected:
+	/// NUT CRC-32 (polynomial 0x04C11DB7, initial value 0, no final xor)
+	static unsigned int crc(const unsigned char* data, size_t size);
+
+	static void putV(std::vector<unsigned char>& out, unsigned long long value);
+	static void putS(std::vector<unsigned char>& out, long long value);
+	static void put32(std::vector<unsigned char>& out, unsigned int value);
+	static void put64(std::vector<unsigned char>& out, unsigned long long value);
+
+	/// Append a startcode, forward pointer, content and checksum packet
+	static void putPacket(std::vector<unsigned char>& out, unsigned long long startcode, const std::vector<unsigned char>& content);
+
+protected:
+	int							mWidth;
+	int							mHeight;
+	std::string					mFourcc;
+	unsigned int				mTimeBase;
+	std::vector<unsigned char>	mHeader;		///< last built header
+	unsigned long long			mPosition;		///< bytes produced so far (headers and frames)
+	unsigned long long			mLastSyncpoint;	///< position of the last syncpoint (0 if none yet)
+};
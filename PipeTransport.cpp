@@ -0,0 +1,242 @@
+#include "PipeTransport.h"
+#include "FrameBufferPool.h"
+
+#include <iostream>
+#include <fstream>	// /proc/sys/fs/pipe-max-size
+#include <algorithm>// std::min
+
+#ifdef __linux__
+	#include <fcntl.h>		// pipe2, F_SETPIPE_SZ, vmsplice
+	#include <unistd.h>
+	#include <spawn.h>
+	#include <sys/ioctl.h>	// FIONREAD
+	#include <sys/uio.h>	// writev, iovec
+	#include <sys/wait.h>
+	#include <cerrno>
+	extern char** environ;
+#endif
+
+
+//===========================================================================================================
+
+bool PipeTransport::available()
+{
+#ifdef __linux__
+	return true;
+#else
+	return false;
+#endif
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+PipeTransport::PipeTransport()
+	: mFd(-1), mPid(-1), mFrameSize(0), mPipeSize(0), mZeroCopy(false), mCurrent(0), mWritten(0)
+{
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+PipeTransport::~PipeTransport()
+{
+	close();
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool PipeTransport::open(const std::string& command, size_t frameSize, bool zeroCopy, size_t pipeSize)
+{
+#ifdef __linux__
+	close();
+
+	int fds[2];
+	if(pipe2(fds, O_CLOEXEC) != 0) // the spawned command only inherits the read end as its stdin
+	{
+		std::cerr<<"[PipeTransport] can not create the pipe"<<std::endl;
+		return false;
+	}
+
+	// the default 64 KiB pipe cut each frame in tiny chunks : ask for a whole frame (or the maximum an unprivileged user is allowed)
+	size_t wanted = pipeSize != 0 ? pipeSize : frameSize;
+	if(fcntl(fds[1], F_SETPIPE_SZ, int(wanted)) < 0)
+	{
+		std::ifstream maxSize("/proc/sys/fs/pipe-max-size");
+		size_t limit = 0;
+		if(maxSize >> limit && limit != 0)
+			fcntl(fds[1], F_SETPIPE_SZ, int(std::min(wanted, limit)));
+	}
+	int capacity = fcntl(fds[1], F_GETPIPE_SZ);
+	mPipeSize = capacity > 0 ? size_t(capacity) : 65536;
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, fds[0], 0);
+	char* argv[] = { const_cast<char*>("sh"), const_cast<char*>("-c"), const_cast<char*>(command.c_str()), nullptr };
+	pid_t pid	= -1;
+	int error	= posix_spawn(&pid, "/bin/sh", &actions, nullptr, argv, environ);
+	posix_spawn_file_actions_destroy(&actions);
+	::close(fds[0]);
+	if(error != 0)
+	{
+		::close(fds[1]);
+		std::cerr<<"[PipeTransport] can not spawn : "<<command<<std::endl;
+		return false;
+	}
+
+	mFd			= fds[1];
+	mPid		= pid;
+	mFrameSize	= frameSize;
+	mZeroCopy	= zeroCopy;
+	mCurrent	= 0;
+	mWritten	= 0;
+	return true;
+#else
+	(void)command; (void)frameSize; (void)zeroCopy; (void)pipeSize;
+	std::cerr<<"[PipeTransport] only available on Linux"<<std::endl;
+	return false;
+#endif
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+unsigned char* PipeTransport::frameBuffer()
+{
+	if(mFd < 0) return nullptr;
+
+	// the next buffer of the ring whose pages are no longer in the pipe :
+	// the pipe can not hold more than its capacity, so anything spliced before the last mPipeSize bytes has been read
+	size_t count	= mBuffers.size();
+	size_t inPipe	= count != 0 ? pending() : 0;
+	for(size_t i = 1; i <= count; i++)
+	{
+		size_t	index	= (mCurrent + i) % count;
+		Buffer&	buffer	= mBuffers[index];
+		if(buffer.end == 0 || buffer.end + inPipe <= mWritten)
+		{
+			mCurrent = index;
+			return buffer.data;
+		}
+	}
+
+	// all still referenced by the pipe : grow the ring (it stabilizes once it covers the pipe capacity)
+	Buffer buffer = { FrameBufferPool::Get().acquire(mFrameSize), 0 };
+	if(buffer.data == nullptr)
+		return nullptr;
+	mBuffers.push_back(buffer);
+	mCurrent = mBuffers.size() - 1;
+	return buffer.data;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool PipeTransport::write(const void* data, size_t size)
+{
+	if(mFd < 0) return false;
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	if(mZeroCopy && !mBuffers.empty() && bytes == mBuffers[mCurrent].data && size <= mFrameSize)
+	{
+		bool written = writeSplice(bytes, size);
+		mBuffers[mCurrent].end = mWritten;
+		return written;
+	}
+	return writeCopy(bytes, size);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool PipeTransport::writeCopy(const unsigned char* data, size_t size)
+{
+#ifdef __linux__
+	struct iovec iov;
+	iov.iov_base	= const_cast<unsigned char*>(data);
+	iov.iov_len		= size;
+	while(iov.iov_len > 0)
+	{
+		ssize_t written = writev(mFd, &iov, 1);
+		if(written < 0)
+		{
+			if(errno == EINTR) continue;
+			std::cerr<<"[PipeTransport] write failed, frame lost..."<<std::endl;
+			return false;
+		}
+		iov.iov_base	= static_cast<unsigned char*>(iov.iov_base) + written;
+		iov.iov_len		-= size_t(written);
+		mWritten		+= size_t(written);
+	}
+	return true;
+#else
+	(void)data; (void)size;
+	return false;
+#endif
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool PipeTransport::writeSplice(const unsigned char* data, size_t size)
+{
+#ifdef __linux__
+	// the pages are recycled by frameBuffer() once read, so they are spliced without SPLICE_F_GIFT
+	struct iovec iov;
+	iov.iov_base	= const_cast<unsigned char*>(data);
+	iov.iov_len		= size;
+	while(iov.iov_len > 0)
+	{
+		ssize_t spliced = vmsplice(mFd, &iov, 1, 0);
+		if(spliced < 0)
+		{
+			if(errno == EINTR) continue;
+			if(errno == EINVAL || errno == ENOSYS || errno == EPERM)
+			{
+				std::cerr<<"[PipeTransport] vmsplice refused, copy the frames with writev..."<<std::endl;
+				mZeroCopy = false;
+				return writeCopy(static_cast<const unsigned char*>(iov.iov_base), iov.iov_len);
+			}
+			std::cerr<<"[PipeTransport] vmsplice failed, frame lost..."<<std::endl;
+			return false;
+		}
+		iov.iov_base	= static_cast<unsigned char*>(iov.iov_base) + spliced;
+		iov.iov_len		-= size_t(spliced);
+		mWritten		+= size_t(spliced);
+	}
+	return true;
+#else
+	(void)data; (void)size;
+	return false;
+#endif
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+size_t PipeTransport::pending() const
+{
+#ifdef __linux__
+	int bytes = 0;
+	if(ioctl(mFd, FIONREAD, &bytes) == 0 && bytes >= 0)
+		return size_t(bytes);
+#endif
+	return mPipeSize; // unknown : assume a full pipe
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+int PipeTransport::close()
+{
+	if(mFd < 0) return -1;
+	int status = -1;
+#ifdef __linux__
+	::close(mFd);
+	int wstatus = 0;
+	pid_t waited = -1;
+	while( (waited = waitpid(mPid, &wstatus, 0)) < 0 && errno == EINTR );
+	if(waited == mPid && WIFEXITED(wstatus))
+		status = WEXITSTATUS(wstatus);
+#endif
+	mFd	 = -1;
+	mPid = -1;
+
+	// the pipe is gone with the command : no page is referenced anymore
+	for(Buffer& buffer : mBuffers)
+		FrameBufferPool::Get().release(buffer.data);
+	mBuffers.clear();
+	return status;
+}
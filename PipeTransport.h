@@ -0,0 +1,74 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+
+/**
+* Linux transport of the raw frames to the ffmpeg process, replacing popen/fwrite :
+* the command is spawned with its stdin on a raw pipe whose capacity is raised with F_SETPIPE_SZ,
+* frames are written with writev (no stdio buffering, no small chunks) or spliced with vmsplice (no copy at all).
+*
+* To be spliced without copy, a frame has to be built in the page-aligned buffer given by frameBuffer().
+* The pipe keeps a reference on these pages until ffmpeg reads them, so frameBuffer() only hands back a buffer
+* once the pipe can not hold it anymore (a ring of buffers from the FrameBufferPool, covering the pipe capacity).
+* Any other buffer given to write() (or if vmsplice is refused) goes through writev.
+*
+* Not available on other systems : open() always fails.
+*/
+class PipeTransport
+{
+public:
+	/// Is the transport implemented on this system
+	static bool available();
+
+	PipeTransport();
+	virtual ~PipeTransport();
+
+	/// Spawn the shell command reading frames of frameSize bytes from its stdin.
+	/// zeroCopy : vmsplice the frames built in frameBuffer(), otherwise writev everything.
+	/// pipeSize : requested pipe capacity in bytes (0 for one frame), capped by /proc/sys/fs/pipe-max-size for unprivileged users.
+	bool open(const std::string& command, size_t frameSize, bool zeroCopy, size_t pipeSize = 0);
+
+	/// Page-aligned buffer of frameSize bytes where to build the next frame to write without copy (no longer referenced by the pipe)
+	unsigned char* frameBuffer();
+
+	/// Write a frame (spliced if it is the last frameBuffer(), copied otherwise). Block while the pipe is full.
+	bool write(const void* data, size_t size);
+
+	/// Close the pipe, wait for the command to exit and return its exit status (-1 if it could not be waited)
+	int close();
+
+	bool	isOpen() const		{ return mFd >= 0; }
+	bool	zeroCopy() const	{ return mZeroCopy; }
+
+	/// Effective capacity of the pipe in bytes
+	size_t	pipeSize() const	{ return mPipeSize; }
+
+protected:
+	/// Copy the bytes to the pipe (handling the partial writes)
+	bool writeCopy(const unsigned char* data, size_t size);
+
+	/// Splice the pages to the pipe (handling the partial splices), false if vmsplice is refused
+	bool writeSplice(const unsigned char* data, size_t size);
+
+	/// Bytes still in the pipe (not read yet by the command)
+	size_t pending() const;
+
+protected:
+	struct Buffer
+	{
+		unsigned char*		data;
+		unsigned long long	end;		///< mWritten after this buffer was spliced (0 if never spliced)
+	};
+
+	int						mFd;			///< write end of the pipe
+	int						mPid;			///< the spawned shell
+	size_t					mFrameSize;
+	size_t					mPipeSize;
+	bool					mZeroCopy;
+	std::vector<Buffer>		mBuffers;		///< ring of frame buffers gifted to the pipe
+	size_t					mCurrent;		///< index of the last buffer given by frameBuffer()
+	unsigned long long		mWritten;		///< total bytes written to the pipe
+};
@@ -0,0 +1,136 @@
+#include "PresetController.h"
+#include "CaptureStats.h"
+
+#include <algorithm>
+
+
+//===========================================================================================================
+
+PresetController::PresetController()
+	: mFastest(0), mSlowest(0), mCrf(23), mMaxCrfRaise(0), mStart(0), mRaiseLevels(0), mLevels(1), mLevel(0)
+	, mCalm(0), mCalmNeeded(CALM), mProbing(false), mChanges(0)
+{
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool PresetController::configure(unsigned int fastestPreset, unsigned int slowestPreset, unsigned int crf, unsigned int maxCrfRaise, unsigned int startPreset)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	slowestPreset = std::max(fastestPreset, slowestPreset);
+	maxCrfRaise	  = std::min(maxCrfRaise, crf < 51 ? 51 - crf : 0);
+	if(mLevels > 1 && fastestPreset == mFastest && slowestPreset == mSlowest && crf == mCrf && maxCrfRaise == mMaxCrfRaise && startPreset == mStart)
+		return false;
+
+	mFastest		= fastestPreset;
+	mSlowest		= slowestPreset;
+	mCrf			= crf;
+	mMaxCrfRaise	= maxCrfRaise;
+	mStart			= startPreset;
+	mRaiseLevels	= (maxCrfRaise + CRF_STEP - 1) / CRF_STEP;
+	mLevels			= mRaiseLevels + slowestPreset - fastestPreset + 1;
+	mLevel			= mRaiseLevels + std::min(std::max(startPreset, fastestPreset), slowestPreset) - fastestPreset;
+	mCalm			= 0;
+	mCalmNeeded		= CALM;
+	mProbing		= false;
+	mChanges		= 0;
+	return true;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool PresetController::update(const CaptureStats& interval)
+{
+	if(interval.framesWritten == 0 || interval.seconds <= 0)
+		return false; // nothing measured
+
+	// the encoder sets the pace : frames waiting for it, lost, or writes blocked longer than a frame period
+	double blocked	= interval.write.totalUs / (interval.seconds * 1e6);
+	bool queueFull	= interval.queueCapacity != 0 && interval.queueDepth * 2 > interval.queueCapacity;
+	bool pressure	= interval.framesDropped != 0 || interval.queueFullEvents != 0 || queueFull
+				   || interval.backpressureEvents * 50 > interval.framesWritten || blocked > 0.5;
+	bool calm		= !pressure && interval.backpressureEvents == 0 && blocked < 0.25;
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	if(pressure)
+	{
+		mCalm = 0;
+		if(mLevel == 0)
+			return false; // nothing faster
+		// a slower level just tried does not keep up : wait longer before the next try, otherwise the load grew
+		mCalmNeeded	= mProbing ? std::min(mCalmNeeded * 2, (unsigned int)MAX_CALM) : (unsigned int)CALM;
+		mProbing	= false;
+		mLevel--;
+		mChanges++;
+		return true;
+	}
+	if(!calm)
+	{
+		mCalm = 0; // keeps up, without room for a slower level
+		return false;
+	}
+	if(++mCalm < (mProbing ? (unsigned int)CALM : mCalmNeeded))
+		return false;
+	mCalm = 0;
+	if(mProbing)
+		mCalmNeeded = CALM; // the level tried keeps up : the next one is tried at once
+	mProbing = false;
+	if(mLevel + 1 >= mLevels)
+		return false;
+	mProbing = true;
+	mLevel++;
+	mChanges++;
+	return true;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+unsigned int PresetController::preset()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	unsigned int preset = 0, crf = 0;
+	settings(mLevel, preset, crf);
+	return preset;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+unsigned int PresetController::crf()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	unsigned int preset = 0, crf = 0;
+	settings(mLevel, preset, crf);
+	return crf;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void PresetController::level(unsigned int& preset, unsigned int& crf)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	settings(mLevel, preset, crf);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+unsigned int PresetController::changes()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mChanges;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void PresetController::settings(unsigned int level, unsigned int& preset, unsigned int& crf) const
+{
+	if(level < mRaiseLevels)
+	{
+		preset	= mFastest;
+		crf		= mCrf + std::min(mMaxCrfRaise, (mRaiseLevels - level) * CRF_STEP);
+	}
+	else
+	{
+		preset	= mFastest + level - mRaiseLevels;
+		crf		= mCrf;
+	}
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <mutex>
+
+struct CaptureStats;
+
+
+/**
+* Chooses the encoder preset and quality of an adaptive recording from its measured throughput (see FFmpegVideoRecorderProcess::adaptivePreset).
+*
+* The levels go from the fastest encoding (fastest preset, crf raised by maxCrfRaise) to the best compression (slowest preset, crf asked for) :
+* the crf is only raised once the fastest preset does not keep up. update() is given the statistics of the capture over an interval :
+* any sign of backpressure (writes to the encoder blocked longer than a frame period, writer queue full or more than half full, frames dropped)
+* steps to a faster level at once, while a slower level is tried after a few calm intervals (the encoder blocked the writes less than a quarter
+* of the time). A slower level which brought the backpressure back is tried again after twice as many calm intervals as the last time.
+*
+* The presets are indices of FFmpegVideoRecorderProcess::PRESET (0 : FASTEST_ENCODING). Thread safe.
+*/
+class PresetController
+{
+public:
+	PresetController();
+
+	/// Levels from fastestPreset with crf + maxCrfRaise to slowestPreset with crf, starting at startPreset (clamped) with crf.
+	/// Nothing is changed (the level reached is kept) if the parameters are the ones of the last call. Return true if the level was reset.
+	bool configure(unsigned int fastestPreset, unsigned int slowestPreset, unsigned int crf, unsigned int maxCrfRaise, unsigned int startPreset);
+
+	/// Give the statistics of the interval since the last update (see CaptureStats::since). Return true if the level changed.
+	bool update(const CaptureStats& interval);
+
+	/// Preset of the current level
+	unsigned int preset();
+
+	/// Crf of the current level
+	unsigned int crf();
+
+	/// Preset and crf of the current level at once
+	void level(unsigned int& preset, unsigned int& crf);
+
+	/// Level changes since the last reset
+	unsigned int changes();
+
+protected:
+	/// Preset and crf of a level (mMutex locked)
+	void settings(unsigned int level, unsigned int& preset, unsigned int& crf) const;
+
+protected:
+	static const unsigned int CRF_STEP		= 2;	///< crf raised per level below the fastest preset
+	static const unsigned int CALM			= 3;	///< calm intervals before trying a slower level, or before keeping the level tried
+	static const unsigned int MAX_CALM		= 96;	///< at most after a slower level failed several times
+
+	std::mutex		mMutex;
+	unsigned int	mFastest;		///< parameters of configure()
+	unsigned int	mSlowest;
+	unsigned int	mCrf;
+	unsigned int	mMaxCrfRaise;
+	unsigned int	mStart;
+	unsigned int	mRaiseLevels;	///< levels raising the crf with the fastest preset
+	unsigned int	mLevels;
+	unsigned int	mLevel;			///< current level (0 : fastest encoding)
+	unsigned int	mCalm;			///< calm intervals at the current level
+	unsigned int	mCalmNeeded;	///< calm intervals before trying the next slower level
+	bool			mProbing;		///< the current level is tried : stepping back from it makes the next try wait longer
+	unsigned int	mChanges;
+};
@@ -0,0 +1,238 @@
+#include "SharedMemoryRing.h"
+
+#include <iostream>
+#include <cstring>	// memcpy, strncpy
+#include <new>		// placement new
+#include <thread>	// sleep_for
+#include <chrono>
+
+#ifndef WIN32
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+static const char gMagic[8] = "VCAPRNG";
+
+
+//===========================================================================================================
+
+bool SharedMemoryRing::available()
+{
+#ifndef WIN32
+	return true;
+#else
+	return false;
+#endif
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+SharedMemoryRing::SharedMemoryRing()
+	: mHeader(nullptr), mMapSize(0), mOwner(false)
+{
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+SharedMemoryRing::~SharedMemoryRing()
+{
+	close();
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool SharedMemoryRing::create(const std::string& name, unsigned int slotCount, size_t frameSize, int width, int height, const std::string& pixFmt,
+							  unsigned int timeBase, unsigned int frameRate)
+{
+#ifndef WIN32
+	close();
+	if(slotCount == 0 || frameSize == 0) return false;
+	size_t page		= size_t(sysconf(_SC_PAGESIZE));
+	size_t headers	= sizeof(Header) + slotCount * sizeof(SlotHeader);
+	size_t offset	= (headers + page - 1) / page * page;
+	size_t slotSize	= (frameSize + page - 1) / page * page;
+	size_t mapSize	= offset + slotCount * slotSize;
+
+	shm_unlink(name.c_str()); // a previous ring of a crashed producer
+	int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+	if(fd < 0)
+	{
+		std::cerr<<"[SharedMemoryRing] can not create the shared memory "<<name<<std::endl;
+		return false;
+	}
+	void* memory = ftruncate(fd, off_t(mapSize)) == 0 ? mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+	::close(fd); // the mapping keeps the memory
+	if(memory == MAP_FAILED)
+	{
+		std::cerr<<"[SharedMemoryRing] can not map "<<mapSize<<" bytes of shared memory "<<name<<std::endl;
+		shm_unlink(name.c_str());
+		return false;
+	}
+
+	mName		= name;
+	mMapSize	= mapSize;
+	mOwner		= true;
+	mHeader		= new(memory) Header();
+	mHeader->version	= VERSION;
+	mHeader->slotCount	= slotCount;
+	mHeader->dataOffset	= offset;
+	mHeader->slotSize	= slotSize;
+	mHeader->frameSize	= frameSize;
+	mHeader->width		= width;
+	mHeader->height		= height;
+	std::strncpy(mHeader->pixFmt, pixFmt.c_str(), sizeof(mHeader->pixFmt) - 1);
+	mHeader->timeBase	= timeBase;
+	mHeader->frameRate	= frameRate;
+	mHeader->written.store(0, std::memory_order_relaxed);
+	mHeader->read.store(0, std::memory_order_relaxed);
+	mHeader->dropped.store(0, std::memory_order_relaxed);
+	mHeader->closed.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	std::memcpy(mHeader->magic, gMagic, sizeof(gMagic)); // a consumer attaching now sees a complete header
+	return true;
+#else
+	(void)name; (void)slotCount; (void)frameSize; (void)width; (void)height; (void)pixFmt; (void)timeBase; (void)frameRate;
+	std::cerr<<"[SharedMemoryRing] only available on POSIX systems"<<std::endl;
+	return false;
+#endif
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+unsigned char* SharedMemoryRing::reserve()
+{
+	if(mHeader == nullptr) return nullptr;
+	unsigned long long written = mHeader->written.load(std::memory_order_relaxed); // only written here
+	if(written - mHeader->read.load(std::memory_order_acquire) >= mHeader->slotCount)
+		return nullptr;
+	return slot(written);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void SharedMemoryRing::publish(size_t size, long long pts)
+{
+	unsigned long long written = mHeader->written.load(std::memory_order_relaxed);
+	SlotHeader* header	= slotHeader(written);
+	header->pts			= pts;
+	header->size		= size;
+	mHeader->written.store(written + 1, std::memory_order_release);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void SharedMemoryRing::drop()
+{
+	if(mHeader != nullptr)
+		mHeader->dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool SharedMemoryRing::attach(const std::string& name)
+{
+#ifndef WIN32
+	close();
+	int fd = shm_open(name.c_str(), O_RDWR, 0);
+	if(fd < 0)
+		return false; // no producer yet
+	struct stat status;
+	void* memory = fstat(fd, &status) == 0 && size_t(status.st_size) >= sizeof(Header)
+				 ? mmap(nullptr, size_t(status.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+	::close(fd);
+	if(memory == MAP_FAILED)
+		return false;
+
+	Header* header = static_cast<Header*>(memory);
+	bool valid = std::memcmp(header->magic, gMagic, sizeof(gMagic)) == 0;
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if(!valid || header->version != VERSION || header->dataOffset + header->slotCount * header->slotSize > (unsigned long long)status.st_size)
+	{
+		std::cerr<<"[SharedMemoryRing] "<<name<<" is not a frame ring of version "<<VERSION<<" (or not ready yet)"<<std::endl;
+		munmap(memory, size_t(status.st_size));
+		return false;
+	}
+	mName		= name;
+	mMapSize	= size_t(status.st_size);
+	mOwner		= false;
+	mHeader		= header;
+	return true;
+#else
+	(void)name;
+	return false;
+#endif
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+const unsigned char* SharedMemoryRing::acquire(size_t& size, long long& pts, int timeoutMs)
+{
+	if(mHeader == nullptr) return nullptr;
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+	while(true)
+	{
+		unsigned long long read = mHeader->read.load(std::memory_order_relaxed); // only written here
+		if(read < mHeader->written.load(std::memory_order_acquire))
+		{
+			const SlotHeader* header = slotHeader(read);
+			size	= size_t(header->size);
+			pts		= header->pts;
+			return slot(read);
+		}
+		if(mHeader->closed.load(std::memory_order_acquire) != 0 || std::chrono::steady_clock::now() >= deadline)
+			return nullptr;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1)); // no cross process wake up : poll
+	}
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void SharedMemoryRing::release()
+{
+	if(mHeader == nullptr) return;
+	unsigned long long read = mHeader->read.load(std::memory_order_relaxed);
+	if(read < mHeader->written.load(std::memory_order_acquire))
+		mHeader->read.store(read + 1, std::memory_order_release);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool SharedMemoryRing::ended() const
+{
+	return mHeader == nullptr || (mHeader->closed.load(std::memory_order_acquire) != 0
+							  && mHeader->read.load(std::memory_order_relaxed) >= mHeader->written.load(std::memory_order_acquire));
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void SharedMemoryRing::close()
+{
+#ifndef WIN32
+	if(mHeader == nullptr) return;
+	if(mOwner)
+	{
+		mHeader->closed.store(1, std::memory_order_release);
+		shm_unlink(mName.c_str());
+	}
+	munmap(mHeader, mMapSize);
+	mHeader		= nullptr;
+	mMapSize	= 0;
+	mOwner		= false;
+#endif
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+unsigned char* SharedMemoryRing::slot(unsigned long long index) const
+{
+	return reinterpret_cast<unsigned char*>(mHeader) + mHeader->dataOffset + (index % mHeader->slotCount) * mHeader->slotSize;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+SharedMemoryRing::SlotHeader* SharedMemoryRing::slotHeader(unsigned long long index) const
+{
+	return reinterpret_cast<SlotHeader*>(mHeader + 1) + index % mHeader->slotCount;
+}
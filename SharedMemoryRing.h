@@ -0,0 +1,109 @@
+#pragma once
+
+#include <string>
+#include <atomic>
+#include <cstddef>
+
+
+/**
+* Ring of frames in POSIX shared memory (shm_open + mmap), written by a recorder and read in place by another local process.
+*
+* The mapping starts with a Header (resolution, pixel format, ring geometry and the counters) and the SlotHeader (pts and size)
+* of each slot, followed by slotCount page-aligned frames. A single producer and a single consumer share it without lock :
+* the producer fills the slot of frame n then publishes it by storing written = n+1 (release), the consumer reads it in place and gives
+* it back by storing read = n+1. The producer never waits for the consumer : when the ring is full (consumer late or absent) the new frame
+* is dropped and counted in the header.
+*
+* The producer removes the name when it closes the ring, a consumer already attached keeps its mapping until it detaches.
+* POSIX only (see available()).
+*/
+class SharedMemoryRing
+{
+public:
+	static const unsigned int VERSION = 1;
+
+	/// Beginning of the shared memory (fixed size types : the consumer may be built by another compiler)
+	struct Header
+	{
+		char						magic[8];		///< "VCAPRNG" (written last by the producer, once the header is complete)
+		unsigned int				version;
+		unsigned int				slotCount;
+		unsigned long long			dataOffset;		///< bytes from the start of the mapping to the first frame (page aligned)
+		unsigned long long			slotSize;		///< bytes between two frames (page aligned)
+		unsigned long long			frameSize;		///< maximal bytes of a frame
+		int							width;
+		int							height;
+		char						pixFmt[16];		///< "rgba" (rows bottom-up), "yuv420p" or "nv12" (rows top-down)
+		unsigned int				timeBase;		///< pts in 1/timeBase seconds (0 : pts is the frame index at frameRate)
+		unsigned int				frameRate;
+		std::atomic<unsigned long long>	written;	///< frames published by the producer
+		std::atomic<unsigned long long>	read;		///< frames given back by the consumer
+		std::atomic<unsigned long long>	dropped;	///< frames the producer dropped because the ring was full
+		std::atomic<unsigned int>		closed;		///< the producer will not publish anymore
+	};
+
+	/// What a slot holds (an array of slotCount right after the Header)
+	struct SlotHeader
+	{
+		long long					pts;
+		unsigned long long			size;			///< bytes of the frame in the slot
+	};
+
+	/// Is the ring implemented on this system
+	static bool available();
+
+	SharedMemoryRing();
+	virtual ~SharedMemoryRing(); ///< close
+
+	// producer side
+
+	/// Create (or replace) the shared memory name ("/something") holding slotCount frames of at most frameSize bytes
+	bool create(const std::string& name, unsigned int slotCount, size_t frameSize, int width, int height, const std::string& pixFmt,
+				unsigned int timeBase, unsigned int frameRate);
+
+	/// Slot where to build the next frame, nullptr if the ring is full (the frame has to be dropped, see drop())
+	unsigned char* reserve();
+
+	/// Publish the frame built in the reserved slot
+	void publish(size_t size, long long pts);
+
+	/// Count a frame dropped by the producer
+	void drop();
+
+	// consumer side
+
+	/// Map the ring created by a producer under name
+	bool attach(const std::string& name);
+
+	/// Next frame to read in place (and its size and pts), waiting at most timeoutMs for it (polling), nullptr if none.
+	/// It stays valid until release().
+	const unsigned char* acquire(size_t& size, long long& pts, int timeoutMs = 0);
+
+	/// Give back the frame of the last acquire() to the producer
+	void release();
+
+	/// Is the stream over (closed by the producer and fully read)
+	bool ended() const;
+
+	// both sides
+
+	/// Unmap the ring (and remove its name if created here, after marking it closed)
+	void close();
+
+	bool				isOpen() const	{ return mHeader != nullptr; }
+	const Header*		header() const	{ return mHeader; }
+	const std::string&	name() const	{ return mName; }
+
+protected:
+	/// Frame bytes of the slot of the frame index
+	unsigned char* slot(unsigned long long index) const;
+
+	/// Slot header of the frame index
+	SlotHeader* slotHeader(unsigned long long index) const;
+
+protected:
+	std::string			mName;
+	Header*				mHeader;	///< start of the mapping (nullptr if closed)
+	size_t				mMapSize;
+	bool				mOwner;		///< created here (producer)
+};
@@ -0,0 +1,431 @@
+/**
+* Offline transcoder of raw frame dumps : encodes a long capture on all the cores, by chunks encoded concurrently then joined without re-encoding.
+*
+* Usage : VideoCapture_Transcoder input output.mp4 [options]
+*
+* input is either a memory-mapped capture (.raw written by SINK::MAPPED_FILE), a compressed capture (.vcq written by SINK::COMPRESSED_FILE,
+* see FrameCodec), both with their geometry and timestamps in their header, or a headerless rawvideo file of known geometry (-s WxH, -pix_fmt, -r).
+* Options :
+*	-s WxH			resolution of a headerless input (required for it)
+*	-pix_fmt fmt	rgba [default, rows bottom-up as read back from OpenGL], bgra, rgb24, bgr24, yuv420p, nv12, yuv420p10le or p010le
+*					(rows top-down, the 10 bits formats are encoded in 10 bits)
+*	-r fps			frame rate of a headerless input or of an untimestamped capture [25]
+*	-preset name	ultrafast, superfast, faster, fast, medium [default], slow or veryslow
+*	-crf value		quality [20], -lossless for -qp 0
+*	-b kbits		target bitrate (then -maxrate, -minrate and -bufsize in kbits too), instead of the crf
+*	-j jobs			concurrent chunks [the number of cores]
+*	-ffmpeg path	ffmpeg executable ["ffmpeg" in the PATH]
+*	-no-baseline	skip the single process encoding measuring the speedup
+*
+* The input is split at frame boundaries (the keyframes of a compressed capture) into one chunk per job. Each chunk is piped to its own ffmpeg process
+* (with the encoding options of FFmpegVideoRecorderProcess, see encodingArguments()), each running cores / jobs encoder threads.
+* The chunks, each starting with a keyframe, are then joined by the concat demuxer with -c copy (no re-encoding).
+* Unless -no-baseline, the whole input is first encoded by a single ffmpeg process into a temporary file to report the speedup as
+* (the input is read once before, so both encodings start from the same warm page cache) :
+*	transcode;frames;jobs;chunked_ms;chunked_fps;single_ms;single_fps;speedup
+*/
+
+#include "FFmpegVideoRecorderProcess.h"
+#include "MappedRawFile.h"
+#include "NutMuxer.h"
+#include "FrameSink.h"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef WIN32
+#define OS_POPEN(X)			_popen(X,"wb")
+#define OS_PCLOSE(X)		_pclose(X)
+#else
+#define OS_POPEN(X)			popen(X,"w")
+#define OS_PCLOSE(X)		pclose(X)
+#endif
+
+typedef FFmpegVideoRecorderProcess::PRESET		PRESET;
+typedef std::chrono::steady_clock				Clock;
+
+static const PRESET gPresets[] = { PRESET::FASTEST_ENCODING, PRESET::FASTER_ENCODING, PRESET::FAST_ENCODING, PRESET(-1) /*fast*/,
+								   PRESET::BALANCED, PRESET::BETTER_COMPRESSION, PRESET::BEST_COMPRESSION };
+
+
+//===========================================================================================================
+
+/// The frames of the input, read from any thread
+class RawInput
+{
+public:
+	int				width		= 0;
+	int				height		= 0;
+	std::string		pixFmt		= "rgba";
+	unsigned int	frameRate	= 25;
+	unsigned int	timeBase	= 0;	///< 0 : constant frame rate
+	size_t			frameSize	= 0;
+	long long		frameCount	= 0;
+
+	/// A memory-mapped or compressed capture if it has their header, otherwise a headerless rawvideo file of the geometry already set
+	bool open(const std::string& filePath)
+	{
+		mPath = filePath;
+		std::ifstream file(filePath.c_str(), std::ios::binary | std::ios::ate);
+		long long fileSize = file.is_open() ? (long long)file.tellg() : 0;
+		char magic[8] = {0};
+		file.seekg(0);
+		file.read(magic, sizeof(magic));
+
+		if(std::memcmp(magic, "VCAPRAW", sizeof(magic)) == 0 && MappedRawFile::available() && mMapped.open(filePath))
+		{
+			const MappedRawFile::Header* header = mMapped.header();
+			setFormat(header->width, header->height, header->pixFmt, header->timeBase, header->frameRate, size_t(header->frameSize));
+			frameCount = (long long)mMapped.frameCount();
+			return frameCount > 0;
+		}
+		if(std::memcmp(magic, "VCAPQOI", sizeof(magic)) == 0)
+			return openCompressed(file, fileSize);
+
+		frameSize = pixelBytes(pixFmt, width, height);
+		if(!file.is_open() || frameSize == 0)
+		{
+			std::cerr << "can not read " << filePath << (frameSize == 0 ? " (give its resolution with -s WxH and a known -pix_fmt)" : "") << std::endl;
+			return false;
+		}
+		frameCount = fileSize / (long long)frameSize; // a truncated last frame is ignored
+		return frameCount > 0;
+	}
+
+	bool mapped() const		{ return mMapped.isOpen(); }
+	bool compressed() const	{ return !mRecords.empty(); }
+
+	/// First frame from frame on which a chunk can start (a keyframe of a compressed capture)
+	long long chunkStart(long long frame) const
+	{
+		while(compressed() && frame < frameCount && !mRecords[size_t(frame)].keyframe)
+			frame++;
+		return std::min(frame, frameCount);
+	}
+
+	/// Read the whole input once, so the timed encodings all start from a warm page cache
+	void warm() const
+	{
+		std::ifstream file(mPath.c_str(), std::ios::binary);
+		std::vector<char> block(1 << 20);
+		while(file.read(block.data(), std::streamsize(block.size())) || file.gcount() > 0);
+	}
+
+	/// Pipe the frames [first, last) to out (in a NUT stream with their pts relative to the first one if timestamped),
+	/// decoding a compressed capture on threads threads
+	bool pipe(FILE* out, long long first, long long last, unsigned int threads) const
+	{
+		NutMuxer* nut = timeBase != 0 ? new NutMuxer(width, height, pixFmt, timeBase) : nullptr;
+		bool ok = nut == nullptr || std::fwrite(nut->fileHeader().data(), nut->fileHeader().size(), 1, out) == 1;
+
+		FILE* in = mapped() ? nullptr : std::fopen(mPath.c_str(), "rb");
+		FrameCodec* decoder = compressed() ? new FrameCodec(threads, 0) : nullptr;
+		std::vector<unsigned char> buffer(in != nullptr ? frameSize : 0), decoded;
+		ok = ok && (mapped() || (in != nullptr && seek(in, compressed() ? mRecords[size_t(first)].offset : first * (long long)frameSize)));
+		long long firstPts = 0;
+		for(long long i = first; ok && i < last; i++)
+		{
+			size_t size		= frameSize;
+			long long pts	= i - first;
+			const unsigned char* data = buffer.data();
+			if(mapped())
+				data = mMapped.frame((unsigned long long)i, size, pts);
+			else if(compressed())
+			{
+				const Record& record = mRecords[size_t(i)];
+				buffer.resize(size_t(record.size));
+				ok		= std::fread(buffer.data(), buffer.size(), 1, in) == 1 && decoder->decode(buffer.data(), buffer.size(), decoded)
+						  && seek(in, record.offset + (long long)record.size + (long long)sizeof(CompressedFileSink::FrameRecord));
+				data	= decoded.data();
+				size	= decoded.size();
+				pts		= record.pts;
+			}
+			else
+				ok = std::fread(buffer.data(), frameSize, 1, in) == 1;
+			if(data == nullptr || !ok)
+			{
+				std::cerr << "can not read the frame " << i << " of " << mPath << std::endl;
+				ok = false;
+				break;
+			}
+			if(nut != nullptr)
+			{
+				firstPts	= i == first ? pts : firstPts;
+				const std::vector<unsigned char>& header = nut->frameHeader(pts - firstPts, size); // each chunk starts at 0
+				ok = std::fwrite(header.data(), header.size(), 1, out) == 1;
+			}
+			ok = ok && std::fwrite(data, size, 1, out) == 1;
+		}
+		if(in != nullptr)
+			std::fclose(in);
+		delete decoder;
+		delete nut;
+		return ok;
+	}
+
+	/// Bytes of a frame of the headerless pixel formats (0 if unknown)
+	static size_t pixelBytes(const std::string& pixFmt, int width, int height)
+	{
+		size_t pixels = size_t(width) * size_t(height);
+		if(pixFmt == "rgba" || pixFmt == "bgra")		return pixels * 4;
+		if(pixFmt == "rgb24" || pixFmt == "bgr24")		return pixels * 3;
+		if(pixFmt == "yuv420p" || pixFmt == "nv12")		return pixels * 3 / 2;
+		if(FFmpegVideoRecorderProcess::highBitDepth(pixFmt))	return pixels * 3;
+		return 0;
+	}
+
+protected:
+	/// Where each compressed frame is in the file
+	struct Record
+	{
+		long long			offset;		///< of the compressed bytes
+		unsigned long long	size;
+		long long			pts;
+		bool				keyframe;
+	};
+
+	void setFormat(int w, int h, const char* fmt, unsigned int tb, unsigned int rate, size_t size)
+	{
+		width		= w;
+		height		= h;
+		pixFmt		= fmt;
+		timeBase	= tb;
+		frameRate	= tb == 0 ? rate : frameRate;
+		frameSize	= size;
+	}
+
+	/// Index the frames of a file written by CompressedFileSink (reading only their records and frame headers)
+	bool openCompressed(std::ifstream& file, long long fileSize)
+	{
+		CompressedFileSink::FileHeader header;
+		file.seekg(0);
+		if(!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.version != FrameCodec::VERSION)
+		{
+			std::cerr << mPath << " is not a compressed capture of version " << FrameCodec::VERSION << std::endl;
+			return false;
+		}
+		header.pixFmt[sizeof(header.pixFmt) - 1] = 0;
+		setFormat(header.width, header.height, header.pixFmt, header.timeBase, header.frameRate, size_t(header.frameSize));
+
+		long long offset = sizeof(header);
+		CompressedFileSink::FrameRecord record;
+		unsigned char frameHeader[sizeof(FrameCodec::FrameHeader)];
+		while(file.seekg(offset) && file.read(reinterpret_cast<char*>(&record), sizeof(record))
+			  && file.read(reinterpret_cast<char*>(frameHeader), sizeof(frameHeader))
+			  && offset + (long long)sizeof(record) + (long long)record.size <= fileSize) // a file cut short ends at its last whole frame
+		{
+			Record frame = { offset + (long long)sizeof(record), record.size, record.pts, FrameCodec::isKeyframe(frameHeader, sizeof(frameHeader)) };
+			mRecords.push_back(frame);
+			offset = frame.offset + (long long)record.size;
+		}
+		frameCount = (long long)mRecords.size();
+		return frameCount > 0 && mRecords[0].keyframe;
+	}
+
+	static bool seek(FILE* in, long long offset)
+	{
+	#ifdef WIN32
+		return _fseeki64(in, offset, SEEK_SET) == 0;
+	#else
+		return fseeko(in, off_t(offset), SEEK_SET) == 0;
+	#endif
+	}
+
+protected:
+	std::string			mPath;
+	MappedRawFile		mMapped;
+	std::vector<Record>	mRecords;	///< frames of a compressed capture
+};
+
+
+//===========================================================================================================
+
+struct Settings
+{
+	std::string							ffmpeg		= "ffmpeg";
+	PRESET								preset		= PRESET::BALANCED;
+	unsigned int						crf			= 20;
+	bool								lossless	= false;
+	FFmpegVideoRecorderProcess::Bitrate	bitrate		= {false, 0, 0, 0, 0};
+	unsigned int						jobs		= std::max(std::thread::hardware_concurrency(), 1u);
+	bool								baseline	= true;
+};
+
+/// The ffmpeg command line encoding the frames of the input piped to its stdin into outFilePath with threads encoder threads
+/// (the same input and output options as FFmpegVideoRecorderProcess::ffmpegCommand)
+static std::string encodeCommand(const RawInput& input, const Settings& settings, unsigned int threads, const std::string& outFilePath)
+{
+	std::stringstream cmd;
+	cmd << "\"" << settings.ffmpeg << "\" -loglevel error ";
+	if(input.timeBase != 0)
+		cmd << "-f nut -i - -vsync vfr ";
+	else
+		cmd << "-s " << input.width << "x" << input.height << " "
+			<< "-framerate " << input.frameRate << " -f rawvideo -vcodec rawvideo -pix_fmt " << input.pixFmt << " -i - ";
+	cmd << "-threads " << threads << " "
+		<< (input.pixFmt == "rgba" ? "-vf vflip " : "")
+		<< "-y "
+		<< FFmpegVideoRecorderProcess::encodingArguments(settings.preset, settings.crf, settings.lossless, settings.bitrate,
+														  FFmpegVideoRecorderProcess::CODEC::H264, FFmpegVideoRecorderProcess::highBitDepth(input.pixFmt))
+		<< "\"" << outFilePath << "\"";
+	return cmd.str();
+}
+
+/// Encode the frames [first, last) of the input into outFilePath, false if ffmpeg failed
+static bool encode(const RawInput& input, const Settings& settings, unsigned int threads, long long first, long long last, const std::string& outFilePath)
+{
+	std::string cmd = encodeCommand(input, settings, threads, outFilePath);
+	FILE* ffmpeg = OS_POPEN(cmd.c_str());
+	if(ffmpeg == nullptr)
+	{
+		std::cerr << "can not run : " << cmd << std::endl;
+		return false;
+	}
+	bool piped = input.pipe(ffmpeg, first, last, threads);
+	return OS_PCLOSE(ffmpeg) == 0 && piped;
+}
+
+/// Join the chunks (each starting with a keyframe, next to outFilePath) without re-encoding
+static bool concatenate(const Settings& settings, const std::vector<std::string>& chunks, const std::string& outFilePath)
+{
+	std::string listPath = outFilePath + ".chunks.txt";
+	{
+		// the concat demuxer resolves the entries from the directory of the list : only the names, quoted ' escaped as '\''
+		std::ofstream list(listPath.c_str());
+		for(const std::string& chunk : chunks)
+		{
+			size_t slash = chunk.find_last_of("/\\");
+			std::string name = slash != std::string::npos ? chunk.substr(slash + 1) : chunk;
+			list << "file '";
+			for(char c : name)
+				list << (c == '\'' ? std::string("'\\''") : std::string(1, c));
+			list << "'\n";
+		}
+	}
+	std::stringstream cmd;
+	cmd << "\"" << settings.ffmpeg << "\" -loglevel error -y -f concat -safe 0 -i \"" << listPath << "\" -c copy \"" << outFilePath << "\"";
+	bool ok = std::system(cmd.str().c_str()) == 0;
+	std::remove(listPath.c_str());
+	return ok;
+}
+
+static double milliseconds(Clock::duration d) { return std::chrono::duration<double, std::milli>(d).count(); }
+
+static bool parsePreset(const std::string& name, PRESET& preset)
+{
+	for(PRESET p : gPresets)
+		if(name == FFmpegVideoRecorderProcess::presetName(p))
+		{
+			preset = p;
+			return true;
+		}
+	return false;
+}
+
+
+//===========================================================================================================
+
+int main(int argc, char** argv)
+{
+	RawInput input;
+	Settings settings;
+	std::vector<std::string> files;
+	bool valid = true;
+	for(int i = 1; i < argc && valid; i++)
+	{
+		std::string arg	= argv[i];
+		bool hasValue	= i + 1 < argc;
+		std::string value = hasValue ? argv[i + 1] : "";
+		if(arg == "-s" && hasValue)				valid = std::sscanf(argv[++i], "%dx%d", &input.width, &input.height) == 2;
+		else if(arg == "-pix_fmt" && hasValue)	input.pixFmt = argv[++i];
+		else if(arg == "-r" && hasValue)		input.frameRate = (unsigned int)std::max(std::atoi(argv[++i]), 1);
+		else if(arg == "-preset" && hasValue)	valid = parsePreset(argv[++i], settings.preset);
+		else if(arg == "-crf" && hasValue)		settings.crf = (unsigned int)std::atoi(argv[++i]);
+		else if(arg == "-lossless")				settings.lossless = true;
+		else if(arg == "-b" && hasValue)		{ settings.bitrate.use = true; settings.bitrate.bitrate = (unsigned int)std::atoi(argv[++i]); }
+		else if(arg == "-maxrate" && hasValue)	settings.bitrate.maxrate = (unsigned int)std::atoi(argv[++i]);
+		else if(arg == "-minrate" && hasValue)	settings.bitrate.minrate = (unsigned int)std::atoi(argv[++i]);
+		else if(arg == "-bufsize" && hasValue)	settings.bitrate.bufsize = (unsigned int)std::atoi(argv[++i]);
+		else if(arg == "-j" && hasValue)		settings.jobs = (unsigned int)std::max(std::atoi(argv[++i]), 1);
+		else if(arg == "-ffmpeg" && hasValue)	settings.ffmpeg = argv[++i];
+		else if(arg == "-no-baseline")			settings.baseline = false;
+		else if(arg[0] != '-')					files.push_back(arg);
+		else									valid = false;
+	}
+	if(!valid || files.size() != 2)
+	{
+		std::cerr << "usage : " << argv[0] << " input output.mp4 [-s WxH] [-pix_fmt rgba] [-r 25] [-preset medium] [-crf 20] [-lossless]"
+				  << " [-b kbits [-maxrate kbits] [-minrate kbits] [-bufsize kbits]] [-j jobs] [-ffmpeg path] [-no-baseline]" << std::endl;
+		return 1;
+	}
+	if(!input.open(files[0]))
+		return 1;
+	const std::string& output = files[1];
+
+	// one chunk per job (at least a few seconds of frames each : every chunk costs a keyframe and an encoder start)
+	long long minFrames		= std::max(2LL * input.frameRate, 1LL);
+	unsigned int chunks		= (unsigned int)std::max(1LL, std::min((long long)settings.jobs, input.frameCount / minFrames));
+	unsigned int cores		= std::max(std::thread::hardware_concurrency(), 1u);
+	unsigned int threads	= std::max(cores / chunks, 1u);
+	std::cerr << files[0] << " : " << input.frameCount << " frames " << input.width << "x" << input.height << " " << input.pixFmt
+			  << (input.mapped() ? " (mapped capture)" : input.compressed() ? " (compressed capture)" : "") << ", " << chunks << " chunks of " << threads << " encoder threads" << std::endl;
+
+	// the single process baseline first, both from the same warm input (the chunked encoding does not find it faulted in by the other)
+	input.warm();
+	double singleMs = 0;
+	if(settings.baseline)
+	{
+		std::string single = output + ".single.mp4";
+		Clock::time_point start = Clock::now();
+		singleMs = encode(input, settings, cores, 0, input.frameCount, single) ? milliseconds(Clock::now() - start) : 0;
+		std::remove(single.c_str());
+	}
+
+	Clock::time_point start = Clock::now();
+	std::vector<std::string> chunkFiles(chunks);
+	std::vector<char> encoded(chunks, 0);
+	std::vector<std::thread> workers;
+	for(unsigned int c = 0; c < chunks; c++)
+	{
+		long long first	= input.chunkStart(input.frameCount * c / chunks);
+		long long last	= input.chunkStart(input.frameCount * (c + 1) / chunks);
+		if(first == last)
+		{
+			encoded[c] = 1; // no keyframe in this part of a compressed capture : the previous chunk goes on
+			continue;
+		}
+		std::stringstream chunkFile;
+		chunkFile << output << ".chunk" << std::setfill('0') << std::setw(3) << c << ".mp4";
+		chunkFiles[c] = chunkFile.str();
+		workers.emplace_back([&, c, first, last]() { encoded[c] = encode(input, settings, threads, first, last, chunkFiles[c]); });
+	}
+	for(std::thread& worker : workers)
+		worker.join();
+	chunkFiles.erase(std::remove(chunkFiles.begin(), chunkFiles.end(), std::string()), chunkFiles.end());
+	bool ok = std::find(encoded.begin(), encoded.end(), 0) == encoded.end() && concatenate(settings, chunkFiles, output);
+	for(const std::string& chunk : chunkFiles)
+		std::remove(chunk.c_str());
+	double chunkedMs = milliseconds(Clock::now() - start);
+	if(!ok)
+	{
+		std::cerr << "transcoding failed (see the ffmpeg errors above)" << std::endl;
+		return 1;
+	}
+
+	std::cout << "transcode;frames;jobs;chunked_ms;chunked_fps;single_ms;single_fps;speedup" << std::endl;
+	std::cout << "transcode;" << input.frameCount << ";" << chunks << ";" << std::fixed
+			  << std::setprecision(1) << chunkedMs << ";" << 1000.0 * input.frameCount / chunkedMs << ";"
+			  << singleMs << ";" << (singleMs > 0 ? 1000.0 * input.frameCount / singleMs : 0) << ";"
+			  << std::setprecision(2) << (singleMs > 0 ? singleMs / chunkedMs : 0) << std::endl;
+	return 0;
+}
@@ -0,0 +1,102 @@
+#include "WorkStealingPool.h"
+
+
+/// pool and index of the worker running on this thread (to keep its tasks in its own deque)
+static thread_local const WorkStealingPool*	gCurrentPool	= nullptr;
+static thread_local unsigned int			gCurrentWorker	= 0;
+
+
+//===========================================================================================================
+
+WorkStealingPool::WorkStealingPool(unsigned int threadCount)
+	: mNext(0), mSteals(0), mPending(0), mStop(false)
+{
+	if(threadCount == 0)
+		threadCount = std::thread::hardware_concurrency();
+	if(threadCount == 0)
+		threadCount = 2;
+	for(unsigned int i = 0; i < threadCount; i++)
+		mDeques.push_back(std::unique_ptr<Deque>(new Deque()));
+	for(unsigned int i = 0; i < threadCount; i++)
+		mWorkers.push_back(std::thread(&WorkStealingPool::run, this, i));
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+WorkStealingPool::~WorkStealingPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStop = true;
+		mCondition.notify_all();
+	}
+	for(std::thread& worker : mWorkers)
+		worker.join();
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void WorkStealingPool::submit(std::function<void()> task)
+{
+	unsigned int index = gCurrentPool == this ? gCurrentWorker : mNext.fetch_add(1, std::memory_order_relaxed) % threadCount();
+	{
+		std::lock_guard<std::mutex> lock(mDeques[index]->mutex);
+		mDeques[index]->tasks.push_back(std::move(task));
+	}
+	// counted once queued : a worker waking up for it is sure to find a task
+	std::lock_guard<std::mutex> lock(mMutex);
+	mPending++;
+	mCondition.notify_one();
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool WorkStealingPool::take(unsigned int self, std::function<void()>& task)
+{
+	{
+		Deque& own = *mDeques[self];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if(!own.tasks.empty())
+		{
+			task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			return true;
+		}
+	}
+	for(unsigned int i = 1; i < mDeques.size(); i++)
+	{
+		Deque& victim = *mDeques[(self + i) % mDeques.size()];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if(!victim.tasks.empty())
+		{
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			mSteals.fetch_add(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+	return false;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void WorkStealingPool::run(unsigned int self)
+{
+	gCurrentPool	= this;
+	gCurrentWorker	= self;
+	std::function<void()> task;
+	while(true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mCondition.wait(lock, [this]() { return mStop || mPending != 0; });
+			if(mPending == 0)
+				return; // stopped and nothing left
+			mPending--; // this worker takes one of them
+		}
+		while(!take(self, task))
+			std::this_thread::yield(); // the one left for this worker was queued behind its scan, look again
+		task();
+		task = nullptr;
+	}
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+
+/**
+* Worker threads each running the tasks of their own deque, and stealing from the others when it is empty.
+*
+* A task submitted by a worker goes to the back of its own deque and is run next by that worker (the frame it just
+* produced is still in its cache), a task submitted from another thread is dealt to the deques in turn.
+* An idle worker steals the oldest task of the other deques, so a burst of work given to one worker spreads to all of them.
+* Each deque has its own mutex (only contended by the thieves), the workers sleep when no task is left anywhere.
+*
+* Unlike WorkerPool there is no ordering between the tasks : the callers keep their own order (see CapturePipeline).
+*/
+class WorkStealingPool
+{
+public:
+	/// Start threadCount workers (0 : one per hardware thread)
+	WorkStealingPool(unsigned int threadCount = 0);
+	virtual ~WorkStealingPool(); ///< run the tasks left then stop the workers
+
+	/// Queue a task (from any thread, tasks included)
+	void submit(std::function<void()> task);
+
+	unsigned int threadCount() const { return (unsigned int)mWorkers.size(); }
+
+	/// Tasks run by another worker than the one they were given to
+	unsigned long long steals() const { return mSteals.load(std::memory_order_relaxed); }
+
+protected:
+	/// Tasks of a worker
+	struct Deque
+	{
+		std::mutex							mutex;
+		std::deque<std::function<void()>>	tasks;
+	};
+
+	/// Take the newest task of worker self, or the oldest task of another one
+	bool take(unsigned int self, std::function<void()>& task);
+
+	/// Worker loop
+	void run(unsigned int self);
+
+protected:
+	std::vector<std::unique_ptr<Deque>>	mDeques;	///< one per worker
+	std::vector<std::thread>			mWorkers;
+	std::atomic<unsigned int>			mNext;		///< deque of the next task submitted from outside the pool
+	std::atomic<unsigned long long>		mSteals;
+	std::mutex							mMutex;		///< to sleep and wake up the workers
+	std::condition_variable				mCondition;
+	unsigned long long					mPending;	///< tasks queued and not taken yet (under mMutex)
+	bool								mStop;
+};
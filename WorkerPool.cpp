@@ -0,0 +1,149 @@
+#include "WorkerPool.h"
+
+
+//===========================================================================================================
+
+WorkerPool::Strand::Strand(WorkerPool& pool)
+	: mPool(pool), mScheduled(false)
+{
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+WorkerPool::Strand::~Strand()
+{
+	wait();
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void WorkerPool::Strand::post(std::function<void()> task, bool blocking)
+{
+	bool schedule = false;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mTasks.push_back({ std::move(task), blocking });
+		schedule	= !mScheduled;
+		mScheduled	= true;
+	}
+	if(schedule)
+		mPool.schedule(this);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void WorkerPool::Strand::wait()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	mIdle.wait(lock, [this]() { return !mScheduled; });
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool WorkerPool::Strand::nextBlocking()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mTasks.front().blocking; // only the worker running the strand pops its tasks
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+bool WorkerPool::Strand::runOne()
+{
+	std::function<void()> task;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		task = std::move(mTasks.front().run);
+		mTasks.pop_front();
+	}
+	task();
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	if(!mTasks.empty())
+		return true;
+	mScheduled = false;
+	mIdle.notify_all();
+	return false;
+}
+
+
+//===========================================================================================================
+
+WorkerPool::WorkerPool(unsigned int threadCount, unsigned int maxBlocking)
+	: mMaxBlocking(maxBlocking), mBlocking(0), mStop(false)
+{
+	if(threadCount == 0)
+		threadCount = std::thread::hardware_concurrency();
+	if(threadCount == 0)
+		threadCount = 2;
+	if(mMaxBlocking == 0 || mMaxBlocking > threadCount)
+		mMaxBlocking = threadCount > 1 ? threadCount - 1 : 1; // a worker left for the non blocking tasks
+	for(unsigned int i = 0; i < threadCount; i++)
+		mWorkers.push_back(std::thread(&WorkerPool::run, this));
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStop = true;
+		mCondition.notify_all();
+	}
+	for(std::thread& worker : mWorkers)
+		worker.join();
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void WorkerPool::schedule(Strand* strand)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mReady.push_back(strand);
+	mCondition.notify_one();
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+void WorkerPool::run()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	while(true)
+	{
+		mCondition.wait(lock, [this]() { return mStop || !mReady.empty(); });
+		if(mReady.empty())
+			return; // stopped and nothing left
+
+		Strand* strand = mReady.front();
+		mReady.pop_front();
+		bool blocking = strand->nextBlocking();
+		if(blocking && mBlocking >= mMaxBlocking)
+		{
+			mParked.push_back(strand); // rescheduled when a blocking task ends
+			continue;
+		}
+		if(blocking)
+			mBlocking++;
+		lock.unlock();
+
+		// one task then back in the queue (fairness between the streams)
+		bool more = strand->runOne();
+		lock.lock();
+		if(blocking)
+		{
+			mBlocking--;
+			if(!mParked.empty())
+			{
+				mReady.push_back(mParked.front());
+				mParked.pop_front();
+				mCondition.notify_one();
+			}
+		}
+		if(more)
+		{
+			mReady.push_back(strand);
+			mCondition.notify_one();
+		}
+	}
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+
+/**
+* Fixed set of worker threads shared by several recorders, instead of one (mostly blocked) writer thread per recorder.
+*
+* The work is posted to strands : the tasks of a strand run one at a time in posting order (a recorder session
+* converts and pipes its frames in order), while different strands run in parallel on the workers.
+* A busy strand is put back at the end of the run queue after each task, so a slow stream does not starve the others.
+*
+* The tasks which may block (writes to a pipe or a file of a stalled consumer) are posted as blocking : at most maxBlocking()
+* workers run them at once, the strands whose next task is blocking wait aside meanwhile, so the other tasks (conversions)
+* of every strand keep a worker.
+*/
+class WorkerPool
+{
+public:
+	/// Serial queue of tasks run by the pool
+	class Strand
+	{
+	public:
+		Strand(WorkerPool& pool);
+		~Strand();	///< wait for the posted tasks
+
+		/// Queue a task, run after the tasks already posted to this strand (blocking : it may wait on I/O, see maxBlocking())
+		void post(std::function<void()> task, bool blocking = false);
+
+		/// Wait until all the posted tasks have run
+		void wait();
+
+	protected:
+		friend class WorkerPool;
+
+		struct Task
+		{
+			std::function<void()>	run;
+			bool					blocking;
+		};
+
+		/// The oldest task may block
+		bool nextBlocking();
+
+		/// Run the oldest task, return true if some are left
+		bool runOne();
+
+	protected:
+		WorkerPool&				mPool;
+		std::mutex				mMutex;
+		std::condition_variable	mIdle;
+		std::deque<Task>		mTasks;
+		bool					mScheduled;	///< in the run queue of the pool or running
+	};
+
+public:
+	/// Start threadCount workers (0 : one per hardware thread), at most maxBlocking of them running blocking tasks (0 : all but one)
+	WorkerPool(unsigned int threadCount = 0, unsigned int maxBlocking = 0);
+	virtual ~WorkerPool(); ///< the strands have to be waited for (or destroyed) before
+
+	unsigned int threadCount() const { return (unsigned int)mWorkers.size(); }
+	unsigned int maxBlocking() const { return mMaxBlocking; }
+
+protected:
+	/// Put a strand with pending tasks in the run queue
+	void schedule(Strand* strand);
+
+	/// Worker loop
+	void run();
+
+protected:
+	std::vector<std::thread>	mWorkers;
+	std::mutex					mMutex;
+	std::condition_variable		mCondition;
+	std::deque<Strand*>			mReady;		///< strands having tasks to run, in order
+	std::deque<Strand*>			mParked;	///< strands whose next task is blocking, waiting for a blocking task to end
+	unsigned int				mMaxBlocking;
+	unsigned int				mBlocking;	///< workers running a blocking task
+	bool						mStop;
+};
@@ -0,0 +1,115 @@
+/**
+ * \file opengl_fallback_functions.h
+ *
+ * Emulate the Qt5 GLFunctions wrapper (see opengl_functions.h) when the project is built without Qt.
+ *
+ * OpenGL 1.1 entry points come straight from <GL/gl.h>.
+ * Every newer entry point we need is declared here as a member function pointer
+ * named like the OpenGL function, so the code calling it is the same with or without Qt.
+ * Pointers are resolved by GLFunctions::init() :
+ *  - under Windows with wglGetProcAddress (an OpenGL context must be current)
+ *  - otherwise with dlsym on the already linked OpenGL library
+ *
+ * A pointer stays nullptr if the driver does not expose the function,
+ * use GLFunctions::hasSyncObjects() before using pixel buffer objects and fences
+ * and GLFunctions::hasShaderConversion() before using shaders and framebuffer objects.
+ */
+
+#ifndef _FALLBACK_OPENGL_FUNCTIONS_H_
+#define _FALLBACK_OPENGL_FUNCTIONS_H_
+
+#ifdef WIN32
+	#include <windows.h>
+#else
+	#include <dlfcn.h>
+#endif
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+/** The fallback always declares the pixel buffer objects and sync objects entry points (check them at runtime) */
+#define OPENGL_HAS_SYNC_OBJECTS 1
+
+/** The fallback always declares the shaders and framebuffer objects entry points (check them at runtime) */
+#define OPENGL_HAS_SHADER_CONVERSION 1
+
+/// List of the non OpenGL 1.1 functions used by the asynchronous read back : X(function pointer type, function name)
+#define GLFUNCTIONS_FALLBACK_SYNC_LIST(X) \
+	X(PFNGLGENBUFFERSPROC,			glGenBuffers) \
+	X(PFNGLDELETEBUFFERSPROC,		glDeleteBuffers) \
+	X(PFNGLBINDBUFFERPROC,			glBindBuffer) \
+	X(PFNGLBUFFERDATAPROC,			glBufferData) \
+	X(PFNGLMAPBUFFERRANGEPROC,		glMapBufferRange) \
+	X(PFNGLUNMAPBUFFERPROC,			glUnmapBuffer) \
+	X(PFNGLFENCESYNCPROC,			glFenceSync) \
+	X(PFNGLCLIENTWAITSYNCPROC,		glClientWaitSync) \
+	X(PFNGLDELETESYNCPROC,			glDeleteSync)
+
+/// List of the non OpenGL 1.1 functions used by the GPU color conversion : X(function pointer type, function name)
+#define GLFUNCTIONS_FALLBACK_SHADER_LIST(X) \
+	X(PFNGLACTIVETEXTUREPROC,		glActiveTexture) \
+	X(PFNGLGENFRAMEBUFFERSPROC,		glGenFramebuffers) \
+	X(PFNGLDELETEFRAMEBUFFERSPROC,	glDeleteFramebuffers) \
+	X(PFNGLBINDFRAMEBUFFERPROC,		glBindFramebuffer) \
+	X(PFNGLFRAMEBUFFERTEXTURE2DPROC,	glFramebufferTexture2D) \
+	X(PFNGLCHECKFRAMEBUFFERSTATUSPROC,	glCheckFramebufferStatus) \
+	X(PFNGLGENVERTEXARRAYSPROC,		glGenVertexArrays) \
+	X(PFNGLDELETEVERTEXARRAYSPROC,	glDeleteVertexArrays) \
+	X(PFNGLBINDVERTEXARRAYPROC,		glBindVertexArray) \
+	X(PFNGLCREATESHADERPROC,		glCreateShader) \
+	X(PFNGLSHADERSOURCEPROC,		glShaderSource) \
+	X(PFNGLCOMPILESHADERPROC,		glCompileShader) \
+	X(PFNGLGETSHADERIVPROC,			glGetShaderiv) \
+	X(PFNGLGETSHADERINFOLOGPROC,	glGetShaderInfoLog) \
+	X(PFNGLDELETESHADERPROC,		glDeleteShader) \
+	X(PFNGLCREATEPROGRAMPROC,		glCreateProgram) \
+	X(PFNGLATTACHSHADERPROC,		glAttachShader) \
+	X(PFNGLLINKPROGRAMPROC,			glLinkProgram) \
+	X(PFNGLGETPROGRAMIVPROC,		glGetProgramiv) \
+	X(PFNGLGETPROGRAMINFOLOGPROC,	glGetProgramInfoLog) \
+	X(PFNGLDELETEPROGRAMPROC,		glDeleteProgram) \
+	X(PFNGLUSEPROGRAMPROC,			glUseProgram) \
+	X(PFNGLGETUNIFORMLOCATIONPROC,	glGetUniformLocation) \
+	X(PFNGLUNIFORM1IPROC,			glUniform1i) \
+	X(PFNGLUNIFORM2IPROC,			glUniform2i)
+
+/// List of all the non OpenGL 1.1 functions we use
+#define GLFUNCTIONS_FALLBACK_LIST(X) \
+	GLFUNCTIONS_FALLBACK_SYNC_LIST(X) \
+	GLFUNCTIONS_FALLBACK_SHADER_LIST(X)
+
+#ifdef WIN32
+	#define GLFUNCTIONS_FALLBACK_GET_PROC(NAME)	wglGetProcAddress(NAME)
+#else
+	#define GLFUNCTIONS_FALLBACK_GET_PROC(NAME)	dlsym(RTLD_DEFAULT, NAME)
+#endif
+#define GLFUNCTIONS_FALLBACK_DECLARE(TYPE, NAME)	TYPE NAME = nullptr;
+#define GLFUNCTIONS_FALLBACK_LOAD(TYPE, NAME)		NAME = reinterpret_cast<TYPE>(GLFUNCTIONS_FALLBACK_GET_PROC(#NAME));
+#define GLFUNCTIONS_FALLBACK_CHECK(TYPE, NAME)		&& NAME != nullptr
+
+
+/// Emulate the class to be coherent with Qt5 opengl impl
+class GLFunctions
+{
+public:
+	void init()
+	{
+		GLFUNCTIONS_FALLBACK_LIST(GLFUNCTIONS_FALLBACK_LOAD)
+	}
+
+	/// true if pixel buffer objects and sync objects functions (OpenGL 3.2 or ARB_sync) were all resolved
+	bool hasSyncObjects() const
+	{
+		return true GLFUNCTIONS_FALLBACK_SYNC_LIST(GLFUNCTIONS_FALLBACK_CHECK);
+	}
+
+	/// true if shaders, framebuffer and vertex array objects functions (OpenGL 3.2) were all resolved
+	bool hasShaderConversion() const
+	{
+		return true GLFUNCTIONS_FALLBACK_SHADER_LIST(GLFUNCTIONS_FALLBACK_CHECK);
+	}
+
+protected:
+	GLFUNCTIONS_FALLBACK_LIST(GLFUNCTIONS_FALLBACK_DECLARE)
+};
+
+#endif // _FALLBACK_OPENGL_FUNCTIONS_H_
@@ -68,6 +68,18 @@
  * with majjor version */
 #define OPENGL_VERSION_MINOR 2
 
+/** Set to 1 when the selected version exposes pixel buffer objects
+ * and sync objects (OpenGL 3.2 onwards, not OpenGL ES 2.0) */
+#if !OPENGL_EMBEDDED_ARCH && (OPENGL_VERSION_MAJOR>3 || (OPENGL_VERSION_MAJOR==3 && OPENGL_VERSION_MINOR>=2))
+#define OPENGL_HAS_SYNC_OBJECTS 1
+#else
+#define OPENGL_HAS_SYNC_OBJECTS 0
+#endif
+
+/** Set to 1 when the selected version exposes GLSL 1.50, framebuffer objects
+ * and vertex array objects used to convert frames on the GPU (OpenGL 3.2 onwards) */
+#define OPENGL_HAS_SHADER_CONVERSION OPENGL_HAS_SYNC_OBJECTS
+
 
 /** Generic class that inherits OpenGL functions from any OpenGL version
  * specified by the OPENGL_VERSION_MAJOR and OPENG_VERSION_MINOR.